@@ -0,0 +1,280 @@
+#include "AABBTree.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace TestApp {
+
+namespace {
+
+AABBTree::Box merge(AABBTree::Box const &a, AABBTree::Box const &b) {
+  return {glm::min(a.min, b.min), glm::max(a.max, b.max)};
+}
+
+float surfaceArea(AABBTree::Box const &box) {
+  auto size = box.max - box.min;
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+bool contains(AABBTree::Box const &outer, AABBTree::Box const &inner) {
+  return glm::all(glm::lessThanEqual(outer.min, inner.min)) &&
+         glm::all(glm::lessThanEqual(inner.max, outer.max));
+}
+
+} // namespace
+
+uint32_t AABBTree::m_allocate() {
+  if (m_freeList == NULL_NODE) {
+    m_nodes.emplace_back();
+    m_nodes.back().height = 0;
+    return m_nodes.size() - 1;
+  }
+
+  auto node = m_freeList;
+  m_freeList = m_nodes[node].parent;
+  m_nodes[node] = Node{};
+  m_nodes[node].height = 0;
+  return node;
+}
+
+void AABBTree::m_free(uint32_t node) {
+  m_nodes[node].parent = m_freeList;
+  m_nodes[node].height = -1;
+  m_freeList = node;
+}
+
+uint32_t AABBTree::insert(Box const &box, uint32_t item) {
+  auto leaf = m_allocate();
+  auto margin = glm::vec3(m_margin);
+  m_nodes[leaf].box = {box.min - margin, box.max + margin};
+  m_nodes[leaf].item = item;
+
+  m_insertLeaf(leaf);
+  m_size++;
+
+  return leaf;
+}
+
+void AABBTree::remove(uint32_t proxy) {
+  if (proxy >= m_nodes.size() || !m_nodes[proxy].leaf() ||
+      m_nodes[proxy].height != 0)
+    throw std::runtime_error("[AABBTREE][ERROR] invalid proxy removed");
+
+  m_removeLeaf(proxy);
+  m_free(proxy);
+  m_size--;
+}
+
+bool AABBTree::move(uint32_t proxy, Box const &box) {
+  auto &node = m_nodes.at(proxy);
+  if (contains(node.box, box))
+    return false;
+
+  m_removeLeaf(proxy);
+  auto margin = glm::vec3(m_margin);
+  m_nodes[proxy].box = {box.min - margin, box.max + margin};
+  m_insertLeaf(proxy);
+
+  return true;
+}
+
+void AABBTree::m_insertLeaf(uint32_t leaf) {
+  if (m_root == NULL_NODE) {
+    m_root = leaf;
+    m_nodes[leaf].parent = NULL_NODE;
+    return;
+  }
+
+  // descend towards the sibling with the lowest surface area cost
+  auto leafBox = m_nodes[leaf].box;
+  auto index = m_root;
+  while (!m_nodes[index].leaf()) {
+    auto &node = m_nodes[index];
+    auto area = surfaceArea(node.box);
+    auto combinedArea = surfaceArea(merge(node.box, leafBox));
+
+    // cost of making new parent of this node and the leaf
+    auto cost = 2.0f * combinedArea;
+    // cost added to every ancestor of the leaf when descending further
+    auto inheritance = 2.0f * (combinedArea - area);
+
+    auto childCost = [&](uint32_t child) {
+      auto &childBox = m_nodes[child].box;
+      auto merged = surfaceArea(merge(childBox, leafBox));
+      if (m_nodes[child].leaf())
+        return merged + inheritance;
+      return merged - surfaceArea(childBox) + inheritance;
+    };
+
+    auto cost0 = childCost(node.children[0]);
+    auto cost1 = childCost(node.children[1]);
+
+    if (cost < cost0 && cost < cost1)
+      break;
+
+    index = cost0 < cost1 ? node.children[0] : node.children[1];
+  }
+
+  auto sibling = index;
+  auto oldParent = m_nodes[sibling].parent;
+  auto newParent = m_allocate();
+
+  m_nodes[newParent].parent = oldParent;
+  m_nodes[newParent].box = merge(leafBox, m_nodes[sibling].box);
+  m_nodes[newParent].height = m_nodes[sibling].height + 1;
+  m_nodes[newParent].children[0] = sibling;
+  m_nodes[newParent].children[1] = leaf;
+  m_nodes[sibling].parent = newParent;
+  m_nodes[leaf].parent = newParent;
+
+  if (oldParent == NULL_NODE)
+    m_root = newParent;
+  else if (m_nodes[oldParent].children[0] == sibling)
+    m_nodes[oldParent].children[0] = newParent;
+  else
+    m_nodes[oldParent].children[1] = newParent;
+
+  m_refit(newParent);
+}
+
+void AABBTree::m_removeLeaf(uint32_t leaf) {
+  if (leaf == m_root) {
+    m_root = NULL_NODE;
+    return;
+  }
+
+  auto parent = m_nodes[leaf].parent;
+  auto grandParent = m_nodes[parent].parent;
+  auto sibling = m_nodes[parent].children[0] == leaf
+                     ? m_nodes[parent].children[1]
+                     : m_nodes[parent].children[0];
+
+  m_free(parent);
+  m_nodes[sibling].parent = grandParent;
+
+  if (grandParent == NULL_NODE) {
+    m_root = sibling;
+    return;
+  }
+
+  if (m_nodes[grandParent].children[0] == parent)
+    m_nodes[grandParent].children[0] = sibling;
+  else
+    m_nodes[grandParent].children[1] = sibling;
+
+  m_refit(grandParent);
+}
+
+void AABBTree::m_refit(uint32_t node) {
+  while (node != NULL_NODE) {
+    node = m_balance(node);
+
+    auto &current = m_nodes[node];
+    auto &child0 = m_nodes[current.children[0]];
+    auto &child1 = m_nodes[current.children[1]];
+    current.height = 1 + std::max(child0.height, child1.height);
+    current.box = merge(child0.box, child1.box);
+
+    node = current.parent;
+  }
+}
+
+uint32_t AABBTree::m_balance(uint32_t iA) {
+  auto &A = m_nodes[iA];
+  if (A.leaf() || A.height < 2)
+    return iA;
+
+  auto iB = A.children[0];
+  auto iC = A.children[1];
+  auto &B = m_nodes[iB];
+  auto &C = m_nodes[iC];
+
+  auto balance = C.height - B.height;
+
+  // rotates child up, child takes place of A and A takes place of the
+  // lower grandchild
+  auto rotate = [&](uint32_t iUp, Node &up, uint32_t iOther, Node &other,
+                    int side) {
+    auto iF = up.children[0];
+    auto iG = up.children[1];
+    auto &F = m_nodes[iF];
+    auto &G = m_nodes[iG];
+
+    up.children[0] = iA;
+    up.parent = A.parent;
+    A.parent = iUp;
+
+    if (up.parent == NULL_NODE)
+      m_root = iUp;
+    else if (m_nodes[up.parent].children[0] == iA)
+      m_nodes[up.parent].children[0] = iUp;
+    else
+      m_nodes[up.parent].children[1] = iUp;
+
+    auto iHigh = F.height > G.height ? iF : iG;
+    auto iLow = F.height > G.height ? iG : iF;
+    auto &high = m_nodes[iHigh];
+    auto &low = m_nodes[iLow];
+
+    up.children[1] = iHigh;
+    A.children[side] = iLow;
+    low.parent = iA;
+
+    A.box = merge(other.box, low.box);
+    up.box = merge(A.box, high.box);
+    A.height = 1 + std::max(other.height, low.height);
+    up.height = 1 + std::max(A.height, high.height);
+  };
+
+  if (balance > 1) {
+    rotate(iC, C, iB, B, 1);
+    return iC;
+  }
+
+  if (balance < -1) {
+    rotate(iB, B, iC, C, 0);
+    return iB;
+  }
+
+  return iA;
+}
+
+void AABBTree::query(Frustum const &frustum,
+                     std::vector<uint32_t> &items) const {
+  if (m_root == NULL_NODE)
+    return;
+
+  // nodes entirely inside of the frustum are marked by the high bit, their
+  // subtrees are collected without further tests
+  constexpr uint32_t INSIDE = 1u << 31;
+
+  std::vector<uint32_t> stack;
+  stack.reserve(64);
+  stack.push_back(m_root);
+
+  while (!stack.empty()) {
+    auto entry = stack.back();
+    stack.pop_back();
+
+    auto index = entry & ~INSIDE;
+    auto &node = m_nodes[index];
+    auto inside = (entry & INSIDE) != 0;
+
+    if (!inside) {
+      if (!frustum.intersects(node.box.min, node.box.max))
+        continue;
+      if (!node.leaf() && frustum.contains(node.box.min, node.box.max))
+        inside = true;
+    }
+
+    if (node.leaf()) {
+      items.push_back(node.item);
+      continue;
+    }
+
+    auto flag = inside ? INSIDE : 0u;
+    stack.push_back(node.children[0] | flag);
+    stack.push_back(node.children[1] | flag);
+  }
+}
+
+} // namespace TestApp
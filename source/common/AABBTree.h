@@ -0,0 +1,90 @@
+#ifndef TESTAPP_AABBTREE_H
+#define TESTAPP_AABBTREE_H
+
+#include "Frustum.h"
+#include <cstdint>
+#include <vector>
+
+namespace TestApp {
+
+/** Dynamic bounding volume hierarchy of axis aligned boxes.
+ *
+ *  Each item is stored in a leaf whose box is enlarged by margin, so items
+ *  moving by less than the margin do not change the tree. Item leaving its
+ *  enlarged box is reinserted: its leaf is removed and inserted again at
+ *  the position with the lowest surface area cost, and ancestors on both
+ *  paths are refitted and rebalanced by tree rotations.
+ */
+class AABBTree {
+public:
+  using Box = Frustum::Box;
+
+  static constexpr uint32_t NULL_NODE = UINT32_MAX;
+
+  explicit AABBTree(float margin = 0.0f) : m_margin(margin) {}
+
+  /** @return proxy identifying the item in the tree */
+  uint32_t insert(Box const &box, uint32_t item);
+
+  void remove(uint32_t proxy);
+
+  /** Updates box of the item.
+   *
+   *  @return true if the item was reinserted
+   */
+  bool move(uint32_t proxy, Box const &box);
+
+  uint32_t item(uint32_t proxy) const { return m_nodes.at(proxy).item; }
+
+  void setItem(uint32_t proxy, uint32_t item) { m_nodes.at(proxy).item = item; }
+
+  /** Enlarged box stored for the item. */
+  Box const &fatBox(uint32_t proxy) const { return m_nodes.at(proxy).box; }
+
+  /** Appends items whose enlarged boxes intersect the frustum. */
+  void query(Frustum const &frustum, std::vector<uint32_t> &items) const;
+
+  uint32_t size() const { return m_size; }
+
+  uint32_t height() const {
+    return m_root == NULL_NODE ? 0 : m_nodes[m_root].height;
+  }
+
+private:
+  struct Node {
+    Box box;
+    uint32_t parent = NULL_NODE;
+    uint32_t children[2] = {NULL_NODE, NULL_NODE};
+    uint32_t item = 0;
+    // leaf has height 0, free node -1
+    int32_t height = -1;
+
+    bool leaf() const { return children[0] == NULL_NODE; }
+  };
+
+  uint32_t m_allocate();
+
+  void m_free(uint32_t node);
+
+  void m_insertLeaf(uint32_t leaf);
+
+  void m_removeLeaf(uint32_t leaf);
+
+  /** Refits boxes and heights from node up to the root. */
+  void m_refit(uint32_t node);
+
+  /** Rotates higher child of node up if children heights differ by more
+   *  than one. Returns node now standing in place of node.
+   */
+  uint32_t m_balance(uint32_t node);
+
+  std::vector<Node> m_nodes;
+  uint32_t m_root = NULL_NODE;
+  // free nodes are linked through their parent
+  uint32_t m_freeList = NULL_NODE;
+  uint32_t m_size = 0;
+  float m_margin;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_AABBTREE_H
@@ -15,6 +15,7 @@ void Camera::m_set_matrix() {
   m_view = glm::translate(m_view, -m_position);
   m_projection = m_get_projection();
   m_projection[1][1] *= -1.0f;
+  m_frustum = Frustum(m_projection * m_view);
 }
 
 glm::vec3 Camera::viewDirection() const {
@@ -28,93 +29,6 @@ glm::vec3 Camera::viewDirection() const {
   return camFront;
 }
 
-static bool intersects(float scope1begin, float scope1end, float scope2begin,
-                       float scope2end) {
-  if (scope1begin < scope2begin) {
-    return scope1end > scope2begin;
-  } else {
-    return scope1begin < scope2end;
-  }
-}
-bool Camera::offBounds(glm::vec3 cubeBegin, glm::vec3 cubeEnd) const {
-
-  glm::vec4 temp;
-  glm::vec3 min, max;
-
-  temp = m_projection * m_view *
-         glm::vec4(cubeBegin.x, cubeBegin.y, cubeBegin.z, 1.0f);
-
-  temp /= glm::abs(temp.w);
-  min = glm::vec3(temp);
-  max = glm::vec3(temp);
-
-  temp = m_projection * m_view *
-         glm::vec4(cubeEnd.x, cubeBegin.y, cubeBegin.z, 1.0f);
-
-  temp /= glm::abs(temp.w);
-  min = glm::vec3(glm::min(temp.x, min.x), glm::min(temp.y, min.y),
-                  glm::min(temp.z, min.z));
-  max = glm::vec3(glm::max(temp.x, max.x), glm::max(temp.y, max.y),
-                  glm::max(temp.z, max.z));
-
-  temp = m_projection * m_view *
-         glm::vec4(cubeBegin.x, cubeEnd.y, cubeBegin.z, 1.0f);
-
-  temp /= glm::abs(temp.w);
-  min = glm::vec3(glm::min(temp.x, min.x), glm::min(temp.y, min.y),
-                  glm::min(temp.z, min.z));
-  max = glm::vec3(glm::max(temp.x, max.x), glm::max(temp.y, max.y),
-                  glm::max(temp.z, max.z));
-
-  temp = m_projection * m_view *
-         glm::vec4(cubeBegin.x, cubeBegin.y, cubeEnd.z, 1.0f);
-
-  temp /= glm::abs(temp.w);
-  min = glm::vec3(glm::min(temp.x, min.x), glm::min(temp.y, min.y),
-                  glm::min(temp.z, min.z));
-  max = glm::vec3(glm::max(temp.x, max.x), glm::max(temp.y, max.y),
-                  glm::max(temp.z, max.z));
-
-  temp = m_projection * m_view *
-         glm::vec4(cubeEnd.x, cubeEnd.y, cubeBegin.z, 1.0f);
-
-  temp /= glm::abs(temp.w);
-  min = glm::vec3(glm::min(temp.x, min.x), glm::min(temp.y, min.y),
-                  glm::min(temp.z, min.z));
-  max = glm::vec3(glm::max(temp.x, max.x), glm::max(temp.y, max.y),
-                  glm::max(temp.z, max.z));
-
-  temp = m_projection * m_view *
-         glm::vec4(cubeEnd.x, cubeBegin.y, cubeEnd.z, 1.0f);
-
-  temp /= glm::abs(temp.w);
-  min = glm::vec3(glm::min(temp.x, min.x), glm::min(temp.y, min.y),
-                  glm::min(temp.z, min.z));
-  max = glm::vec3(glm::max(temp.x, max.x), glm::max(temp.y, max.y),
-                  glm::max(temp.z, max.z));
-
-  temp = m_projection * m_view *
-         glm::vec4(cubeBegin.x, cubeEnd.y, cubeEnd.z, 1.0f);
-
-  temp /= glm::abs(temp.w);
-  min = glm::vec3(glm::min(temp.x, min.x), glm::min(temp.y, min.y),
-                  glm::min(temp.z, min.z));
-  max = glm::vec3(glm::max(temp.x, max.x), glm::max(temp.y, max.y),
-                  glm::max(temp.z, max.z));
-
-  temp =
-      m_projection * m_view * glm::vec4(cubeEnd.x, cubeEnd.y, cubeEnd.z, 1.0f);
-
-  temp /= glm::abs(temp.w);
-  min = glm::vec3(glm::min(temp.x, min.x), glm::min(temp.y, min.y),
-                  glm::min(temp.z, min.z));
-  max = glm::vec3(glm::max(temp.x, max.x), glm::max(temp.y, max.y),
-                  glm::max(temp.z, max.z));
-
-  return !intersects(-1.0f, 1.0f, min.x, max.x) ||
-         !intersects(-1.0f, 1.0f, min.y, max.y) ||
-         !intersects(0.0f, 1.0f, min.z, max.z);
-}
 void ControlledCamera::update(float deltaTime) {
   float currentSpeed = glm::length(m_velocity);
 
@@ -173,6 +87,7 @@ void Camera::lookAt(glm::vec3 eyePos, glm::vec3 center, glm::vec3 up) {
   m_Tilt = 0.0f;
   m_projection = m_get_projection();
   m_projection[1][1] *= -1.0f;
+  m_frustum = Frustum(m_projection * m_view);
 }
 
 glm::mat4 CameraOrtho::m_get_projection() const {
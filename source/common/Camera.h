@@ -1,6 +1,7 @@
 #ifndef TESTAPP_CAMERA_H
 #define TESTAPP_CAMERA_H
 
+#include "Frustum.h"
 #include <algorithm>
 #include <array>
 #include <cstdint>
@@ -71,7 +72,9 @@ public:
 
   float tilt() const { return m_Tilt; }
 
-  bool offBounds(glm::vec3 cubeBegin, glm::vec3 cubeEnd) const;
+  /** View volume as of the last matrix update. */
+  Frustum const &frustum() const { return m_frustum; }
+
   /** Here child classes can push their state during frame time. */
   virtual void update(float deltaTime) { setMatrices(); };
 
@@ -88,6 +91,8 @@ private:
 
   glm::mat4 m_view{};
 
+  Frustum m_frustum;
+
 protected:
   bool m_need_set_matrix = true;
   virtual glm::mat4 m_get_projection() const = 0;
@@ -4,6 +4,7 @@
 #include "SwapChainImpl.h"
 #include "Utils.h"
 #include <CommonApp.h>
+#include <filesystem>
 #include <iostream>
 #include <vkw/Fence.hpp>
 #include <vkw/FrameBuffer.hpp>
@@ -53,6 +54,10 @@ public:
             gui, WindowSettings{.title = "Application stat", .autoSize = true}),
         m_window(window), m_monitor(monitor) {}
 
+  void addItem(std::function<void()> item) {
+    m_items.emplace_back(std::move(item));
+  }
+
 protected:
   void onGui() override {
     ImGui::Text("FPS: %.2f", m_window.get().clock().fps());
@@ -61,9 +66,12 @@ protected:
                 m_monitor.get().totalAllocations(),
                 m_monitor.get().totalReallocations(),
                 m_monitor.get().totalFrees());
+    for (auto &item : m_items)
+      item();
   }
 
 private:
+  std::vector<std::function<void()>> m_items;
   // TODO: rewite to StrongReference
   std::reference_wrapper<TestApp::WindowIO> m_window;
   vkw::StrongReference<VulkanMemoryMonitor const> m_monitor;
@@ -183,6 +191,8 @@ struct CommonApp::InternalState {
   InternalState(vkw::Device &device, RenderEngine::ShaderLoader &shaderLoader,
                 VkFormat colorFormat, VkFormat depthFormat)
       : pass(device, colorFormat, depthFormat, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR),
+        latePass(device, colorFormat, depthFormat,
+                 VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ATTACHMENT_LOAD_OP_LOAD),
         renderQueue(device.anyGraphicsQueue()),
         mainPool(device, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
                  renderQueue.family().index()),
@@ -225,6 +235,9 @@ struct CommonApp::InternalState {
   }
   void submit() { renderQueue.submit(submitInfo, fence); }
   LightPass pass;
+  // resumes pass, framebuffers are shared as the passes are compatible
+  LightPass latePass;
+  bool lateMainPass = false;
   std::vector<vkw::FrameBuffer> framebuffers;
   vkw::Queue renderQueue;
   vkw::CommandPool mainPool;
@@ -302,6 +315,12 @@ CommonApp::CommonApp(AppCreateInfo const &createInfo) {
   m_physDevice = std::make_unique<vkw::PhysicalDevice>(instance(), 0u);
 
   physDevice().enableExtension(vkw::ext::KHR_swapchain);
+  // lets allocator report heap budgets of the driver instead of estimates
+  if (physDevice().isExtensionSupported(vkw::ext::EXT_memory_budget))
+    physDevice().enableExtension(vkw::ext::EXT_memory_budget);
+  // lets shadow cascades be rendered by one layered pass
+  if (physDevice().isExtensionSupported(vkw::ext::KHR_multiview))
+    physDevice().enableExtension(vkw::ext::KHR_multiview);
 
   TestApp::requestQueues(physDevice());
   createInfo.amendDeviceCreateInfo(physDevice());
@@ -315,10 +334,18 @@ CommonApp::CommonApp(AppCreateInfo const &createInfo) {
   auto *swapChain =
       dynamic_cast<SwapChainWithFramebuffers *>(m_swapChain.get());
 
+  // assets.pack is built by assetpack tool, loose files are used without it
+  std::shared_ptr<const RenderEngine::AssetPack> assetPack;
+  if (auto packPath = std::filesystem::path(EXAMPLE_ASSET_PATH) / "assets.pack";
+      std::filesystem::exists(packPath))
+    assetPack = std::make_shared<RenderEngine::AssetPack>(packPath);
+
   m_shaderLoader = std::make_unique<RenderEngine::ShaderLoader>(
-      device(), EXAMPLE_ASSET_PATH + std::string("/shaders/"));
+      device(), EXAMPLE_ASSET_PATH + std::string("/shaders/"),
+      RenderEngine::AssetPackDirectory{assetPack, "shaders/"});
   m_textureLoader = std::make_unique<RenderEngine::TextureLoader>(
-      device(), EXAMPLE_ASSET_PATH + std::string("/textures/"));
+      device(), EXAMPLE_ASSET_PATH + std::string("/textures/"),
+      RenderEngine::AssetPackDirectory{assetPack, "textures/"});
 
   m_internalState = std::make_unique<InternalState>(
       device(), shaderLoader(), swapChain->attachments().front().format(),
@@ -345,8 +372,21 @@ CommonApp::CommonApp(AppCreateInfo const &createInfo) {
 
 CommonApp::~CommonApp() = default;
 
+void CommonApp::addStatistics(std::function<void()> item) {
+  m_internal().appStat->addItem(std::move(item));
+}
+
 vkw::RenderPass &CommonApp::onScreenPass() { return m_internalState->pass; }
 
+vkw::Image<vkw::DEPTH, vkw::I2D, vkw::SINGLE> const &
+CommonApp::mainDepthImage() const {
+  return m_internalState->swapChain->depthImage();
+}
+
+void CommonApp::enableLateMainPass(bool enable) {
+  m_internalState->lateMainPass = enable;
+}
+
 void CommonApp::run() {
   RenderEngine::GraphicsPipelinePool pipelinePool{device(), shaderLoader()};
   RenderEngine::GraphicsRecordingState recordingState{m_internal().mainBuffer,
@@ -447,6 +487,21 @@ void CommonApp::run() {
 
     onMainPass(commandBuffer, recorder);
 
+    if (m_internal().lateMainPass) {
+      commandBuffer.endRenderPass();
+
+      betweenMainPasses(commandBuffer, pipelinePool);
+
+      commandBuffer.beginRenderPass(m_internal().latePass, fb, renderArea,
+                                    false, values.size(), values.data());
+
+      commandBuffer.setViewports({&viewport, 1}, 0);
+      commandBuffer.setScissors({&scissor, 1}, 0);
+      recorder.reset();
+
+      onLateMainPass(commandBuffer, recorder);
+    }
+
     m_internal().gui->draw(recorder);
 
     commandBuffer.endRenderPass();
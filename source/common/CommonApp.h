@@ -2,6 +2,7 @@
 #define TESTAPP_COMMONAPP_H
 
 #include <vkw/Fence.hpp>
+#include <vkw/Image.hpp>
 #include <vkw/Library.hpp>
 #include <vkw/Semaphore.hpp>
 #include <vkw/SwapChain.hpp>
@@ -12,6 +13,7 @@
 #include <RenderEngine/Shaders/ShaderLoader.h>
 #include <SceneProjector.h>
 
+#include <functional>
 #include <memory>
 
 namespace TestApp {
@@ -58,6 +60,9 @@ protected:
 
   GUIFrontEnd &gui();
 
+  /** Adds custom lines drawn inside application statistics window. */
+  void addStatistics(std::function<void()> item);
+
   vkw::RenderPass &onScreenPass();
 
   void addMainPassDependency(std::shared_ptr<vkw::Semaphore> waitFor,
@@ -67,12 +72,28 @@ protected:
 
   unsigned mainPassQueueFamilyIndex() const;
 
+  /** Depth attachment of on screen pass. Recreated with the swap chain. */
+  vkw::Image<vkw::DEPTH, vkw::I2D, vkw::SINGLE> const &mainDepthImage() const;
+
+  /** Splits main pass in two. betweenMainPasses() is recorded outside of
+   *  render pass after onMainPass(), then the pass is resumed with attachment
+   *  contents kept and onLateMainPass() is recorded. GUI is drawn last.
+   */
+  void enableLateMainPass(bool enable);
+
   virtual void preMainPass(vkw::PrimaryCommandBuffer &buffer,
                            RenderEngine::GraphicsPipelinePool &pool) {}
 
   virtual void onMainPass(vkw::PrimaryCommandBuffer &buffer,
                           RenderEngine::GraphicsRecordingState &recorder) {}
 
+  virtual void betweenMainPasses(vkw::PrimaryCommandBuffer &buffer,
+                                 RenderEngine::GraphicsPipelinePool &pool) {}
+
+  virtual void onLateMainPass(vkw::PrimaryCommandBuffer &buffer,
+                              RenderEngine::GraphicsRecordingState &recorder) {
+  }
+
   virtual void afterMainPass(vkw::PrimaryCommandBuffer &buffer,
                              RenderEngine::GraphicsPipelinePool &pool) {}
 
@@ -0,0 +1,910 @@
+#include "CookedModel.h"
+#include <RenderEngine/AssetImport/AssetImport.h>
+#include <RenderEngine/AssetImport/BlockCompression.h>
+#include <RenderEngine/AssetImport/PixelConversion.h>
+#include <RenderEngine/JobSystem.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
+#include <iostream>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<TestApp::ModelAttributes>,
+              "ModelAttributes must be trivially copyable to be cooked");
+
+namespace {
+
+/** Strided read access to tinygltf accessor data. */
+class AccessorReader {
+public:
+  AccessorReader(tinygltf::Model const &model, int accessorIndex) {
+    auto &accessor = model.accessors.at(accessorIndex);
+    auto &view = model.bufferViews.at(accessor.bufferView);
+    m_data = &model.buffers.at(view.buffer)
+                  .data.at(accessor.byteOffset + view.byteOffset);
+    auto stride = accessor.ByteStride(view);
+    if (stride <= 0)
+      throw std::runtime_error(
+          "[GLTF][ERROR] accessor has invalid byte stride");
+    m_stride = stride;
+    m_count = accessor.count;
+    m_componentType = accessor.componentType;
+    m_components = tinygltf::GetNumComponentsInType(accessor.type);
+  }
+
+  size_t count() const { return m_count; }
+
+  int components() const { return m_components; }
+
+  /** Reads component of element as float. Integer types are treated as
+   * normalized. */
+  float read(size_t element, int component) const {
+    auto *src = m_data + element * m_stride;
+    switch (m_componentType) {
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+      return load<float>(src, component);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      return static_cast<float>(load<uint8_t>(src, component)) / 255.0f;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+      return static_cast<float>(load<uint16_t>(src, component)) / 65535.0f;
+    default:
+      throw std::runtime_error(
+          "[GLTF][ERROR] accessor has unsupported component type");
+    }
+  }
+
+  /** Reads component of element as integer without normalization. */
+  uint32_t readInteger(size_t element, int component) const {
+    auto *src = m_data + element * m_stride;
+    switch (m_componentType) {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+      return load<uint32_t>(src, component);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+      return load<uint16_t>(src, component);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      return load<uint8_t>(src, component);
+    default:
+      throw std::runtime_error(
+          "[GLTF][ERROR] accessor has unsupported integer component type");
+    }
+  }
+
+  uint32_t readIndex(size_t element) const {
+    auto *src = m_data + element * m_stride;
+    switch (m_componentType) {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+      return load<uint32_t>(src, 0);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+      return load<uint16_t>(src, 0);
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      return load<uint8_t>(src, 0);
+    default:
+      throw std::runtime_error(
+          "[MESH][ERROR] loaded gltf model has invalid index type");
+    }
+  }
+
+private:
+  template <typename T>
+  static T load(const unsigned char *src, int component) {
+    T ret;
+    memcpy(&ret, src + component * sizeof(T), sizeof(T));
+    return ret;
+  }
+
+  const unsigned char *m_data;
+  size_t m_stride;
+  size_t m_count;
+  int m_componentType;
+  int m_components;
+};
+
+std::optional<AccessorReader> findAttribute(tinygltf::Model const &model,
+                                            tinygltf::Primitive const &prim,
+                                            std::string const &name) {
+  auto found = prim.attributes.find(name);
+  if (found == prim.attributes.end())
+    return std::nullopt;
+  return AccessorReader{model, found->second};
+}
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+/** FNV-1a variant consuming 8 bytes per step, texel data is large. */
+uint64_t hashTexels(std::span<const unsigned char> data) {
+  uint64_t hash = 14695981039346656037ull;
+  size_t i = 0;
+  for (; i + 8 <= data.size(); i += 8) {
+    uint64_t word;
+    memcpy(&word, data.data() + i, 8);
+    hash = (hash ^ word) * 1099511628211ull;
+  }
+  for (; i < data.size(); ++i)
+    hash = (hash ^ data[i]) * 1099511628211ull;
+  return hash;
+}
+
+std::vector<unsigned char> expandToRGBA(tinygltf::Image const &image) {
+  if (image.bits != 8 && image.bits != 16)
+    throw std::runtime_error("[GLTF][ERROR] image '" + image.name +
+                             "' has unsupported bit depth");
+
+  size_t texelCount = static_cast<size_t>(image.width) * image.height;
+  auto bytesPerChannel = static_cast<size_t>(image.bits / 8);
+  std::vector<unsigned char> rgba(texelCount * 4);
+
+  if (image.bits == 8) {
+    RenderEngine::PixelConversion::expandToRGBA(
+        image.image.data(), image.component, rgba.data(), texelCount);
+    return rgba;
+  }
+
+  auto *src = image.image.data();
+  auto *dst = rgba.data();
+  for (size_t i = 0; i < texelCount; ++i) {
+    unsigned char texel[4] = {0, 0, 0, 255};
+    for (int c = 0; c < image.component; ++c)
+      // for 16 bit images take most significant byte (little endian)
+      texel[c] = src[c * bytesPerChannel + bytesPerChannel - 1];
+    // grayscale images
+    if (image.component <= 2) {
+      texel[3] = image.component == 2 ? texel[1] : 255;
+      texel[1] = texel[0];
+      texel[2] = texel[0];
+    }
+    memcpy(dst, texel, 4);
+    src += image.component * bytesPerChannel;
+    dst += 4;
+  }
+
+  return rgba;
+}
+
+void nodeTransform(tinygltf::Node const &node, TestApp::cooked::Node &dst) {
+  glm::vec3 translation{0.0f};
+  glm::quat rotation{1.0f, 0.0f, 0.0f, 0.0f};
+  glm::vec3 scale{1.0f};
+
+  if (node.matrix.size() == 16) {
+    glm::vec3 skew;
+    glm::vec4 perspective;
+    glm::decompose(glm::mat4(glm::make_mat4x4(node.matrix.data())), scale,
+                   rotation, translation, skew, perspective);
+  } else {
+    if (node.translation.size() == 3)
+      translation = glm::make_vec3(node.translation.data());
+    if (node.rotation.size() == 4)
+      rotation = glm::make_quat(node.rotation.data());
+    if (node.scale.size() == 3)
+      scale = glm::make_vec3(node.scale.data());
+  }
+
+  memcpy(dst.translation, glm::value_ptr(translation), sizeof(dst.translation));
+  dst.rotation[0] = rotation.x;
+  dst.rotation[1] = rotation.y;
+  dst.rotation[2] = rotation.z;
+  dst.rotation[3] = rotation.w;
+  memcpy(dst.scale, glm::value_ptr(scale), sizeof(dst.scale));
+}
+
+} // namespace
+
+TestApp::CookedModel
+TestApp::CookedModel::cook(std::filesystem::path const &source,
+                           RenderEngine::TextureCompressor const *compressor) {
+  if (!source.has_extension())
+    throw std::runtime_error("[MODEL][ERROR] " + source.generic_string() +
+                             " file has no extension.");
+
+  tinygltf::Model gltfModel;
+  tinygltf::TinyGLTF gltfContext;
+
+  std::string error, warning;
+
+  bool fileLoaded;
+
+  if (source.extension() == ".gltf")
+    fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning,
+                                               source.generic_string());
+  else if (source.extension() == ".glb")
+    fileLoaded = gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning,
+                                                source.generic_string());
+  else
+    throw std::runtime_error(
+        "[MODEL][ERROR] " + source.generic_string() +
+        " file has incorrect extension. Supported extensions are: gltf, glb");
+
+  if (!fileLoaded)
+    throw std::runtime_error("[GLTF][ERROR] failed to load model from file " +
+                             source.generic_string() + ". " + error);
+
+  if (!warning.empty())
+    std::cout << "[GLTF][WARNING]: " << warning << std::endl;
+
+  return cook(gltfModel, compressor);
+}
+
+TestApp::CookedModel
+TestApp::CookedModel::cook(tinygltf::Model const &model,
+                           RenderEngine::TextureCompressor const *compressor) {
+  CookedModel ret;
+
+  auto addName = [&ret](std::string const &name) {
+    cooked::Name entry{static_cast<uint32_t>(ret.m_strings.size()),
+                       static_cast<uint32_t>(name.size())};
+    ret.m_strings.insert(ret.m_strings.end(), name.begin(), name.end());
+    return entry;
+  };
+
+  auto textureSource = [&model](tinygltf::Parameter const &param) {
+    return model.textures.at(param.TextureIndex()).source;
+  };
+
+  // Texture roles decide compressed format. Image shared between roles is
+  // treated as color map, since color formats keep all channels.
+
+  std::vector<RenderEngine::TextureRole> roles(
+      model.images.size(), RenderEngine::TextureRole::Color);
+  std::vector<bool> usedAsColor(model.images.size());
+
+  for (auto &mat : model.materials) {
+    if (auto found = mat.values.find("baseColorTexture");
+        found != mat.values.end())
+      usedAsColor.at(textureSource(found->second)) = true;
+
+    if (auto found = mat.additionalValues.find("normalTexture");
+        found != mat.additionalValues.end())
+      roles.at(textureSource(found->second)) =
+          RenderEngine::TextureRole::Normal;
+
+    if (auto found = mat.values.find("metallicRoughnessTexture");
+        found != mat.values.end())
+      roles.at(textureSource(found->second)) =
+          RenderEngine::TextureRole::MetallicRoughness;
+  }
+
+  for (size_t i = 0; i < roles.size(); ++i)
+    if (usedAsColor[i])
+      roles[i] = RenderEngine::TextureRole::Color;
+
+  // Textures
+
+  // Mip chains of all images are generated in parallel. Compressor spreads
+  // each texture over the job system on its own, so it runs sequentially.
+
+  std::vector<std::vector<unsigned char>> chains(model.images.size());
+  auto &jobs = RenderEngine::JobSystem::shared();
+  jobs.wait(jobs.parallelFor(
+      model.images.size(), 1, [&model, &chains](size_t begin, size_t end) {
+        for (auto i = begin; i < end; ++i) {
+          auto &image = model.images[i];
+          auto rgba = expandToRGBA(image);
+          chains[i] = RenderEngine::BlockCompression::generateMipChain(
+              rgba, image.width, image.height,
+              RenderEngine::BlockCompression::mipLevelCount(image.width,
+                                                            image.height));
+        }
+      }));
+
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    auto &image = model.images[i];
+    size_t width = image.width;
+    size_t height = image.height;
+    auto mipLevels =
+        RenderEngine::BlockCompression::mipLevelCount(width, height);
+    auto chain = std::move(chains[i]);
+
+    auto &texture = ret.m_textures.emplace_back();
+    texture.width = width;
+    texture.height = height;
+    texture.mipLevels = mipLevels;
+    texture.format = VK_FORMAT_R8G8B8A8_UNORM;
+    texture.offset = alignUp(ret.m_texels.size(), cooked::SECTION_ALIGNMENT);
+
+    std::span<const unsigned char> texels = chain;
+    RenderEngine::CompressedTexture compressed;
+
+    if (compressor) {
+      compressed =
+          compressor->compress(chain, width, height, mipLevels, roles[i]);
+      texture.format = compressed.format;
+      texels = compressed.mipChain;
+    }
+
+    texture.size = texels.size();
+    texture.contentHash = hashTexels(texels);
+    ret.m_texels.resize(texture.offset + texels.size());
+    memcpy(ret.m_texels.data() + texture.offset, texels.data(), texels.size());
+  }
+
+  // Materials
+
+  for (auto &mat : model.materials) {
+    cooked::Material material{-1, -1, -1, 0};
+
+    if (auto found = mat.values.find("baseColorTexture");
+        found != mat.values.end())
+      material.colorMap = textureSource(found->second);
+
+    if (auto found = mat.additionalValues.find("normalTexture");
+        found != mat.additionalValues.end())
+      material.normalMap = textureSource(found->second);
+
+    if (auto found = mat.values.find("metallicRoughnessTexture");
+        found != mat.values.end())
+      material.metallicRoughnessMap = textureSource(found->second);
+
+    ret.m_materials.push_back(material);
+  }
+
+  // primitives without material use default one appended at the end
+  int32_t defaultMaterial = -1;
+
+  // Meshes
+
+  for (auto &mesh : model.meshes) {
+    auto &cookedMesh = ret.m_meshes.emplace_back();
+    cookedMesh.name = addName(mesh.name);
+    cookedMesh.firstPrimitive = ret.m_primitives.size();
+    cookedMesh.primitiveCount = mesh.primitives.size();
+    cookedMesh.firstVertex = ret.m_vertices.size();
+    cookedMesh.firstIndex = ret.m_indices.size();
+
+    for (auto &primitive : mesh.primitives) {
+      auto position = findAttribute(model, primitive, "POSITION");
+      if (!position)
+        throw std::runtime_error(
+            "[MESH][ERROR] gltf primitive has no POSITION attribute");
+
+      auto &cookedPrimitive = ret.m_primitives.emplace_back();
+      if (primitive.material < 0) {
+        if (defaultMaterial < 0) {
+          defaultMaterial = ret.m_materials.size();
+          ret.m_materials.push_back(cooked::Material{-1, -1, -1, 0});
+        }
+        cookedPrimitive.material = defaultMaterial;
+      } else
+        cookedPrimitive.material = primitive.material;
+
+      cookedPrimitive.firstVertex =
+          ret.m_vertices.size() - cookedMesh.firstVertex;
+      cookedPrimitive.vertexCount = position->count();
+      cookedPrimitive.firstIndex = ret.m_indices.size() - cookedMesh.firstIndex;
+
+      auto &posAccessor =
+          model.accessors.at(primitive.attributes.at("POSITION"));
+      for (int i = 0; i < 3; ++i) {
+        cookedPrimitive.min[i] = posAccessor.minValues.size() == 3
+                                     ? posAccessor.minValues[i]
+                                     : -FLT_MAX;
+        cookedPrimitive.max[i] = posAccessor.maxValues.size() == 3
+                                     ? posAccessor.maxValues[i]
+                                     : FLT_MAX;
+      }
+
+      auto normal = findAttribute(model, primitive, "NORMAL");
+      auto tangent = findAttribute(model, primitive, "TANGENT");
+      auto uv = findAttribute(model, primitive, "TEXCOORD_0");
+      auto color = findAttribute(model, primitive, "COLOR_0");
+      auto joints = findAttribute(model, primitive, "JOINTS_0");
+      auto weights = findAttribute(model, primitive, "WEIGHTS_0");
+
+      auto readVec = [](std::optional<AccessorReader> const &reader,
+                        size_t element, int components, float *dst) {
+        for (int c = 0; c < std::min(components, reader->components()); ++c)
+          dst[c] = reader->read(element, c);
+      };
+
+      for (size_t i = 0; i < position->count(); ++i) {
+        ModelAttributes vertex{};
+        vertex.pos = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        readVec(position, i, 3, glm::value_ptr(vertex.pos));
+
+        if (normal)
+          readVec(normal, i, 3, glm::value_ptr(vertex.normal));
+        else
+          vertex.normal = glm::normalize(glm::vec3(1.0f));
+
+        if (tangent)
+          readVec(tangent, i, 3, glm::value_ptr(vertex.tangent));
+        else
+          vertex.tangent = glm::normalize(glm::vec3(1.0f));
+
+        if (uv)
+          readVec(uv, i, 2, glm::value_ptr(vertex.uv));
+
+        if (color)
+          readVec(color, i, 4, glm::value_ptr(vertex.color));
+
+        if (joints && weights) {
+          for (int c = 0; c < std::min(4, joints->components()); ++c)
+            vertex.joint[c] = static_cast<float>(joints->readInteger(i, c));
+          readVec(weights, i, 4, glm::value_ptr(vertex.weight));
+          // quantized weights rarely sum up to exactly one
+          auto total = glm::dot(vertex.weight, glm::vec4(1.0f));
+          if (total > 0.0f)
+            vertex.weight /= total;
+        }
+
+        ret.m_vertices.push_back(vertex);
+      }
+
+      if (primitive.indices >= 0) {
+        AccessorReader indices{model, primitive.indices};
+        cookedPrimitive.indexCount = indices.count();
+        for (size_t i = 0; i < indices.count(); ++i)
+          ret.m_indices.push_back(indices.readIndex(i));
+      } else
+        cookedPrimitive.indexCount = 0;
+    }
+
+    cookedMesh.vertexCount = ret.m_vertices.size() - cookedMesh.firstVertex;
+    cookedMesh.indexCount = ret.m_indices.size() - cookedMesh.firstIndex;
+  }
+
+  // Nodes
+
+  const tinygltf::Scene &scene =
+      model.scenes.at(model.defaultScene > -1 ? model.defaultScene : 0);
+
+  // glTF node index -> cooked node index, -1 for nodes outside of the scene
+  std::vector<int32_t> cookedNodes(model.nodes.size(), -1);
+
+  std::function<void(int, int32_t)> addNode = [&](int nodeIndex,
+                                                  int32_t parent) {
+    auto &node = model.nodes.at(nodeIndex);
+    auto index = static_cast<int32_t>(ret.m_nodes.size());
+    cookedNodes.at(nodeIndex) = index;
+    cooked::Node cookedNode{};
+    cookedNode.name = addName(node.name);
+    cookedNode.parent = parent;
+    cookedNode.mesh = node.mesh;
+    cookedNode.skin = node.mesh > -1 ? node.skin : -1;
+    nodeTransform(node, cookedNode);
+    ret.m_nodes.push_back(cookedNode);
+
+    for (int child : node.children)
+      addNode(child, index);
+  };
+
+  for (int nodeIndex : scene.nodes)
+    addNode(nodeIndex, -1);
+
+  // Skins
+
+  for (auto &skin : model.skins) {
+    auto &cookedSkin = ret.m_skins.emplace_back();
+    cookedSkin.name = addName(skin.name);
+    cookedSkin.firstJoint = ret.m_joints.size();
+    cookedSkin.jointCount = skin.joints.size();
+
+    std::optional<AccessorReader> inverseBind;
+    if (skin.inverseBindMatrices > -1)
+      inverseBind.emplace(model, skin.inverseBindMatrices);
+
+    for (size_t i = 0; i < skin.joints.size(); ++i) {
+      auto &joint = ret.m_joints.emplace_back();
+      joint.node = cookedNodes.at(skin.joints[i]);
+      auto identity = glm::mat4(1.0f);
+      memcpy(joint.inverseBind, glm::value_ptr(identity),
+             sizeof(joint.inverseBind));
+      if (inverseBind && i < inverseBind->count())
+        for (int c = 0; c < 16; ++c)
+          joint.inverseBind[c] = inverseBind->read(i, c);
+    }
+  }
+
+  // Animations
+
+  for (auto &animation : model.animations) {
+    auto &cookedAnimation = ret.m_animations.emplace_back();
+    cookedAnimation.name = addName(animation.name);
+    cookedAnimation.firstChannel = ret.m_channels.size();
+    cookedAnimation.duration = 0.0f;
+
+    for (auto &channel : animation.channels) {
+      cooked::ChannelPath path;
+      if (channel.target_path == "translation")
+        path = cooked::ChannelPath::Translation;
+      else if (channel.target_path == "rotation")
+        path = cooked::ChannelPath::Rotation;
+      else if (channel.target_path == "scale")
+        path = cooked::ChannelPath::Scale;
+      else
+        // morph target weights are not supported
+        continue;
+
+      if (channel.target_node < 0 || cookedNodes.at(channel.target_node) < 0)
+        continue;
+
+      auto &sampler = animation.samplers.at(channel.sampler);
+      AccessorReader input{model, sampler.input};
+      AccessorReader output{model, sampler.output};
+
+      auto interpolation = cooked::Interpolation::Linear;
+      if (sampler.interpolation == "STEP")
+        interpolation = cooked::Interpolation::Step;
+      else if (sampler.interpolation == "CUBICSPLINE")
+        interpolation = cooked::Interpolation::CubicSpline;
+
+      // cubic spline output holds in-tangent, value and out-tangent per key
+      auto stride = cooked::valuesPerKey(interpolation);
+      if (input.count() == 0 || output.count() < input.count() * stride)
+        throw std::runtime_error(
+            "[GLTF][ERROR] animation sampler has mismatching key count");
+
+      cooked::Channel cookedChannel{};
+      cookedChannel.node = cookedNodes.at(channel.target_node);
+      cookedChannel.path = path;
+      cookedChannel.interpolation = interpolation;
+      cookedChannel.firstKey = ret.m_keyTimes.size();
+      cookedChannel.keyCount = input.count();
+      cookedChannel.firstValue = ret.m_keyValues.size();
+
+      for (size_t key = 0; key < input.count(); ++key)
+        ret.m_keyTimes.push_back(input.read(key, 0));
+
+      for (size_t i = 0; i < input.count() * stride; ++i) {
+        glm::vec4 value{0.0f};
+        for (int c = 0; c < std::min(4, output.components()); ++c)
+          value[c] = output.read(i, c);
+        ret.m_keyValues.push_back(value);
+      }
+
+      cookedAnimation.duration =
+          std::max(cookedAnimation.duration, ret.m_keyTimes.back());
+      ret.m_channels.push_back(cookedChannel);
+    }
+
+    cookedAnimation.channelCount =
+        ret.m_channels.size() - cookedAnimation.firstChannel;
+  }
+
+  return ret;
+}
+
+TestApp::CookedModelView TestApp::CookedModel::view() const {
+  return CookedModelView{m_meshes,   m_primitives, m_nodes,     m_materials,
+                         m_textures, m_skins,      m_joints,    m_animations,
+                         m_channels, m_keyTimes,   m_keyValues, m_vertices,
+                         m_indices,  m_texels,     m_strings};
+}
+
+void TestApp::CookedModel::write(std::filesystem::path const &destination,
+                                 uint64_t sourceSize,
+                                 int64_t sourceTime) const {
+  cooked::Header header{};
+  memcpy(header.magic, cooked::MAGIC, sizeof(header.magic));
+  header.version = cooked::FORMAT_VERSION;
+  header.vertexStride = sizeof(ModelAttributes);
+  header.sourceSize = sourceSize;
+  header.sourceTime = sourceTime;
+  header.meshCount = m_meshes.size();
+  header.primitiveCount = m_primitives.size();
+  header.nodeCount = m_nodes.size();
+  header.materialCount = m_materials.size();
+  header.textureCount = m_textures.size();
+  header.skinCount = m_skins.size();
+  header.jointCount = m_joints.size();
+  header.animationCount = m_animations.size();
+  header.channelCount = m_channels.size();
+  header.keyCount = m_keyTimes.size();
+  header.keyValueCount = m_keyValues.size();
+  header.vertexCount = m_vertices.size();
+  header.indexCount = m_indices.size();
+  header.texelBytes = m_texels.size();
+  header.stringBytes = m_strings.size();
+
+  struct Section {
+    const void *data;
+    uint64_t size;
+    uint64_t *offset;
+  };
+
+  Section sections[] = {
+      {m_meshes.data(), m_meshes.size() * sizeof(cooked::Mesh),
+       &header.meshOffset},
+      {m_primitives.data(), m_primitives.size() * sizeof(cooked::Primitive),
+       &header.primitiveOffset},
+      {m_nodes.data(), m_nodes.size() * sizeof(cooked::Node),
+       &header.nodeOffset},
+      {m_materials.data(), m_materials.size() * sizeof(cooked::Material),
+       &header.materialOffset},
+      {m_textures.data(), m_textures.size() * sizeof(cooked::Texture),
+       &header.textureOffset},
+      {m_skins.data(), m_skins.size() * sizeof(cooked::Skin),
+       &header.skinOffset},
+      {m_joints.data(), m_joints.size() * sizeof(cooked::Joint),
+       &header.jointOffset},
+      {m_animations.data(), m_animations.size() * sizeof(cooked::Animation),
+       &header.animationOffset},
+      {m_channels.data(), m_channels.size() * sizeof(cooked::Channel),
+       &header.channelOffset},
+      {m_keyTimes.data(), m_keyTimes.size() * sizeof(float),
+       &header.keyTimeOffset},
+      {m_keyValues.data(), m_keyValues.size() * sizeof(glm::vec4),
+       &header.keyValueOffset},
+      {m_vertices.data(), m_vertices.size() * sizeof(ModelAttributes),
+       &header.vertexOffset},
+      {m_indices.data(), m_indices.size() * sizeof(uint32_t),
+       &header.indexOffset},
+      {m_texels.data(), m_texels.size(), &header.texelOffset},
+      {m_strings.data(), m_strings.size(), &header.stringOffset}};
+
+  uint64_t offset = alignUp(sizeof(header), cooked::SECTION_ALIGNMENT);
+  for (auto &section : sections) {
+    *section.offset = offset;
+    offset = alignUp(offset + section.size, cooked::SECTION_ALIGNMENT);
+  }
+
+  // write to temporary file first, so partially written file never appears
+  // under the final name
+  auto temporary = destination;
+  temporary += ".tmp";
+
+  {
+    std::ofstream os(temporary, std::ios::binary | std::ios::trunc);
+    if (!os.is_open())
+      throw std::runtime_error("[MODEL][ERROR] cannot open " +
+                               temporary.generic_string() + " for writing");
+
+    const char padding[cooked::SECTION_ALIGNMENT] = {};
+    auto pad = [&os, &padding]() {
+      auto position = static_cast<uint64_t>(os.tellp());
+      os.write(padding,
+               alignUp(position, cooked::SECTION_ALIGNMENT) - position);
+    };
+
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    pad();
+    for (auto &section : sections) {
+      os.write(static_cast<const char *>(section.data), section.size);
+      pad();
+    }
+
+    if (!os)
+      throw std::runtime_error("[MODEL][ERROR] failed to write " +
+                               temporary.generic_string());
+  }
+
+  std::filesystem::rename(temporary, destination);
+}
+
+TestApp::MappedCookedModel::MappedCookedModel(
+    std::filesystem::path const &path)
+    : m_file(path), m_header(m_file.view<cooked::Header>(0, 1).data()) {
+  if (memcmp(m_header->magic, cooked::MAGIC, sizeof(cooked::MAGIC)) != 0)
+    throw std::runtime_error("[MODEL][ERROR] " + path.generic_string() +
+                             " is not a cooked model");
+
+  if (m_header->version != cooked::FORMAT_VERSION ||
+      m_header->vertexStride != sizeof(ModelAttributes))
+    throw std::runtime_error("[MODEL][ERROR] " + path.generic_string() +
+                             " has incompatible cooked format version");
+
+  auto &h = *m_header;
+  m_view.meshes = m_file.view<cooked::Mesh>(h.meshOffset, h.meshCount);
+  m_view.primitives =
+      m_file.view<cooked::Primitive>(h.primitiveOffset, h.primitiveCount);
+  m_view.nodes = m_file.view<cooked::Node>(h.nodeOffset, h.nodeCount);
+  m_view.materials =
+      m_file.view<cooked::Material>(h.materialOffset, h.materialCount);
+  m_view.textures =
+      m_file.view<cooked::Texture>(h.textureOffset, h.textureCount);
+  m_view.skins = m_file.view<cooked::Skin>(h.skinOffset, h.skinCount);
+  m_view.joints = m_file.view<cooked::Joint>(h.jointOffset, h.jointCount);
+  m_view.animations =
+      m_file.view<cooked::Animation>(h.animationOffset, h.animationCount);
+  m_view.channels =
+      m_file.view<cooked::Channel>(h.channelOffset, h.channelCount);
+  m_view.keyTimes = m_file.view<float>(h.keyTimeOffset, h.keyCount);
+  m_view.keyValues =
+      m_file.view<glm::vec4>(h.keyValueOffset, h.keyValueCount);
+  m_view.vertices =
+      m_file.view<ModelAttributes>(h.vertexOffset, h.vertexCount);
+  m_view.indices = m_file.view<uint32_t>(h.indexOffset, h.indexCount);
+  m_view.texels = m_file.view<unsigned char>(h.texelOffset, h.texelBytes);
+  m_view.strings = m_file.view<char>(h.stringOffset, h.stringBytes);
+
+  m_validate(path);
+}
+
+void TestApp::MappedCookedModel::m_validate(
+    std::filesystem::path const &path) const {
+  auto fail = [&path](std::string const &what) {
+    throw std::runtime_error("[MODEL][ERROR] " + path.generic_string() +
+                             " has " + what + " out of bounds");
+  };
+  auto inside = [](uint64_t first, uint64_t count, uint64_t size) {
+    return first <= size && count <= size - first;
+  };
+  // -1 stands for no reference
+  auto reference = [](int32_t index, size_t size) {
+    return index >= -1 && (index < 0 || static_cast<size_t>(index) < size);
+  };
+  auto &v = m_view;
+  auto named = [&](cooked::Name const &name) {
+    return inside(name.offset, name.size, v.strings.size());
+  };
+
+  for (auto &texture : v.textures) {
+    if (!inside(texture.offset, texture.size, v.texels.size()))
+      fail("texture texels");
+    auto format = static_cast<VkFormat>(texture.format);
+    if (texture.width == 0 || texture.height == 0 || texture.mipLevels == 0 ||
+        texture.mipLevels > RenderEngine::BlockCompression::mipLevelCount(
+                                texture.width, texture.height) ||
+        (format != VK_FORMAT_R8G8B8A8_UNORM &&
+         format != VK_FORMAT_R8G8B8A8_SRGB &&
+         !RenderEngine::BlockCompression::isBlockCompressed(format)))
+      fail("texture extent or format");
+    // mip uploads read the whole chain from the mapping
+    uint64_t chainSize = 0;
+    for (uint32_t level = 0; level < texture.mipLevels; ++level)
+      chainSize += RenderEngine::TextureLoader::mipLevelSize(
+          format, std::max(texture.width >> level, 1u),
+          std::max(texture.height >> level, 1u));
+    if (chainSize > texture.size)
+      fail("texture mip chain");
+  }
+
+  for (auto &mesh : v.meshes) {
+    if (!named(mesh.name))
+      fail("mesh name");
+    if (!inside(mesh.firstPrimitive, mesh.primitiveCount,
+                v.primitives.size()))
+      fail("mesh primitives");
+    if (!inside(mesh.firstVertex, mesh.vertexCount, v.vertices.size()) ||
+        !inside(mesh.firstIndex, mesh.indexCount, v.indices.size()))
+      fail("mesh vertices or indices");
+    for (auto &primitive :
+         v.primitives.subspan(mesh.firstPrimitive, mesh.primitiveCount)) {
+      if (!inside(primitive.firstVertex, primitive.vertexCount,
+                  mesh.vertexCount) ||
+          !inside(primitive.firstIndex, primitive.indexCount,
+                  mesh.indexCount))
+        fail("primitive vertices or indices");
+      if (!reference(primitive.material, v.materials.size()))
+        fail("primitive material");
+      // indices are relative to the first vertex of the primitive
+      auto indices = v.indices.subspan(mesh.firstIndex + primitive.firstIndex,
+                                       primitive.indexCount);
+      if (std::any_of(indices.begin(), indices.end(),
+                      [&primitive](uint32_t index) {
+                        return index >= primitive.vertexCount;
+                      }))
+        fail("primitive index value");
+    }
+  }
+
+  // hierarchy is linearized relying on parents preceding their children
+  for (size_t i = 0; i < v.nodes.size(); ++i) {
+    auto &node = v.nodes[i];
+    if (!named(node.name) || !reference(node.parent, i) ||
+        !reference(node.mesh, v.meshes.size()) ||
+        !reference(node.skin, v.skins.size()))
+      fail("node reference");
+  }
+
+  for (auto &material : v.materials)
+    if (!reference(material.colorMap, v.textures.size()) ||
+        !reference(material.normalMap, v.textures.size()) ||
+        !reference(material.metallicRoughnessMap, v.textures.size()))
+      fail("material texture");
+
+  for (auto &skin : v.skins)
+    if (!named(skin.name) ||
+        !inside(skin.firstJoint, skin.jointCount, v.joints.size()))
+      fail("skin joints");
+
+  for (auto &joint : v.joints)
+    if (!reference(joint.node, v.nodes.size()))
+      fail("joint node");
+
+  for (auto &animation : v.animations)
+    if (!named(animation.name) || !inside(animation.firstChannel,
+                                         animation.channelCount,
+                                         v.channels.size()))
+      fail("animation channels");
+
+  for (auto &channel : v.channels) {
+    if (channel.path > cooked::ChannelPath::Scale ||
+        channel.interpolation > cooked::Interpolation::CubicSpline)
+      fail("channel path or interpolation");
+    if (!reference(channel.node, v.nodes.size()) ||
+        !inside(channel.firstKey, channel.keyCount, v.keyTimes.size()) ||
+        !inside(channel.firstValue,
+                uint64_t(channel.keyCount) *
+                    cooked::valuesPerKey(channel.interpolation),
+                v.keyValues.size()))
+      fail("channel keys");
+  }
+}
+
+namespace {
+
+uint64_t fnv1a(std::string_view data) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+struct SourceStamp {
+  uint64_t size;
+  int64_t time;
+};
+
+SourceStamp stampOf(std::filesystem::path const &source) {
+  return {std::filesystem::file_size(source),
+          static_cast<int64_t>(std::filesystem::last_write_time(source)
+                                   .time_since_epoch()
+                                   .count())};
+}
+
+} // namespace
+
+TestApp::ModelCache::ModelCache(
+    std::filesystem::path directory,
+    std::optional<RenderEngine::TextureCompressionSettings> compression)
+    : m_directory(std::move(directory)) {
+  std::filesystem::create_directories(m_directory);
+  if (compression)
+    m_compressor.emplace(*compression, m_directory / "textures");
+}
+
+std::filesystem::path
+TestApp::ModelCache::cachePathOf(std::filesystem::path const &source) const {
+  auto key = std::filesystem::absolute(source).lexically_normal();
+  char hash[17];
+  snprintf(hash, sizeof(hash), "%016llx",
+           static_cast<unsigned long long>(fnv1a(key.generic_string())));
+  auto name = source.stem().string() + "-" + hash;
+
+  if (m_compressor) {
+    snprintf(hash, sizeof(hash), "%016llx",
+             static_cast<unsigned long long>(
+                 m_compressor->settings().hash()));
+    name += std::string("-bc") + hash;
+  }
+
+  return m_directory / (name + ".cooked");
+}
+
+std::optional<TestApp::MappedCookedModel>
+TestApp::ModelCache::tryMap(std::filesystem::path const &source) const {
+  auto path = cachePathOf(source);
+  if (!std::filesystem::exists(path))
+    return std::nullopt;
+
+  try {
+    MappedCookedModel mapped{path};
+    auto stamp = stampOf(source);
+    if (mapped.header().sourceSize != stamp.size ||
+        mapped.header().sourceTime != stamp.time)
+      return std::nullopt;
+    return mapped;
+  } catch (std::runtime_error &e) {
+    std::cout << "[MODEL][WARNING]: ignoring cache entry " +
+                     path.generic_string() + ": " + e.what()
+              << std::endl;
+    return std::nullopt;
+  }
+}
+
+void TestApp::ModelCache::store(std::filesystem::path const &source,
+                                CookedModel const &model) const {
+  auto stamp = stampOf(source);
+  model.write(cachePathOf(source), stamp.size, stamp.time);
+}
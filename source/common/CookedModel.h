@@ -0,0 +1,295 @@
+#ifndef TESTAPP_COOKEDMODEL_H
+#define TESTAPP_COOKEDMODEL_H
+
+#include "Model.h"
+#include <RenderEngine/AssetImport/MappedFile.h>
+#include <RenderEngine/AssetImport/TextureCompressor.h>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace TestApp {
+
+/** Binary layout of cooked model files.
+ *
+ *  File starts with Header followed by sections located at offsets
+ *  stored in the header. Every section is aligned to SECTION_ALIGNMENT so
+ *  it can be viewed directly from mapped memory. Any change to the records
+ *  below or to ModelAttributes must bump FORMAT_VERSION.
+ */
+namespace cooked {
+
+constexpr char MAGIC[8] = {'V', 'K', 'W', 'M', 'O', 'D', 'E', 'L'};
+constexpr uint32_t FORMAT_VERSION = 5;
+constexpr uint64_t SECTION_ALIGNMENT = 16;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t vertexStride;
+  // source file stamp, used to detect stale cache entries
+  uint64_t sourceSize;
+  int64_t sourceTime;
+
+  uint32_t meshCount;
+  uint32_t primitiveCount;
+  uint32_t nodeCount;
+  uint32_t materialCount;
+  uint32_t textureCount;
+  uint32_t skinCount;
+  uint32_t jointCount;
+  uint32_t animationCount;
+  uint32_t channelCount;
+  uint32_t keyCount;
+  uint64_t keyValueCount;
+  uint64_t vertexCount;
+  uint64_t indexCount;
+  uint64_t texelBytes;
+  uint64_t stringBytes;
+
+  uint64_t meshOffset;
+  uint64_t primitiveOffset;
+  uint64_t nodeOffset;
+  uint64_t materialOffset;
+  uint64_t textureOffset;
+  uint64_t skinOffset;
+  uint64_t jointOffset;
+  uint64_t animationOffset;
+  uint64_t channelOffset;
+  uint64_t keyTimeOffset;
+  uint64_t keyValueOffset;
+  uint64_t vertexOffset;
+  uint64_t indexOffset;
+  uint64_t texelOffset;
+  uint64_t stringOffset;
+};
+
+/** Reference into string section. */
+struct Name {
+  uint32_t offset;
+  uint32_t size;
+};
+
+/** Range of vertex and index streams owned by single mesh. */
+struct Mesh {
+  Name name;
+  uint32_t firstPrimitive;
+  uint32_t primitiveCount;
+  uint32_t firstVertex;
+  uint32_t vertexCount;
+  uint32_t firstIndex;
+  uint32_t indexCount;
+};
+
+/** Vertex and index ranges are relative to owning mesh. */
+struct Primitive {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t firstVertex;
+  uint32_t vertexCount;
+  int32_t material;
+  float min[3];
+  float max[3];
+};
+
+/** Nodes are stored in depth-first order, so parent precedes its children. */
+struct Node {
+  Name name;
+  int32_t parent;
+  int32_t mesh;
+  int32_t skin;
+  float translation[3];
+  float rotation[4]; // x, y, z, w as in glTF
+  float scale[3];
+};
+
+/** Joints of skin are stored contiguously. Vertex joint attributes index
+ *  joints relative to firstJoint of the skin.
+ */
+struct Skin {
+  Name name;
+  uint32_t firstJoint;
+  uint32_t jointCount;
+};
+
+/** Joint node is -1 if node is not part of the cooked scene. */
+struct Joint {
+  int32_t node;
+  float inverseBind[16];
+};
+
+struct Animation {
+  Name name;
+  uint32_t firstChannel;
+  uint32_t channelCount;
+  float duration;
+};
+
+enum class ChannelPath : uint32_t { Translation = 0, Rotation = 1, Scale = 2 };
+
+enum class Interpolation : uint32_t { Step = 0, Linear = 1, CubicSpline = 2 };
+
+/** Key times are range of key time section starting at firstKey. Key values
+ *  start at firstValue of key value section, one per key or, for cubic
+ *  spline, three per key: in-tangent, value and out-tangent as in glTF.
+ *  Values are stored as vec4: translation and scale in xyz, rotation
+ *  quaternion as x, y, z, w.
+ */
+struct Channel {
+  int32_t node;
+  ChannelPath path;
+  Interpolation interpolation;
+  uint32_t firstKey;
+  uint32_t keyCount;
+  uint32_t firstValue;
+};
+
+/** Key values per key of channel. */
+inline uint32_t valuesPerKey(Interpolation interpolation) {
+  return interpolation == Interpolation::CubicSpline ? 3 : 1;
+}
+
+struct Material {
+  int32_t colorMap;
+  int32_t normalMap;
+  int32_t metallicRoughnessMap;
+  int32_t reserved;
+};
+
+/** Texel data holds all mip levels of the texture tightly packed.
+ *  contentHash is hash of the texel data, so identical textures of
+ *  different models are recognized without reading them.
+ */
+struct Texture {
+  uint32_t width;
+  uint32_t height;
+  uint32_t mipLevels;
+  uint32_t format;
+  uint64_t offset;
+  uint64_t size;
+  uint64_t contentHash;
+};
+
+} // namespace cooked
+
+/** Non-owning view on cooked model data. Either points into CookedModel
+ *  vectors or directly into mapped cache file.
+ */
+struct CookedModelView {
+  std::span<const cooked::Mesh> meshes;
+  std::span<const cooked::Primitive> primitives;
+  std::span<const cooked::Node> nodes;
+  std::span<const cooked::Material> materials;
+  std::span<const cooked::Texture> textures;
+  std::span<const cooked::Skin> skins;
+  std::span<const cooked::Joint> joints;
+  std::span<const cooked::Animation> animations;
+  std::span<const cooked::Channel> channels;
+  std::span<const float> keyTimes;
+  std::span<const glm::vec4> keyValues;
+  std::span<const ModelAttributes> vertices;
+  std::span<const uint32_t> indices;
+  std::span<const unsigned char> texels;
+  std::span<const char> strings;
+
+  std::string_view name(cooked::Name name) const {
+    return {strings.data() + name.offset, name.size};
+  }
+};
+
+/** Result of processing glTF file: converted vertex attributes, mipmapped
+ *  textures, flattened node hierarchy, skins and animations. Textures are
+ *  stored as RGBA8 unless compressor is given, in which case format is
+ *  chosen from the role texture plays in materials.
+ */
+class CookedModel {
+public:
+  static CookedModel
+  cook(std::filesystem::path const &source,
+       RenderEngine::TextureCompressor const *compressor = nullptr);
+
+  static CookedModel
+  cook(tinygltf::Model const &model,
+       RenderEngine::TextureCompressor const *compressor = nullptr);
+
+  void write(std::filesystem::path const &destination, uint64_t sourceSize,
+             int64_t sourceTime) const;
+
+  CookedModelView view() const;
+
+private:
+  std::vector<cooked::Mesh> m_meshes;
+  std::vector<cooked::Primitive> m_primitives;
+  std::vector<cooked::Node> m_nodes;
+  std::vector<cooked::Material> m_materials;
+  std::vector<cooked::Texture> m_textures;
+  std::vector<cooked::Skin> m_skins;
+  std::vector<cooked::Joint> m_joints;
+  std::vector<cooked::Animation> m_animations;
+  std::vector<cooked::Channel> m_channels;
+  std::vector<float> m_keyTimes;
+  std::vector<glm::vec4> m_keyValues;
+  std::vector<ModelAttributes> m_vertices;
+  std::vector<uint32_t> m_indices;
+  std::vector<unsigned char> m_texels;
+  std::vector<char> m_strings;
+};
+
+/** Cooked model file mapped into memory. */
+class MappedCookedModel {
+public:
+  explicit MappedCookedModel(std::filesystem::path const &path);
+
+  cooked::Header const &header() const { return *m_header; }
+
+  CookedModelView const &view() const { return m_view; }
+
+private:
+  /** Checks that every range and index stored in entries stays within its
+   *  section, texture mip chains fit their texel ranges and nodes follow
+   *  their parents, so stale or truncated cache is rejected instead of read
+   *  out of bounds.
+   */
+  void m_validate(std::filesystem::path const &path) const;
+
+  RenderEngine::MappedFile m_file;
+  cooked::Header const *m_header;
+  CookedModelView m_view;
+};
+
+/** Directory holding cooked models keyed by source path and texture
+ *  compression settings. Compressed textures are additionally cached by
+ *  content in "textures" subdirectory, so re-cooking model whose images did
+ *  not change does not run encoders again.
+ */
+class ModelCache {
+public:
+  explicit ModelCache(
+      std::filesystem::path directory,
+      std::optional<RenderEngine::TextureCompressionSettings> compression =
+          std::nullopt);
+
+  /** Null if textures are kept uncompressed. */
+  RenderEngine::TextureCompressor const *compressor() const {
+    return m_compressor ? &m_compressor.value() : nullptr;
+  }
+
+  std::filesystem::path cachePathOf(std::filesystem::path const &source) const;
+
+  /** Maps cached entry if it exists and matches source file stamp. */
+  std::optional<MappedCookedModel>
+  tryMap(std::filesystem::path const &source) const;
+
+  void store(std::filesystem::path const &source,
+             CookedModel const &model) const;
+
+private:
+  std::filesystem::path m_directory;
+  std::optional<RenderEngine::TextureCompressor> m_compressor;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_COOKEDMODEL_H
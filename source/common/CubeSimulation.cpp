@@ -0,0 +1,521 @@
+#include "CubeSimulation.h"
+#include <RenderEngine/JobSystem.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vkw/CommandPool.hpp>
+#include <vkw/Device.hpp>
+#include <vkw/Queue.hpp>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||            \
+    defined(_M_IX86)
+#define CUBE_SIMULATION_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+namespace TestApp {
+
+namespace {
+
+// cubes processed by single AVX2 iteration
+constexpr size_t LANES = 8;
+// blocks of LANES cubes updated by single job
+constexpr size_t BLOCK_GRAIN = 256;
+
+struct Streams {
+  float *px, *py, *pz;
+  float *rx, *ry, *rz;
+  float const *sx, *sy, *sz;
+  float const *vx, *vy, *vz;
+  float const *wx, *wy, *wz;
+};
+
+float wrapDegrees(float angle) {
+  return angle - 360.0f * std::nearbyint(angle * (1.0f / 360.0f));
+}
+
+void updateScalar(Streams const &s, float deltaTime, size_t begin,
+                  size_t end, InstanceCulling::Instance *instances) {
+  for (auto i = begin; i < end; ++i) {
+    s.px[i] += s.vx[i] * deltaTime;
+    s.py[i] += s.vy[i] * deltaTime;
+    s.pz[i] += s.vz[i] * deltaTime;
+    s.rx[i] = wrapDegrees(s.rx[i] + s.wx[i] * deltaTime);
+    s.ry[i] = wrapDegrees(s.ry[i] + s.wy[i] * deltaTime);
+    s.rz[i] = wrapDegrees(s.rz[i] + s.wz[i] * deltaTime);
+
+    auto sinX = std::sin(glm::radians(s.rx[i]));
+    auto cosX = std::cos(glm::radians(s.rx[i]));
+    auto sinY = std::sin(glm::radians(s.ry[i]));
+    auto cosY = std::cos(glm::radians(s.ry[i]));
+    auto sinZ = std::sin(glm::radians(s.rz[i]));
+    auto cosZ = std::cos(glm::radians(s.rz[i]));
+
+    auto &model = instances[i].model;
+    model[0] = glm::vec4{cosY * cosZ, sinX * sinY * cosZ + cosX * sinZ,
+                         sinX * sinZ - cosX * sinY * cosZ, 0.0f} *
+               s.sx[i];
+    model[1] = glm::vec4{-cosY * sinZ, cosX * cosZ - sinX * sinY * sinZ,
+                         cosX * sinY * sinZ + sinX * cosZ, 0.0f} *
+               s.sy[i];
+    model[2] = glm::vec4{sinY, -sinX * cosY, cosX * cosY, 0.0f} * s.sz[i];
+    model[3] = glm::vec4{s.px[i], s.py[i], s.pz[i], 1.0f};
+  }
+}
+
+#ifdef CUBE_SIMULATION_X86
+
+bool hasAVX2() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  bool fma = info[2] & (1 << 12);
+  bool osxsave = info[2] & (1 << 27);
+  if (!fma || !osxsave || (_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return info[1] & (1 << 5);
+#else
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+/** Sine and cosine of angles within [-pi, pi]. Angle is reduced to
+ *  [-pi/4, pi/4] around the nearest multiple of pi/2, whose quadrant
+ *  selects and negates minimax polynomials of the remainder.
+ */
+AVX2_TARGET void sinCos(__m256 angle, __m256 &sine, __m256 &cosine) {
+  auto quadrant = _mm256_round_ps(
+      _mm256_mul_ps(angle, _mm256_set1_ps(0.636619772f)),
+      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  // pi/2 split in three parts so the first products are exact
+  auto x = _mm256_fnmadd_ps(quadrant, _mm256_set1_ps(1.5703125f), angle);
+  x = _mm256_fnmadd_ps(quadrant, _mm256_set1_ps(4.837512969970703125e-4f), x);
+  x = _mm256_fnmadd_ps(quadrant, _mm256_set1_ps(7.549789948768648e-8f), x);
+  auto x2 = _mm256_mul_ps(x, x);
+
+  auto s = _mm256_fmadd_ps(_mm256_set1_ps(-1.9515295891e-4f), x2,
+                           _mm256_set1_ps(8.3321608736e-3f));
+  s = _mm256_fmadd_ps(s, x2, _mm256_set1_ps(-1.6666654611e-1f));
+  s = _mm256_fmadd_ps(_mm256_mul_ps(s, x2), x, x);
+
+  auto c = _mm256_fmadd_ps(_mm256_set1_ps(2.443315711809948e-5f), x2,
+                           _mm256_set1_ps(-1.388731625493765e-3f));
+  c = _mm256_fmadd_ps(c, x2, _mm256_set1_ps(4.166664568298827e-2f));
+  c = _mm256_fmadd_ps(c, x2, _mm256_set1_ps(-0.5f));
+  c = _mm256_fmadd_ps(c, x2, _mm256_set1_ps(1.0f));
+
+  // odd quadrants swap sine and cosine, sine is negated in quadrants 2, 3
+  // and cosine in quadrants 1, 2
+  auto q = _mm256_cvtps_epi32(quadrant);
+  auto swap = _mm256_castsi256_ps(
+      _mm256_cmpeq_epi32(_mm256_and_si256(q, _mm256_set1_epi32(1)),
+                         _mm256_set1_epi32(1)));
+  auto sineSign = _mm256_castsi256_ps(
+      _mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30));
+  auto cosineSign = _mm256_castsi256_ps(_mm256_slli_epi32(
+      _mm256_and_si256(_mm256_add_epi32(q, _mm256_set1_epi32(1)),
+                       _mm256_set1_epi32(2)),
+      30));
+
+  sine = _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), sineSign);
+  cosine = _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), cosineSign);
+}
+
+/** In place transpose, row i becomes element i of every row. */
+AVX2_TARGET void transpose(__m256 (&rows)[8]) {
+  __m256 t[8], s[8];
+  for (int i = 0; i < 4; ++i) {
+    t[2 * i] = _mm256_unpacklo_ps(rows[2 * i], rows[2 * i + 1]);
+    t[2 * i + 1] = _mm256_unpackhi_ps(rows[2 * i], rows[2 * i + 1]);
+  }
+  for (int i = 0; i < 8; i += 4) {
+    s[i] = _mm256_shuffle_ps(t[i], t[i + 2], 0x44);
+    s[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], 0xEE);
+    s[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0x44);
+    s[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0xEE);
+  }
+  for (int i = 0; i < 4; ++i) {
+    rows[i] = _mm256_permute2f128_ps(s[i], s[i + 4], 0x20);
+    rows[i + 4] = _mm256_permute2f128_ps(s[i], s[i + 4], 0x31);
+  }
+}
+
+/** State is integrated without fused multiply-add, rounding like scalar
+ *  code and the compute shader, otherwise the difference of the same
+ *  rounding repeated every frame grows linearly with time. The file is
+ *  built with contraction off, so compiler does not fuse them either.
+ */
+AVX2_TARGET void integrate(float *value, float const *rate, __m256 deltaTime) {
+  auto step = _mm256_mul_ps(_mm256_loadu_ps(rate), deltaTime);
+  _mm256_storeu_ps(value, _mm256_add_ps(_mm256_loadu_ps(value), step));
+}
+
+AVX2_TARGET __m256 rotate(float *angle, float const *rate, __m256 deltaTime) {
+  auto degrees = _mm256_add_ps(_mm256_loadu_ps(angle),
+                               _mm256_mul_ps(_mm256_loadu_ps(rate), deltaTime));
+  auto turns = _mm256_round_ps(
+      _mm256_mul_ps(degrees, _mm256_set1_ps(1.0f / 360.0f)),
+      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  degrees =
+      _mm256_sub_ps(degrees, _mm256_mul_ps(turns, _mm256_set1_ps(360.0f)));
+  _mm256_storeu_ps(angle, degrees);
+  return _mm256_mul_ps(degrees, _mm256_set1_ps(glm::radians(1.0f)));
+}
+
+/** Eight cubes per iteration: sixteen registers hold one matrix element of
+ *  each cube and are transposed into two halves of each matrix. Streaming
+ *  stores need 32 byte alignment, so unaligned output is stored normally.
+ */
+AVX2_TARGET void updateAVX2(Streams const &s, float deltaTime, size_t begin,
+                            size_t end, InstanceCulling::Instance *instances) {
+  auto dt = _mm256_set1_ps(deltaTime);
+  auto zero = _mm256_setzero_ps();
+  auto one = _mm256_set1_ps(1.0f);
+  bool aligned = reinterpret_cast<uintptr_t>(instances + begin) % 32 == 0;
+
+  auto i = begin;
+  for (; i + LANES <= end; i += LANES) {
+    integrate(s.px + i, s.vx + i, dt);
+    integrate(s.py + i, s.vy + i, dt);
+    integrate(s.pz + i, s.vz + i, dt);
+
+    __m256 sinX, cosX, sinY, cosY, sinZ, cosZ;
+    sinCos(rotate(s.rx + i, s.wx + i, dt), sinX, cosX);
+    sinCos(rotate(s.ry + i, s.wy + i, dt), sinY, cosY);
+    sinCos(rotate(s.rz + i, s.wz + i, dt), sinZ, cosZ);
+
+    auto scaleX = _mm256_loadu_ps(s.sx + i);
+    auto scaleY = _mm256_loadu_ps(s.sy + i);
+    auto scaleZ = _mm256_loadu_ps(s.sz + i);
+    auto sinXsinY = _mm256_mul_ps(sinX, sinY);
+    auto cosXsinY = _mm256_mul_ps(cosX, sinY);
+
+    __m256 columns01[8] = {
+        _mm256_mul_ps(_mm256_mul_ps(cosY, cosZ), scaleX),
+        _mm256_mul_ps(_mm256_fmadd_ps(sinXsinY, cosZ,
+                                      _mm256_mul_ps(cosX, sinZ)),
+                      scaleX),
+        _mm256_mul_ps(_mm256_fnmadd_ps(cosXsinY, cosZ,
+                                       _mm256_mul_ps(sinX, sinZ)),
+                      scaleX),
+        zero,
+        _mm256_mul_ps(_mm256_mul_ps(cosY, sinZ), _mm256_sub_ps(zero, scaleY)),
+        _mm256_mul_ps(_mm256_fnmadd_ps(sinXsinY, sinZ,
+                                       _mm256_mul_ps(cosX, cosZ)),
+                      scaleY),
+        _mm256_mul_ps(_mm256_fmadd_ps(cosXsinY, sinZ,
+                                      _mm256_mul_ps(sinX, cosZ)),
+                      scaleY),
+        zero};
+    __m256 columns23[8] = {
+        _mm256_mul_ps(sinY, scaleZ),
+        _mm256_mul_ps(_mm256_mul_ps(sinX, cosY), _mm256_sub_ps(zero, scaleZ)),
+        _mm256_mul_ps(_mm256_mul_ps(cosX, cosY), scaleZ),
+        zero,
+        _mm256_loadu_ps(s.px + i),
+        _mm256_loadu_ps(s.py + i),
+        _mm256_loadu_ps(s.pz + i),
+        one};
+    transpose(columns01);
+    transpose(columns23);
+
+    for (size_t lane = 0; lane < LANES; ++lane) {
+      auto *model = &instances[i + lane].model[0][0];
+      if (aligned) {
+        _mm256_stream_ps(model, columns01[lane]);
+        _mm256_stream_ps(model + 8, columns23[lane]);
+      } else {
+        _mm256_storeu_ps(model, columns01[lane]);
+        _mm256_storeu_ps(model + 8, columns23[lane]);
+      }
+    }
+  }
+
+  // streamed matrices must be visible before the job is reported finished
+  _mm_sfence();
+  updateScalar(s, deltaTime, i, end, instances);
+}
+
+#endif
+
+} // namespace
+
+void CubeSimulation::M_Vec3Array::resize(size_t size) {
+  x.resize(size);
+  y.resize(size);
+  z.resize(size);
+}
+
+glm::vec3 CubeSimulation::M_Vec3Array::get(size_t index) const {
+  return {x.at(index), y.at(index), z.at(index)};
+}
+
+void CubeSimulation::M_Vec3Array::set(size_t index, glm::vec3 value) {
+  x.at(index) = value.x;
+  y.at(index) = value.y;
+  z.at(index) = value.z;
+}
+
+CubeSimulation::CubeSimulation(uint32_t capacity) : m_capacity(capacity) {
+  for (auto *array :
+       {&m_position, &m_rotation, &m_scale, &m_velocity, &m_angularVelocity})
+    array->resize(capacity);
+}
+
+uint32_t CubeSimulation::add(Cube const &cube) {
+  if (m_size == m_capacity)
+    throw std::runtime_error("[CUBES][ERROR] cube simulation is full");
+
+  auto index = m_size++;
+  m_position.set(index, cube.position);
+  m_rotation.set(index, {wrapDegrees(cube.rotation.x),
+                         wrapDegrees(cube.rotation.y),
+                         wrapDegrees(cube.rotation.z)});
+  m_scale.set(index, cube.scale);
+  m_velocity.set(index, cube.velocity);
+  m_angularVelocity.set(index, cube.angularVelocity);
+  return index;
+}
+
+void CubeSimulation::remove(uint32_t index) {
+  if (index >= m_size)
+    throw std::runtime_error("[CUBES][ERROR] removed cube does not exist");
+
+  auto last = --m_size;
+  if (index == last)
+    return;
+
+  m_position.set(index, m_position.get(last));
+  m_rotation.set(index, m_rotation.get(last));
+  m_scale.set(index, m_scale.get(last));
+  m_velocity.set(index, m_velocity.get(last));
+  m_angularVelocity.set(index, m_angularVelocity.get(last));
+}
+
+CubeSimulation::Cube CubeSimulation::get(uint32_t index) const {
+  if (index >= m_size)
+    throw std::runtime_error("[CUBES][ERROR] cube does not exist");
+
+  return Cube{.position = m_position.get(index),
+              .rotation = m_rotation.get(index),
+              .scale = m_scale.get(index),
+              .velocity = m_velocity.get(index),
+              .angularVelocity = m_angularVelocity.get(index)};
+}
+
+void CubeSimulation::set(uint32_t index, Cube const &cube) {
+  if (index >= m_size)
+    throw std::runtime_error("[CUBES][ERROR] cube does not exist");
+
+  m_position.set(index, cube.position);
+  m_rotation.set(index, cube.rotation);
+  m_scale.set(index, cube.scale);
+  m_velocity.set(index, cube.velocity);
+  m_angularVelocity.set(index, cube.angularVelocity);
+}
+
+void CubeSimulation::update(float deltaTime,
+                            std::span<InstanceCulling::Instance> instances) {
+  if (instances.size() < m_size)
+    throw std::runtime_error(
+        "[CUBES][ERROR] instances are fewer than simulated cubes");
+
+  // ranges start at multiples of LANES, so only the last one has a tail
+  auto &jobs = RenderEngine::JobSystem::shared();
+  auto blocks = (m_size + LANES - 1) / LANES;
+  jobs.wait(jobs.parallelFor(
+      blocks, BLOCK_GRAIN,
+      [this, deltaTime, instances](size_t begin, size_t end) {
+        m_update(deltaTime, begin * LANES,
+                 std::min<size_t>(end * LANES, m_size), instances.data());
+      }));
+}
+
+bool CubeSimulation::vectorized() {
+#ifdef CUBE_SIMULATION_X86
+  static const bool avx2 = hasAVX2();
+  return avx2;
+#else
+  return false;
+#endif
+}
+
+void CubeSimulation::m_update(float deltaTime, size_t begin, size_t end,
+                              InstanceCulling::Instance *instances) {
+  Streams streams{m_position.x.data(),        m_position.y.data(),
+                  m_position.z.data(),        m_rotation.x.data(),
+                  m_rotation.y.data(),        m_rotation.z.data(),
+                  m_scale.x.data(),           m_scale.y.data(),
+                  m_scale.z.data(),           m_velocity.x.data(),
+                  m_velocity.y.data(),        m_velocity.z.data(),
+                  m_angularVelocity.x.data(), m_angularVelocity.y.data(),
+                  m_angularVelocity.z.data()};
+
+#ifdef CUBE_SIMULATION_X86
+  if (vectorized()) {
+    updateAVX2(streams, deltaTime, begin, end, instances);
+    return;
+  }
+#endif
+  updateScalar(streams, deltaTime, begin, end, instances);
+}
+
+CubeSimulationLayout::CubeSimulationLayout(
+    vkw::Device &device, RenderEngine::ShaderLoaderInterface &loader,
+    uint32_t maxSimulations)
+    : RenderEngine::ComputeLayout(
+          device, loader,
+          RenderEngine::SubstageDescription{.shaderSubstageName =
+                                                "cube_simulation"},
+          maxSimulations) {}
+
+DeviceCubeSimulation::DeviceCubeSimulation(
+    vkw::Device &device, CubeSimulationLayout &layout, uint32_t capacity,
+    vkw::Buffer<InstanceCulling::Instance> &instances)
+    : RenderEngine::Compute(layout), m_device(device),
+      m_cubes(device, std::max(capacity, 1u),
+              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+              VmaAllocationCreateInfo{
+                  .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+                  .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT}),
+      m_instances(instances) {
+  static_assert(sizeof(M_Cube) == 5 * sizeof(glm::vec4),
+                "M_Cube must match std430 layout of Cube");
+
+  if (instances.size() < capacity)
+    throw std::runtime_error(
+        "[CUBES][ERROR] instances are fewer than simulation capacity");
+
+  set().writeStorageBuffer(0, m_cubes);
+  set().writeStorageBuffer(1, instances);
+}
+
+void DeviceCubeSimulation::upload(CubeSimulation const &simulation) {
+  if (simulation.size() > capacity())
+    throw std::runtime_error(
+        "[CUBES][ERROR] cubes exceed device simulation capacity");
+
+  m_size = simulation.size();
+  if (m_size == 0)
+    return;
+
+  vkw::Buffer<M_Cube> stage{
+      m_device, m_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VmaAllocationCreateInfo{
+          .usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+          .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT}};
+  stage.map();
+  auto mapped = stage.mapped();
+  for (uint32_t i = 0; i < m_size; ++i) {
+    auto cube = simulation.get(i);
+    mapped[i] = M_Cube{glm::vec4(cube.position, 0.0f),
+                       glm::vec4(cube.rotation, 0.0f),
+                       glm::vec4(cube.scale, 0.0f),
+                       glm::vec4(cube.velocity, 0.0f),
+                       glm::vec4(cube.angularVelocity, 0.0f)};
+  }
+  stage.flush();
+  stage.unmap();
+
+  m_copy(stage, m_cubes);
+}
+
+void DeviceCubeSimulation::download(CubeSimulation &simulation) const {
+  if (simulation.size() != m_size)
+    throw std::runtime_error(
+        "[CUBES][ERROR] simulation does not match downloaded cubes");
+
+  if (m_size == 0)
+    return;
+
+  // coherent, so read back state needs no invalidation
+  vkw::Buffer<M_Cube> stage{
+      m_device, m_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VmaAllocationCreateInfo{
+          .usage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+          .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT}};
+  m_copy(m_cubes, stage);
+
+  stage.map();
+  auto mapped = stage.mapped();
+  for (uint32_t i = 0; i < m_size; ++i)
+    simulation.set(i, CubeSimulation::Cube{
+                          .position = mapped[i].position,
+                          .rotation = mapped[i].rotation,
+                          .scale = mapped[i].scale,
+                          .velocity = mapped[i].velocity,
+                          .angularVelocity = mapped[i].angularVelocity});
+  stage.unmap();
+}
+
+void DeviceCubeSimulation::update(vkw::CommandBuffer &buffer,
+                                  float deltaTime,
+                                  uint32_t firstInstance) const {
+  if (m_size == 0)
+    return;
+
+  struct {
+    float deltaTime;
+    uint32_t cubeCount;
+    uint32_t firstInstance;
+  } constants{deltaTime, m_size, firstInstance};
+
+  buffer.pushConstants(layout().pipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT,
+                       0, constants);
+  dispatch(buffer, (m_size + CubeSimulationLayout::GROUP_SIZE - 1) /
+                       CubeSimulationLayout::GROUP_SIZE);
+
+  VkBufferMemoryBarrier barriers[2]{};
+  for (auto &barrier : barriers) {
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+  }
+  barriers[0].buffer = m_cubes;
+  barriers[1].buffer = m_instances;
+
+  // matrices are read by culling and by draws of visible cubes
+  buffer.bufferMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                             barriers);
+}
+
+void DeviceCubeSimulation::m_copy(vkw::Buffer<M_Cube> const &from,
+                                  vkw::Buffer<M_Cube> const &to) const {
+  auto const &queue = m_device.get().anyTransferQueue();
+  auto commandPool = vkw::CommandPool{
+      m_device, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, queue.family().index()};
+  auto commandBuffer = vkw::PrimaryCommandBuffer{commandPool};
+
+  commandBuffer.begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+  VkBufferCopy region{};
+  region.size = m_size * sizeof(M_Cube);
+  commandBuffer.copyBufferToBuffer(from, to, {&region, 1});
+
+  commandBuffer.end();
+
+  queue.submit(vkw::SubmitInfo{commandBuffer});
+
+  queue.waitIdle();
+}
+
+} // namespace TestApp
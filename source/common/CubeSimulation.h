@@ -0,0 +1,148 @@
+#ifndef TESTAPP_CUBESIMULATION_H
+#define TESTAPP_CUBESIMULATION_H
+
+#include "InstanceCulling.h"
+#include <RenderEngine/Pipelines/Compute.h>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+#include <vkw/CommandBuffer.hpp>
+
+namespace TestApp {
+
+/** Motion of cubes stored as structure of arrays.
+ *
+ *  Every component of every vector lives in its own array, so eight cubes
+ *  are integrated and their model matrices built at once in AVX2 registers
+ *  when the CPU supports it. Matrices are equal to translate * rotate(x) *
+ *  rotate(y) * rotate(z) * scale with angles in degrees. Angles are kept
+ *  within [-180, 180] to preserve precision of long running simulation.
+ */
+class CubeSimulation {
+public:
+  struct Cube {
+    glm::vec3 position;
+    glm::vec3 rotation;
+    glm::vec3 scale = glm::vec3{1.0f};
+    glm::vec3 velocity = glm::vec3{0.0f};
+    // degrees per second around each axis
+    glm::vec3 angularVelocity = glm::vec3{0.0f};
+  };
+
+  explicit CubeSimulation(uint32_t capacity);
+
+  uint32_t size() const { return m_size; }
+
+  uint32_t capacity() const { return m_capacity; }
+
+  /** @return index of added cube */
+  uint32_t add(Cube const &cube);
+
+  /** Moves the last cube into place of removed one. */
+  void remove(uint32_t index);
+
+  Cube get(uint32_t index) const;
+
+  void set(uint32_t index, Cube const &cube);
+
+  /** Advances all cubes by deltaTime and writes their model matrices into
+   *  instances with streaming stores, so written memory is not read into
+   *  cache. Work is split between workers of the shared job system.
+   */
+  void update(float deltaTime, std::span<InstanceCulling::Instance> instances);
+
+  /** True if the AVX2 kernel is used on this CPU. */
+  static bool vectorized();
+
+private:
+  struct M_Vec3Array {
+    std::vector<float> x, y, z;
+
+    void resize(size_t size);
+
+    glm::vec3 get(size_t index) const;
+
+    void set(size_t index, glm::vec3 value);
+  };
+
+  /** Integrates and writes cubes of [begin, end). */
+  void m_update(float deltaTime, size_t begin, size_t end,
+                InstanceCulling::Instance *instances);
+
+  M_Vec3Array m_position;
+  M_Vec3Array m_rotation;
+  M_Vec3Array m_scale;
+  M_Vec3Array m_velocity;
+  M_Vec3Array m_angularVelocity;
+  uint32_t m_size = 0;
+  uint32_t m_capacity;
+};
+
+class CubeSimulationLayout : public RenderEngine::ComputeLayout {
+public:
+  /** Cubes integrated by single invocation group. Must match
+   *  cube_simulation.comp.
+   */
+  static constexpr uint32_t GROUP_SIZE = 64;
+
+  CubeSimulationLayout(vkw::Device &device,
+                       RenderEngine::ShaderLoaderInterface &loader,
+                       uint32_t maxSimulations);
+};
+
+/** Motion of cubes integrated by compute shader.
+ *
+ *  State lives in device local memory and is copied from or to host
+ *  simulation only when simulation moves between them. Matrices are equal
+ *  to those of CubeSimulation up to precision of device trigonometry.
+ */
+class DeviceCubeSimulation : public RenderEngine::Compute {
+public:
+  /** @param instances  storage buffer model matrices are written to */
+  DeviceCubeSimulation(vkw::Device &device, CubeSimulationLayout &layout,
+                       uint32_t capacity,
+                       vkw::Buffer<InstanceCulling::Instance> &instances);
+
+  uint32_t size() const { return m_size; }
+
+  uint32_t capacity() const { return m_cubes.size(); }
+
+  /** Copies all cubes of simulation to device. Blocks until copy is done,
+   *  device must not be executing update() meanwhile.
+   */
+  void upload(CubeSimulation const &simulation);
+
+  /** Copies cubes back into simulation holding as many cubes. Blocks until
+   *  copy is done, recorded updates must be finished before.
+   */
+  void download(CubeSimulation &simulation) const;
+
+  /** Records integration of all cubes and barrier making written matrices
+   *  visible to compute and vertex shaders and state to the next update.
+   *
+   *  @param firstInstance  instance matrix of the first cube is written to
+   */
+  void update(vkw::CommandBuffer &buffer, float deltaTime,
+              uint32_t firstInstance = 0) const;
+
+private:
+  // std430 layout of Cube in cube_simulation.comp, w is unused
+  struct M_Cube {
+    glm::vec4 position;
+    glm::vec4 rotation;
+    glm::vec4 scale;
+    glm::vec4 velocity;
+    glm::vec4 angularVelocity;
+  };
+
+  void m_copy(vkw::Buffer<M_Cube> const &from,
+              vkw::Buffer<M_Cube> const &to) const;
+
+  vkw::StrongReference<vkw::Device> m_device;
+  vkw::Buffer<M_Cube> m_cubes;
+  VkBuffer m_instances;
+  uint32_t m_size = 0;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_CUBESIMULATION_H
@@ -0,0 +1,152 @@
+#include "DepthPyramid.h"
+#include "Utils.h"
+#include <algorithm>
+#include <bit>
+
+namespace TestApp {
+
+namespace {
+
+VkImageMemoryBarrier levelBarrier(VkImage image, VkImageAspectFlags aspect,
+                                  uint32_t baseLevel, uint32_t levelCount) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+  barrier.image = image;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.subresourceRange.aspectMask = aspect;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  barrier.subresourceRange.baseMipLevel = baseLevel;
+  barrier.subresourceRange.levelCount = levelCount;
+  return barrier;
+}
+
+} // namespace
+
+DepthPyramidLayout::DepthPyramidLayout(
+    vkw::Device &device, RenderEngine::ShaderLoaderInterface &loader,
+    uint32_t maxLevels)
+    : RenderEngine::ComputeLayout(
+          device, loader,
+          RenderEngine::SubstageDescription{.shaderSubstageName =
+                                                "depth_pyramid"},
+          maxLevels) {}
+
+DepthPyramid::M_Reduction::M_Reduction(
+    DepthPyramidLayout &layout, vkw::ImageViewVT<vkw::V2D> const &source,
+    VkImageLayout sourceLayout, vkw::Sampler const &sampler,
+    vkw::ImageView<vkw::COLOR, vkw::V2D> const &destination)
+    : RenderEngine::Compute(layout) {
+  set().write(0, source, sourceLayout, sampler);
+  set().writeStorageImage(1, destination);
+}
+
+DepthPyramid::DepthPyramid(
+    vkw::Device &device, RenderEngine::ShaderLoaderInterface &loader,
+    vkw::Image<vkw::DEPTH, vkw::I2D, vkw::SINGLE> const &depth)
+    : m_depth(depth.vkw::AllocatedImage::operator VkImage_T *()),
+      m_levels(std::bit_width(std::max(std::bit_floor(depth.width()),
+                                        std::bit_floor(depth.height())))),
+      m_pyramid(device.getAllocator(),
+                VmaAllocationCreateInfo{
+                    .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+                    .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT},
+                VK_FORMAT_R32_SFLOAT, std::bit_floor(depth.width()),
+                std::bit_floor(depth.height()), 1, 1, m_levels,
+                VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT),
+      m_depthView(device, depth, depth.format()),
+      m_view(device, m_pyramid, m_pyramid.format(), 0u, 1u, 0u, m_levels),
+      m_sampler(device, m_samplerInfo()),
+      m_layout(device, loader, m_levels) {
+  doTransitLayout(m_pyramid, device, VK_IMAGE_LAYOUT_UNDEFINED,
+                  VK_IMAGE_LAYOUT_GENERAL);
+
+  // views are referenced by descriptors, so they must not be reallocated
+  m_levelViews.reserve(m_levels);
+  for (uint32_t level = 0; level < m_levels; ++level)
+    m_levelViews.emplace_back(device, m_pyramid, m_pyramid.format(), 0u, 1u,
+                              level, 1u);
+
+  m_reductions.emplace_back(std::make_unique<M_Reduction>(
+      m_layout, m_depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+      m_sampler, m_levelViews.front()));
+  for (uint32_t level = 1; level < m_levels; ++level)
+    m_reductions.emplace_back(std::make_unique<M_Reduction>(
+        m_layout, m_levelViews.at(level - 1), VK_IMAGE_LAYOUT_GENERAL,
+        m_sampler, m_levelViews.at(level)));
+}
+
+void DepthPyramid::build(vkw::CommandBuffer &buffer) const {
+  // depth goes to read only layout, pyramid waits for culling of the
+  // previous frame to finish reading it
+  VkImageMemoryBarrier before[2] = {
+      levelBarrier(m_depth, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1),
+      levelBarrier(m_pyramid.vkw::AllocatedImage::operator VkImage_T *(),
+                   VK_IMAGE_ASPECT_COLOR_BIT, 0, m_levels)};
+  before[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  before[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  before[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  before[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  before[1].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+  before[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  before[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  before[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+  buffer.imageMemoryBarrier(VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, before);
+
+  for (uint32_t level = 0; level < m_levels; ++level) {
+    auto levelWidth = std::max(width() >> level, 1u);
+    auto levelHeight = std::max(height() >> level, 1u);
+    m_reductions.at(level)->dispatch(
+        buffer,
+        (levelWidth + DepthPyramidLayout::GROUP_SIZE - 1) /
+            DepthPyramidLayout::GROUP_SIZE,
+        (levelHeight + DepthPyramidLayout::GROUP_SIZE - 1) /
+            DepthPyramidLayout::GROUP_SIZE);
+
+    auto written = levelBarrier(
+        m_pyramid.vkw::AllocatedImage::operator VkImage_T *(),
+        VK_IMAGE_ASPECT_COLOR_BIT, level, 1);
+    written.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    written.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    written.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    written.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    buffer.imageMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                              {&written, 1});
+  }
+
+  auto after = levelBarrier(m_depth, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1);
+  after.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  after.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  after.srcAccessMask = 0;
+  after.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  buffer.imageMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                            {&after, 1});
+}
+
+VkSamplerCreateInfo DepthPyramid::m_samplerInfo() {
+  VkSamplerCreateInfo createInfo{};
+
+  createInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  createInfo.pNext = nullptr;
+  createInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  createInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  createInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  createInfo.magFilter = VK_FILTER_NEAREST;
+  createInfo.minFilter = VK_FILTER_NEAREST;
+  createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  createInfo.anisotropyEnable = false;
+  createInfo.minLod = 0.0f;
+  createInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+  return createInfo;
+}
+
+} // namespace TestApp
@@ -0,0 +1,79 @@
+#ifndef TESTAPP_DEPTHPYRAMID_H
+#define TESTAPP_DEPTHPYRAMID_H
+
+#include <RenderEngine/Pipelines/Compute.h>
+#include <memory>
+#include <vector>
+#include <vkw/CommandBuffer.hpp>
+#include <vkw/Image.hpp>
+#include <vkw/Sampler.hpp>
+
+namespace TestApp {
+
+class DepthPyramidLayout : public RenderEngine::ComputeLayout {
+public:
+  /** Side of texel block reduced by single invocation group. Must match
+   *  depth_pyramid.comp.
+   */
+  static constexpr uint32_t GROUP_SIZE = 8;
+
+  DepthPyramidLayout(vkw::Device &device,
+                     RenderEngine::ShaderLoaderInterface &loader,
+                     uint32_t maxLevels);
+};
+
+/** Mip chain of the farthest depth over each texel footprint.
+ *
+ *  Level 0 is the largest power of two size fitting into the depth image,
+ *  every next level halves it. Texel of a level is never nearer than any
+ *  depth it covers, so a box whose nearest depth is behind all pyramid
+ *  texels under its screen rectangle is hidden. Pyramid must be recreated
+ *  with the depth image.
+ */
+class DepthPyramid {
+public:
+  DepthPyramid(vkw::Device &device, RenderEngine::ShaderLoaderInterface &loader,
+               vkw::Image<vkw::DEPTH, vkw::I2D, vkw::SINGLE> const &depth);
+
+  /** Records reduction of depth image written by preceding render pass.
+   *  Depth must be in attachment layout and is returned to it. Pyramid is
+   *  readable by compute shaders after this call.
+   */
+  void build(vkw::CommandBuffer &buffer) const;
+
+  /** All levels in general layout, sampled with nearest filter. */
+  vkw::ImageView<vkw::COLOR, vkw::V2D> const &view() const { return m_view; }
+
+  vkw::Sampler const &sampler() const { return m_sampler; }
+
+  uint32_t width() const { return m_pyramid.width(); }
+
+  uint32_t height() const { return m_pyramid.height(); }
+
+  uint32_t levels() const { return m_levels; }
+
+private:
+  class M_Reduction : public RenderEngine::Compute {
+  public:
+    M_Reduction(DepthPyramidLayout &layout,
+                vkw::ImageViewVT<vkw::V2D> const &source,
+                VkImageLayout sourceLayout, vkw::Sampler const &sampler,
+                vkw::ImageView<vkw::COLOR, vkw::V2D> const &destination);
+  };
+
+  static VkSamplerCreateInfo m_samplerInfo();
+
+  VkImage m_depth;
+  uint32_t m_levels;
+  vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE> m_pyramid;
+  vkw::ImageView<vkw::DEPTH, vkw::V2D> m_depthView;
+  vkw::ImageView<vkw::COLOR, vkw::V2D> m_view;
+  std::vector<vkw::ImageView<vkw::COLOR, vkw::V2D>> m_levelViews;
+  vkw::Sampler m_sampler;
+  // owns descriptor pool of the reductions, recreated with the pyramid
+  DepthPyramidLayout m_layout;
+  std::vector<std::unique_ptr<M_Reduction>> m_reductions;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_DEPTHPYRAMID_H
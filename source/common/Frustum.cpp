@@ -0,0 +1,191 @@
+#include "Frustum.h"
+#include <stdexcept>
+
+#if defined(__SSE__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace TestApp {
+
+namespace {
+
+glm::vec4 normalizePlane(glm::vec4 plane) {
+  return plane / glm::length(glm::vec3(plane));
+}
+
+void checkVisibilitySize(size_t count, std::span<uint8_t> visibility) {
+  if (visibility.size() < count)
+    throw std::runtime_error(
+        "[FRUSTUM][ERROR] visibility is shorter than culled volumes");
+}
+
+} // namespace
+
+Frustum::Frustum(glm::mat4 const &viewProjection) {
+  auto row = [&](int i) {
+    return glm::vec4(viewProjection[0][i], viewProjection[1][i],
+                     viewProjection[2][i], viewProjection[3][i]);
+  };
+
+  // Gribb-Hartmann: clip space inequalities -w <= x, y <= w and 0 <= z <= w
+  // turned into world space planes
+  m_planes[0] = normalizePlane(row(3) + row(0));
+  m_planes[1] = normalizePlane(row(3) - row(0));
+  m_planes[2] = normalizePlane(row(3) + row(1));
+  m_planes[3] = normalizePlane(row(3) - row(1));
+  m_planes[4] = normalizePlane(row(2));
+  m_planes[5] = normalizePlane(row(3) - row(2));
+}
+
+Frustum Frustum::extruded(glm::vec3 direction) const {
+  // side planes parallel to direction may come out slightly tilted from
+  // matrix extraction, they are kept
+  constexpr float PARALLEL_EPSILON = 1e-4f;
+
+  auto ret = *this;
+  direction = glm::normalize(direction);
+  for (auto &plane : ret.m_planes)
+    if (glm::dot(glm::vec3(plane), direction) < -PARALLEL_EPSILON)
+      plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+  return ret;
+}
+
+bool Frustum::intersects(glm::vec3 min, glm::vec3 max) const {
+  for (auto &plane : m_planes) {
+    // corner furthest along the plane normal
+    glm::vec3 corner{plane.x >= 0.0f ? max.x : min.x,
+                     plane.y >= 0.0f ? max.y : min.y,
+                     plane.z >= 0.0f ? max.z : min.z};
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+      return false;
+  }
+  return true;
+}
+
+bool Frustum::intersects(glm::vec3 center, float radius) const {
+  for (auto &plane : m_planes)
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+      return false;
+  return true;
+}
+
+bool Frustum::contains(glm::vec3 min, glm::vec3 max) const {
+  for (auto &plane : m_planes) {
+    // corner nearest along the plane normal
+    glm::vec3 corner{plane.x >= 0.0f ? min.x : max.x,
+                     plane.y >= 0.0f ? min.y : max.y,
+                     plane.z >= 0.0f ? min.z : max.z};
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+      return false;
+  }
+  return true;
+}
+
+uint32_t Frustum::cull(std::span<const Box> boxes,
+                       std::span<uint8_t> visibility) const {
+  checkVisibilitySize(boxes.size(), visibility);
+
+  uint32_t visible = 0;
+  size_t i = 0;
+
+#ifdef FRUSTUM_SSE
+  auto zero = _mm_setzero_ps();
+
+  for (; i + 4 <= boxes.size(); i += 4) {
+    auto *b = boxes.data() + i;
+    __m128 min[3] = {
+        _mm_setr_ps(b[0].min.x, b[1].min.x, b[2].min.x, b[3].min.x),
+        _mm_setr_ps(b[0].min.y, b[1].min.y, b[2].min.y, b[3].min.y),
+        _mm_setr_ps(b[0].min.z, b[1].min.z, b[2].min.z, b[3].min.z)};
+    __m128 max[3] = {
+        _mm_setr_ps(b[0].max.x, b[1].max.x, b[2].max.x, b[3].max.x),
+        _mm_setr_ps(b[0].max.y, b[1].max.y, b[2].max.y, b[3].max.y),
+        _mm_setr_ps(b[0].max.z, b[1].max.z, b[2].max.z, b[3].max.z)};
+
+    auto inside = _mm_cmpeq_ps(zero, zero);
+
+    for (auto &plane : m_planes) {
+      // plane is the same for all lanes, so the furthest corner is picked
+      // per plane rather than per lane
+      auto x = plane.x >= 0.0f ? max[0] : min[0];
+      auto y = plane.y >= 0.0f ? max[1] : min[1];
+      auto z = plane.z >= 0.0f ? max[2] : min[2];
+      auto distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)),
+                     _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+          _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)),
+                     _mm_set1_ps(plane.w)));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+    }
+
+    auto mask = _mm_movemask_ps(inside);
+    for (int lane = 0; lane < 4; ++lane) {
+      auto laneVisible = static_cast<uint8_t>((mask >> lane) & 1);
+      visibility[i + lane] = laneVisible;
+      visible += laneVisible;
+    }
+  }
+#endif
+
+  for (; i < boxes.size(); ++i) {
+    auto laneVisible = intersects(boxes[i].min, boxes[i].max);
+    visibility[i] = laneVisible;
+    visible += laneVisible;
+  }
+
+  return visible;
+}
+
+uint32_t Frustum::cull(std::span<const Sphere> spheres,
+                       std::span<uint8_t> visibility) const {
+  checkVisibilitySize(spheres.size(), visibility);
+
+  uint32_t visible = 0;
+  size_t i = 0;
+
+#ifdef FRUSTUM_SSE
+  static_assert(sizeof(Sphere) == 4 * sizeof(float),
+                "spheres are loaded as four packed floats");
+
+  for (; i + 4 <= spheres.size(); i += 4) {
+    auto *s = &spheres[i].center.x;
+    auto x = _mm_loadu_ps(s);
+    auto y = _mm_loadu_ps(s + 4);
+    auto z = _mm_loadu_ps(s + 8);
+    auto radius = _mm_loadu_ps(s + 12);
+    // rows of centers and radii to lanes of four spheres
+    _MM_TRANSPOSE4_PS(x, y, z, radius);
+    auto negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+    auto inside = _mm_cmpeq_ps(negativeRadius, negativeRadius);
+
+    for (auto &plane : m_planes) {
+      auto distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)),
+                     _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+          _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)),
+                     _mm_set1_ps(plane.w)));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+    }
+
+    auto mask = _mm_movemask_ps(inside);
+    for (int lane = 0; lane < 4; ++lane) {
+      auto laneVisible = static_cast<uint8_t>((mask >> lane) & 1);
+      visibility[i + lane] = laneVisible;
+      visible += laneVisible;
+    }
+  }
+#endif
+
+  for (; i < spheres.size(); ++i) {
+    auto laneVisible = intersects(spheres[i].center, spheres[i].radius);
+    visibility[i] = laneVisible;
+    visible += laneVisible;
+  }
+
+  return visible;
+}
+
+} // namespace TestApp
@@ -0,0 +1,70 @@
+#ifndef TESTAPP_FRUSTUM_H
+#define TESTAPP_FRUSTUM_H
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+
+namespace TestApp {
+
+/** View volume of a camera as six planes facing inwards.
+ *
+ *  Planes are extracted from the view-projection matrix once, so a test of
+ *  a box or sphere is a few dot products with no transform or perspective
+ *  divide. Like the rasterizer, the volume spans clip space depth [0, w].
+ *  Tests are conservative: volumes near frustum corners may be reported as
+ *  visible while being outside of it.
+ *
+ *  Batch tests process four volumes at once in SSE registers when the
+ *  target supports it.
+ */
+class Frustum {
+public:
+  struct Box {
+    glm::vec3 min;
+    glm::vec3 max;
+  };
+
+  struct Sphere {
+    glm::vec3 center;
+    float radius;
+  };
+
+  Frustum() = default;
+
+  explicit Frustum(glm::mat4 const &viewProjection);
+
+  bool intersects(glm::vec3 min, glm::vec3 max) const;
+
+  bool intersects(glm::vec3 center, float radius) const;
+
+  /** True if the box is entirely inside of the frustum. */
+  bool contains(glm::vec3 min, glm::vec3 max) const;
+
+  /** Writes 1 to visibility of each box intersecting the frustum and 0 to
+   *  others. Visibility must be at least as long as boxes.
+   *
+   *  @return number of visible boxes
+   */
+  uint32_t cull(std::span<const Box> boxes,
+                std::span<uint8_t> visibility) const;
+
+  uint32_t cull(std::span<const Sphere> spheres,
+                std::span<uint8_t> visibility) const;
+
+  /** Volume swept infinitely along direction. Planes the sweep would cross
+   *  are dropped, so the result is exact for orthographic projections
+   *  looking along direction and conservative otherwise.
+   */
+  Frustum extruded(glm::vec3 direction) const;
+
+  /** Normal in xyz, distance from origin in w. */
+  std::array<glm::vec4, 6> const &planes() const { return m_planes; }
+
+private:
+  std::array<glm::vec4, 6> m_planes{};
+};
+
+} // namespace TestApp
+#endif // TESTAPP_FRUSTUM_H
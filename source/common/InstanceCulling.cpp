@@ -0,0 +1,328 @@
+#include "InstanceCulling.h"
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+namespace TestApp {
+
+InstanceCullingLayout::InstanceCullingLayout(
+    vkw::Device &device, RenderEngine::ShaderLoaderInterface &loader,
+    uint32_t maxPools)
+    : RenderEngine::ComputeLayout(
+          device, loader,
+          RenderEngine::SubstageDescription{.shaderSubstageName =
+                                                "instance_culling"},
+          maxPools) {}
+
+InstanceOcclusionLayout::InstanceOcclusionLayout(
+    vkw::Device &device, RenderEngine::ShaderLoaderInterface &loader,
+    uint32_t maxPools)
+    : RenderEngine::ComputeLayout(
+          device, loader,
+          RenderEngine::SubstageDescription{.shaderSubstageName =
+                                                "instance_occlusion"},
+          maxPools) {}
+
+class InstanceCulling::M_Occlusion : public RenderEngine::Compute {
+public:
+  M_Occlusion(InstanceOcclusionLayout &layout, InstanceCulling &culling)
+      : RenderEngine::Compute(layout) {
+    // instances are bound by InstanceCulling::m_bindInstances()
+    set().writeStorageBuffer(1, culling.m_visible);
+    set().writeStorageBuffer(2, culling.m_passes);
+    set().writeStorageBuffer(3, culling.m_visibility);
+  }
+
+  void bindInstances(vkw::Buffer<Instance> &instances) {
+    set().writeStorageBuffer(0, instances);
+  }
+
+  /** Pyramid may be recreated between frames, so it is written each time
+   *  before late phase is recorded.
+   */
+  void bindPyramid(DepthPyramid const &pyramid) {
+    set().write(4, pyramid.view(), VK_IMAGE_LAYOUT_GENERAL, pyramid.sampler());
+  }
+};
+
+InstanceCulling::InstanceCulling(vkw::Device &device,
+                                 InstanceCullingLayout &layout,
+                                 Frustum::Box localBounds,
+                                 uint32_t vertexCount, uint32_t capacity,
+                                 uint32_t maxPasses,
+                                 InstanceOcclusionLayout *occlusionLayout)
+    : RenderEngine::Compute(layout),
+      m_instances(device, std::max(capacity * INSTANCE_REGIONS, 1u),
+                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                  VmaAllocationCreateInfo{
+                      .usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+                      .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT}),
+      m_deviceInstances(
+          device, std::max(capacity, 1u), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VmaAllocationCreateInfo{
+              .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+              .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT}),
+      m_visible(device, std::max(capacity * (maxPasses + 1), 1u),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VmaAllocationCreateInfo{
+                    .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+                    .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT}),
+      // instance counters are read back by host for statistics, so memory
+      // is coherent to avoid invalidation
+      m_passes(device, maxPasses + 1,
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                   VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+               VmaAllocationCreateInfo{
+                   .usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+                   .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT}),
+      m_visibility(device, std::max(capacity, 1u),
+                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                       VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                   VmaAllocationCreateInfo{
+                       .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+                       .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT}),
+      m_localBounds(localBounds), m_vertexCount(vertexCount),
+      m_capacity(capacity), m_maxPasses(maxPasses) {
+  static_assert(sizeof(M_Pass) == 7 * sizeof(glm::vec4),
+                "M_Pass must match std430 layout of DrawPass");
+
+  m_instances.map();
+  m_mapped = m_instances.mapped().data();
+  std::fill_n(m_mapped, m_instances.size(), Instance{});
+
+  m_passes.map();
+  m_mappedPasses = m_passes.mapped().data();
+  std::fill_n(m_mappedPasses, m_passes.size(), M_Pass{});
+
+  set().writeStorageBuffer(1, m_visible);
+  set().writeStorageBuffer(2, m_passes);
+  set().writeStorageBuffer(3, m_visibility);
+
+  if (occlusionLayout)
+    m_occlusion = std::make_unique<M_Occlusion>(*occlusionLayout, *this);
+
+  m_bindInstances();
+}
+
+InstanceCulling::~InstanceCulling() = default;
+
+void InstanceCulling::setDeviceWritten(bool deviceWritten) {
+  if (deviceWritten == m_deviceWritten)
+    return;
+
+  m_deviceWritten = deviceWritten;
+  m_bindInstances();
+}
+
+void InstanceCulling::m_bindInstances() {
+  auto &instances = instanceBuffer();
+  set().writeStorageBuffer(0, instances);
+  if (m_occlusion)
+    m_occlusion->bindInstances(instances);
+}
+
+void InstanceCulling::cull(vkw::CommandBuffer &buffer, uint32_t count,
+                           std::span<const Frustum> frustums,
+                           uint32_t occludedPass) {
+  if (frustums.size() > m_maxPasses)
+    throw std::runtime_error(
+        "[CULLING][ERROR] more frustums than culling passes");
+  if (count > m_capacity)
+    throw std::runtime_error(
+        "[CULLING][ERROR] more instances than culling capacity");
+  if (occludedPass != NO_OCCLUSION &&
+      (!m_occlusion || occludedPass >= frustums.size()))
+    throw std::runtime_error(
+        "[CULLING][ERROR] occluded pass can not be culled in two phases");
+
+  // previous frame finished, so its counters are final
+  m_lastDrawn = 0;
+  for (uint32_t pass = 0; pass < m_passCount; ++pass)
+    m_lastDrawn += m_mappedPasses[pass].command.instanceCount;
+  m_lastDisoccluded =
+      m_lateCulled ? m_mappedPasses[m_latePass()].command.instanceCount : 0;
+  m_lastDrawn += m_lastDisoccluded;
+
+  m_passCount = frustums.size();
+  m_occludedPass = occludedPass;
+  m_instanceCount = count;
+  m_lateCulled = false;
+  // host may write the next frame while device reads this one
+  m_culledFirst = firstInstance();
+  m_writeRegion = (m_writeRegion + 1) % INSTANCE_REGIONS;
+
+  auto &late = m_mappedPasses[m_latePass()].command;
+  late.vertexCount = m_vertexCount;
+  late.instanceCount = 0;
+  late.firstVertex = 0;
+  late.firstInstance = m_latePass() * m_capacity;
+
+  for (uint32_t pass = 0; pass < m_passCount; ++pass) {
+    auto &mapped = m_mappedPasses[pass];
+    std::copy(frustums[pass].planes().begin(), frustums[pass].planes().end(),
+              mapped.planes);
+    mapped.command.vertexCount = m_vertexCount;
+    mapped.command.instanceCount = 0;
+    mapped.command.firstVertex = 0;
+    mapped.command.firstInstance = pass * m_capacity;
+  }
+
+  if (count == 0 || m_passCount == 0)
+    return;
+
+  if (!m_deviceWritten)
+    m_instances.flush(m_culledFirst * sizeof(Instance),
+                      count * sizeof(Instance));
+
+  if (!m_visibilityCleared)
+    m_clearVisibility(buffer);
+
+  struct {
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    uint32_t instanceCount;
+    uint32_t occludedPass;
+    uint32_t firstInstance;
+  } constants{glm::vec4(m_localBounds.min, 1.0f),
+              glm::vec4(m_localBounds.max, 1.0f), count, occludedPass,
+              m_culledFirst};
+
+  buffer.pushConstants(layout().pipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT,
+                       0, constants);
+  dispatch(buffer,
+           (count + InstanceCullingLayout::GROUP_SIZE - 1) /
+               InstanceCullingLayout::GROUP_SIZE,
+           m_passCount);
+
+  m_barrierForDraws(buffer);
+}
+
+void InstanceCulling::cullOccluded(vkw::CommandBuffer &buffer,
+                                   DepthPyramid const &pyramid,
+                                   glm::mat4 const &viewProjection) {
+  if (m_occludedPass == NO_OCCLUSION)
+    throw std::runtime_error(
+        "[CULLING][ERROR] no pass is occlusion culled this frame");
+
+  m_lateCulled = true;
+
+  if (m_instanceCount == 0)
+    return;
+
+  m_occlusion->bindPyramid(pyramid);
+
+  // early phase must finish reading visibility before it is rewritten
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = m_visibility;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+  buffer.bufferMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             {&barrier, 1});
+
+  struct {
+    glm::mat4 viewProjection;
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    glm::vec2 pyramidSize;
+    uint32_t instanceCount;
+    uint32_t occludedPass;
+    uint32_t latePass;
+    uint32_t firstInstance;
+  } constants{viewProjection,
+              glm::vec4(m_localBounds.min, 1.0f),
+              glm::vec4(m_localBounds.max, 1.0f),
+              glm::vec2(pyramid.width(), pyramid.height()),
+              m_instanceCount,
+              m_occludedPass,
+              m_latePass(),
+              m_culledFirst};
+  static_assert(sizeof(constants) <= 128,
+                "push constants must fit into guaranteed minimum size");
+
+  buffer.pushConstants(m_occlusion->layout().pipelineLayout(),
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, constants);
+  m_occlusion->dispatch(buffer, (m_instanceCount +
+                                 InstanceOcclusionLayout::GROUP_SIZE - 1) /
+                                    InstanceOcclusionLayout::GROUP_SIZE);
+
+  m_barrierForDraws(buffer);
+}
+
+void InstanceCulling::m_clearVisibility(vkw::CommandBuffer &buffer) {
+  // nothing is visible before the first late phase, so the first early
+  // phase draws nothing and the late one draws every visible instance
+  buffer.fillBuffer(m_visibility, 0, VK_WHOLE_SIZE, 0u);
+
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = m_visibility;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+  buffer.bufferMemoryBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             {&barrier, 1});
+
+  m_visibilityCleared = true;
+}
+
+void InstanceCulling::m_barrierForDraws(vkw::CommandBuffer &buffer) const {
+  VkBufferMemoryBarrier barriers[2]{};
+  for (auto &barrier : barriers) {
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+  }
+  barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barriers[0].buffer = m_visible;
+  barriers[1].dstAccessMask =
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+  barriers[1].buffer = m_passes;
+
+  buffer.bufferMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                                 VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_HOST_BIT,
+                             barriers);
+}
+
+void InstanceCulling::drawDisoccluded(vkw::CommandBuffer &buffer) const {
+  if (!m_lateCulled)
+    throw std::runtime_error(
+        "[CULLING][ERROR] late phase was not culled this frame");
+
+  buffer.drawIndirect(m_passes,
+                      m_latePass() * sizeof(M_Pass) +
+                          offsetof(M_Pass, command),
+                      1, sizeof(M_Pass));
+}
+
+void InstanceCulling::draw(vkw::CommandBuffer &buffer, uint32_t pass) const {
+  if (pass >= m_passCount)
+    throw std::runtime_error(
+        "[CULLING][ERROR] drawn pass was not culled this frame");
+
+  buffer.drawIndirect(m_passes,
+                      pass * sizeof(M_Pass) + offsetof(M_Pass, command), 1,
+                      sizeof(M_Pass));
+}
+
+} // namespace TestApp
@@ -0,0 +1,204 @@
+#ifndef TESTAPP_INSTANCECULLING_H
+#define TESTAPP_INSTANCECULLING_H
+
+#include "DepthPyramid.h"
+#include "Frustum.h"
+#include <RenderEngine/Pipelines/Compute.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <span>
+#include <vkw/Buffer.hpp>
+#include <vkw/CommandBuffer.hpp>
+
+namespace TestApp {
+
+class InstanceCullingLayout : public RenderEngine::ComputeLayout {
+public:
+  /** Instances culled by single invocation group. Must match
+   *  instance_culling.comp.
+   */
+  static constexpr uint32_t GROUP_SIZE = 64;
+
+  InstanceCullingLayout(vkw::Device &device,
+                        RenderEngine::ShaderLoaderInterface &loader,
+                        uint32_t maxPools);
+};
+
+class InstanceOcclusionLayout : public RenderEngine::ComputeLayout {
+public:
+  /** Must match instance_occlusion.comp. */
+  static constexpr uint32_t GROUP_SIZE = 64;
+
+  InstanceOcclusionLayout(vkw::Device &device,
+                          RenderEngine::ShaderLoaderInterface &loader,
+                          uint32_t maxPools);
+};
+
+/** Culls instances of a single mesh against frustums of several passes on
+ *  device.
+ *
+ *  Model matrices are written by host into mapped memory or by device
+ *  shaders. Host written instance buffer has a region per frame in flight
+ *  plus one being written for the next frame, each cull() reads the written
+ *  region and moves writes to the next one, so they never touch data device
+ *  may still read. Device written instances live in a separate device local
+ *  buffer with a single region, as queue order already separates frames.
+ *  Each pass gets its own region of capacity() slots in the visible buffer,
+ *  into which the compute shader appends indices of instances whose bounds
+ *  intersect the pass frustum, counting them in the indirect draw command
+ *  of the pass. Vertex shader reads the index at gl_InstanceIndex from
+ *  visibleBuffer() and fetches the matrix from instanceBuffer(), so
+ *  matrices are stored once whatever the number of passes.
+ *  All passes are culled by one dispatch before any of them is drawn.
+ *
+ *  One pass may also be occlusion culled in two phases. Early phase keeps
+ *  only instances visible in the previous frame. Once they are drawn, their
+ *  depth is reduced to a pyramid and the late phase tests every instance
+ *  against it. Instances passing the test form the visibility of the next
+ *  frame, those of them not drawn early are drawn by the late pass.
+ */
+class InstanceCulling : public RenderEngine::Compute {
+public:
+  struct Instance {
+    glm::mat4 model;
+  };
+
+  static constexpr uint32_t NO_OCCLUSION = UINT32_MAX;
+
+  /** Regions of instance buffer, a single frame is in flight. */
+  static constexpr uint32_t INSTANCE_REGIONS = 2;
+
+  /** @param localBounds  box of the mesh in its own space
+   *  @param vertexCount  vertices drawn per instance
+   *  @param occlusionLayout  enables occlusion culling if not null
+   */
+  InstanceCulling(vkw::Device &device, InstanceCullingLayout &layout,
+                  Frustum::Box localBounds, uint32_t vertexCount,
+                  uint32_t capacity, uint32_t maxPasses,
+                  InstanceOcclusionLayout *occlusionLayout = nullptr);
+
+  ~InstanceCulling();
+
+  uint32_t capacity() const { return m_capacity; }
+
+  uint32_t maxPasses() const { return m_maxPasses; }
+
+  /** Mapped region culled by the next cull() if instances are written by
+   *  host.
+   */
+  std::span<Instance> instances() {
+    return {m_mapped + m_writeRegion * m_capacity, m_capacity};
+  }
+
+  /** Index of the first instance of region culled by the next cull() in
+   *  the buffer it is culled from.
+   */
+  uint32_t firstInstance() const {
+    return m_deviceWritten ? 0 : m_writeRegion * m_capacity;
+  }
+
+  /** Device local storage buffer of capacity() instances culled from while
+   *  instances are device written.
+   */
+  vkw::Buffer<Instance> &deviceInstanceBuffer() { return m_deviceInstances; }
+
+  /** Storage buffer instances are culled from and drawn with. Changes with
+   *  setDeviceWritten().
+   */
+  vkw::Buffer<Instance> &instanceBuffer() {
+    return m_deviceWritten ? m_deviceInstances : m_instances;
+  }
+
+  /** Storage buffer of indices into instanceBuffer() of visible instances,
+   *  indexed by gl_InstanceIndex of draws.
+   */
+  vkw::Buffer<uint32_t> &visibleBuffer() { return m_visible; }
+
+  /** Instances are written by device shaders into deviceInstanceBuffer()
+   *  instead of host, so they are culled from it and not flushed by cull().
+   *  Writes must be made visible to compute and vertex shaders before
+   *  cull() is recorded. Must be called when previous frame finished
+   *  execution.
+   */
+  void setDeviceWritten(bool deviceWritten);
+
+  /** Flushes first count instances of the written region and records their
+   *  culling against each frustum followed by barrier making results
+   *  visible to indirect draws. Moves writes to the next region.
+   *  Must be called once per frame when previous frame finished execution.
+   *
+   *  @param occludedPass  pass culled in two phases, its early phase is
+   *  recorded here
+   */
+  void cull(vkw::CommandBuffer &buffer, uint32_t count,
+            std::span<const Frustum> frustums,
+            uint32_t occludedPass = NO_OCCLUSION);
+
+  /** Records late phase of occluded pass after its early draws are done and
+   *  the pyramid is built from their depth. viewProjection must be the one
+   *  depth was rendered with.
+   */
+  void cullOccluded(vkw::CommandBuffer &buffer, DepthPyramid const &pyramid,
+                    glm::mat4 const &viewProjection);
+
+  /** Draws visible instances of the pass. */
+  void draw(vkw::CommandBuffer &buffer, uint32_t pass) const;
+
+  /** Draws instances found visible by late phase but not drawn early. */
+  void drawDisoccluded(vkw::CommandBuffer &buffer) const;
+
+  /** Instances drawn by all passes culled in the previous frame. */
+  uint32_t drawnCount() const { return m_lastDrawn; }
+
+  /** Instances drawn by late phase in the previous frame. */
+  uint32_t disoccludedCount() const { return m_lastDisoccluded; }
+
+private:
+  // std430 layout of DrawPass in instance_culling.comp
+  struct M_Pass {
+    glm::vec4 planes[6];
+    VkDrawIndirectCommand command;
+  };
+
+  class M_Occlusion;
+
+  /** Zeroes visibility on device before it is first read. */
+  void m_clearVisibility(vkw::CommandBuffer &buffer);
+
+  void m_barrierForDraws(vkw::CommandBuffer &buffer) const;
+
+  /** Writes buffer instances are culled from into descriptor sets. */
+  void m_bindInstances();
+
+  // command of late phase follows commands of culled passes
+  uint32_t m_latePass() const { return m_maxPasses; }
+
+  vkw::Buffer<Instance> m_instances;
+  Instance *m_mapped;
+  vkw::Buffer<Instance> m_deviceInstances;
+  // regions of passes followed by region of late phase
+  vkw::Buffer<uint32_t> m_visible;
+  vkw::Buffer<M_Pass> m_passes;
+  M_Pass *m_mappedPasses;
+  // nonzero for instances found visible by the last late phase
+  vkw::Buffer<uint32_t> m_visibility;
+  std::unique_ptr<M_Occlusion> m_occlusion;
+  Frustum::Box m_localBounds;
+  uint32_t m_vertexCount;
+  uint32_t m_capacity;
+  uint32_t m_maxPasses;
+  uint32_t m_passCount = 0;
+  uint32_t m_occludedPass = NO_OCCLUSION;
+  uint32_t m_instanceCount = 0;
+  // region instances are written to and region culled this frame
+  uint32_t m_writeRegion = 0;
+  uint32_t m_culledFirst = 0;
+  bool m_lateCulled = false;
+  bool m_deviceWritten = false;
+  bool m_visibilityCleared = false;
+  uint32_t m_lastDrawn = 0;
+  uint32_t m_lastDisoccluded = 0;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_INSTANCECULLING_H
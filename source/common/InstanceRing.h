@@ -0,0 +1,78 @@
+#ifndef TESTAPP_INSTANCERING_H
+#define TESTAPP_INSTANCERING_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <vkw/Device.hpp>
+#include <vkw/VertexBuffer.hpp>
+
+namespace TestApp {
+
+/** Per-frame linear allocator of instance data for culled draws. Slots
+ *  handed out during a frame stay valid until reset() is called.
+ */
+template <typename T> class InstanceRing {
+public:
+  InstanceRing(vkw::Device &device, uint32_t capacity)
+      : m_device(device), m_buffer(m_createBuffer(device, capacity)) {
+    m_buffer.map();
+    m_mapped = m_buffer.mapped().data();
+  }
+
+  /** Must be called once per frame when previous frame finished execution.
+   */
+  void reset() {
+    m_retired.clear();
+    m_cursor = 0;
+  }
+
+  /** Makes room for up to maxCount slots and returns first of them. */
+  uint32_t begin(uint32_t maxCount) {
+    if (m_cursor + maxCount <= m_buffer.size())
+      return m_cursor;
+
+    // Draws already recorded this frame keep referencing the old buffer, so
+    // it is retired instead of being destroyed. New slots start from zero.
+    auto capacity = std::max<uint32_t>(m_buffer.size() * 2, maxCount);
+    auto buffer = m_createBuffer(m_device.get(), capacity);
+    buffer.map();
+    m_mapped = buffer.mapped().data();
+    m_retired.emplace_back(std::move(m_buffer));
+    m_buffer = std::move(buffer);
+    m_cursor = 0;
+
+    return m_cursor;
+  }
+
+  /** Commits count slots starting from slot returned by begin(). */
+  void end(uint32_t count) { m_cursor += count; }
+
+  T &at(uint32_t slot) { return m_mapped[slot]; }
+
+  vkw::VertexBuffer<T> const &buffer() const { return m_buffer; }
+
+  void flush(uint32_t firstSlot, uint32_t slotCount) {
+    m_buffer.flush(firstSlot * sizeof(T), slotCount * sizeof(T));
+  }
+
+private:
+  static vkw::VertexBuffer<T> m_createBuffer(vkw::Device &device,
+                                             uint32_t capacity) {
+    return vkw::VertexBuffer<T>{
+        device, capacity,
+        VmaAllocationCreateInfo{
+            .usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+            .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT}};
+  }
+
+  vkw::StrongReference<vkw::Device> m_device;
+  vkw::VertexBuffer<T> m_buffer;
+  // buffers outgrown during current frame, may still be referenced by it
+  std::vector<vkw::VertexBuffer<T>> m_retired;
+  T *m_mapped;
+  uint32_t m_cursor = 0;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_INSTANCERING_H
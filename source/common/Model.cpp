@@ -1,9 +1,17 @@
 #include "Model.h"
+#include "CookedModel.h"
+#include "ModelAnimation.h"
+#include "ModelSkinning.h"
 #include "Utils.h"
+#include <RenderEngine/AssetImport/BlockCompression.h>
+#include <RenderEngine/JobSystem.h>
 #include <RenderEngine/RecordingState.h>
+#include <algorithm>
+#include <cmath>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/matrix_decompose.hpp>
 #include <iostream>
+#include <limits>
 
 #define TINYGLTF_IMPLEMENTATION
 
@@ -13,251 +21,121 @@ static const vkw::VertexInputStateCreateInfo<
     vkw::per_vertex<TestApp::ModelAttributes, 0>>
     ModelVertexInputState{};
 
-TestApp::MeshBase::MeshBase(vkw::Device &device, tinygltf::Model const &model,
-                            tinygltf::Mesh const &mesh,
+// instances culled on the recording thread alone and by single job
+static constexpr uint32_t PARALLEL_CULL_THRESHOLD = 4096;
+static constexpr size_t CULL_GRAIN = 1024;
+
+TestApp::MeshBase::MeshBase(vkw::Device &device, CookedModelView const &model,
+                            uint32_t meshIndex,
                             std::vector<ModelMaterial> const &materials,
                             MeshCreateFlags flags)
     : indexBuffer(device, 1, VmaAllocationCreateInfo{}),
-      vertexBuffer(device, 1, VmaAllocationCreateInfo{}), name_(mesh.name) {
-
-  std::vector<AttributeType> attrMapping{};
-
-  for (int i = 0; i < static_cast<int>(AttributeType::LAST); ++i)
-    attrMapping.push_back(static_cast<AttributeType>(i));
-
-  size_t totalIndexCount = 0, totalVertexCount = 0;
-
-  std::vector<ModelAttributes> vertexBuf;
-  std::vector<uint32_t> indexBuf;
-  size_t perVertexSize = 0;
-
-  for (auto &attr : attrMapping) {
-    switch (attr) {
-
-    case AttributeType::NORMAL:
-      perVertexSize += sizeof(glm::vec3);
-      break;
-    case AttributeType::UV:
-      perVertexSize += sizeof(glm::vec2);
-      break;
-    case AttributeType::POSITION:
-    case AttributeType::COLOR:
-    case AttributeType::JOINT:
-    case AttributeType::WEIGHT:
-      perVertexSize += sizeof(glm::vec4);
-      break;
-    case AttributeType::LAST:
-      break;
-    }
-  }
-
-  for (auto &primitive : mesh.primitives) {
+      vertexBuffer(device, 1, VmaAllocationCreateInfo{}), m_device(device) {
+  auto &mesh = model.meshes[meshIndex];
+  name_ = model.name(mesh.name);
 
+  for (auto &primitive :
+       model.primitives.subspan(mesh.firstPrimitive, mesh.primitiveCount)) {
     auto &evalPrimitive = primitives_.emplace_back();
     evalPrimitive.material = &materials.at(primitive.material);
+    evalPrimitive.firstVertex = primitive.firstVertex;
+    evalPrimitive.vertexCount = primitive.vertexCount;
+    evalPrimitive.firstIndex = primitive.firstIndex;
+    evalPrimitive.indexCount = primitive.indexCount;
+    evalPrimitive.setDimensions(glm::make_vec3(primitive.min),
+                                glm::make_vec3(primitive.max));
+  }
 
-    evalPrimitive.firstVertex = totalVertexCount;
-    evalPrimitive.firstIndex = totalIndexCount;
-
-    evalPrimitive.vertexCount =
-        model.accessors[primitive.attributes.find("POSITION")->second].count;
-
-    auto indexRef = primitive.indices;
-    if (indexRef >= 0)
-      evalPrimitive.indexCount = model.accessors[indexRef].count;
-    else
-      evalPrimitive.indexCount = 0;
-
-    totalIndexCount += evalPrimitive.indexCount;
-    totalVertexCount += evalPrimitive.vertexCount;
-
-    vertexBuf.resize(totalVertexCount);
-    indexBuf.reserve(totalIndexCount);
-
-    const float *bufferPos = nullptr;
-    const float *bufferNormals = nullptr;
-    const float *bufferTexCoords = nullptr;
-    const float *bufferColors = nullptr;
-    const float *bufferTangents = nullptr;
-
-    int numColorComponents;
-
-    const tinygltf::Accessor &posAccessor =
-        model.accessors[primitive.attributes.find("POSITION")->second];
-    const tinygltf::BufferView &posView =
-        model.bufferViews[posAccessor.bufferView];
-    bufferPos = reinterpret_cast<const float *>(
-        &(model.buffers[posView.buffer]
-              .data[posAccessor.byteOffset + posView.byteOffset]));
-    auto posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1],
-                            posAccessor.minValues[2]);
-    auto posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1],
-                            posAccessor.maxValues[2]);
-
-    evalPrimitive.setDimensions(posMin, posMax);
-    if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-      const tinygltf::Accessor &normAccessor =
-          model.accessors[primitive.attributes.find("NORMAL")->second];
-      const tinygltf::BufferView &normView =
-          model.bufferViews[normAccessor.bufferView];
-      bufferNormals = reinterpret_cast<const float *>(
-          &(model.buffers[normView.buffer]
-                .data[normAccessor.byteOffset + normView.byteOffset]));
-    }
+  // TODO: implement vertex pretransformation here
 
-    if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-      const tinygltf::Accessor &uvAccessor =
-          model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-      const tinygltf::BufferView &uvView =
-          model.bufferViews[uvAccessor.bufferView];
-      bufferTexCoords = reinterpret_cast<const float *>(
-          &(model.buffers[uvView.buffer]
-                .data[uvAccessor.byteOffset + uvView.byteOffset]));
-    }
+  m_sourceVertices = model.vertices.subspan(mesh.firstVertex, mesh.vertexCount);
+  m_sourceIndices = model.indices.subspan(mesh.firstIndex, mesh.indexCount);
+  m_vertexUsage = flags & MESH_SKINNED ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0;
 
-    if (primitive.attributes.find("COLOR_0") != primitive.attributes.end()) {
-      const tinygltf::Accessor &colorAccessor =
-          model.accessors[primitive.attributes.find("COLOR_0")->second];
-      const tinygltf::BufferView &colorView =
-          model.bufferViews[colorAccessor.bufferView];
-      // Color buffer are either of type vec3 or vec4
-      numColorComponents =
-          colorAccessor.type == TINYGLTF_PARAMETER_TYPE_FLOAT_VEC3 ? 3 : 4;
-      bufferColors = reinterpret_cast<const float *>(
-          &(model.buffers[colorView.buffer]
-                .data[colorAccessor.byteOffset + colorView.byteOffset]));
-    }
+  vertexCount_ = m_sourceVertices.size();
+  m_upload();
+}
 
-    if (primitive.attributes.find("COLOR_0") != primitive.attributes.end()) {
-      const tinygltf::Accessor &colorAccessor =
-          model.accessors[primitive.attributes.find("COLOR_0")->second];
-      const tinygltf::BufferView &colorView =
-          model.bufferViews[colorAccessor.bufferView];
-      // Color buffer are either of type vec3 or vec4
-      numColorComponents =
-          colorAccessor.type == TINYGLTF_PARAMETER_TYPE_FLOAT_VEC3 ? 3 : 4;
-      bufferColors = reinterpret_cast<const float *>(
-          &(model.buffers[colorView.buffer]
-                .data[colorAccessor.byteOffset + colorView.byteOffset]));
-    }
+void TestApp::MeshBase::m_upload() {
+  vertexBuffer =
+      createStaticBuffer<vkw::VertexBuffer<ModelAttributes>, ModelAttributes>(
+          m_device.get(), m_sourceVertices.begin(), m_sourceVertices.end(),
+          m_vertexUsage);
 
-    if (primitive.attributes.find("TANGENT") != primitive.attributes.end()) {
-      const tinygltf::Accessor &tangentAccessor =
-          model.accessors[primitive.attributes.find("TANGENT")->second];
-      const tinygltf::BufferView &tangentView =
-          model.bufferViews[tangentAccessor.bufferView];
-      bufferTangents = reinterpret_cast<const float *>(
-          &(model.buffers[tangentView.buffer]
-                .data[tangentAccessor.byteOffset + tangentView.byteOffset]));
-    }
+  if (!m_sourceIndices.empty())
+    indexBuffer =
+        createStaticBuffer<vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>, uint32_t>(
+            m_device.get(), m_sourceIndices.begin(), m_sourceIndices.end());
 
-    for (size_t i = 0; i < evalPrimitive.vertexCount; ++i) {
-      size_t vertexOffset = (evalPrimitive.firstVertex + i);
-      size_t localOffset = 0;
-      for (auto &attr : attrMapping) {
-        switch (attr) {
-        case AttributeType::POSITION: {
-          glm::vec4 pos = glm::vec4(glm::make_vec3(bufferPos + i * 3), 1.0f);
-          vertexBuf.at(vertexOffset).pos = pos;
-          break;
-        }
-        case AttributeType::NORMAL: {
-          if (bufferNormals) {
-            glm::vec3 normal = glm::vec3(glm::make_vec3(bufferNormals + i * 3));
-            vertexBuf.at(vertexOffset).normal = normal;
-          } else {
-            vertexBuf.at(vertexOffset).normal = glm::normalize(glm::vec3(1.0f));
-          }
-          break;
-        }
-        case AttributeType::TANGENT: {
-          if (bufferTangents) {
-            glm::vec3 tangent =
-                glm::vec3(glm::make_vec3(bufferTangents + i * 3));
-            vertexBuf.at(vertexOffset).tangent = tangent;
-          } else {
-            vertexBuf.at(vertexOffset).tangent =
-                glm::normalize(glm::vec3(1.0f));
-          }
-          break;
-        }
-        case AttributeType::UV: {
-          if (bufferTexCoords) {
-            glm::vec2 uv = glm::vec2(glm::make_vec2(bufferTexCoords + i * 2));
-            vertexBuf.at(vertexOffset).uv = uv;
-          } else {
-            vertexBuf.at(vertexOffset).uv = glm::vec2(0.0f);
-          }
-          break;
-        }
-        case AttributeType::COLOR: {
-          if (bufferColors) {
-            glm::vec4 color = glm::vec4(0.0f);
-            color = numColorComponents == 4
-                        ? glm::make_vec4(bufferColors + i * 4)
-                        : glm::vec4(glm::make_vec3(bufferColors + i * 3), 0.0f);
-            vertexBuf.at(vertexOffset).color = color;
-          } else {
-            vertexBuf.at(vertexOffset).color = glm::vec4(0.0f);
-          }
-          break;
-        }
-        default:
-          break;
-        }
-      }
-    }
+  m_resident = true;
+}
 
-    if (evalPrimitive.indexCount > 0) {
-      const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
-      const tinygltf::BufferView &bufferView =
-          model.bufferViews[accessor.bufferView];
-      const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-
-      switch (accessor.componentType) {
-      case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-        auto *buf = new uint32_t[accessor.count];
-        memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset],
-               accessor.count * sizeof(uint32_t));
-        for (size_t index = 0; index < accessor.count; index++) {
-          indexBuf.push_back(buf[index]);
-        }
-        break;
-      }
-      case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-        auto *buf = new uint16_t[accessor.count];
-        memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset],
-               accessor.count * sizeof(uint16_t));
-        for (size_t index = 0; index < accessor.count; index++) {
-          indexBuf.push_back(buf[index]);
-        }
-        break;
-      }
-      case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-        auto *buf = new uint8_t[accessor.count];
-        memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset],
-               accessor.count * sizeof(uint8_t));
-        for (size_t index = 0; index < accessor.count; index++) {
-          indexBuf.push_back(buf[index]);
-        }
-        break;
-      }
-      default:
-        throw std::runtime_error(
-            "[MESH][ERROR] loaded gltf model has invalid index type");
-      }
-    }
+size_t TestApp::MeshBase::residentBytes() const {
+  if (!m_resident)
+    return 0;
+  return m_sourceVertices.size_bytes() + m_sourceIndices.size_bytes();
+}
+
+void TestApp::MeshBase::evict() {
+  // placeholders keep buffers valid to bind, as before the first upload
+  vertexBuffer = vkw::VertexBuffer<ModelAttributes>(m_device.get(), 1,
+                                                    VmaAllocationCreateInfo{});
+  indexBuffer = vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>(
+      m_device.get(), 1, VmaAllocationCreateInfo{});
+  m_resident = false;
+}
+
+void TestApp::MeshBase::restore(vkw::CommandBuffer &buffer) {
+  if (m_resident)
+    return;
+
+  VmaAllocationCreateInfo createInfo{};
+  createInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+  createInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+  std::vector<VkBufferMemoryBarrier> barriers;
+  auto &barrier = barriers.emplace_back();
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+
+  vertexBuffer = vkw::VertexBuffer<ModelAttributes>(
+      m_device.get(), m_sourceVertices.size(), createInfo,
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT | m_vertexUsage);
+  m_vertexStaging.emplace(m_device.get(), m_sourceVertices);
+
+  VkBufferCopy region{};
+  region.size = m_sourceVertices.size_bytes();
+  buffer.copyBufferToBuffer(*m_vertexStaging, vertexBuffer, {&region, 1});
+  barriers.back().buffer = vertexBuffer;
+
+  if (!m_sourceIndices.empty()) {
+    indexBuffer = vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>(
+        m_device.get(), m_sourceIndices.size(), createInfo,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_indexStaging.emplace(m_device.get(), m_sourceIndices);
+
+    region.size = m_sourceIndices.size_bytes();
+    buffer.copyBufferToBuffer(*m_indexStaging, indexBuffer, {&region, 1});
+    barriers.push_back(barriers.back());
+    barriers.back().dstAccessMask = VK_ACCESS_INDEX_READ_BIT;
+    barriers.back().buffer = indexBuffer;
   }
 
-  // TODO: implement vertex pretransformation here
+  buffer.bufferMemoryBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, barriers);
 
-  vertexBuffer =
-      createStaticBuffer<vkw::VertexBuffer<ModelAttributes>, ModelAttributes>(
-          device, vertexBuf.begin(), vertexBuf.end());
+  m_resident = true;
+}
 
-  indexBuffer =
-      createStaticBuffer<vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>, uint32_t>(
-          device, indexBuf.begin(), indexBuf.end());
+void TestApp::MeshBase::finishRestore() {
+  m_vertexStaging.reset();
+  m_indexStaging.reset();
 }
 
 void TestApp::MeshBase::bindBuffers(
@@ -267,28 +145,30 @@ void TestApp::MeshBase::bindBuffers(
 }
 
 void TestApp::MeshBase::drawPrimitive(
-    RenderEngine::GraphicsRecordingState &recorder, int index) const {
+    RenderEngine::GraphicsRecordingState &recorder, int index,
+    uint32_t firstInstance, uint32_t instanceCount,
+    uint32_t baseVertex) const {
   auto &primitive = primitives_.at(index);
   recorder.setMaterial(*primitive.material);
-  recorder.bindPipeline();
-
-  if (primitive.indexCount != 0)
-    recorder.commands().drawIndexed(
-        primitive.indexCount, 1, primitive.firstIndex, primitive.firstVertex);
-  else
-    recorder.commands().draw(primitive.vertexCount, primitive.firstVertex);
+  drawPrimitiveWithoutMaterial(recorder, index, firstInstance, instanceCount,
+                               baseVertex);
 }
 
 void TestApp::MeshBase::drawPrimitiveWithoutMaterial(
-    RenderEngine::GraphicsRecordingState &recorder, int index) const {
+    RenderEngine::GraphicsRecordingState &recorder, int index,
+    uint32_t firstInstance, uint32_t instanceCount,
+    uint32_t baseVertex) const {
   auto &primitive = primitives_.at(index);
   recorder.bindPipeline();
 
   if (primitive.indexCount != 0)
     recorder.commands().drawIndexed(
-        primitive.indexCount, 1, primitive.firstIndex, primitive.firstVertex);
+        primitive.indexCount, instanceCount, primitive.firstIndex,
+        primitive.firstVertex + baseVertex, firstInstance);
   else
-    recorder.commands().draw(primitive.vertexCount, primitive.firstVertex);
+    recorder.commands().draw(primitive.vertexCount, instanceCount,
+                             primitive.firstVertex + baseVertex,
+                             firstInstance);
 }
 
 void TestApp::Primitive::setDimensions(glm::vec3 min, glm::vec3 max) {
@@ -299,168 +179,171 @@ void TestApp::Primitive::setDimensions(glm::vec3 min, glm::vec3 max) {
   dimensions.radius = glm::distance(min, max) / 2.0f;
 }
 
-TestApp::MMesh::MMesh(vkw::Device &device, tinygltf::Model const &model,
-                      tinygltf::Node const &node,
+TestApp::MMesh::MMesh(vkw::Device &device, CookedModelView const &model,
+                      uint32_t meshIndex,
                       const std::vector<ModelMaterial> &materials,
-                      uint32_t maxInstances)
-    : MeshBase(device, model, model.meshes[node.mesh], materials) {}
-
-void TestApp::GLTFModel::loadImages(tinygltf::Model &gltfModel) {
-  RenderEngine::TextureLoader loader(renderer_, "");
-
-  for (auto &image : gltfModel.images) {
-    unsigned char *imageBuf = image.image.data();
-    size_t bufferSize = image.width * image.height * 4;
-    bool deleteBuffer = false;
-    if (image.component == 3) {
-      imageBuf = new unsigned char[bufferSize];
-      unsigned char *rgba = imageBuf;
-      unsigned char *rgb = &image.image[0];
-      for (size_t i = 0; i < image.width * image.height; ++i) {
-        for (int32_t j = 0; j < 3; ++j) {
-          rgba[j] = rgb[j];
-        }
-        rgba += 4;
-        rgb += 3;
-      }
-      deleteBuffer = true;
-    }
+                      ModelGeometryLayout &layout, uint32_t instanceCapacity,
+                      SkinningLayout *skinningLayout, uint32_t jointCount)
+    : MeshBase(device, model, meshIndex, materials,
+               skinningLayout ? MESH_SKINNED : 0),
+      m_geometry(device, layout, instanceCapacity) {
+  if (skinningLayout)
+    m_skinning = std::make_unique<MeshSkinning>(device, *skinningLayout,
+                                                vertices(), vertexCount(),
+                                                jointCount, instanceCapacity);
+}
 
-    textures.push_back(loader.loadTexture(imageBuf, image.width, image.height));
-  }
+TestApp::MMesh::~MMesh() = default;
+
+void TestApp::MMesh::reserve(uint32_t capacity, uint32_t count) {
+  m_geometry.reserve(capacity, count);
+  if (m_skinning)
+    m_skinning->reserve(capacity, count);
 }
 
-TestApp::ModelGeometry &
-TestApp::MMesh::addNewInstance(size_t instanceId, ModelGeometryLayout &layout,
-                               vkw::Device &device) {
-  return m_instances.emplace(instanceId, ModelGeometry{device, layout})
-      .first->second;
+void TestApp::GLTFModel::loadImages(CookedModelView const &model) {
+  bool compressionSupported = renderer_.get()
+                                  .physicalDevice()
+                                  .enabledFeatures()
+                                  .textureCompressionBC;
+
+  for (auto &texture : model.textures) {
+    auto format = static_cast<VkFormat>(texture.format);
+    if (RenderEngine::BlockCompression::isBlockCompressed(format) &&
+        !compressionSupported)
+      throw std::runtime_error(
+          "[MODEL][ERROR] model has block compressed textures, but "
+          "textureCompressionBC feature is not enabled");
+
+    auto key = TextureCache::Key{.contentHash = texture.contentHash,
+                                 .format = format,
+                                 .width = texture.width,
+                                 .height = texture.height,
+                                 .mipLevels = texture.mipLevels};
+    m_textures.push_back(m_textureCache.get().acquire(
+        key, model.texels.subspan(texture.offset, texture.size), m_source));
+    m_textureGenerations.push_back(m_textures.back().generation());
+  }
 }
 
-void TestApp::MMesh::eraseInstance(size_t instanceId) {
-  m_instances.erase(instanceId);
+void TestApp::MMesh::drawSkinned(
+    RenderEngine::GraphicsRecordingState &recorder, uint32_t firstInstance,
+    uint32_t instanceCount, bool withMaterial) const {
+  m_geometry.bind(recorder);
+
+  bindBuffers(recorder);
+  recorder.commands().bindVertexBuffer(m_skinning->output(), 0, 0);
+
+  // every instance has its own skinned copy of vertices
+  for (auto id = firstInstance; id < firstInstance + instanceCount; ++id) {
+    auto baseVertex = id * vertexCount();
+    for (int i = 0; i < primitives_.size(); ++i) {
+      if (withMaterial)
+        drawPrimitive(recorder, i, id, 1, baseVertex);
+      else
+        drawPrimitiveWithoutMaterial(recorder, i, id, 1, baseVertex);
+    }
+  }
 }
 
 void TestApp::MMesh::draw(RenderEngine::GraphicsRecordingState &recorder,
-                          size_t instanceId) const {
-  recorder.setGeometry(m_instances.at(instanceId));
+                          uint32_t firstInstance,
+                          uint32_t instanceCount) const {
+  if (m_skinning) {
+    drawSkinned(recorder, firstInstance, instanceCount, true);
+    return;
+  }
+
+  m_geometry.bind(recorder);
 
   bindBuffers(recorder);
 
   for (int i = 0; i < primitives_.size(); ++i) {
-    drawPrimitive(recorder, i);
+    drawPrimitive(recorder, i, firstInstance, instanceCount);
   }
 }
 
-const TestApp::ModelGeometry &TestApp::MMesh::instance(size_t id) const {
-  return m_instances.at(id);
-}
-
-TestApp::ModelGeometry &TestApp::MMesh::instance(size_t id) {
-  return m_instances.at(id);
-}
-
 void TestApp::MMesh::drawGeometryOnly(
-    RenderEngine::GraphicsRecordingState &recorder, size_t instanceId) const {
-  recorder.setGeometry(m_instances.at(instanceId));
+    RenderEngine::GraphicsRecordingState &recorder, uint32_t firstInstance,
+    uint32_t instanceCount) const {
+  if (m_skinning) {
+    drawSkinned(recorder, firstInstance, instanceCount, false);
+    return;
+  }
+
+  m_geometry.bind(recorder);
 
   bindBuffers(recorder);
 
   for (int i = 0; i < primitives_.size(); ++i) {
-    drawPrimitiveWithoutMaterial(recorder, i);
+    drawPrimitiveWithoutMaterial(recorder, i, firstInstance, instanceCount);
   }
 }
 
 TestApp::GLTFModel::GLTFModel(vkw::Device &device,
                               RenderEngine::ShaderLoaderInterface &loader,
                               DefaultTexturePool &pool,
-                              std::filesystem::path const &path)
-    : renderer_(device),
-      sampler(device,
-              VkSamplerCreateInfo{
-                  .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-                  .pNext = nullptr,
-                  .magFilter = VK_FILTER_LINEAR,
-                  .minFilter = VK_FILTER_LINEAR,
-                  .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
-                  .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-                  .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-                  .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-
-                  .minLod = 0.0f,
-                  .maxLod = 1.0f,
-              }),
+                              TextureCache &textureCache,
+                              std::filesystem::path const &path,
+                              ModelCache const *cache,
+                              ResidencyManager *residency)
+    : m_textureCache(textureCache), renderer_(device),
       materialLayout(device, loader), geometryLayout(device, loader),
-      m_defaultTexturePool(pool) {
+      m_defaultTexturePool(pool), m_residency(residency),
+      m_visibleInstances(device, 1024) {
 
-  if (!path.has_extension())
-    throw std::runtime_error("[MODEL][ERROR] " + path.generic_string() +
-                             " file has no extension.");
-
-  tinygltf::Model gltfModel;
-  tinygltf::TinyGLTF gltfContext;
+  if (!cache) {
+    auto cooked = std::make_shared<CookedModel>(CookedModel::cook(path));
+    m_source = cooked;
+    load(cooked->view(), loader);
+    return;
+  }
 
-  std::string error, warning;
+  if (auto mapped = cache->tryMap(path)) {
+    auto source = std::make_shared<MappedCookedModel>(std::move(*mapped));
+    m_source = source;
+    load(source->view(), loader);
+    return;
+  }
 
-  bool fileLoaded;
+  auto cooked = std::make_shared<CookedModel>(
+      CookedModel::cook(path, cache->compressor()));
+  cache->store(path, *cooked);
+  m_source = cooked;
+  load(cooked->view(), loader);
+}
 
-  if (path.extension() == ".gltf")
-    fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning,
-                                               path.generic_string());
-  else if (path.extension() == ".glb")
-    fileLoaded = gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning,
-                                                path.generic_string());
-  else
-    throw std::runtime_error(
-        "[MODEL][ERROR] " + path.generic_string() +
-        " file has incorrect extension. Supported extensions are: gltf, glb");
+TestApp::GLTFModel::~GLTFModel() {
+  for (auto id : m_meshResidency)
+    if (id >= 0)
+      m_residency->remove(id);
+}
 
-  if (!fileLoaded)
-    throw std::runtime_error("[GLTF][ERROR] failed to load model from file " +
-                             path.generic_string() + ". " + error);
+void TestApp::GLTFModel::load(CookedModelView const &model,
+                              RenderEngine::ShaderLoaderInterface &loader) {
+  loadImages(model);
 
-  if (!warning.empty())
-    std::cout << "[GLTF][WARNING]: " << warning << std::endl;
+  loadMaterials(model);
 
-  loadImages(gltfModel);
+  loadNodes(model, loader);
 
-  loadMaterials(gltfModel);
+  m_animation = std::make_unique<ModelAnimation>(model);
+}
 
-  const tinygltf::Scene &scene =
-      gltfModel
-          .scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
+void TestApp::GLTFModel::loadMaterials(CookedModelView const &model) {
+  auto textureOrNull = [this](int32_t index) {
+    return index < 0 ? nullptr : &m_textures.at(index).view();
+  };
 
-  for (int nodeIndex : scene.nodes) {
-    const tinygltf::Node node = gltfModel.nodes[nodeIndex];
-    loadNode(gltfModel, nullptr, node, nodeIndex);
-  }
-}
+  for (auto &mat : model.materials) {
+    m_materialTextures.push_back(
+        {mat.colorMap, mat.normalMap, mat.metallicRoughnessMap});
 
-void TestApp::GLTFModel::loadMaterials(tinygltf::Model &gltfModel) {
-  uint32_t counter = 0;
-  for (tinygltf::Material &mat : gltfModel.materials) {
     MaterialInfo material;
-    if (mat.values.find("baseColorTexture") != mat.values.end()) {
-      material.colorMap = &getTexture(
-          gltfModel.textures[mat.values["baseColorTexture"].TextureIndex()]
-              .source);
-    }
-    material.sampler = &sampler;
-
-    if (mat.additionalValues.find("normalTexture") !=
-        mat.additionalValues.end()) {
-      material.normalMap = &getTexture(
-          gltfModel
-              .textures[mat.additionalValues["normalTexture"].TextureIndex()]
-              .source);
-    }
-
-    if (mat.values.find("metallicRoughnessTexture") != mat.values.end()) {
-      material.metallicRoughnessMap = &getTexture(
-          gltfModel
-              .textures[mat.values["metallicRoughnessTexture"].TextureIndex()]
-              .source);
-    }
+    material.colorMap = textureOrNull(mat.colorMap);
+    material.normalMap = textureOrNull(mat.normalMap);
+    material.metallicRoughnessMap = textureOrNull(mat.metallicRoughnessMap);
+    material.sampler = &m_textureCache.get().sampler();
 #if 0
         // Metallic roughness workflow
 
@@ -510,131 +393,514 @@ void TestApp::GLTFModel::loadMaterials(tinygltf::Model &gltfModel) {
 
         material.compileDescriptors();
 #endif
-    materials.emplace_back(renderer_.get(), m_defaultTexturePool,
-                           materialLayout, material);
+    materials.emplace_back(m_defaultTexturePool, materialLayout, material);
   }
 }
 
-void TestApp::GLTFModel::loadNode(tinygltf::Model &gltfModel,
-                                  std::shared_ptr<MNode> parent,
-                                  const tinygltf::Node &node,
-                                  uint32_t nodeIndex) {
+void TestApp::GLTFModel::loadNodes(
+    CookedModelView const &model,
+    RenderEngine::ShaderLoaderInterface &loader) {
+  std::vector<int32_t> parents;
+  std::vector<TransformHierarchy::LocalTransform> locals;
+
+  for (auto &node : model.nodes) {
+    parents.push_back(node.parent);
+    auto &local = locals.emplace_back();
+    local.translation = glm::make_vec3(node.translation);
+    local.rotation = glm::make_quat(node.rotation);
+    local.scale = glm::make_vec3(node.scale);
+  }
+
+  m_transforms = TransformHierarchy{std::move(parents), std::move(locals)};
+
+  auto skinnedCount = std::count_if(
+      model.nodes.begin(), model.nodes.end(),
+      [](auto &node) { return node.mesh > -1 && node.skin > -1; });
+  if (skinnedCount > 0)
+    m_skinningLayout =
+        std::make_unique<SkinningLayout>(renderer_, loader, skinnedCount);
 
-  std::shared_ptr<MNode> newNode = std::make_shared<MNode>();
-  newNode->index = nodeIndex;
-  newNode->parent = parent;
-  newNode->name = node.name;
+  m_meshResidency.resize(model.nodes.size(), -1);
 
-  // Generate local node matrix
+  glm::vec3 boundsMin{FLT_MAX};
+  glm::vec3 boundsMax{-FLT_MAX};
 
-  // if node transform stored in uniform matrix - decompose it
-  if (node.matrix.size() == 16) {
-    glm::vec4 dummyPer;
-    glm::mat4 uniformMatrix = glm::make_mat4x4(node.matrix.data());
-    newNode->initialData.transform = uniformMatrix;
-  } else {
-    glm::mat4 transform{1.0f};
+  // nodes are stored parent first, so parent is always created before child
+  for (uint32_t nodeIndex = 0; nodeIndex < model.nodes.size(); ++nodeIndex) {
+    auto &node = model.nodes[nodeIndex];
 
-    glm::vec3 translation = glm::vec3(0.0f);
-    if (node.translation.size() == 3) {
-      translation = glm::make_vec3(node.translation.data());
+    std::shared_ptr<MNode> newNode = std::make_shared<MNode>();
+    newNode->index = nodeIndex;
+    newNode->name = model.name(node.name);
+
+    if (node.parent > -1) {
+      auto &parent = linearNodes.at(node.parent);
+      newNode->parent = parent;
+      parent->children.push_back(newNode);
+    } else {
+      rootNodes.push_back(newNode);
     }
-    transform = glm::translate(transform, translation);
 
-    glm::mat4 rotation = glm::mat4(1.0f);
-    if (node.rotation.size() == 4) {
-      glm::quat q = glm::make_quat(node.rotation.data());
-      rotation = glm::mat4(q);
+    if (node.mesh > -1 && node.skin > -1) {
+      auto &skin = model.skins[node.skin];
+      auto &skinned = m_skinnedMeshes.emplace_back();
+      skinned.node = nodeIndex;
+      for (auto &joint :
+           model.joints.subspan(skin.firstJoint, skin.jointCount)) {
+        skinned.joints.push_back(joint.node);
+        skinned.inverseBind.push_back(glm::make_mat4(joint.inverseBind));
+      }
+      newNode->mesh = std::make_unique<MMesh>(
+          renderer_, model, node.mesh, materials, geometryLayout,
+          m_instanceCapacity, m_skinningLayout.get(), skin.jointCount);
+      m_meshNodes.push_back(nodeIndex);
+    } else if (node.mesh > -1) {
+      newNode->mesh =
+          std::make_unique<MMesh>(renderer_, model, node.mesh, materials,
+                                  geometryLayout, m_instanceCapacity);
+      m_meshNodes.push_back(nodeIndex);
     }
-    transform = transform * rotation;
 
-    glm::vec3 scale = glm::vec3(1.0f);
-    if (node.scale.size() == 3) {
-      scale = glm::make_vec3(node.scale.data());
+    // skinning reads source vertices of the mesh, so it is kept resident
+    if (m_residency && newNode->mesh && !newNode->mesh->skinning() &&
+        newNode->mesh->residentBytes() != 0)
+      m_meshResidency[nodeIndex] = m_residency->add(*newNode->mesh);
+
+    if (newNode->mesh) {
+      auto modelTransform = m_transforms.initialWorld(nodeIndex);
+      for (int i = 0; i < newNode->mesh->primitiveCount(); ++i) {
+        auto box = newNode->mesh->getPrimitiveBoundingBox(i);
+        for (int corner = 0; corner < 8; ++corner) {
+          glm::vec3 local{corner & 1 ? box.max.x : box.min.x,
+                          corner & 2 ? box.max.y : box.min.y,
+                          corner & 4 ? box.max.z : box.min.z};
+          auto point = glm::vec3(modelTransform * glm::vec4(local, 1.0f));
+          boundsMin = glm::min(boundsMin, point);
+          boundsMax = glm::max(boundsMax, point);
+        }
+      }
     }
-    transform = glm::scale(transform, scale);
-    newNode->initialData.transform = transform;
+
+    linearNodes.push_back(newNode);
+  }
+
+  if (boundsMin.x > boundsMax.x) {
+    boundsMin = glm::vec3(0.0f);
+    boundsMax = glm::vec3(0.0f);
+  }
+
+  Primitive bounds{};
+  bounds.setDimensions(boundsMin, boundsMax);
+  m_bounds = bounds.dimensions;
+}
+
+TestApp::GLTFModelInstance TestApp::GLTFModel::createNewInstance() {
+  auto id = m_instances.size();
+
+  if (id == m_instanceCapacity) {
+    m_instanceCapacity *= 2;
+    for (auto node : m_meshNodes)
+      linearNodes[node]->mesh->reserve(m_instanceCapacity, id);
+    // skinning output is not preserved by reallocation
+    m_skinBegin = 0;
+    m_skinEnd = std::max<uint32_t>(m_skinEnd, id);
   }
 
-  // Node with children
-  if (!node.children.empty()) {
-    for (int i : node.children) {
-      loadNode(gltfModel, newNode, gltfModel.nodes[i], i);
+  auto handle = m_instances.insert();
+  m_playedAnimations.push_back(-1);
+  m_animationTimes.push_back(0.0f);
+  m_transforms.addInstance();
+
+  return {this, handle};
+}
+
+bool TestApp::GLTFModel::useMesh(uint32_t node) {
+  if (m_residency && m_meshResidency[node] >= 0)
+    return m_residency->use(m_meshResidency[node]);
+  return true;
+}
+
+void TestApp::GLTFModel::destroyInstance(SlotMap::Handle instance) {
+  // keep slots dense: move last instance into freed slot
+  auto [id, last] = m_instances.erase(instance);
+
+  if (id != last) {
+    for (auto node : m_meshNodes) {
+      auto &instances = linearNodes[node]->mesh->instances();
+      instances.at(id) = instances.at(last);
     }
+
+    for (auto &skinned : m_skinnedMeshes)
+      linearNodes[skinned.node]->mesh->skinning()->moveInstance(last, id);
+    if (!m_skinnedMeshes.empty()) {
+      m_skinBegin = std::min<uint32_t>(m_skinBegin, id);
+      m_skinEnd = std::max<uint32_t>(m_skinEnd, id + 1);
+    }
+
+    m_playedAnimations.at(id) = m_playedAnimations.at(last);
+    m_animationTimes.at(id) = m_animationTimes.at(last);
   }
 
-  if (node.mesh > -1) {
-    newNode->mesh =
-        std::make_unique<MMesh>(renderer_, gltfModel, node, materials, 10000);
+  m_playedAnimations.pop_back();
+  m_animationTimes.pop_back();
+  m_transforms.removeInstance(id);
+}
+
+void TestApp::GLTFModel::syncInstances() {
+  auto changed = m_transforms.update();
+
+  for (auto id : changed) {
+    for (auto node : m_meshNodes)
+      linearNodes[node]->mesh->instances().at(id).transform =
+          m_transforms.world(id, node);
+    updateJoints(id);
   }
 
-  if (parent) {
-    parent->children.push_back(newNode);
-  } else {
-    rootNodes.push_back(newNode);
+  if (!changed.empty()) {
+    m_instances.markDirty(changed.front(),
+                          changed.back() + 1 - changed.front());
+    if (!m_skinnedMeshes.empty()) {
+      m_skinBegin = std::min(m_skinBegin, changed.front());
+      m_skinEnd = std::max(m_skinEnd, changed.back() + 1);
+    }
   }
-  linearNodes.push_back(newNode);
+
+  auto dirty = m_instances.dirty();
+  if (dirty.count == 0)
+    return;
+
+  for (auto node : m_meshNodes)
+    linearNodes[node]->mesh->instances().flush(dirty.first, dirty.count);
+
+  m_instances.clearDirty();
 }
 
-TestApp::GLTFModelInstance TestApp::GLTFModel::createNewInstance() {
-  size_t id;
-  if (!freeIDs.empty()) {
-    id = freeIDs.top();
-    freeIDs.pop();
-  } else {
-    id = instanceCount;
+void TestApp::GLTFModel::updateJoints(uint32_t id) {
+  for (auto &skinned : m_skinnedMeshes) {
+    auto *joints = linearNodes[skinned.node]->mesh->skinning()->joints(id);
+    // vertex shader applies mesh node transform after skinning
+    auto meshInverse = glm::inverse(m_transforms.world(id, skinned.node));
+    for (size_t i = 0; i < skinned.joints.size(); ++i) {
+      auto node = skinned.joints[i];
+      joints[i] = node < 0 ? glm::mat4(1.0f)
+                           : meshInverse * m_transforms.world(id, node) *
+                                 skinned.inverseBind[i];
+    }
   }
+}
 
-  instanceCount++;
+void TestApp::GLTFModel::skin(vkw::CommandBuffer &buffer) {
+  syncInstances();
+
+  m_skinEnd = std::min<uint32_t>(m_skinEnd, m_instances.size());
+  if (m_skinBegin >= m_skinEnd)
+    return;
+
+  for (auto &skinned : m_skinnedMeshes)
+    linearNodes[skinned.node]->mesh->skinning()->skin(
+        buffer, m_skinBegin, m_skinEnd - m_skinBegin);
+
+  m_skinBegin = UINT32_MAX;
+  m_skinEnd = 0;
+}
+
+uint32_t TestApp::GLTFModel::animationCount() const {
+  return m_animation->count();
+}
+
+std::string_view
+TestApp::GLTFModel::animationName(uint32_t animation) const {
+  return m_animation->name(animation);
+}
+
+void TestApp::GLTFModel::playAnimation(SlotMap::Handle instance,
+                                       int32_t animation, float time) {
+  if (animation >= static_cast<int32_t>(animationCount()))
+    throw std::runtime_error("[MODEL][ERROR] model has no animation " +
+                             std::to_string(animation));
+  auto id = m_instances.index(instance);
+  m_playedAnimations.at(id) = animation < 0 ? -1 : animation;
+  m_animationTimes.at(id) = time;
+}
+
+void TestApp::GLTFModel::animate(float deltaTime) {
+  m_animatedInstances.clear();
+
+  for (uint32_t id = 0; id < m_instances.size(); ++id) {
+    auto animation = m_playedAnimations[id];
+    if (animation < 0)
+      continue;
+    auto duration = m_animation->duration(animation);
+    auto &time = m_animationTimes[id];
+    time = duration > 0.0f ? std::fmod(time + deltaTime, duration) : 0.0f;
+    m_animatedInstances.push_back(id);
+  }
+
+  // instances playing the same animation at the same time share samples
+  std::sort(m_animatedInstances.begin(), m_animatedInstances.end(),
+            [this](uint32_t a, uint32_t b) {
+              if (m_playedAnimations[a] != m_playedAnimations[b])
+                return m_playedAnimations[a] < m_playedAnimations[b];
+              return m_animationTimes[a] < m_animationTimes[b];
+            });
+
+  for (auto first = m_animatedInstances.begin();
+       first != m_animatedInstances.end();) {
+    auto animation = m_playedAnimations[*first];
+    auto last = std::find_if(first, m_animatedInstances.end(),
+                             [&](uint32_t id) {
+                               return m_playedAnimations[id] != animation;
+                             });
+    m_animation->sample(m_transforms, animation, {first, last},
+                        m_animationTimes);
+    first = last;
+  }
+}
+
+void TestApp::GLTFModel::draw(RenderEngine::GraphicsRecordingState &recorder) {
+  if (m_instances.empty())
+    return;
+
+  syncInstances();
 
   for (auto &node : linearNodes) {
-    auto &data =
-        node->instanceBuffers.emplace(id, node->initialData).first->second;
     if (node->mesh) {
-      auto &geom = node->mesh->addNewInstance(id, geometryLayout, renderer_);
-      geom.data = data;
-      geom.update();
+      if (useMesh(node->index))
+        node->mesh->draw(recorder, 0, m_instances.size());
     }
   }
-
-  return {this, id};
 }
 
-void TestApp::GLTFModel::destroyInstance(size_t id) {
-  instanceCount--;
-  if (id != instanceCount) {
-    freeIDs.push(id);
-  }
+void TestApp::GLTFModel::drawGeometryOnly(
+    RenderEngine::GraphicsRecordingState &recorder) {
+  if (m_instances.empty())
+    return;
+
+  syncInstances();
 
   for (auto &node : linearNodes) {
-    node->instanceBuffers.erase(id);
-    if (node->mesh)
-      node->mesh->eraseInstance(id);
+    if (node->mesh) {
+      if (useMesh(node->index))
+        node->mesh->drawGeometryOnly(recorder, 0, m_instances.size());
+    }
   }
 }
 
 void TestApp::GLTFModel::drawInstance(
-    RenderEngine::GraphicsRecordingState &recorder, size_t id) {
+    RenderEngine::GraphicsRecordingState &recorder, SlotMap::Handle instance) {
+  syncInstances();
+
+  auto id = m_instances.index(instance);
 
   for (auto &node : linearNodes) {
     if (node->mesh) {
-      node->mesh->draw(recorder, id);
+      if (useMesh(node->index))
+        node->mesh->draw(recorder, id, 1);
     }
   }
 }
 
 void TestApp::GLTFModel::drawInstanceGeometryOnly(
-    RenderEngine::GraphicsRecordingState &recorder, size_t id) {
+    RenderEngine::GraphicsRecordingState &recorder, SlotMap::Handle instance) {
+  syncInstances();
+
+  auto id = m_instances.index(instance);
+
   for (auto &node : linearNodes) {
     if (node->mesh) {
-      node->mesh->drawGeometryOnly(recorder, id);
+      if (useMesh(node->index))
+        node->mesh->drawGeometryOnly(recorder, id, 1);
+    }
+  }
+}
+
+void TestApp::GLTFModel::streamTextures(Camera const &camera,
+                                        float viewportHeight) {
+  syncInstances();
+
+  // views of textures replaced by the last cache update were recreated
+  std::vector<bool> changed(m_textures.size());
+  bool anyChanged = false;
+  for (size_t i = 0; i < m_textures.size(); ++i) {
+    auto generation = m_textures[i].generation();
+    changed[i] = generation != m_textureGenerations[i];
+    anyChanged = anyChanged || changed[i];
+    m_textureGenerations[i] = generation;
+  }
+
+  if (anyChanged) {
+    for (size_t i = 0; i < materials.size(); ++i) {
+      auto &textures = m_materialTextures[i];
+      if (std::any_of(textures.begin(), textures.end(), [&](int32_t texture) {
+            return texture >= 0 && changed[texture];
+          }))
+        materials[i].refresh();
+    }
+  }
+
+  auto &streamer = m_textureCache.get().streamer();
+
+  // pixels covered by unit length at unit distance
+  auto pixelsPerUnit = camera.projection()[1][1] * viewportHeight * 0.5f;
+  auto eye = camera.position();
+
+  for (auto node : m_meshNodes) {
+    auto &mesh = *linearNodes[node]->mesh;
+
+    for (int i = 0; i < mesh.primitiveCount(); ++i) {
+      auto &textures = m_materialTextures.at(mesh.getPrimitiveMaterial(i) -
+                                             materials.data());
+      if (std::all_of(textures.begin(), textures.end(),
+                      [](int32_t texture) { return texture < 0; }))
+        continue;
+
+      auto box = mesh.getPrimitiveBoundingBox(i);
+      float pixels = 0.0f;
+
+      // UVs are assumed to span the primitive once, so its screen size
+      // approximates resolution of textures it needs
+      for (uint32_t id = 0; id < m_instances.size(); ++id) {
+        auto &world = m_transforms.world(id, node);
+        auto center = glm::vec3(world * glm::vec4(box.center, 1.0f));
+        auto radius = box.radius * glm::max(glm::max(glm::length(world[0]),
+                                                     glm::length(world[1])),
+                                            glm::length(world[2]));
+        if (!camera.frustum().intersects(center, radius))
+          continue;
+        auto distance = glm::length(center - eye) - radius;
+        if (distance <= 0.0f) {
+          pixels = std::numeric_limits<float>::max();
+          break;
+        }
+        pixels = std::max(pixels, 2.0f * radius * pixelsPerUnit / distance);
+      }
+
+      if (pixels == 0.0f)
+        continue;
+
+      for (auto texture : textures) {
+        if (texture < 0)
+          continue;
+        auto slot = m_textures[texture].texture();
+        auto dim = std::max(streamer.width(slot), streamer.height(slot));
+        auto level = pixels >= dim ? 0u
+                                   : static_cast<uint32_t>(
+                                         std::floor(std::log2(dim / pixels)));
+        streamer.request(slot, std::min(level, streamer.mipLevels(slot) - 1));
+      }
+    }
+  }
+}
+
+void TestApp::GLTFModel::newFrame() {
+  m_visibleInstances.reset();
+  m_lastCullingStats = m_cullingStats;
+  m_cullingStats = CullingStatistics{};
+}
+
+void TestApp::GLTFModel::draw(RenderEngine::GraphicsRecordingState &recorder,
+                              Frustum const &frustum) {
+  drawCulled(recorder, frustum, true);
+}
+
+void TestApp::GLTFModel::drawGeometryOnly(
+    RenderEngine::GraphicsRecordingState &recorder, Frustum const &frustum) {
+  drawCulled(recorder, frustum, false);
+}
+
+void TestApp::GLTFModel::drawCulled(
+    RenderEngine::GraphicsRecordingState &recorder, Frustum const &frustum,
+    bool withMaterial) {
+  if (m_instances.empty())
+    return;
+
+  syncInstances();
+
+  uint32_t instanceCount = m_instances.size();
+
+  for (auto node : m_meshNodes) {
+    auto &mesh = *linearNodes[node]->mesh;
+    bool bound = false;
+
+    // bind pose bounds do not enclose animated vertices, so skinned meshes
+    // are drawn without culling
+    if (mesh.skinning()) {
+      if (withMaterial)
+        mesh.draw(recorder, 0, instanceCount);
+      else
+        mesh.drawGeometryOnly(recorder, 0, instanceCount);
+      m_cullingStats.visible += instanceCount * mesh.primitiveCount();
+      continue;
+    }
+
+    for (int i = 0; i < mesh.primitiveCount(); ++i) {
+      auto box = mesh.getPrimitiveBoundingBox(i);
+      auto extent = box.size * 0.5f;
+
+      m_cullBoxes.resize(instanceCount);
+      m_cullVisibility.resize(instanceCount);
+
+      auto cullRange = [&](size_t begin, size_t end) {
+        for (auto id = begin; id < end; ++id) {
+          auto &world = m_transforms.world(id, node);
+          // world space AABB of transformed box
+          auto center = glm::vec3(world * glm::vec4(box.center, 1.0f));
+          auto worldExtent = glm::abs(glm::vec3(world[0])) * extent.x +
+                             glm::abs(glm::vec3(world[1])) * extent.y +
+                             glm::abs(glm::vec3(world[2])) * extent.z;
+          m_cullBoxes[id] = {center - worldExtent, center + worldExtent};
+        }
+
+        frustum.cull(std::span{m_cullBoxes}.subspan(begin, end - begin),
+                     std::span{m_cullVisibility}.subspan(begin, end - begin));
+      };
+
+      if (instanceCount < PARALLEL_CULL_THRESHOLD) {
+        cullRange(0, instanceCount);
+      } else {
+        auto &jobs = RenderEngine::JobSystem::shared();
+        jobs.wait(jobs.parallelFor(instanceCount, CULL_GRAIN, cullRange));
+      }
+
+      auto first = m_visibleInstances.begin(instanceCount);
+      uint32_t visible = 0;
+
+      for (uint32_t id = 0; id < instanceCount; ++id)
+        if (m_cullVisibility[id])
+          m_visibleInstances.at(first + visible++).transform =
+              m_transforms.world(id, node);
+
+      m_visibleInstances.end(visible);
+      m_cullingStats.visible += visible;
+      m_cullingStats.culled += instanceCount - visible;
+
+      if (visible == 0)
+        continue;
+
+      m_visibleInstances.flush(first, visible);
+
+      if (!bound) {
+        // mesh is not drawable until its restore completes
+        if (!useMesh(node))
+          break;
+        mesh.instances().bind(recorder);
+        mesh.bindBuffers(recorder);
+        bound = true;
+      }
+
+      recorder.commands().bindVertexBuffer(m_visibleInstances.buffer(), 1, 0);
+
+      if (withMaterial)
+        mesh.drawPrimitive(recorder, i, first, visible);
+      else
+        mesh.drawPrimitiveWithoutMaterial(recorder, i, first, visible);
     }
   }
 }
 
 TestApp::GLTFModelInstance::~GLTFModelInstance() {
-  if (id_)
-    model_->destroyInstance(id_.value());
+  if (handle_)
+    model_->destroyInstance(handle_.value());
 }
 
 void TestApp::GLTFModelInstance::update() {
@@ -646,34 +912,18 @@ void TestApp::GLTFModelInstance::update() {
   rot = glm::rotate(rot, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
   rot = glm::scale(rot, scale);
 
-  model_->setRootMatrix(rot, id_.value());
+  model_->setRootMatrix(rot, handle_.value());
 }
 
-static void updateMatricesRecursively(TestApp::ModelGeometry::Data parentData,
-                                      TestApp::MNode *node, size_t id) {
-  if (!node)
-    return;
-  auto data = node->instanceBuffers.at(id);
-  data.transform = parentData.transform * data.transform;
-  if (node->mesh) {
-    auto &geom = node->mesh->instance(id);
-    geom.data = data;
-    geom.update();
-  }
-  for (auto &child : node->children) {
-    updateMatricesRecursively(data, child.get(), id);
-  }
+void TestApp::GLTFModelInstance::setNodeTransform(
+    size_t node, TransformHierarchy::LocalTransform const &transform) {
+  model_->m_transforms.setLocal(model_->m_instances.index(handle_.value()),
+                                node, transform);
 }
 
-void TestApp::GLTFModel::setRootMatrix(glm::mat4 transform, size_t id) {
-  for (auto &node : rootNodes) {
-    auto &buffer = node->instanceBuffers.at(id);
-    buffer.transform = transform;
-
-    TestApp::ModelGeometry::Data init{};
-    init.transform = glm::mat4{1.0f};
-    updateMatricesRecursively(init, node.get(), id);
-  }
+void TestApp::GLTFModel::setRootMatrix(glm::mat4 transform,
+                                       SlotMap::Handle instance) {
+  m_transforms.setRoot(m_instances.index(instance), transform);
 }
 
 TestApp::ModelMaterialLayout::ModelMaterialLayout(
@@ -689,40 +939,28 @@ TestApp::ModelMaterialLayout::ModelMaterialLayout(
 
 }
 
-TestApp::ModelMaterial::ModelMaterial(vkw::Device &device,
-                                      DefaultTexturePool &pool,
+TestApp::ModelMaterial::ModelMaterial(DefaultTexturePool &pool,
                                       ModelMaterialLayout &layout,
                                       MaterialInfo info)
-    : RenderEngine::Material(layout), m_info(info),
-      m_colorMapView(device, info.colorMap ? *info.colorMap : pool.colorMap(),
-                     info.colorMap ? info.colorMap->format()
-                                   : pool.colorMap().format()),
-      m_normalMapView(device,
-                      info.normalMap ? *info.normalMap : pool.normalMap(),
-                      info.normalMap ? info.normalMap->format()
-                                     : pool.normalMap().format()),
-      m_mrMapView(device,
-                  info.metallicRoughnessMap ? *info.metallicRoughnessMap
-                                            : pool.metallicRoughnessMap(),
-                  info.metallicRoughnessMap
-                      ? info.metallicRoughnessMap->format()
-                      : pool.metallicRoughnessMap().format()) {
-  VkComponentMapping mapping{};
-  mapping.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-  mapping.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-  mapping.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-  mapping.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-  auto *colorMap = info.colorMap ? info.colorMap : &pool.colorMap();
-  auto *normalMap = info.normalMap ? info.normalMap : &pool.colorMap();
-  auto *mrMap = info.metallicRoughnessMap ? info.metallicRoughnessMap
-                                          : &pool.metallicRoughnessMap();
-
-  set().write(0, m_colorMapView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-              *info.sampler);
-  set().write(1, m_normalMapView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-              *info.sampler);
-  set().write(2, m_mrMapView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-              *info.sampler);
+    : RenderEngine::Material(layout), m_info(info) {
+  if (!m_info.colorMap)
+    m_info.colorMap = &pool.colorMapView();
+  if (!m_info.normalMap)
+    m_info.normalMap = &pool.normalMapView();
+  if (!m_info.metallicRoughnessMap)
+    m_info.metallicRoughnessMap = &pool.metallicRoughnessMapView();
+  m_writeSet();
+}
+
+void TestApp::ModelMaterial::refresh() { m_writeSet(); }
+
+void TestApp::ModelMaterial::m_writeSet() {
+  set().write(0, *m_info.colorMap, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+              *m_info.sampler);
+  set().write(1, *m_info.normalMap, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+              *m_info.sampler);
+  set().write(2, *m_info.metallicRoughnessMap,
+              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, *m_info.sampler);
 }
 
 TestApp::ModelGeometryLayout::ModelGeometryLayout(
@@ -731,24 +969,44 @@ TestApp::ModelGeometryLayout::ModelGeometryLayout(
           device, loader,
           RenderEngine::GeometryLayout::CreateInfo{
               std::make_unique<vkw::VertexInputStateCreateInfo<
-                  vkw::per_vertex<TestApp::ModelAttributes, 0>>>(),
+                  vkw::per_vertex<TestApp::ModelAttributes, 0>,
+                  vkw::per_instance<TestApp::ModelInstanceAttributes, 1>>>(),
               vkw::InputAssemblyStateCreateInfo{},
-              RenderEngine::SubstageDescription{"model"}, 1000}) {}
+              RenderEngine::SubstageDescription{"model"}, 1}) {}
 
 TestApp::ModelGeometry::ModelGeometry(vkw::Device &device,
-                                      TestApp::ModelGeometryLayout &layout)
-    : RenderEngine::Geometry(layout),
-      m_ubo(device, VmaAllocationCreateInfo{
-                        .usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
-                        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT}) {
-  m_ubo.map();
-  m_mapped = m_ubo.mapped().data();
-  set().write(0, m_ubo);
+                                      TestApp::ModelGeometryLayout &layout,
+                                      uint32_t capacity)
+    : RenderEngine::Geometry(layout), m_device(device),
+      m_instances(device, capacity,
+                  {.usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+                   .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT}) {
+  m_instances.map();
+  m_mapped = m_instances.mapped().data();
+}
+
+void TestApp::ModelGeometry::reserve(uint32_t capacity, uint32_t count) {
+  if (capacity <= m_instances.size())
+    return;
+
+  vkw::VertexBuffer<ModelInstanceAttributes> instances{
+      m_device, capacity,
+      VmaAllocationCreateInfo{
+          .usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+          .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT}};
+  instances.map();
+  auto *mapped = instances.mapped().data();
+  std::copy(m_mapped, m_mapped + count, mapped);
+  instances.flush();
+
+  m_instances = std::move(instances);
+  m_mapped = mapped;
 }
 
-void TestApp::ModelGeometry::update() {
-  *m_mapped = data;
-  m_ubo.flush();
+void TestApp::ModelGeometry::bind(
+    RenderEngine::GraphicsRecordingState &state) const {
+  RenderEngine::Geometry::bind(state);
+  state.commands().bindVertexBuffer(m_instances, 1, 0);
 }
 
 TestApp::DefaultTexturePool::DefaultTexturePool(vkw::Device &device,
@@ -771,7 +1029,11 @@ TestApp::DefaultTexturePool::DefaultTexturePool(vkw::Device &device,
                                   .requiredFlags =
                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT},
           VK_FORMAT_R8G8B8A8_UNORM, textureDim, textureDim, 1, 1, 1,
-          VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT)
+          VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT),
+      m_colorMapView(device, m_colorMap, m_colorMap.format()),
+      m_normalMapView(device, m_normalMap, m_normalMap.format()),
+      m_metallicRoughnessMapView(device, m_metallicRoughnessMap,
+                                 m_metallicRoughnessMap.format())
 
 {
   vkw::Buffer<uint32_t> stageBuffer{
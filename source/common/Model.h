@@ -3,13 +3,21 @@
 
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 
+#include "Camera.h"
+#include "InstanceRing.h"
+#include "ResidencyManager.h"
+#include "SlotMap.h"
+#include "TextureCache.h"
+#include "TransformHierarchy.h"
 #include <RenderEngine/AssetImport/AssetImport.h>
 #include <RenderEngine/Pipelines/PipelinePool.h>
+#include <array>
 #include <filesystem>
+#include <memory>
 #include <glm/detail/type_quat.hpp>
 #include <glm/glm.hpp>
-#include <stack>
 #include <stdexcept>
+#include <optional>
 #include <tiny_gltf/tiny_gltf.h>
 #include <vkw/CommandBuffer.hpp>
 #include <vkw/DescriptorPool.hpp>
@@ -17,6 +25,7 @@
 #include <vkw/Pipeline.hpp>
 #include <vkw/Sampler.hpp>
 #include <vkw/Shader.hpp>
+#include <vkw/StagingBuffer.hpp>
 #include <vkw/VertexBuffer.hpp>
 
 namespace TestApp {
@@ -52,6 +61,10 @@ struct ModelAttributes
 
 class ModelMaterial;
 
+struct CookedModelView;
+
+class ModelCache;
+
 struct Primitive {
   uint32_t firstIndex;
   uint32_t indexCount;
@@ -75,34 +88,59 @@ enum MeshCreateFlagsBits {
   MESH_PRE_TRANSFORM_VERTICES = 0x00000001,
   MESH_PRE_MULTIPLY_COLORS = 0x00000002,
   MESH_FLIP_Y = 0x00000004,
+  // vertex buffer is also readable as storage buffer by skinning shader
+  MESH_SKINNED = 0x00000008,
 };
 
 using MeshCreateFlags = uint32_t;
 
-class MeshBase {
+/** Mesh buffers can be evicted from device memory and restored from cooked
+ *  data, which must outlive the mesh. */
+class MeshBase : public ResidencyManager::Asset {
   vkw::VertexBuffer<ModelAttributes> vertexBuffer;
   vkw::IndexBuffer<VK_INDEX_TYPE_UINT32> indexBuffer;
+  uint32_t vertexCount_ = 0;
+
+  vkw::StrongReference<vkw::Device> m_device;
+  std::span<const ModelAttributes> m_sourceVertices;
+  std::span<const uint32_t> m_sourceIndices;
+  VkBufferUsageFlags m_vertexUsage = 0;
+  bool m_resident = false;
+  // sources of restore copies recorded into a frame still in flight
+  std::optional<vkw::StagingBuffer<ModelAttributes>> m_vertexStaging;
+  std::optional<vkw::StagingBuffer<uint32_t>> m_indexStaging;
+
+  void m_upload();
 
 protected:
   std::vector<Primitive> primitives_;
   std::string name_;
 
 public:
-  MeshBase(vkw::Device &device, tinygltf::Model const &model,
-           tinygltf::Mesh const &mesh,
-           std::vector<ModelMaterial> const &materials,
+  MeshBase(vkw::Device &device, CookedModelView const &model,
+           uint32_t meshIndex, std::vector<ModelMaterial> const &materials,
            MeshCreateFlags flags = 0);
 
   void bindBuffers(RenderEngine::GraphicsRecordingState &recorder) const;
 
-  /** bindBuffers must be called before executing this method */
-  void drawPrimitive(RenderEngine::GraphicsRecordingState &recorder,
-                     int index) const;
+  /** bindBuffers must be called before executing this method. baseVertex
+   * is added to vertex indices of the primitive. */
+  void drawPrimitive(RenderEngine::GraphicsRecordingState &recorder, int index,
+                     uint32_t firstInstance = 0, uint32_t instanceCount = 1,
+                     uint32_t baseVertex = 0) const;
 
   /** bindBuffers must be called before executing this method */
   void
   drawPrimitiveWithoutMaterial(RenderEngine::GraphicsRecordingState &recorder,
-                               int index) const;
+                               int index, uint32_t firstInstance = 0,
+                               uint32_t instanceCount = 1,
+                               uint32_t baseVertex = 0) const;
+
+  vkw::VertexBuffer<ModelAttributes> const &vertices() const {
+    return vertexBuffer;
+  }
+
+  uint32_t vertexCount() const { return vertexCount_; }
 
   size_t primitiveCount() const { return primitives_.size(); };
 
@@ -111,8 +149,20 @@ public:
     return primitives_.at(index).dimensions;
   };
 
+  ModelMaterial const *getPrimitiveMaterial(int index) const {
+    return primitives_.at(index).material;
+  }
+
   std::string_view name() const { return name_; }
 
+  size_t residentBytes() const override;
+
+  void evict() override;
+
+  void restore(vkw::CommandBuffer &buffer) override;
+
+  void finishRestore() override;
+
   virtual ~MeshBase() = default;
 };
 
@@ -121,9 +171,10 @@ class GLTFModel;
 class DefaultTexturePool;
 
 struct MaterialInfo {
-  Texture2D *colorMap = nullptr;
-  Texture2D *normalMap = nullptr;
-  Texture2D *metallicRoughnessMap = nullptr;
+  // null views are substituted with DefaultTexturePool ones
+  Texture2DView const *colorMap = nullptr;
+  Texture2DView const *normalMap = nullptr;
+  Texture2DView const *metallicRoughnessMap = nullptr;
   vkw::Sampler const *sampler;
 
   auto operator<=>(MaterialInfo const &another) const = default;
@@ -139,71 +190,110 @@ private:
 
 class ModelMaterial : public RenderEngine::Material {
 public:
-  ModelMaterial(vkw::Device &device, DefaultTexturePool &pool,
-                ModelMaterialLayout &layout, MaterialInfo info);
+  /** Views referenced by info must outlive the material. */
+  ModelMaterial(DefaultTexturePool &pool, ModelMaterialLayout &layout,
+                MaterialInfo info);
 
   MaterialInfo const &info() const { return m_info; }
 
+  /** Rewrites descriptors after views referenced by info were recreated. */
+  void refresh();
+
 private:
-  Texture2DView m_colorMapView;
-  Texture2DView m_normalMapView;
-  Texture2DView m_mrMapView;
+  void m_writeSet();
 
   MaterialInfo m_info;
 };
 
+struct ModelInstanceAttributes
+    : public vkw::AttributeBase<
+          vkw::VertexAttributeType::VEC4F, vkw::VertexAttributeType::VEC4F,
+          vkw::VertexAttributeType::VEC4F, vkw::VertexAttributeType::VEC4F> {
+  glm::mat4 transform = glm::mat4(1.0f);
+};
+
 class ModelGeometryLayout : public RenderEngine::GeometryLayout {
 public:
   explicit ModelGeometryLayout(vkw::Device &device,
                                RenderEngine::ShaderLoaderInterface &loader);
 };
 
+/** Holds per-instance node transforms of a mesh in a single instance
+ *  vertex buffer, so all instances of a model can be drawn at once.
+ */
 class ModelGeometry : public RenderEngine::Geometry {
 public:
-  struct Data {
-    glm::mat4 transform = glm::mat4(1.0f);
-  } data;
+  ModelGeometry(vkw::Device &device, ModelGeometryLayout &layout,
+                uint32_t capacity);
 
-  ModelGeometry(vkw::Device &device, ModelGeometryLayout &layout);
+  ModelInstanceAttributes &at(uint32_t slot) { return m_mapped[slot]; }
 
-  void update();
+  ModelInstanceAttributes const &at(uint32_t slot) const {
+    return m_mapped[slot];
+  }
+
+  uint32_t capacity() const { return m_instances.size(); }
+
+  /** Reallocates instance buffer preserving first count slots. */
+  void reserve(uint32_t capacity, uint32_t count);
+
+  void flush() { m_instances.flush(); }
+
+  void flush(uint32_t firstSlot, uint32_t slotCount) {
+    m_instances.flush(firstSlot * sizeof(ModelInstanceAttributes),
+                      slotCount * sizeof(ModelInstanceAttributes));
+  }
+
+  void bind(RenderEngine::GraphicsRecordingState &state) const override;
 
 private:
-  vkw::UniformBuffer<Data> m_ubo;
-  Data *m_mapped;
+  vkw::StrongReference<vkw::Device> m_device;
+  vkw::VertexBuffer<ModelInstanceAttributes> m_instances;
+  ModelInstanceAttributes *m_mapped;
 };
 
-class MMesh;
+using ModelInstanceRing = InstanceRing<ModelInstanceAttributes>;
+
+class SkinningLayout;
+
+class MeshSkinning;
+
+class ModelAnimation;
 
 class MMesh : public MeshBase {
 
-  std::map<size_t, ModelGeometry> m_instances{};
+  ModelGeometry m_geometry;
+  std::unique_ptr<MeshSkinning> m_skinning;
 
-public:
-  struct InstanceData {
-    glm::mat4 transform = glm::mat4(1.0f);
-  };
+  void drawSkinned(RenderEngine::GraphicsRecordingState &recorder,
+                   uint32_t firstInstance, uint32_t instanceCount,
+                   bool withMaterial) const;
 
-  MMesh(vkw::Device &device, tinygltf::Model const &model,
-        tinygltf::Node const &node, const std::vector<ModelMaterial> &materials,
-        uint32_t maxInstances);
+public:
+  /** Mesh is skinned if skinning layout is given. Skinned instances are
+   *  drawn one by one from skinning output. */
+  MMesh(vkw::Device &device, CookedModelView const &model, uint32_t meshIndex,
+        const std::vector<ModelMaterial> &materials,
+        ModelGeometryLayout &layout, uint32_t instanceCapacity,
+        SkinningLayout *skinningLayout = nullptr, uint32_t jointCount = 0);
 
   void draw(RenderEngine::GraphicsRecordingState &recorder,
-            size_t instanceId) const;
+            uint32_t firstInstance, uint32_t instanceCount) const;
 
   void drawGeometryOnly(RenderEngine::GraphicsRecordingState &recorder,
-                        size_t instanceId) const;
+                        uint32_t firstInstance, uint32_t instanceCount) const;
 
-  ModelGeometry const &instance(size_t id) const;
+  ModelGeometry const &instances() const { return m_geometry; }
 
-  ModelGeometry &instance(size_t id);
+  ModelGeometry &instances() { return m_geometry; }
 
-  ModelGeometry &addNewInstance(size_t instanceId, ModelGeometryLayout &layout,
-                                vkw::Device &device);
+  /** Null if mesh is not skinned. */
+  MeshSkinning *skinning() const { return m_skinning.get(); }
 
-  void eraseInstance(size_t instanceId);
+  /** Grows instance and skinning buffers preserving first count slots. */
+  void reserve(uint32_t capacity, uint32_t count);
 
-  ~MMesh() override = default;
+  ~MMesh() override;
 };
 
 struct MNode {
@@ -213,13 +303,6 @@ struct MNode {
   std::unique_ptr<MMesh> mesh;
 
   std::string name;
-
-  // this fields are used to store initial data of a Node
-  // and not used by actual instances
-
-  ModelGeometry::Data initialData{};
-
-  std::map<uint32_t, ModelGeometry::Data> instanceBuffers;
 };
 
 class GLTFModelInstance;
@@ -234,59 +317,198 @@ public:
 
   Texture2D &metallicRoughnessMap() { return m_metallicRoughnessMap; }
 
+  Texture2DView const &colorMapView() const { return m_colorMapView; }
+
+  Texture2DView const &normalMapView() const { return m_normalMapView; }
+
+  Texture2DView const &metallicRoughnessMapView() const {
+    return m_metallicRoughnessMapView;
+  }
+
 private:
   Texture2D m_colorMap;
   Texture2D m_normalMap;
   Texture2D m_metallicRoughnessMap;
+  Texture2DView m_colorMapView;
+  Texture2DView m_normalMapView;
+  Texture2DView m_metallicRoughnessMapView;
 };
 
 class GLTFModel {
-  std::vector<Texture2D> textures;
+  // owner of cooked data textures are streamed from
+  std::shared_ptr<const void> m_source;
+  vkw::StrongReference<TextureCache> m_textureCache;
+  // declared before materials, so cached views outlive materials using them
+  std::vector<TextureCache::Handle> m_textures;
+  // generation of each texture materials were last written with
+  std::vector<uint64_t> m_textureGenerations;
   vkw::StrongReference<DefaultTexturePool> m_defaultTexturePool;
   ModelMaterialLayout materialLayout;
   ModelGeometryLayout geometryLayout;
+  // null if model has no skinned meshes, outlives meshes skinned with it
+  std::unique_ptr<SkinningLayout> m_skinningLayout;
   std::vector<ModelMaterial> materials;
+  // color, normal and metallic-roughness texture of each material
+  std::vector<std::array<int32_t, 3>> m_materialTextures;
 
   std::vector<std::shared_ptr<MNode>> rootNodes;
   std::vector<std::shared_ptr<MNode>> linearNodes;
   vkw::StrongReference<vkw::Device> renderer_;
 
-  vkw::Sampler sampler;
-  std::stack<size_t> freeIDs;
-  size_t instanceCount = 0;
+  // instance slots are kept dense, instances refer to them by handle
+  SlotMap m_instances;
+  uint32_t m_instanceCapacity = 16;
+  TransformHierarchy m_transforms;
+  std::vector<uint32_t> m_meshNodes;
+  // null if meshes are kept resident for the whole model lifetime
+  ResidencyManager *m_residency = nullptr;
+  // residency index of mesh of each node, -1 if it is not tracked
+  std::vector<int32_t> m_meshResidency;
+
+  struct SkinnedMesh {
+    uint32_t node;
+    // joint node, -1 if joint is outside of the scene
+    std::vector<int32_t> joints;
+    std::vector<glm::mat4> inverseBind;
+  };
+
+  std::vector<SkinnedMesh> m_skinnedMeshes;
+  // range of instance slots whose joints changed since last skinning
+  uint32_t m_skinBegin = UINT32_MAX;
+  uint32_t m_skinEnd = 0;
+
+  std::unique_ptr<ModelAnimation> m_animation;
+  // per instance slot, -1 if instance is not animated
+  std::vector<int32_t> m_playedAnimations;
+  std::vector<float> m_animationTimes;
+  std::vector<uint32_t> m_animatedInstances;
+
+  Primitive::BoundingBox m_bounds;
+
+  ModelInstanceRing m_visibleInstances;
+  // scratch space of per instance frustum tests
+  std::vector<Frustum::Box> m_cullBoxes;
+  std::vector<uint8_t> m_cullVisibility;
+
+public:
+  struct CullingStatistics {
+    uint32_t visible = 0;
+    uint32_t culled = 0;
+  };
+
+private:
+  CullingStatistics m_cullingStats;
+  CullingStatistics m_lastCullingStats;
+
+  void loadImages(CookedModelView const &model);
 
-  Texture2D &getTexture(int index) { return textures.at(index); }
+  void loadMaterials(CookedModelView const &model);
 
-  void loadImages(tinygltf::Model &gltfModel);
+  void loadNodes(CookedModelView const &model,
+                 RenderEngine::ShaderLoaderInterface &loader);
 
-  void loadMaterials(tinygltf::Model &gltfModel);
+  void load(CookedModelView const &model,
+            RenderEngine::ShaderLoaderInterface &loader);
 
-  void loadNode(tinygltf::Model &gltfModel, std::shared_ptr<MNode> parent,
-                const tinygltf::Node &node, uint32_t nodeIndex);
+  /** Requests restore of mesh of node if it was evicted. Called before it
+   *  is drawn, mesh is skipped while false is returned.
+   */
+  bool useMesh(uint32_t node);
 
-  void destroyInstance(size_t id);
+  void destroyInstance(SlotMap::Handle instance);
 
-  void setRootMatrix(glm::mat4 transform, size_t id);
+  /** Propagates dirty transforms and uploads changed instance slots. */
+  void syncInstances();
 
-  void drawInstance(RenderEngine::GraphicsRecordingState &recorder, size_t id);
+  /** Recomputes joint matrices of every skinned mesh of instance. */
+  void updateJoints(uint32_t id);
+
+  void playAnimation(SlotMap::Handle instance, int32_t animation,
+                     float time);
+
+  void setRootMatrix(glm::mat4 transform, SlotMap::Handle instance);
+
+  void drawInstance(RenderEngine::GraphicsRecordingState &recorder,
+                    SlotMap::Handle instance);
 
   void drawInstanceGeometryOnly(RenderEngine::GraphicsRecordingState &recorder,
-                                size_t id);
+                                SlotMap::Handle instance);
+
+  void drawCulled(RenderEngine::GraphicsRecordingState &recorder,
+                  Frustum const &frustum, bool withMaterial);
 
 public:
+  /** If cache is provided, model is mapped from cooked file when one is
+   *  present and up to date. Otherwise, it is cooked and stored to the cache.
+   *  If residency manager is provided, meshes not drawn recently may be
+   *  evicted when device memory is over budget. It must outlive the model.
+   */
   GLTFModel(vkw::Device &renderer, RenderEngine::ShaderLoaderInterface &loader,
-            DefaultTexturePool &pool, std::filesystem::path const &path);
+            DefaultTexturePool &pool, TextureCache &textureCache,
+            std::filesystem::path const &path,
+            ModelCache const *cache = nullptr,
+            ResidencyManager *residency = nullptr);
+
+  ~GLTFModel();
 
   GLTFModelInstance createNewInstance();
 
+  size_t instanceCount() const { return m_instances.size(); }
+
+  /** Bounding box of the whole model in model space. */
+  Primitive::BoundingBox const &bounds() const { return m_bounds; }
+
+  /** Draws all instances of the model with one instanced draw per
+   * primitive. */
+  void draw(RenderEngine::GraphicsRecordingState &recorder);
+
+  void drawGeometryOnly(RenderEngine::GraphicsRecordingState &recorder);
+
+  /** Must be called once per frame before any culled draw is recorded. */
+  void newFrame();
+
+  /** Estimates texture detail needed from screen size of visible primitives
+   *  and requests it from the texture cache, which uploads it during its
+   *  next update. Must be called once per frame after the cache update and
+   *  before the model is drawn.
+   */
+  void streamTextures(Camera const &camera, float viewportHeight);
+
+  uint32_t animationCount() const;
+
+  std::string_view animationName(uint32_t animation) const;
+
+  /** Advances every played animation by deltaTime, looping it, and samples
+   *  node transforms of animated instances. */
+  void animate(float deltaTime);
+
+  /** Records skinning of instances whose joints changed since previous
+   *  call. Must be called once per frame outside of render pass before the
+   *  model is drawn.
+   */
+  void skin(vkw::CommandBuffer &buffer);
+
+  /** Draws instances of every primitive whose bounds intersect frustum. */
+  void draw(RenderEngine::GraphicsRecordingState &recorder,
+            Frustum const &frustum);
+
+  void drawGeometryOnly(RenderEngine::GraphicsRecordingState &recorder,
+                        Frustum const &frustum);
+
+  /** Primitive instances drawn and culled during previous frame. */
+  CullingStatistics const &cullingStatistics() const {
+    return m_lastCullingStats;
+  }
+
   friend class GLTFModelInstance;
 };
 
 class GLTFModelInstance {
   GLTFModel *model_;
-  std::optional<size_t> id_;
+  std::optional<SlotMap::Handle> handle_;
 
-  GLTFModelInstance(GLTFModel *model, size_t id) : model_(model), id_(id) {}
+  GLTFModelInstance(GLTFModel *model, SlotMap::Handle handle)
+      : model_(model), handle_(handle) {}
 
 public:
   glm::vec3 rotation = glm::vec3{0.0f};
@@ -295,29 +517,51 @@ public:
 
   GLTFModelInstance(GLTFModelInstance const &another) = delete;
 
-  GLTFModelInstance(GLTFModelInstance &&another) noexcept {
+  GLTFModelInstance(GLTFModelInstance &&another) noexcept
+      : rotation(another.rotation), scale(another.scale),
+        translation(another.translation) {
     model_ = another.model_;
-    id_ = another.id_;
-    another.id_.reset();
+    handle_ = another.handle_;
+    another.handle_.reset();
   };
 
   GLTFModelInstance const &operator=(GLTFModelInstance const &another) = delete;
 
   GLTFModelInstance &operator=(GLTFModelInstance &&another) noexcept {
+    if (this == &another)
+      return *this;
+    if (handle_)
+      model_->destroyInstance(handle_.value());
+    rotation = another.rotation;
+    scale = another.scale;
+    translation = another.translation;
     model_ = another.model_;
-    id_ = another.id_;
-    another.id_.reset();
+    handle_ = another.handle_;
+    another.handle_.reset();
     return *this;
   }
 
+  /** Applies rotation, scale and translation to the instance root. */
   void update();
 
+  /** Overrides local transform of a single node of this instance. */
+  void setNodeTransform(size_t node,
+                        TransformHierarchy::LocalTransform const &transform);
+
+  /** Loops model animation starting at time. Negative animation stops
+   *  playback leaving nodes in their current pose. */
+  void playAnimation(int32_t animation, float time = 0.0f) {
+    model_->playAnimation(handle_.value(), animation, time);
+  }
+
+  /** Draws only this instance. Use GLTFModel::draw to draw all instances at
+   * once. */
   void draw(RenderEngine::GraphicsRecordingState &recorder) {
-    model_->drawInstance(recorder, id_.value());
+    model_->drawInstance(recorder, handle_.value());
   };
 
   void drawGeometryOnly(RenderEngine::GraphicsRecordingState &recorder) {
-    model_->drawInstanceGeometryOnly(recorder, id_.value());
+    model_->drawInstanceGeometryOnly(recorder, handle_.value());
   };
 
   ~GLTFModelInstance();
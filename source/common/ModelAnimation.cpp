@@ -0,0 +1,216 @@
+#include "ModelAnimation.h"
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MODEL_ANIMATION_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace TestApp {
+
+namespace {
+
+glm::vec4 lerp(glm::vec4 const &a, glm::vec4 const &b, float t) {
+  return a + (b - a) * t;
+}
+
+glm::vec4 nlerp(glm::vec4 const &a, glm::vec4 const &b, float t) {
+  auto end = glm::dot(a, b) < 0.0f ? -b : b;
+  return glm::normalize(a + (end - a) * t);
+}
+
+/** Cubic spline keys hold in-tangent, value and out-tangent. Tangents are
+ *  scaled by key interval as glTF specifies, rotation is normalized.
+ */
+glm::vec4 hermite(std::span<const float> keyTimes,
+                  std::span<const glm::vec4> values, uint32_t key, float t,
+                  bool rotation) {
+  auto &from = values[key * 3 + 1];
+  // clamped time has no next key
+  if (t == 0.0f)
+    return from;
+
+  auto interval = keyTimes[key + 1] - keyTimes[key];
+  auto &outTangent = values[key * 3 + 2];
+  auto &inTangent = values[key * 3 + 3];
+  auto &to = values[key * 3 + 4];
+
+  auto t2 = t * t;
+  auto t3 = t2 * t;
+  auto ret = (2.0f * t3 - 3.0f * t2 + 1.0f) * from +
+             (t3 - 2.0f * t2 + t) * interval * outTangent +
+             (3.0f * t2 - 2.0f * t3) * to + (t3 - t2) * interval * inTangent;
+  return rotation ? glm::normalize(ret) : ret;
+}
+
+/** Key interval of every instance as the index of its first key and the
+ *  weight of the second one. Time outside of key range is clamped by zero
+ *  weight. Consecutive instances within the same interval reuse the lookup,
+ *  so instances sorted by time search keys once per interval.
+ */
+void locate(cooked::Channel const &channel, std::span<const float> keyTimes,
+            std::span<const uint32_t> instances, std::span<const float> times,
+            std::span<uint32_t> keys, std::span<float> weights) {
+  auto last = static_cast<uint32_t>(keyTimes.size() - 1);
+  uint32_t prev = 0;
+  bool found = false;
+
+  for (size_t i = 0; i < instances.size(); ++i) {
+    auto time = times[instances[i]];
+
+    // also catches NaN
+    if (!(time > keyTimes.front() && time < keyTimes.back())) {
+      keys[i] = time <= keyTimes.front() ? 0 : last;
+      weights[i] = 0.0f;
+      continue;
+    }
+
+    if (!found || time < keyTimes[prev] || time >= keyTimes[prev + 1]) {
+      prev = std::upper_bound(keyTimes.begin(), keyTimes.end(), time) -
+             keyTimes.begin() - 1;
+      found = true;
+    }
+
+    keys[i] = prev;
+    weights[i] = channel.interpolation == cooked::Interpolation::Step
+                     ? 0.0f
+                     : (time - keyTimes[prev]) /
+                           (keyTimes[prev + 1] - keyTimes[prev]);
+  }
+}
+
+#ifdef MODEL_ANIMATION_SSE
+
+/** Interpolates four instances at once. Keys are transposed so that every
+ *  register holds one component of four instances, weights are loaded as
+ *  they are and no horizontal operations are needed.
+ */
+void interpolate4(std::span<const glm::vec4> values, uint32_t const *keys,
+                  float const *weights, bool rotation, glm::vec4 *dst) {
+  auto last = static_cast<uint32_t>(values.size() - 1);
+  __m128 a[4], b[4];
+  for (int i = 0; i < 4; ++i) {
+    a[i] = _mm_loadu_ps(&values[keys[i]].x);
+    b[i] = _mm_loadu_ps(&values[std::min(keys[i] + 1, last)].x);
+  }
+  _MM_TRANSPOSE4_PS(a[0], a[1], a[2], a[3]);
+  _MM_TRANSPOSE4_PS(b[0], b[1], b[2], b[3]);
+
+  auto t = _mm_loadu_ps(weights);
+
+  if (rotation) {
+    // negate b where quaternions are more than half turn apart
+    auto dot = _mm_mul_ps(a[0], b[0]);
+    for (int c = 1; c < 4; ++c)
+      dot = _mm_add_ps(dot, _mm_mul_ps(a[c], b[c]));
+    auto sign = _mm_and_ps(dot, _mm_set1_ps(-0.0f));
+    for (auto &component : b)
+      component = _mm_xor_ps(component, sign);
+  }
+
+  __m128 mixed[4];
+  for (int c = 0; c < 4; ++c)
+    mixed[c] = _mm_add_ps(a[c], _mm_mul_ps(_mm_sub_ps(b[c], a[c]), t));
+
+  if (rotation) {
+    auto lengthSq = _mm_mul_ps(mixed[0], mixed[0]);
+    for (int c = 1; c < 4; ++c)
+      lengthSq = _mm_add_ps(lengthSq, _mm_mul_ps(mixed[c], mixed[c]));
+    auto length = _mm_sqrt_ps(lengthSq);
+    for (auto &component : mixed)
+      component = _mm_div_ps(component, length);
+  }
+
+  _MM_TRANSPOSE4_PS(mixed[0], mixed[1], mixed[2], mixed[3]);
+  for (int i = 0; i < 4; ++i)
+    _mm_storeu_ps(&dst[i].x, mixed[i]);
+}
+
+#endif
+
+/** Values of channel for located instances. */
+void interpolate(cooked::Channel const &channel,
+                 std::span<const float> keyTimes,
+                 std::span<const glm::vec4> values,
+                 std::span<const uint32_t> keys,
+                 std::span<const float> weights, std::span<glm::vec4> dst) {
+  bool rotation = channel.path == cooked::ChannelPath::Rotation;
+
+  if (channel.interpolation == cooked::Interpolation::CubicSpline) {
+    for (size_t i = 0; i < dst.size(); ++i)
+      dst[i] = hermite(keyTimes, values, keys[i], weights[i], rotation);
+    return;
+  }
+
+  size_t i = 0;
+
+#ifdef MODEL_ANIMATION_SSE
+  for (; i + 4 <= dst.size(); i += 4)
+    interpolate4(values, &keys[i], &weights[i], rotation, &dst[i]);
+#endif
+
+  auto last = static_cast<uint32_t>(values.size() - 1);
+  for (; i < dst.size(); ++i) {
+    auto &a = values[keys[i]];
+    auto &b = values[std::min(keys[i] + 1, last)];
+    dst[i] = rotation ? nlerp(a, b, weights[i]) : lerp(a, b, weights[i]);
+  }
+}
+
+} // namespace
+
+ModelAnimation::ModelAnimation(CookedModelView const &model)
+    : m_animations(model.animations), m_channels(model.channels),
+      m_keyTimes(model.keyTimes), m_keyValues(model.keyValues),
+      m_strings(model.strings) {}
+
+std::string_view ModelAnimation::name(uint32_t animation) const {
+  auto &name = m_animations[animation].name;
+  return {m_strings.data() + name.offset, name.size};
+}
+
+void ModelAnimation::sample(TransformHierarchy &transforms, uint32_t animation,
+                            std::span<const uint32_t> instances,
+                            std::span<const float> times) const {
+  auto &anim = m_animations[animation];
+
+  std::vector<uint32_t> keys(instances.size());
+  std::vector<float> weights(instances.size());
+  std::vector<glm::vec4> values(instances.size());
+
+  for (auto &channel :
+       m_channels.subspan(anim.firstChannel, anim.channelCount)) {
+    if (channel.keyCount == 0)
+      continue;
+
+    auto keyTimes = m_keyTimes.subspan(channel.firstKey, channel.keyCount);
+    auto keyValues = m_keyValues.subspan(
+        channel.firstValue,
+        channel.keyCount * cooked::valuesPerKey(channel.interpolation));
+
+    locate(channel, keyTimes, instances, times, keys, weights);
+    interpolate(channel, keyTimes, keyValues, keys, weights, values);
+
+    for (size_t i = 0; i < instances.size(); ++i) {
+      auto instance = instances[i];
+      auto &value = values[i];
+
+      switch (channel.path) {
+      case cooked::ChannelPath::Translation:
+        transforms.setTranslation(instance, channel.node, glm::vec3(value));
+        break;
+      case cooked::ChannelPath::Rotation:
+        transforms.setRotation(instance, channel.node,
+                               glm::quat(value.w, value.x, value.y, value.z));
+        break;
+      case cooked::ChannelPath::Scale:
+        transforms.setScale(instance, channel.node, glm::vec3(value));
+        break;
+      }
+    }
+  }
+}
+
+} // namespace TestApp
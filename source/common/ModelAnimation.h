@@ -0,0 +1,52 @@
+#ifndef TESTAPP_MODELANIMATION_H
+#define TESTAPP_MODELANIMATION_H
+
+#include "CookedModel.h"
+#include "TransformHierarchy.h"
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace TestApp {
+
+/** Keyframe animations of cooked model sampled on CPU into local node
+ *  transforms of TransformHierarchy instances.
+ *
+ *  Sampling walks channels of the animation across all instances playing
+ *  it. Instances are first located in key intervals, then interpolated four
+ *  per SSE register with components of four instances in each register:
+ *  translation and scale linearly, rotation by normalized lerp along the
+ *  shorter arc. Cubic spline channels are evaluated as Hermite curves of
+ *  key values and tangents one instance at a time.
+ */
+class ModelAnimation {
+public:
+  /** View data must outlive the object. */
+  explicit ModelAnimation(CookedModelView const &model);
+
+  uint32_t count() const { return m_animations.size(); }
+
+  float duration(uint32_t animation) const {
+    return m_animations[animation].duration;
+  }
+
+  std::string_view name(uint32_t animation) const;
+
+  /** Writes animated node transforms of instances. Times are indexed by
+   *  instance. Instances sorted by time reuse key lookups of the same
+   *  interval.
+   */
+  void sample(TransformHierarchy &transforms, uint32_t animation,
+              std::span<const uint32_t> instances,
+              std::span<const float> times) const;
+
+private:
+  std::span<const cooked::Animation> m_animations;
+  std::span<const cooked::Channel> m_channels;
+  std::span<const float> m_keyTimes;
+  std::span<const glm::vec4> m_keyValues;
+  std::span<const char> m_strings;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_MODELANIMATION_H
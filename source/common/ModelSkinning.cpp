@@ -0,0 +1,119 @@
+#include "ModelSkinning.h"
+#include <algorithm>
+
+namespace TestApp {
+
+namespace {
+
+vkw::Buffer<glm::mat4> createJointBuffer(vkw::Device &device,
+                                         uint32_t count) {
+  return vkw::Buffer<glm::mat4>{
+      device, std::max(count, 1u), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VmaAllocationCreateInfo{
+          .usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+          .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT}};
+}
+
+vkw::VertexBuffer<ModelAttributes> createOutputBuffer(vkw::Device &device,
+                                                      uint32_t count) {
+  return vkw::VertexBuffer<ModelAttributes>{
+      device, std::max(count, 1u),
+      VmaAllocationCreateInfo{
+          .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+          .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT},
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT};
+}
+
+} // namespace
+
+SkinningLayout::SkinningLayout(vkw::Device &device,
+                               RenderEngine::ShaderLoaderInterface &loader,
+                               uint32_t maxMeshes)
+    : RenderEngine::ComputeLayout(
+          device, loader,
+          RenderEngine::SubstageDescription{.shaderSubstageName = "skinning"},
+          maxMeshes) {}
+
+MeshSkinning::MeshSkinning(vkw::Device &device, SkinningLayout &layout,
+                           vkw::VertexBuffer<ModelAttributes> const &source,
+                           uint32_t vertexCount, uint32_t jointCount,
+                           uint32_t capacity)
+    : RenderEngine::Compute(layout), m_device(device), m_source(&source),
+      m_vertexCount(vertexCount), m_jointCount(jointCount),
+      m_capacity(capacity),
+      m_joints(createJointBuffer(device, capacity * jointCount)),
+      m_output(createOutputBuffer(device, capacity * vertexCount)) {
+  m_joints.map();
+  m_mapped = m_joints.mapped().data();
+  std::fill_n(m_mapped, capacity * jointCount, glm::mat4(1.0f));
+  m_writeSet();
+}
+
+void MeshSkinning::m_writeSet() {
+  set().writeStorageBuffer(0, *m_source);
+  set().writeStorageBuffer(1, m_output);
+  set().writeStorageBuffer(2, m_joints);
+}
+
+void MeshSkinning::reserve(uint32_t capacity, uint32_t count) {
+  if (capacity <= m_capacity)
+    return;
+
+  auto joints = createJointBuffer(m_device, capacity * m_jointCount);
+  joints.map();
+  auto *mapped = joints.mapped().data();
+  std::copy_n(m_mapped, count * m_jointCount, mapped);
+  std::fill(mapped + count * m_jointCount, mapped + capacity * m_jointCount,
+            glm::mat4(1.0f));
+
+  m_joints = std::move(joints);
+  m_mapped = mapped;
+  m_output = createOutputBuffer(m_device, capacity * m_vertexCount);
+  m_capacity = capacity;
+
+  m_writeSet();
+}
+
+void MeshSkinning::moveInstance(uint32_t from, uint32_t to) {
+  std::copy_n(joints(from), m_jointCount, joints(to));
+}
+
+void MeshSkinning::skin(vkw::CommandBuffer &buffer, uint32_t firstInstance,
+                        uint32_t instanceCount) {
+  if (instanceCount == 0 || m_vertexCount == 0)
+    return;
+
+  m_joints.flush(firstInstance * m_jointCount * sizeof(glm::mat4),
+                 instanceCount * m_jointCount * sizeof(glm::mat4));
+
+  struct {
+    uint32_t vertexCount;
+    uint32_t jointCount;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+  } constants{m_vertexCount, m_jointCount, firstInstance, instanceCount};
+
+  buffer.pushConstants(layout().pipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT,
+                       0, constants);
+  dispatch(buffer,
+           (m_vertexCount + SkinningLayout::GROUP_SIZE - 1) /
+               SkinningLayout::GROUP_SIZE,
+           instanceCount);
+
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = m_output;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+
+  buffer.bufferMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                             {&barrier, 1});
+}
+
+} // namespace TestApp
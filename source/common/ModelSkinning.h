@@ -0,0 +1,76 @@
+#ifndef TESTAPP_MODELSKINNING_H
+#define TESTAPP_MODELSKINNING_H
+
+#include "Model.h"
+#include <RenderEngine/Pipelines/Compute.h>
+#include <glm/glm.hpp>
+#include <vkw/CommandBuffer.hpp>
+#include <vkw/VertexBuffer.hpp>
+
+namespace TestApp {
+
+class SkinningLayout : public RenderEngine::ComputeLayout {
+public:
+  /** Vertices skinned by single invocation group. Must match skinning.comp.
+   */
+  static constexpr uint32_t GROUP_SIZE = 64;
+
+  SkinningLayout(vkw::Device &device,
+                 RenderEngine::ShaderLoaderInterface &loader,
+                 uint32_t maxMeshes);
+};
+
+/** Skins vertices of a single mesh node for all instances of the model.
+ *
+ *  Joint matrices are written by host into mapped memory. Skinned vertices
+ *  of instance i are stored at [i * vertexCount(), (i + 1) * vertexCount())
+ *  of output buffer, which is drawn instead of mesh's own vertex buffer, so
+ *  the main pass and every shadow cascade read the same skinning result.
+ */
+class MeshSkinning : public RenderEngine::Compute {
+public:
+  MeshSkinning(vkw::Device &device, SkinningLayout &layout,
+               vkw::VertexBuffer<ModelAttributes> const &source,
+               uint32_t vertexCount, uint32_t jointCount, uint32_t capacity);
+
+  uint32_t vertexCount() const { return m_vertexCount; }
+
+  uint32_t jointCount() const { return m_jointCount; }
+
+  /** Joint matrices of instance in mesh node space. */
+  glm::mat4 *joints(uint32_t instance) {
+    return m_mapped + instance * m_jointCount;
+  }
+
+  /** Reallocates buffers preserving joint matrices of first count instances.
+   *  Output of all instances must be skinned again afterwards.
+   */
+  void reserve(uint32_t capacity, uint32_t count);
+
+  void moveInstance(uint32_t from, uint32_t to);
+
+  /** Flushes joint matrices of instance range and records its skinning
+   *  followed by barrier making output visible to vertex input.
+   */
+  void skin(vkw::CommandBuffer &buffer, uint32_t firstInstance,
+            uint32_t instanceCount);
+
+  vkw::VertexBuffer<ModelAttributes> const &output() const {
+    return m_output;
+  }
+
+private:
+  void m_writeSet();
+
+  vkw::StrongReference<vkw::Device> m_device;
+  vkw::VertexBuffer<ModelAttributes> const *m_source;
+  uint32_t m_vertexCount;
+  uint32_t m_jointCount;
+  uint32_t m_capacity;
+  vkw::Buffer<glm::mat4> m_joints;
+  glm::mat4 *m_mapped;
+  vkw::VertexBuffer<ModelAttributes> m_output;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_MODELSKINNING_H
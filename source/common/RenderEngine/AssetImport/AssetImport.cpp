@@ -1,9 +1,10 @@
 #include "AssetImport.h"
+#include "BlockCompression.h"
+#include "PixelConversion.h"
 #include "tiny_gltf/stb_image.h"
 #include <algorithm>
 #include <array>
 #include <cstring>
-#include <fstream>
 #include <iostream>
 #include <ranges>
 #include <set>
@@ -16,51 +17,110 @@
 
 bool RenderEngine::AssetImporterBase::try_open(
     const std::string &filename) const {
-  std::ifstream is(m_root + filename,
-                   std::ios::binary | std::ios::in | std::ios::ate);
-  return is.is_open();
+  std::error_code error;
+  return std::filesystem::is_regular_file(m_root + filename, error);
 }
 
-vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE>
-RenderEngine::TextureLoader::loadTexture(const std::string &name, int mipLevels,
-                                         VkImageLayout finalLayout,
-                                         VkImageUsageFlags imageUsage,
-                                         VmaMemoryUsage memUsage) const {
-  std::set<std::string> fileExtensions = {"png", "jpg", "jpeg"};
-  std::string filename;
-  for (auto &ext : fileExtensions) {
-    filename = name + "." + ext;
-    if (try_open(filename))
-      break;
-    else
-      filename = "";
-  }
+RenderEngine::AssetData RenderEngine::AssetImporterBase::read_binary(
+    std::string const &filename) const {
+  if (auto packed = find_in_pack(filename))
+    return std::move(*packed);
 
-  if (filename.empty())
-    throw std::runtime_error(
-        "Failed to import '" + name +
-        "' texture: could not open file with any known extension");
+  auto file = std::make_shared<MappedFile>(m_root + filename);
+  auto data = file->data();
+  return {data, std::move(file)};
+}
+
+std::optional<RenderEngine::AssetData>
+RenderEngine::AssetImporterBase::find_in_pack(std::string const &name) const {
+  if (!m_pack.pack)
+    return std::nullopt;
+  if (auto blob = m_pack.pack->find(m_pack.prefix + name))
+    return AssetData{*blob, m_pack.pack};
+  return std::nullopt;
+}
 
-  auto data = read_binary(filename);
+RenderEngine::TextureLoader::DecodedImage
+RenderEngine::TextureLoader::m_decode(std::string const &name) const {
+  // pack has images under their names without extension
+  auto data = find_in_pack(name);
+
+  if (!data) {
+    std::set<std::string> fileExtensions = {"png", "jpg", "jpeg"};
+    std::string filename;
+    for (auto &ext : fileExtensions) {
+      filename = name + "." + ext;
+      if (try_open(filename))
+        break;
+      else
+        filename = "";
+    }
+
+    if (filename.empty())
+      throw std::runtime_error(
+          "Failed to import '" + name +
+          "' texture: could not open file with any known extension");
+
+    data = read_binary(filename);
+  }
 
-  int width, height, bits;
+  DecodedImage ret{{nullptr, stbi_image_free}, 0, 0, 0};
 
-  auto *imageData =
-      stbi_load_from_memory(reinterpret_cast<unsigned char *>(data.data()),
-                            data.size(), &width, &height, &bits, 4);
-  if (!imageData)
+  // keep channel count of the file, expansion to RGBA is done while writing
+  // to destination memory
+  ret.texels.reset(stbi_load_from_memory(data->data().data(), data->size(),
+                                         &ret.width, &ret.height,
+                                         &ret.channels, 0));
+  if (!ret.texels)
     throw std::runtime_error("Failed to read image data.");
 
-  try {
-    vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE> ret = loadTexture(
-        imageData, width, height, mipLevels, finalLayout, imageUsage, memUsage);
-    stbi_image_free(imageData);
-    return ret;
-  } catch (std::runtime_error &e) {
-    stbi_image_free(imageData);
-    throw;
-  }
+  return ret;
 }
+
+vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE>
+RenderEngine::TextureLoader::loadTexture(const std::string &name, int mipLevels,
+                                         VkImageLayout finalLayout,
+                                         VkImageUsageFlags imageUsage,
+                                         VmaMemoryUsage memUsage) const {
+  auto image = m_decode(name);
+  size_t rowSize = static_cast<size_t>(image.width) * image.channels;
+
+  return m_uploadRGBA(
+      [&](unsigned char *dst, size_t firstRow, size_t rowCount) {
+        PixelConversion::expandToRGBA(image.texels.get() + firstRow * rowSize,
+                                      image.channels, dst,
+                                      rowCount * image.width);
+      },
+      image.width, image.height, mipLevels, finalLayout, imageUsage, memUsage);
+}
+
+vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE>
+RenderEngine::TextureLoader::loadTexture(std::string const &name,
+                                         TextureRole role,
+                                         TextureCompressor const &compressor,
+                                         VkImageLayout finalLayout,
+                                         VkImageUsageFlags imageUsage,
+                                         VmaMemoryUsage memUsage) const {
+  auto image = m_decode(name);
+  size_t width = image.width;
+  size_t height = image.height;
+
+  // mip chain is built and encoded on CPU from RGBA8 base level
+  auto mipLevels = BlockCompression::mipLevelCount(width, height);
+  std::vector<unsigned char> rgba(width * height * 4);
+  PixelConversion::expandToRGBA(image.texels.get(), image.channels,
+                                rgba.data(), width * height);
+  m_statistics.bytesCopied += rgba.size();
+  image.texels.reset();
+
+  auto chain =
+      BlockCompression::generateMipChain(rgba, width, height, mipLevels);
+  auto compressed = compressor.compress(chain, width, height, mipLevels, role);
+
+  return loadTexture(compressed.mipChain, compressed.format, width, height,
+                     mipLevels, finalLayout, imageUsage, memUsage);
+}
+
 static void
 generateMipMaps(vkw::CommandBuffer &buffer,
                 vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE> &image,
@@ -138,6 +198,21 @@ RenderEngine::TextureLoader::loadTexture(const unsigned char *texture,
                                          VkImageLayout finalLayout,
                                          VkImageUsageFlags imageUsage,
                                          VmaMemoryUsage memUsage) const {
+  size_t rowSize = textureWidth * 4u;
+
+  return m_uploadRGBA(
+      [&](unsigned char *dst, size_t firstRow, size_t rowCount) {
+        memcpy(dst, texture + firstRow * rowSize, rowCount * rowSize);
+      },
+      textureWidth, textureHeight, mipLevels, finalLayout, imageUsage,
+      memUsage);
+}
+
+vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE>
+RenderEngine::TextureLoader::m_uploadRGBA(
+    RowWriter const &writeRows, size_t textureWidth, size_t textureHeight,
+    int mipLevels, VkImageLayout finalLayout, VkImageUsageFlags imageUsage,
+    VmaMemoryUsage memUsage) const {
 
   VmaAllocationCreateInfo allocInfo{};
 
@@ -201,24 +276,31 @@ RenderEngine::TextureLoader::loadTexture(const unsigned char *texture,
                                      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
                                      {&transitLayout1, 1});
   // Limit the size of single staging buffer by 100MB
-  auto linesPerCopy = 100000000u / (4 * textureWidth);
+  size_t rowSize = textureWidth * 4u;
+  auto linesPerCopy = std::max<size_t>(100000000u / rowSize, 1u);
+
+  VmaAllocationCreateInfo stagingInfo{};
+  stagingInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+  stagingInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
 
-  auto dataSizePerCopy = textureWidth * linesPerCopy * 4u;
-  auto textureEnd = texture + textureWidth * textureHeight * 4u;
-  std::vector<vkw::StagingBuffer<unsigned char>> stagingBuffers;
+  std::vector<vkw::Buffer<unsigned char>> stagingBuffers;
 
-  for (auto i = 0u; i <= textureHeight / linesPerCopy; ++i) {
-    auto startOffset = texture + i * textureWidth * linesPerCopy * 4u;
+  for (size_t firstRow = 0; firstRow < textureHeight;
+       firstRow += linesPerCopy) {
 #undef min
-    auto linesToCopy = std::min(
-        (size_t)(textureEnd - startOffset) / (textureWidth * 4u), linesPerCopy);
+    auto linesToCopy = std::min(textureHeight - firstRow, linesPerCopy);
     auto &stageBuffer = stagingBuffers.emplace_back(
-        m_device,
-        std::span<const unsigned char>{
-            startOffset, std::min(startOffset + dataSizePerCopy, textureEnd)});
+        m_device, linesToCopy * rowSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        stagingInfo);
+
+    // texels are written straight into mapped memory, no intermediate copy
+    stageBuffer.map();
+    writeRows(stageBuffer.mapped().data(), firstRow, linesToCopy);
+    stageBuffer.flush();
+    stageBuffer.unmap();
 
     VkBufferImageCopy bufferCopy{};
-    bufferCopy.imageOffset = {0, static_cast<int>(i * linesPerCopy), 0};
+    bufferCopy.imageOffset = {0, static_cast<int>(firstRow), 0};
     bufferCopy.imageExtent = {static_cast<uint32_t>(textureWidth),
                               static_cast<uint32_t>(linesToCopy), 1};
     bufferCopy.imageSubresource.mipLevel = 0;
@@ -230,6 +312,9 @@ RenderEngine::TextureLoader::loadTexture(const unsigned char *texture,
                                       {&bufferCopy, 1});
   }
 
+  m_statistics.texels += textureWidth * textureHeight;
+  m_statistics.bytesCopied += textureHeight * rowSize;
+
   if (mipLevels > 1) {
     generateMipMaps(transferCommand, ret, mipLevels);
   } else
@@ -244,11 +329,141 @@ RenderEngine::TextureLoader::loadTexture(const unsigned char *texture,
   return ret;
 }
 
+size_t RenderEngine::TextureLoader::mipLevelSize(VkFormat format, size_t width,
+                                                size_t height) {
+  switch (format) {
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+    return width * height * 4u;
+  default:
+    if (auto blockSize = BlockCompression::blockSize(format)) {
+      auto dim = BlockCompression::BLOCK_DIM;
+      return ((width + dim - 1) / dim) * ((height + dim - 1) / dim) *
+             blockSize;
+    }
+    throw std::runtime_error("Texture import failed: unsupported format " +
+                             std::to_string(format));
+  }
+}
+
+vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE>
+RenderEngine::TextureLoader::loadTexture(
+    std::span<const unsigned char> mipChain, VkFormat format,
+    size_t textureWidth, size_t textureHeight, int mipLevels,
+    VkImageLayout finalLayout, VkImageUsageFlags imageUsage,
+    VmaMemoryUsage memUsage) const {
+  auto const &transferQueue = m_device.get().anyTransferQueue();
+  auto commandPool =
+      vkw::CommandPool{m_device, 0, transferQueue.family().index()};
+  auto transferCommand = vkw::PrimaryCommandBuffer{commandPool};
+  transferCommand.begin(0);
+
+  auto pending = recordTextureUpload(transferCommand, mipChain, format,
+                                     textureWidth, textureHeight, mipLevels,
+                                     finalLayout, imageUsage, memUsage);
+
+  transferCommand.end();
+
+  transferQueue.submit(transferCommand);
+  transferQueue.waitIdle();
+
+  return std::move(pending.image);
+}
+
+RenderEngine::TextureLoader::PendingTexture
+RenderEngine::TextureLoader::recordTextureUpload(
+    vkw::CommandBuffer &buffer, std::span<const unsigned char> mipChain,
+    VkFormat format, size_t textureWidth, size_t textureHeight, int mipLevels,
+    VkImageLayout finalLayout, VkImageUsageFlags imageUsage,
+    VmaMemoryUsage memUsage, VkPipelineStageFlags dstStage) const {
+  std::vector<VkBufferImageCopy> regions;
+  size_t offset = 0;
+  size_t texels = 0;
+  auto mipWidth = textureWidth;
+  auto mipHeight = textureHeight;
+
+  for (int i = 0; i < mipLevels; ++i) {
+    auto &region = regions.emplace_back();
+    region.bufferOffset = offset;
+    region.imageExtent = {static_cast<uint32_t>(mipWidth),
+                          static_cast<uint32_t>(mipHeight), 1};
+    region.imageSubresource.mipLevel = i;
+    region.imageSubresource.layerCount = 1;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+    offset += mipLevelSize(format, mipWidth, mipHeight);
+    texels += mipWidth * mipHeight;
+    mipWidth = std::max<size_t>(mipWidth / 2, 1);
+    mipHeight = std::max<size_t>(mipHeight / 2, 1);
+  }
+
+  if (offset > mipChain.size())
+    throw std::runtime_error(
+        "Texture import failed: mip chain data is smaller than expected");
+
+  VmaAllocationCreateInfo allocInfo{};
+
+  allocInfo.usage = memUsage;
+  if (memUsage == VMA_MEMORY_USAGE_GPU_ONLY)
+    allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+  auto image = vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE>{
+      m_device.get().getAllocator(),
+      allocInfo,
+      format,
+      static_cast<uint32_t>(textureWidth),
+      static_cast<uint32_t>(textureHeight),
+      1,
+      1,
+      static_cast<uint32_t>(mipLevels),
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT | imageUsage};
+
+  VkImageMemoryBarrier transitLayout{};
+  transitLayout.image = image.vkw::AllocatedImage::operator VkImage_T *();
+  transitLayout.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  transitLayout.pNext = nullptr;
+  transitLayout.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  transitLayout.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  transitLayout.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  transitLayout.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  transitLayout.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  transitLayout.subresourceRange.baseArrayLayer = 0;
+  transitLayout.subresourceRange.baseMipLevel = 0;
+  transitLayout.subresourceRange.layerCount = 1;
+  transitLayout.subresourceRange.levelCount = mipLevels;
+  transitLayout.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  transitLayout.srcAccessMask = 0;
+
+  // Single copy: source memory (possibly mapped file) -> staging buffer
+  vkw::StagingBuffer<unsigned char> stageBuffer{m_device,
+                                                mipChain.subspan(0, offset)};
+  m_statistics.texels += texels;
+  m_statistics.bytesCopied += offset;
+
+  buffer.imageMemoryBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            {&transitLayout, 1});
+
+  buffer.copyBufferToImage(stageBuffer, image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regions);
+
+  transitLayout.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  transitLayout.newLayout = finalLayout;
+  transitLayout.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  transitLayout.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  buffer.imageMemoryBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage,
+                            {&transitLayout, 1});
+
+  return {std::move(image), std::move(stageBuffer)};
+}
+
 vkw::SPIRVModule
 RenderEngine::ShaderImporter::loadModule(std::string_view name) const {
   std::string filename = std::string(name) + ".spv";
-  auto code = read_binary<uint32_t>(filename);
-  return vkw::SPIRVModule{code};
+  auto code = read_binary(filename);
+  return vkw::SPIRVModule{code.as<uint32_t>()};
 }
 
 vkw::VertexShader
@@ -283,5 +498,6 @@ vkw::ComputeShader RenderEngine::ShaderImporter::loadComputeShader(
 }
 
 RenderEngine::ShaderImporter::ShaderImporter(vkw::Device &device,
-                                             std::string const &rootDirectory)
-    : AssetImporterBase(rootDirectory), m_device(device) {}
+                                             std::string const &rootDirectory,
+                                             AssetPackDirectory pack)
+    : AssetImporterBase(rootDirectory, std::move(pack)), m_device(device) {}
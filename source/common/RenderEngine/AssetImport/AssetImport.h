@@ -1,58 +1,49 @@
 #ifndef TESTAPP_ASSETIMPORT_H
 #define TESTAPP_ASSETIMPORT_H
 
-#include <fstream>
+#include "AssetPack.h"
+#include "TextureCompressor.h"
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <vector>
+#include <vkw/CommandBuffer.hpp>
 #include <vkw/Device.hpp>
 #include <vkw/Image.hpp>
 #include <vkw/Shader.hpp>
+#include <vkw/StagingBuffer.hpp>
 
 namespace RenderEngine {
 
 class AssetImporterBase {
 public:
-  explicit AssetImporterBase(std::string rootDirectory)
-      : m_root(std::move(rootDirectory)){};
+  /** Assets are looked up in pack first, then in root directory. */
+  explicit AssetImporterBase(std::string rootDirectory,
+                             AssetPackDirectory pack = {})
+      : m_root(std::move(rootDirectory)), m_pack(std::move(pack)){};
 
   virtual ~AssetImporterBase() = default;
 
 protected:
   bool try_open(std::string const &filename) const;
 
-  template <typename T = char>
-  std::vector<T> read_binary(std::string const &filename) const {
-    std::ifstream is(m_root + filename,
-                     std::ios::binary | std::ios::in | std::ios::ate);
+  /** Memory mapped contents of the file, no copies are made. */
+  AssetData read_binary(std::string const &filename) const;
 
-    if (is.is_open()) {
-      size_t size = is.tellg();
-      is.seekg(0, std::ios::beg);
-
-      std::vector<T> ret{};
-
-      ret.resize(size / sizeof(T));
-      is.read(reinterpret_cast<char *>(ret.data()), size);
-      is.close();
-
-      if (size == 0)
-        throw std::runtime_error("Asset import failed: could not read " +
-                                 filename);
-
-      return ret;
-    }
-    throw std::runtime_error("Asset import failed: cannot open file '" +
-                             filename + "'");
-  }
+  std::optional<AssetData> find_in_pack(std::string const &name) const;
 
 private:
   std::string m_root;
+  AssetPackDirectory m_pack;
 };
 
 class TextureLoader : public AssetImporterBase {
 public:
-  TextureLoader(vkw::Device &device, std::string const &rootDirectory)
-      : AssetImporterBase(rootDirectory), m_device(device) {}
+  TextureLoader(vkw::Device &device, std::string const &rootDirectory,
+                AssetPackDirectory pack = {})
+      : AssetImporterBase(rootDirectory, std::move(pack)), m_device(device) {}
 
   vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE> loadTexture(
       const unsigned char *texture, size_t textureWidth, size_t textureHeight,
@@ -67,13 +58,92 @@ public:
       VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_SAMPLED_BIT,
       VmaMemoryUsage = VMA_MEMORY_USAGE_GPU_ONLY) const;
 
+  /** Uploads texture with complete mip chain already present in memory.
+   *  Levels are tightly packed one after another starting from level 0.
+   */
+  vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE> loadTexture(
+      std::span<const unsigned char> mipChain, VkFormat format,
+      size_t textureWidth, size_t textureHeight, int mipLevels,
+      VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_SAMPLED_BIT,
+      VmaMemoryUsage = VMA_MEMORY_USAGE_GPU_ONLY) const;
+
+  /** Image whose upload is recorded into a command buffer, but not yet
+   *  executed. Staging buffer must be kept alive until it is.
+   */
+  struct PendingTexture {
+    vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE> image;
+    vkw::StagingBuffer<unsigned char> staging;
+  };
+
+  /** Records upload of mip chain into given buffer instead of submitting
+   *  it, so it can be executed as part of a frame.
+   *
+   *  @param dstStage stage that first reads the image after the upload
+   */
+  PendingTexture recordTextureUpload(
+      vkw::CommandBuffer &buffer, std::span<const unsigned char> mipChain,
+      VkFormat format, size_t textureWidth, size_t textureHeight,
+      int mipLevels,
+      VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_SAMPLED_BIT,
+      VmaMemoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT)
+      const;
+
+  /** Builds full mip chain on CPU and uploads it block compressed. Device
+   *  must have textureCompressionBC feature enabled.
+   */
+  vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE> loadTexture(
+      std::string const &name, TextureRole role,
+      TextureCompressor const &compressor,
+      VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_SAMPLED_BIT,
+      VmaMemoryUsage = VMA_MEMORY_USAGE_GPU_ONLY) const;
+
+  /** Size in bytes of single mip level of given format. */
+  static size_t mipLevelSize(VkFormat format, size_t width, size_t height);
+
+  struct Statistics {
+    // texels uploaded by this loader
+    size_t texels = 0;
+    // bytes written by CPU after decoding: channel expansion, intermediate
+    // buffers and staging copies
+    size_t bytesCopied = 0;
+  };
+
+  Statistics const &statistics() const { return m_statistics; }
+
 private:
+  /** Image as decoded by stb_image, in its own channel count. */
+  struct DecodedImage {
+    std::unique_ptr<unsigned char, void (*)(void *)> texels;
+    int width;
+    int height;
+    int channels;
+  };
+
+  DecodedImage m_decode(std::string const &name) const;
+
+  /** Writes rows [firstRow, firstRow + rowCount) of RGBA8 image to dst. */
+  using RowWriter =
+      std::function<void(unsigned char *dst, size_t firstRow, size_t rowCount)>;
+
+  /** Uploads RGBA8 image filled directly in mapped staging memory and
+   *  generates its mip levels on GPU. */
+  vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE>
+  m_uploadRGBA(RowWriter const &writeRows, size_t textureWidth,
+               size_t textureHeight, int mipLevels, VkImageLayout finalLayout,
+               VkImageUsageFlags imageUsage, VmaMemoryUsage memUsage) const;
+
   vkw::StrongReference<vkw::Device> m_device;
+  mutable Statistics m_statistics;
 };
 
 class ShaderImporter : public AssetImporterBase {
 public:
-  ShaderImporter(vkw::Device &device, std::string const &rootDirectory);
+  ShaderImporter(vkw::Device &device, std::string const &rootDirectory,
+                 AssetPackDirectory pack = {});
 
   vkw::SPIRVModule loadModule(std::string_view name) const;
 
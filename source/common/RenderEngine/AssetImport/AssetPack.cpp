@@ -0,0 +1,196 @@
+#include "AssetPack.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace RenderEngine {
+
+namespace {
+
+// same order TextureLoader probes files in, first match gets the alias
+constexpr const char *IMAGE_EXTENSIONS[] = {".jpeg", ".jpg", ".png"};
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+bool isUnder(std::filesystem::path const &path,
+             std::filesystem::path const &directory) {
+  auto relative = path.lexically_relative(directory);
+  return !relative.empty() && *relative.begin() != "..";
+}
+
+void padTo(std::ofstream &os, uint64_t &position, uint64_t target) {
+  static const char zeros[pack::BLOB_ALIGNMENT] = {};
+  while (position < target) {
+    auto count = std::min<uint64_t>(target - position, sizeof(zeros));
+    os.write(zeros, count);
+    position += count;
+  }
+}
+
+} // namespace
+
+uint64_t AssetPack::hashName(std::string_view name) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : name)
+    hash = (hash ^ c) * 1099511628211ull;
+  return hash;
+}
+
+AssetPack::AssetPack(std::filesystem::path const &path) : m_file(path) {
+  auto failure = [&path](std::string const &reason) {
+    return std::runtime_error("Asset import failed: '" +
+                              path.generic_string() + "' " + reason);
+  };
+
+  auto &header = m_file.view<pack::Header>(0, 1).front();
+
+  if (memcmp(header.magic, pack::MAGIC, sizeof(pack::MAGIC)) != 0)
+    throw failure("is not an asset pack");
+  if (header.version != pack::FORMAT_VERSION)
+    throw failure("has unsupported version " + std::to_string(header.version));
+
+  m_entries =
+      m_file.view<pack::Entry>(header.directoryOffset, header.entryCount);
+  m_names = m_file.view<char>(header.nameOffset, header.nameBytes);
+
+  for (auto &entry : m_entries)
+    if (entry.offset + entry.size > m_file.size() ||
+        entry.nameOffset + entry.nameSize > m_names.size())
+      throw failure("is corrupted");
+}
+
+std::optional<std::span<const unsigned char>>
+AssetPack::find(std::string_view name) const {
+  auto hash = hashName(name);
+  auto found = std::lower_bound(
+      m_entries.begin(), m_entries.end(), hash,
+      [](pack::Entry const &entry, uint64_t h) { return entry.nameHash < h; });
+
+  for (; found != m_entries.end() && found->nameHash == hash; ++found)
+    if (std::string_view{m_names.data() + found->nameOffset,
+                         found->nameSize} == name)
+      return m_file.data().subspan(found->offset, found->size);
+
+  return std::nullopt;
+}
+
+size_t AssetPack::build(std::filesystem::path const &root,
+                        std::filesystem::path const &output,
+                        std::span<const std::filesystem::path> excluded) {
+  struct Blob {
+    std::filesystem::path path;
+    std::string name;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  auto outputPath = std::filesystem::weakly_canonical(output);
+  auto temporary = outputPath;
+  temporary += ".tmp";
+  std::vector<Blob> blobs;
+
+  for (auto &file : std::filesystem::recursive_directory_iterator(root)) {
+    if (!file.is_regular_file() || file.file_size() == 0)
+      continue;
+    auto path = std::filesystem::weakly_canonical(file.path());
+    if (path == outputPath || path == temporary ||
+        std::any_of(excluded.begin(), excluded.end(), [&](auto &dir) {
+          return isUnder(path, std::filesystem::weakly_canonical(dir));
+        }))
+      continue;
+    blobs.push_back({file.path(),
+                     file.path().lexically_relative(root).generic_string(), 0,
+                     file.file_size()});
+  }
+
+  std::sort(blobs.begin(), blobs.end(),
+            [](Blob const &a, Blob const &b) { return a.name < b.name; });
+
+  uint64_t offset = alignUp(sizeof(pack::Header), pack::BLOB_ALIGNMENT);
+  for (auto &blob : blobs) {
+    blob.offset = offset;
+    offset = alignUp(offset + blob.size, pack::BLOB_ALIGNMENT);
+  }
+
+  // directory: every file by full name plus images by name without extension
+  std::vector<pack::Entry> entries;
+  std::string names;
+  std::set<std::string> taken;
+
+  auto addEntry = [&](std::string const &name, Blob const &blob) {
+    if (!taken.insert(name).second)
+      return;
+    entries.push_back({hashName(name), blob.offset, blob.size,
+                       static_cast<uint32_t>(names.size()),
+                       static_cast<uint32_t>(name.size())});
+    names += name;
+  };
+
+  for (auto &blob : blobs)
+    addEntry(blob.name, blob);
+
+  for (auto *extension : IMAGE_EXTENSIONS)
+    for (auto &blob : blobs)
+      if (blob.path.extension() == extension)
+        addEntry(blob.name.substr(0, blob.name.size() - strlen(extension)),
+                 blob);
+
+  std::sort(entries.begin(), entries.end(),
+            [&names](pack::Entry const &a, pack::Entry const &b) {
+              if (a.nameHash != b.nameHash)
+                return a.nameHash < b.nameHash;
+              return names.compare(a.nameOffset, a.nameSize, names,
+                                   b.nameOffset, b.nameSize) < 0;
+            });
+
+  pack::Header header{};
+  memcpy(header.magic, pack::MAGIC, sizeof(header.magic));
+  header.version = pack::FORMAT_VERSION;
+  header.entryCount = entries.size();
+  header.directoryOffset = alignUp(offset, alignof(pack::Entry));
+  header.nameOffset =
+      header.directoryOffset + entries.size() * sizeof(pack::Entry);
+  header.nameBytes = names.size();
+
+  {
+    std::ofstream os(temporary, std::ios::binary | std::ios::trunc);
+    if (!os.is_open())
+      throw std::runtime_error("Asset pack build failed: cannot open " +
+                               temporary.generic_string() + " for writing");
+
+    uint64_t position = sizeof(header);
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (auto &blob : blobs) {
+      padTo(os, position, blob.offset);
+      MappedFile source{blob.path};
+      if (source.size() != blob.size)
+        throw std::runtime_error("Asset pack build failed: " +
+                                 blob.path.generic_string() +
+                                 " changed while packing");
+      os.write(reinterpret_cast<const char *>(source.data().data()),
+               source.size());
+      position += source.size();
+    }
+
+    padTo(os, position, header.directoryOffset);
+    os.write(reinterpret_cast<const char *>(entries.data()),
+             entries.size() * sizeof(pack::Entry));
+    os.write(names.data(), names.size());
+
+    if (!os)
+      throw std::runtime_error("Asset pack build failed: failed to write " +
+                               temporary.generic_string());
+  }
+
+  std::filesystem::rename(temporary, outputPath);
+
+  return blobs.size();
+}
+
+} // namespace RenderEngine
@@ -0,0 +1,114 @@
+#ifndef TESTAPP_ASSETPACK_H
+#define TESTAPP_ASSETPACK_H
+
+#include "MappedFile.h"
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace RenderEngine {
+
+/** Read-only bytes of an asset. Points either into mapped file or into
+ *  mapped pack and keeps its owner alive.
+ */
+class AssetData {
+public:
+  AssetData(std::span<const unsigned char> data,
+            std::shared_ptr<const void> owner)
+      : m_data(data), m_owner(std::move(owner)) {}
+
+  std::span<const unsigned char> data() const { return m_data; }
+
+  size_t size() const { return m_data.size(); }
+
+  template <typename T> std::span<const T> as() const {
+    if (m_data.size() % sizeof(T) != 0 ||
+        reinterpret_cast<uintptr_t>(m_data.data()) % alignof(T) != 0)
+      throw std::runtime_error(
+          "Asset import failed: asset data is not an array of requested type");
+    return {reinterpret_cast<const T *>(m_data.data()),
+            m_data.size() / sizeof(T)};
+  }
+
+private:
+  std::span<const unsigned char> m_data;
+  std::shared_ptr<const void> m_owner;
+};
+
+namespace pack {
+
+constexpr char MAGIC[8] = {'V', 'K', 'W', 'A', 'P', 'A', 'C', 'K'};
+constexpr uint32_t FORMAT_VERSION = 1;
+constexpr uint64_t BLOB_ALIGNMENT = 64;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t entryCount;
+  uint64_t directoryOffset;
+  uint64_t nameOffset;
+  uint64_t nameBytes;
+};
+
+/** Directory entries are sorted by name hash. Several entries may share the
+ *  same blob.
+ */
+struct Entry {
+  uint64_t nameHash;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t nameOffset;
+  uint32_t nameSize;
+};
+
+} // namespace pack
+
+/** Single mapped file holding all assets of a directory tree.
+ *
+ *  Assets are addressed by their path relative to the packed directory
+ *  using '/' as separator, e.g. "shaders/pbr.mt.frag.spv". Images are also
+ *  reachable by name without extension ("textures/earth_color"), so
+ *  loaders need no extension probing. Blobs are aligned to
+ *  pack::BLOB_ALIGNMENT, so they can be viewed as arrays of any scalar type.
+ */
+class AssetPack {
+public:
+  explicit AssetPack(std::filesystem::path const &path);
+
+  /** Single hash lookup, nullopt if pack has no such asset. */
+  std::optional<std::span<const unsigned char>>
+  find(std::string_view name) const;
+
+  size_t entryCount() const { return m_entries.size(); }
+
+  static uint64_t hashName(std::string_view name);
+
+  /** Packs every non-empty regular file under root except excluded paths.
+   *
+   *  @return number of packed files
+   */
+  static size_t build(std::filesystem::path const &root,
+                      std::filesystem::path const &output,
+                      std::span<const std::filesystem::path> excluded = {});
+
+private:
+  MappedFile m_file;
+  std::span<const pack::Entry> m_entries;
+  std::span<const char> m_names;
+};
+
+/** Part of pack seen by single importer: assets whose names start with
+ *  prefix (e.g. "shaders/"). Empty if no pack is used.
+ */
+struct AssetPackDirectory {
+  std::shared_ptr<const AssetPack> pack;
+  std::string prefix;
+};
+
+} // namespace RenderEngine
+#endif // TESTAPP_ASSETPACK_H
@@ -0,0 +1,515 @@
+#include "BlockCompression.h"
+#include "RenderEngine/JobSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace RenderEngine::BlockCompression {
+
+namespace {
+
+/** Fits segment through block texels along their principal axis. */
+template <int N>
+void fitEndpoints(const float (&texels)[16][N], float (&lo)[N],
+                  float (&hi)[N]) {
+  float mean[N] = {};
+  float min[N], max[N];
+  std::fill_n(min, N, 255.0f);
+  std::fill_n(max, N, 0.0f);
+
+  for (auto &texel : texels)
+    for (int c = 0; c < N; ++c) {
+      mean[c] += texel[c] / 16.0f;
+      min[c] = std::min(min[c], texel[c]);
+      max[c] = std::max(max[c], texel[c]);
+    }
+
+  float covariance[N][N] = {};
+  for (auto &texel : texels)
+    for (int a = 0; a < N; ++a)
+      for (int b = 0; b < N; ++b)
+        covariance[a][b] += (texel[a] - mean[a]) * (texel[b] - mean[b]);
+
+  // power iteration starting from bounding box diagonal
+  float axis[N];
+  for (int c = 0; c < N; ++c)
+    axis[c] = max[c] - min[c];
+
+  for (int iteration = 0; iteration < 8; ++iteration) {
+    float next[N] = {};
+    float norm = 0.0f;
+    for (int a = 0; a < N; ++a) {
+      for (int b = 0; b < N; ++b)
+        next[a] += covariance[a][b] * axis[b];
+      norm = std::max(norm, std::abs(next[a]));
+    }
+    if (norm < 1e-6f)
+      break;
+    for (int c = 0; c < N; ++c)
+      axis[c] = next[c] / norm;
+  }
+
+  float length = 0.0f;
+  for (int c = 0; c < N; ++c)
+    length += axis[c] * axis[c];
+  length = std::sqrt(length);
+
+  if (length < 1e-6f) {
+    // flat block
+    std::copy_n(mean, N, lo);
+    std::copy_n(mean, N, hi);
+    return;
+  }
+
+  float tMin = std::numeric_limits<float>::max();
+  float tMax = -tMin;
+  for (auto &texel : texels) {
+    float t = 0.0f;
+    for (int c = 0; c < N; ++c)
+      t += (texel[c] - mean[c]) * axis[c] / length;
+    tMin = std::min(tMin, t);
+    tMax = std::max(tMax, t);
+  }
+
+  for (int c = 0; c < N; ++c) {
+    lo[c] = std::clamp(mean[c] + tMin * axis[c] / length, 0.0f, 255.0f);
+    hi[c] = std::clamp(mean[c] + tMax * axis[c] / length, 0.0f, 255.0f);
+  }
+}
+
+template <int N>
+void loadTexels(const unsigned char *texels, float (&dst)[16][N]) {
+  for (int i = 0; i < 16; ++i)
+    for (int c = 0; c < N; ++c)
+      dst[i][c] = texels[i * 4 + c];
+}
+
+uint16_t packRGB565(const float (&color)[3]) {
+  auto r = static_cast<uint16_t>(std::lround(color[0] * 31.0f / 255.0f));
+  auto g = static_cast<uint16_t>(std::lround(color[1] * 63.0f / 255.0f));
+  auto b = static_cast<uint16_t>(std::lround(color[2] * 31.0f / 255.0f));
+  return (r << 11) | (g << 5) | b;
+}
+
+void unpackRGB565(uint16_t packed, int (&color)[3]) {
+  auto r = (packed >> 11) & 31;
+  auto g = (packed >> 5) & 63;
+  auto b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+/** BC1 color block in four color mode. Also used as color part of BC3. */
+void encodeColorBlock(const unsigned char *texels, unsigned char *block) {
+  float rgb[16][3];
+  loadTexels(texels, rgb);
+
+  float lo[3], hi[3];
+  fitEndpoints(rgb, lo, hi);
+
+  auto color0 = packRGB565(hi);
+  auto color1 = packRGB565(lo);
+  // four color mode requires color0 > color1
+  if (color0 < color1)
+    std::swap(color0, color1);
+
+  uint32_t indices = 0;
+
+  if (color0 != color1) {
+    int palette[4][3];
+    unpackRGB565(color0, palette[0]);
+    unpackRGB565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    for (int i = 0; i < 16; ++i) {
+      int best = 0;
+      float bestError = 0.0f;
+      for (int p = 0; p < 4; ++p) {
+        float error = 0.0f;
+        for (int c = 0; c < 3; ++c) {
+          auto d = rgb[i][c] - palette[p][c];
+          error += d * d;
+        }
+        if (p == 0 || error < bestError) {
+          bestError = error;
+          best = p;
+        }
+      }
+      indices |= static_cast<uint32_t>(best) << (2 * i);
+    }
+  }
+
+  memcpy(block, &color0, 2);
+  memcpy(block + 2, &color1, 2);
+  memcpy(block + 4, &indices, 4);
+}
+
+/** Little endian bit stream used to pack BC7 blocks. */
+class BitWriter {
+public:
+  explicit BitWriter(unsigned char *block) : m_block(block) {
+    std::fill_n(m_block, 16, 0);
+  }
+
+  void write(uint32_t value, int bits) {
+    for (int i = 0; i < bits; ++i, ++m_position)
+      if (value & (1u << i))
+        m_block[m_position / 8] |= 1u << (m_position % 8);
+  }
+
+private:
+  unsigned char *m_block;
+  int m_position = 0;
+};
+
+/** Quantizes endpoint to 7 bits per channel plus shared p-bit. */
+void quantizeEndpoint(const float (&endpoint)[4], uint32_t (&quantized)[4],
+                      uint32_t &pBit) {
+  float bestError = 0.0f;
+  for (uint32_t p = 0; p < 2; ++p) {
+    uint32_t candidate[4];
+    float error = 0.0f;
+    for (int c = 0; c < 4; ++c) {
+      candidate[c] = std::clamp<long>(std::lround((endpoint[c] - p) / 2.0f),
+                                      0, 127);
+      auto d = static_cast<float>(candidate[c] << 1 | p) - endpoint[c];
+      error += d * d;
+    }
+    if (p == 0 || error < bestError) {
+      bestError = error;
+      pBit = p;
+      std::copy_n(candidate, 4, quantized);
+    }
+  }
+}
+
+struct LevelJob {
+  const unsigned char *source;
+  unsigned char *destination;
+  size_t width;
+  size_t height;
+  size_t blocksX;
+  size_t blocksY;
+  size_t firstRow;
+};
+
+bool hasEncoder(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void encodeBlock(VkFormat format, const unsigned char *texels,
+                 unsigned char *block) {
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    encodeBC1(texels, block);
+    break;
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+    encodeBC3(texels, block);
+    break;
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+    encodeBC4(texels, 0, block);
+    break;
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+    encodeBC5(texels, block);
+    break;
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    encodeBC7(texels, block);
+    break;
+  default:
+    break;
+  }
+}
+
+void encodeRow(VkFormat format, LevelJob const &level, size_t row) {
+  auto blockBytes = blockSize(format);
+  unsigned char texels[BLOCK_DIM * BLOCK_DIM * 4];
+
+  for (size_t bx = 0; bx < level.blocksX; ++bx) {
+    // texels outside of the level replicate its last row/column
+    for (size_t y = 0; y < BLOCK_DIM; ++y) {
+      auto sy = std::min(row * BLOCK_DIM + y, level.height - 1);
+      for (size_t x = 0; x < BLOCK_DIM; ++x) {
+        auto sx = std::min(bx * BLOCK_DIM + x, level.width - 1);
+        memcpy(texels + (y * BLOCK_DIM + x) * 4,
+               level.source + (sy * level.width + sx) * 4, 4);
+      }
+    }
+    encodeBlock(format, texels,
+                level.destination + (row * level.blocksX + bx) * blockBytes);
+  }
+}
+
+} // namespace
+
+bool isBlockCompressed(VkFormat format) { return blockSize(format) != 0; }
+
+size_t blockSize(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+  case VK_FORMAT_BC4_SNORM_BLOCK:
+    return 8;
+  case VK_FORMAT_BC2_UNORM_BLOCK:
+  case VK_FORMAT_BC2_SRGB_BLOCK:
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+  case VK_FORMAT_BC5_SNORM_BLOCK:
+  case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+  case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+void encodeBC1(const unsigned char *texels, unsigned char *block) {
+  encodeColorBlock(texels, block);
+}
+
+void encodeBC3(const unsigned char *texels, unsigned char *block) {
+  // alpha block has the same layout as BC4
+  encodeBC4(texels, 3, block);
+  encodeColorBlock(texels, block + 8);
+}
+
+void encodeBC4(const unsigned char *texels, int channel,
+               unsigned char *block) {
+  int lo = 255, hi = 0;
+  for (int i = 0; i < 16; ++i) {
+    lo = std::min<int>(lo, texels[i * 4 + channel]);
+    hi = std::max<int>(hi, texels[i * 4 + channel]);
+  }
+
+  block[0] = hi;
+  block[1] = lo;
+
+  uint64_t indices = 0;
+
+  if (hi != lo) {
+    // eight value mode, since red0 > red1
+    int palette[8] = {hi, lo};
+    for (int p = 2; p < 8; ++p)
+      palette[p] = ((8 - p) * hi + (p - 1) * lo) / 7;
+
+    for (int i = 0; i < 16; ++i) {
+      int value = texels[i * 4 + channel];
+      int best = 0;
+      for (int p = 1; p < 8; ++p)
+        if (std::abs(palette[p] - value) < std::abs(palette[best] - value))
+          best = p;
+      indices |= static_cast<uint64_t>(best) << (3 * i);
+    }
+  }
+
+  for (int i = 0; i < 6; ++i)
+    block[2 + i] = static_cast<unsigned char>(indices >> (8 * i));
+}
+
+void encodeBC5(const unsigned char *texels, unsigned char *block) {
+  encodeBC4(texels, 0, block);
+  encodeBC4(texels, 1, block + 8);
+}
+
+void encodeBC7(const unsigned char *texels, unsigned char *block) {
+  static constexpr int weights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                      34, 38, 43, 47, 51, 55, 60, 64};
+
+  float rgba[16][4];
+  loadTexels(texels, rgba);
+
+  float lo[4], hi[4];
+  fitEndpoints(rgba, lo, hi);
+
+  uint32_t endpoints[2][4];
+  uint32_t pBits[2];
+  quantizeEndpoint(lo, endpoints[0], pBits[0]);
+  quantizeEndpoint(hi, endpoints[1], pBits[1]);
+
+  int palette[16][4];
+  for (int c = 0; c < 4; ++c) {
+    int e0 = endpoints[0][c] << 1 | pBits[0];
+    int e1 = endpoints[1][c] << 1 | pBits[1];
+    for (int w = 0; w < 16; ++w)
+      palette[w][c] = ((64 - weights[w]) * e0 + weights[w] * e1 + 32) >> 6;
+  }
+
+  uint32_t indices[16];
+  for (int i = 0; i < 16; ++i) {
+    int best = 0;
+    float bestError = 0.0f;
+    for (int p = 0; p < 16; ++p) {
+      float error = 0.0f;
+      for (int c = 0; c < 4; ++c) {
+        auto d = rgba[i][c] - palette[p][c];
+        error += d * d;
+      }
+      if (p == 0 || error < bestError) {
+        bestError = error;
+        best = p;
+      }
+    }
+    indices[i] = best;
+  }
+
+  // most significant bit of the anchor index is implicitly zero
+  if (indices[0] & 8) {
+    std::swap(endpoints[0], endpoints[1]);
+    std::swap(pBits[0], pBits[1]);
+    for (auto &index : indices)
+      index = 15 - index;
+  }
+
+  BitWriter writer{block};
+  writer.write(1u << 6, 7); // mode 6
+  for (int c = 0; c < 4; ++c) {
+    writer.write(endpoints[0][c], 7);
+    writer.write(endpoints[1][c], 7);
+  }
+  writer.write(pBits[0], 1);
+  writer.write(pBits[1], 1);
+  writer.write(indices[0], 3);
+  for (int i = 1; i < 16; ++i)
+    writer.write(indices[i], 4);
+}
+
+uint32_t mipLevelCount(size_t width, size_t height) {
+  return static_cast<uint32_t>(
+             std::floor(std::log2(std::max<size_t>({width, height, 1})))) +
+         1;
+}
+
+std::vector<unsigned char> generateMipChain(std::span<const unsigned char> rgba,
+                                            size_t width, size_t height,
+                                            uint32_t mipLevels) {
+  size_t chainSize = 0;
+  for (auto w = width, h = height, i = size_t{0}; i < mipLevels;
+       ++i, w = std::max<size_t>(w / 2, 1), h = std::max<size_t>(h / 2, 1))
+    chainSize += w * h * 4;
+
+  if (rgba.size() < width * height * 4)
+    throw std::runtime_error(
+        "Texture import failed: base level data is smaller than expected");
+
+  std::vector<unsigned char> ret(chainSize);
+  memcpy(ret.data(), rgba.data(), width * height * 4);
+
+  auto *level = ret.data();
+  for (uint32_t i = 1; i < mipLevels; ++i) {
+    auto nextWidth = std::max<size_t>(width / 2, 1);
+    auto nextHeight = std::max<size_t>(height / 2, 1);
+    auto *next = level + width * height * 4;
+
+    // 2x2 box filter, odd dimensions clamp last row/column
+    for (size_t y = 0; y < nextHeight; ++y) {
+      auto y0 = std::min(2 * y, height - 1);
+      auto y1 = std::min(2 * y + 1, height - 1);
+      for (size_t x = 0; x < nextWidth; ++x) {
+        auto x0 = std::min(2 * x, width - 1);
+        auto x1 = std::min(2 * x + 1, width - 1);
+        for (int c = 0; c < 4; ++c) {
+          unsigned sum = level[(y0 * width + x0) * 4 + c] +
+                         level[(y0 * width + x1) * 4 + c] +
+                         level[(y1 * width + x0) * 4 + c] +
+                         level[(y1 * width + x1) * 4 + c];
+          next[(y * nextWidth + x) * 4 + c] =
+              static_cast<unsigned char>((sum + 2) / 4);
+        }
+      }
+    }
+
+    level = next;
+    width = nextWidth;
+    height = nextHeight;
+  }
+
+  return ret;
+}
+
+std::vector<unsigned char>
+compressMipChain(std::span<const unsigned char> rgbaChain, VkFormat format,
+                 size_t width, size_t height, uint32_t mipLevels) {
+  // checked up front, before any row is encoded
+  if (!hasEncoder(format))
+    throw std::runtime_error("Texture import failed: no encoder for format " +
+                             std::to_string(format));
+
+  auto blockBytes = blockSize(format);
+
+  std::vector<LevelJob> levels;
+  size_t sourceOffset = 0;
+  size_t destinationSize = 0;
+  size_t totalRows = 0;
+
+  for (uint32_t i = 0; i < mipLevels; ++i) {
+    auto &level = levels.emplace_back();
+    level.width = width;
+    level.height = height;
+    level.blocksX = (width + BLOCK_DIM - 1) / BLOCK_DIM;
+    level.blocksY = (height + BLOCK_DIM - 1) / BLOCK_DIM;
+    level.firstRow = totalRows;
+    level.source = rgbaChain.data() + sourceOffset;
+
+    sourceOffset += width * height * 4;
+    totalRows += level.blocksY;
+    destinationSize += level.blocksX * level.blocksY * blockBytes;
+
+    width = std::max<size_t>(width / 2, 1);
+    height = std::max<size_t>(height / 2, 1);
+  }
+
+  if (sourceOffset > rgbaChain.size())
+    throw std::runtime_error(
+        "Texture import failed: mip chain data is smaller than expected");
+
+  std::vector<unsigned char> ret(destinationSize);
+  size_t destinationOffset = 0;
+  for (auto &level : levels) {
+    level.destination = ret.data() + destinationOffset;
+    destinationOffset += level.blocksX * level.blocksY * blockBytes;
+  }
+
+  // block rows of all levels form one range, so small tail levels do not
+  // leave workers idle
+  auto &jobs = JobSystem::shared();
+  jobs.wait(jobs.parallelFor(totalRows, 1, [&](size_t begin, size_t end) {
+    for (auto row = begin; row < end; ++row) {
+      auto level = std::find_if(levels.rbegin(), levels.rend(),
+                                [row](LevelJob const &level) {
+                                  return level.firstRow <= row;
+                                });
+      encodeRow(format, *level, row - level->firstRow);
+    }
+  }));
+
+  return ret;
+}
+
+} // namespace RenderEngine::BlockCompression
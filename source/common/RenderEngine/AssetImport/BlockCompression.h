@@ -0,0 +1,65 @@
+#ifndef TESTAPP_BLOCKCOMPRESSION_H
+#define TESTAPP_BLOCKCOMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace RenderEngine {
+
+/** CPU encoders for BCn texture formats.
+ *
+ *  Every encoder takes 4x4 block of RGBA8 texels (64 bytes, row-major) and
+ *  writes single compressed block. Endpoints are fitted along the principal
+ *  axis of block colors, which is fast and gives quality close to the
+ *  reference encoders on typical content.
+ */
+namespace BlockCompression {
+
+constexpr size_t BLOCK_DIM = 4;
+
+/** Bumped whenever encoder output changes, invalidates cached textures. */
+constexpr uint32_t ENCODER_VERSION = 1;
+
+bool isBlockCompressed(VkFormat format);
+
+/** Size in bytes of single 4x4 block, 0 if format is not block compressed. */
+size_t blockSize(VkFormat format);
+
+/** Opaque RGB, 8 bytes. */
+void encodeBC1(const unsigned char *texels, unsigned char *block);
+
+/** RGB with interpolated alpha, 16 bytes. */
+void encodeBC3(const unsigned char *texels, unsigned char *block);
+
+/** Single channel, 8 bytes. */
+void encodeBC4(const unsigned char *texels, int channel, unsigned char *block);
+
+/** Two channels (red and green), 16 bytes. */
+void encodeBC5(const unsigned char *texels, unsigned char *block);
+
+/** RGBA using mode 6 only (single subset, 7.7.7.7 endpoints with p-bits and
+ *  4-bit indices), 16 bytes. */
+void encodeBC7(const unsigned char *texels, unsigned char *block);
+
+/** Number of levels in full mip chain of given base extent. */
+uint32_t mipLevelCount(size_t width, size_t height);
+
+/** Builds tightly packed RGBA8 mip chain from base level with 2x2 box
+ *  filter. */
+std::vector<unsigned char> generateMipChain(std::span<const unsigned char> rgba,
+                                            size_t width, size_t height,
+                                            uint32_t mipLevels);
+
+/** Encodes tightly packed RGBA8 mip chain into given block compressed
+ *  format. Block rows of all levels are spread over JobSystem::shared().
+ */
+std::vector<unsigned char>
+compressMipChain(std::span<const unsigned char> rgbaChain, VkFormat format,
+                 size_t width, size_t height, uint32_t mipLevels);
+
+} // namespace BlockCompression
+} // namespace RenderEngine
+#endif // TESTAPP_BLOCKCOMPRESSION_H
@@ -0,0 +1,113 @@
+#include "MappedFile.h"
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef min
+#undef max
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+RenderEngine::MappedFile::MappedFile(std::filesystem::path const &path) {
+  auto failure = [&path](std::string const &reason) {
+    return std::runtime_error("Asset import failed: cannot map file '" +
+                              path.generic_string() + "': " + reason);
+  };
+#ifdef _WIN32
+  m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (m_file == INVALID_HANDLE_VALUE) {
+    m_file = nullptr;
+    throw failure("could not open");
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0) {
+    m_unmap();
+    throw failure("file is empty");
+  }
+  m_size = static_cast<size_t>(fileSize.QuadPart);
+
+  m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!m_mapping) {
+    m_unmap();
+    throw failure("CreateFileMapping failed");
+  }
+
+  m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!m_data) {
+    m_unmap();
+    throw failure("MapViewOfFile failed");
+  }
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw failure("could not open");
+
+  struct stat fileStat {};
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+    close(fd);
+    throw failure("file is empty");
+  }
+  m_size = static_cast<size_t>(fileStat.st_size);
+
+  void *mapped = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // mapping stays valid after descriptor is closed
+  close(fd);
+
+  if (mapped == MAP_FAILED)
+    throw failure("mmap failed");
+
+  m_data = mapped;
+#endif
+}
+
+RenderEngine::MappedFile::MappedFile(MappedFile &&another) noexcept
+    : m_data(std::exchange(another.m_data, nullptr)),
+      m_size(std::exchange(another.m_size, 0))
+#ifdef _WIN32
+      ,
+      m_file(std::exchange(another.m_file, nullptr)),
+      m_mapping(std::exchange(another.m_mapping, nullptr))
+#endif
+{
+}
+
+RenderEngine::MappedFile &
+RenderEngine::MappedFile::operator=(MappedFile &&another) noexcept {
+  if (this == &another)
+    return *this;
+  m_unmap();
+  m_data = std::exchange(another.m_data, nullptr);
+  m_size = std::exchange(another.m_size, 0);
+#ifdef _WIN32
+  m_file = std::exchange(another.m_file, nullptr);
+  m_mapping = std::exchange(another.m_mapping, nullptr);
+#endif
+  return *this;
+}
+
+void RenderEngine::MappedFile::m_unmap() noexcept {
+#ifdef _WIN32
+  if (m_data)
+    UnmapViewOfFile(m_data);
+  if (m_mapping)
+    CloseHandle(m_mapping);
+  if (m_file)
+    CloseHandle(m_file);
+  m_file = nullptr;
+  m_mapping = nullptr;
+#else
+  if (m_data)
+    munmap(const_cast<void *>(m_data), m_size);
+#endif
+  m_data = nullptr;
+  m_size = 0;
+}
+
+RenderEngine::MappedFile::~MappedFile() { m_unmap(); }
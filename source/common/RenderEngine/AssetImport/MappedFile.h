@@ -0,0 +1,56 @@
+#ifndef TESTAPP_MAPPEDFILE_H
+#define TESTAPP_MAPPEDFILE_H
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+namespace RenderEngine {
+
+/** Read-only memory mapping of a whole file. */
+class MappedFile {
+public:
+  explicit MappedFile(std::filesystem::path const &path);
+
+  MappedFile(MappedFile &&another) noexcept;
+  MappedFile &operator=(MappedFile &&another) noexcept;
+
+  MappedFile(MappedFile const &another) = delete;
+  MappedFile &operator=(MappedFile const &another) = delete;
+
+  std::span<const unsigned char> data() const {
+    return {static_cast<const unsigned char *>(m_data), m_size};
+  }
+
+  size_t size() const { return m_size; }
+
+  /** Returns view on count objects of type T placed at given byte offset. */
+  template <typename T>
+  std::span<const T> view(size_t offset, size_t count) const {
+    // written so that corrupt offset or count can not overflow the check
+    if (offset > m_size || count > (m_size - offset) / sizeof(T) ||
+        offset % alignof(T) != 0)
+      throw std::runtime_error(
+          "Asset import failed: mapped file range is out of bounds");
+    return {reinterpret_cast<const T *>(
+                static_cast<const unsigned char *>(m_data) + offset),
+            count};
+  }
+
+  ~MappedFile();
+
+private:
+  void m_unmap() noexcept;
+
+  const void *m_data = nullptr;
+  size_t m_size = 0;
+#ifdef _WIN32
+  void *m_file = nullptr;
+  void *m_mapping = nullptr;
+#endif
+};
+
+} // namespace RenderEngine
+#endif // TESTAPP_MAPPEDFILE_H
@@ -0,0 +1,114 @@
+#include "PixelConversion.h"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||            \
+    defined(_M_IX86)
+#define PIXEL_CONVERSION_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SSSE3_TARGET
+#else
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#endif
+#endif
+
+namespace RenderEngine::PixelConversion {
+
+namespace {
+
+void expandRGBScalar(const unsigned char *src, unsigned char *dst,
+                     size_t texelCount) {
+  for (size_t i = 0; i < texelCount; ++i, src += 3, dst += 4) {
+    dst[0] = src[0];
+    dst[1] = src[1];
+    dst[2] = src[2];
+    dst[3] = 255;
+  }
+}
+
+#ifdef PIXEL_CONVERSION_X86
+
+bool hasSSSE3() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  return info[2] & (1 << 9);
+#else
+  return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+/** 16 texels per iteration: 48 bytes are split into four 12 byte groups,
+ *  each shuffled into 4 RGBA texels with alpha or-ed in. */
+SSSE3_TARGET void expandRGBSSSE3(const unsigned char *src, unsigned char *dst,
+                                 size_t texelCount) {
+  const __m128i shuffle =
+      _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+
+  size_t i = 0;
+  for (; i + 16 <= texelCount; i += 16, src += 48, dst += 64) {
+    auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+    auto c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+
+    __m128i groups[4] = {a, _mm_alignr_epi8(b, a, 12),
+                         _mm_alignr_epi8(c, b, 8), _mm_srli_si128(c, 4)};
+
+    for (int g = 0; g < 4; ++g)
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i *>(dst + g * 16),
+          _mm_or_si128(_mm_shuffle_epi8(groups[g], shuffle), alpha));
+  }
+
+  expandRGBScalar(src, dst, texelCount - i);
+}
+
+#endif
+
+void expandRGB(const unsigned char *src, unsigned char *dst,
+               size_t texelCount) {
+#ifdef PIXEL_CONVERSION_X86
+  static const bool ssse3 = hasSSSE3();
+  if (ssse3) {
+    expandRGBSSSE3(src, dst, texelCount);
+    return;
+  }
+#endif
+  expandRGBScalar(src, dst, texelCount);
+}
+
+} // namespace
+
+void expandToRGBA(const unsigned char *src, int channels, unsigned char *dst,
+                  size_t texelCount) {
+  switch (channels) {
+  case 1:
+    for (size_t i = 0; i < texelCount; ++i, dst += 4) {
+      dst[0] = dst[1] = dst[2] = src[i];
+      dst[3] = 255;
+    }
+    return;
+  case 2:
+    for (size_t i = 0; i < texelCount; ++i, src += 2, dst += 4) {
+      dst[0] = dst[1] = dst[2] = src[0];
+      dst[3] = src[1];
+    }
+    return;
+  case 3:
+    expandRGB(src, dst, texelCount);
+    return;
+  case 4:
+    memcpy(dst, src, texelCount * 4);
+    return;
+  default:
+    throw std::runtime_error("Texture import failed: unsupported channel "
+                             "count " +
+                             std::to_string(channels));
+  }
+}
+
+} // namespace RenderEngine::PixelConversion
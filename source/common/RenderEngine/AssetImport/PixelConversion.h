@@ -0,0 +1,25 @@
+#ifndef TESTAPP_PIXELCONVERSION_H
+#define TESTAPP_PIXELCONVERSION_H
+
+#include <cstddef>
+
+namespace RenderEngine {
+
+/** Conversions of decoded 8-bit images into layouts accepted by the GPU.
+ *
+ *  Destination may be mapped device memory, so every output byte is written
+ *  exactly once and never read back.
+ */
+namespace PixelConversion {
+
+/** Expands texels of 1 (gray), 2 (gray, alpha), 3 (RGB) or 4 (RGBA) channels
+ *  into RGBA8. Missing alpha is set to 255. RGB expansion uses SSSE3 when
+ *  CPU supports it.
+ */
+void expandToRGBA(const unsigned char *src, int channels, unsigned char *dst,
+                  size_t texelCount);
+
+} // namespace PixelConversion
+
+} // namespace RenderEngine
+#endif // TESTAPP_PIXELCONVERSION_H
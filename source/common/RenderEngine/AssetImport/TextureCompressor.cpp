@@ -0,0 +1,186 @@
+#include "TextureCompressor.h"
+#include "BlockCompression.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace RenderEngine {
+
+namespace {
+
+constexpr char CACHE_MAGIC[8] = {'V', 'K', 'W', 'B', 'C', 'T', 'E', 'X'};
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t encoderVersion;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t mipLevels;
+  uint32_t reserved;
+  uint64_t size;
+};
+
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+/** FNV-1a variant consuming 8 bytes per step, source textures are large. */
+uint64_t hashBytes(std::span<const unsigned char> data,
+                   uint64_t hash = FNV_OFFSET) {
+  size_t i = 0;
+  for (; i + 8 <= data.size(); i += 8) {
+    uint64_t word;
+    memcpy(&word, data.data() + i, 8);
+    hash = (hash ^ word) * FNV_PRIME;
+  }
+  for (; i < data.size(); ++i)
+    hash = (hash ^ data[i]) * FNV_PRIME;
+  return hash;
+}
+
+uint64_t hashValue(uint64_t value, uint64_t hash) {
+  return hashBytes({reinterpret_cast<const unsigned char *>(&value), 8}, hash);
+}
+
+bool hasAlpha(std::span<const unsigned char> rgba, size_t texelCount) {
+  for (size_t i = 0; i < texelCount; ++i)
+    if (rgba[i * 4 + 3] != 255)
+      return true;
+  return false;
+}
+
+} // namespace
+
+uint64_t TextureCompressionSettings::hash() const {
+  auto ret = hashValue(BlockCompression::ENCODER_VERSION, FNV_OFFSET);
+  return hashValue(highQuality, ret);
+}
+
+TextureCompressor::TextureCompressor(
+    TextureCompressionSettings settings,
+    std::optional<std::filesystem::path> cacheDirectory)
+    : m_settings(settings), m_cacheDirectory(std::move(cacheDirectory)) {
+  if (m_cacheDirectory)
+    std::filesystem::create_directories(*m_cacheDirectory);
+}
+
+VkFormat TextureCompressor::formatFor(TextureRole role, bool hasAlpha) const {
+  switch (role) {
+  case TextureRole::Color:
+    if (m_settings.highQuality)
+      return VK_FORMAT_BC7_UNORM_BLOCK;
+    return hasAlpha ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+  case TextureRole::Normal:
+    return VK_FORMAT_BC5_UNORM_BLOCK;
+  case TextureRole::MetallicRoughness:
+    return m_settings.highQuality ? VK_FORMAT_BC7_UNORM_BLOCK
+                                  : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+  case TextureRole::Mask:
+    return VK_FORMAT_BC4_UNORM_BLOCK;
+  }
+  throw std::runtime_error("Texture import failed: unknown texture role");
+}
+
+CompressedTexture
+TextureCompressor::compress(std::span<const unsigned char> rgbaChain,
+                            size_t width, size_t height, uint32_t mipLevels,
+                            TextureRole role) const {
+  auto format =
+      formatFor(role, role == TextureRole::Color &&
+                          hasAlpha(rgbaChain, width * height));
+
+  std::optional<std::filesystem::path> cachePath;
+
+  if (m_cacheDirectory) {
+    // mip levels are derived from the base one, so hashing it is enough
+    auto key = hashBytes(rgbaChain.subspan(0, width * height * 4));
+    key = hashValue(width, key);
+    key = hashValue(height, key);
+    key = hashValue(mipLevels, key);
+    key = hashValue(format, key);
+    key = hashValue(m_settings.hash(), key);
+
+    char name[24];
+    snprintf(name, sizeof(name), "%016llx.bctex",
+             static_cast<unsigned long long>(key));
+    cachePath = *m_cacheDirectory / name;
+
+    if (auto cached = m_load(*cachePath, format, width, height, mipLevels))
+      return std::move(*cached);
+  }
+
+  CompressedTexture ret{format,
+                        BlockCompression::compressMipChain(
+                            rgbaChain, format, width, height, mipLevels)};
+
+  if (cachePath)
+    m_store(*cachePath, ret, width, height, mipLevels);
+
+  return ret;
+}
+
+std::optional<CompressedTexture>
+TextureCompressor::m_load(std::filesystem::path const &path, VkFormat format,
+                          size_t width, size_t height,
+                          uint32_t mipLevels) const {
+  std::ifstream is(path, std::ios::binary | std::ios::in);
+  if (!is.is_open())
+    return std::nullopt;
+
+  CacheHeader header{};
+  is.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+  // hash collisions are astronomically unlikely, but truncated or foreign
+  // files are not
+  if (!is || memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+      header.encoderVersion != BlockCompression::ENCODER_VERSION ||
+      header.format != format || header.width != width ||
+      header.height != height || header.mipLevels != mipLevels) {
+    std::cout << "[TEXTURE][WARNING]: ignoring cache entry "
+              << path.generic_string() << std::endl;
+    return std::nullopt;
+  }
+
+  CompressedTexture ret{format, std::vector<unsigned char>(header.size)};
+  is.read(reinterpret_cast<char *>(ret.mipChain.data()), header.size);
+  if (!is)
+    return std::nullopt;
+
+  return ret;
+}
+
+void TextureCompressor::m_store(std::filesystem::path const &path,
+                                CompressedTexture const &texture,
+                                size_t width, size_t height,
+                                uint32_t mipLevels) const {
+  CacheHeader header{};
+  memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+  header.encoderVersion = BlockCompression::ENCODER_VERSION;
+  header.format = texture.format;
+  header.width = width;
+  header.height = height;
+  header.mipLevels = mipLevels;
+  header.size = texture.mipChain.size();
+
+  auto temporary = path;
+  temporary += ".tmp";
+
+  {
+    std::ofstream os(temporary, std::ios::binary | std::ios::trunc);
+    if (!os.is_open())
+      throw std::runtime_error("Texture import failed: cannot open " +
+                               temporary.generic_string() + " for writing");
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    os.write(reinterpret_cast<const char *>(texture.mipChain.data()),
+             texture.mipChain.size());
+    if (!os)
+      throw std::runtime_error("Texture import failed: failed to write " +
+                               temporary.generic_string());
+  }
+
+  std::filesystem::rename(temporary, path);
+}
+
+} // namespace RenderEngine
@@ -0,0 +1,72 @@
+#ifndef TESTAPP_TEXTURECOMPRESSOR_H
+#define TESTAPP_TEXTURECOMPRESSOR_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace RenderEngine {
+
+/** How texture is sampled, decides which channels must survive compression.
+ */
+enum class TextureRole {
+  Color,
+  // tangent space normal in red and green, blue is reconstructed in shader
+  Normal,
+  // glTF layout: roughness in green, metallic in blue
+  MetallicRoughness,
+  // single channel in red
+  Mask
+};
+
+struct TextureCompressionSettings {
+  // BC7 for color and metallic-roughness maps, BC1/BC3 otherwise
+  bool highQuality = true;
+
+  /** Hash of settings affecting encoder output. */
+  uint64_t hash() const;
+};
+
+struct CompressedTexture {
+  VkFormat format;
+  std::vector<unsigned char> mipChain;
+};
+
+/** Encodes RGBA8 mip chains into BCn formats. Results are optionally kept in
+ *  cache directory keyed by hash of source texels and encoder settings, so
+ *  every texture is encoded only once.
+ */
+class TextureCompressor {
+public:
+  explicit TextureCompressor(
+      TextureCompressionSettings settings = {},
+      std::optional<std::filesystem::path> cacheDirectory = std::nullopt);
+
+  TextureCompressionSettings const &settings() const { return m_settings; }
+
+  VkFormat formatFor(TextureRole role, bool hasAlpha) const;
+
+  /** @param rgbaChain tightly packed RGBA8 mip chain */
+  CompressedTexture compress(std::span<const unsigned char> rgbaChain,
+                             size_t width, size_t height, uint32_t mipLevels,
+                             TextureRole role) const;
+
+private:
+  std::optional<CompressedTexture> m_load(std::filesystem::path const &path,
+                                          VkFormat format, size_t width,
+                                          size_t height,
+                                          uint32_t mipLevels) const;
+
+  void m_store(std::filesystem::path const &path,
+               CompressedTexture const &texture, size_t width, size_t height,
+               uint32_t mipLevels) const;
+
+  TextureCompressionSettings m_settings;
+  std::optional<std::filesystem::path> m_cacheDirectory;
+};
+
+} // namespace RenderEngine
+#endif // TESTAPP_TEXTURECOMPRESSOR_H
@@ -0,0 +1,271 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <deque>
+#include <exception>
+
+namespace RenderEngine {
+
+class JobSystem::Job {
+public:
+  std::function<void()> task;
+  // spawning job, finishes after this one
+  JobHandle parent;
+  // task and spawned jobs not done yet
+  std::atomic<uint32_t> unfinished = 1;
+  // unfinished dependencies, plus one while the job is being scheduled
+  std::atomic<uint32_t> blockers = 1;
+  std::atomic<bool> done = false;
+
+  std::mutex mutex;
+  // guarded by mutex
+  bool completed = false;
+  std::vector<JobHandle> dependents;
+  std::exception_ptr error;
+};
+
+class JobSystem::M_Queue {
+public:
+  void push(JobHandle job) {
+    std::lock_guard lock{m_mutex};
+    m_jobs.push_back(std::move(job));
+  }
+
+  /** Newest job, its data is likely still in cache of the owner. */
+  JobHandle pop() {
+    std::lock_guard lock{m_mutex};
+    if (m_jobs.empty())
+      return nullptr;
+    auto job = std::move(m_jobs.back());
+    m_jobs.pop_back();
+    return job;
+  }
+
+  /** Oldest job, usually the largest piece of split work. */
+  JobHandle steal() {
+    std::lock_guard lock{m_mutex};
+    if (m_jobs.empty())
+      return nullptr;
+    auto job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+    return job;
+  }
+
+private:
+  std::mutex m_mutex;
+  std::deque<JobHandle> m_jobs;
+};
+
+namespace {
+
+// pool the current thread works for, if any, and index of its deque
+thread_local JobSystem const *t_system = nullptr;
+thread_local unsigned t_queue = 0;
+// job whose task runs on the current thread
+thread_local JobSystem::JobHandle const *t_running = nullptr;
+
+} // namespace
+
+JobSystem::JobSystem(unsigned workerCount) {
+  for (unsigned i = 0; i <= workerCount; ++i)
+    m_queues.emplace_back(std::make_unique<M_Queue>());
+
+  m_workers.reserve(workerCount);
+  for (unsigned i = 0; i < workerCount; ++i)
+    m_workers.emplace_back([this, i]() { m_work(i); });
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard lock{m_sleepMutex};
+    m_stopping = true;
+  }
+  m_wake.notify_all();
+
+  for (auto &worker : m_workers)
+    worker.join();
+}
+
+JobSystem &JobSystem::shared() {
+  static JobSystem system;
+  return system;
+}
+
+unsigned JobSystem::defaultWorkerCount() {
+  return std::max(std::thread::hardware_concurrency(), 2u) - 1;
+}
+
+JobSystem::JobHandle
+JobSystem::schedule(std::function<void()> task,
+                    std::span<const JobHandle> dependencies) {
+  auto job = std::make_shared<Job>();
+  job->task = std::move(task);
+
+  for (auto &dependency : dependencies) {
+    std::lock_guard lock{dependency->mutex};
+    if (dependency->completed)
+      continue;
+    job->blockers++;
+    dependency->dependents.push_back(job);
+  }
+
+  if (job->blockers.fetch_sub(1) == 1)
+    m_push(job);
+
+  return job;
+}
+
+JobSystem::JobHandle
+JobSystem::parallelFor(size_t count, size_t grainSize,
+                       std::function<void(size_t, size_t)> body,
+                       std::span<const JobHandle> dependencies) {
+  grainSize = std::max<size_t>(grainSize, 1);
+  auto shared = std::make_shared<std::function<void(size_t, size_t)>>(
+      std::move(body));
+
+  return schedule(
+      [this, count, grainSize, shared]() {
+        m_split(*t_running, 0, count, grainSize, shared);
+      },
+      dependencies);
+}
+
+void JobSystem::wait(JobHandle const &job) {
+  while (!job->done.load(std::memory_order_acquire)) {
+    if (auto next = m_find())
+      m_run(next);
+    else
+      std::this_thread::yield();
+  }
+
+  std::exception_ptr error;
+  {
+    std::lock_guard lock{job->mutex};
+    error = job->error;
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+bool JobSystem::finished(JobHandle const &job) const {
+  return job->done.load(std::memory_order_acquire);
+}
+
+void JobSystem::m_work(unsigned queue) {
+  t_system = this;
+  t_queue = queue;
+
+  for (;;) {
+    if (auto job = m_find()) {
+      m_run(job);
+      continue;
+    }
+
+    std::unique_lock lock{m_sleepMutex};
+    m_sleeping++;
+    m_wake.wait(lock, [this]() { return m_stopping || m_queued > 0; });
+    m_sleeping--;
+    if (m_stopping && m_queued == 0)
+      return;
+  }
+}
+
+unsigned JobSystem::m_queueIndex() const {
+  return t_system == this ? t_queue : m_workers.size();
+}
+
+void JobSystem::m_push(JobHandle job) {
+  m_queues.at(m_queueIndex())->push(std::move(job));
+  m_queued++;
+
+  // sleeping worker checks m_queued after announcing itself, so either it
+  // sees the job or the job's owner sees it sleeping
+  if (m_sleeping > 0) {
+    std::lock_guard lock{m_sleepMutex};
+    m_wake.notify_one();
+  }
+}
+
+JobSystem::JobHandle JobSystem::m_find() {
+  auto own = m_queueIndex();
+  auto job = m_queues[own]->pop();
+
+  for (size_t i = 1; !job && i < m_queues.size(); ++i)
+    job = m_queues[(own + i) % m_queues.size()]->steal();
+
+  if (job)
+    m_queued--;
+  return job;
+}
+
+void JobSystem::m_run(JobHandle const &job) {
+  auto *outer = t_running;
+  t_running = &job;
+
+  try {
+    job->task();
+  } catch (...) {
+    std::lock_guard lock{job->mutex};
+    if (!job->error)
+      job->error = std::current_exception();
+  }
+
+  t_running = outer;
+  // releases captures as soon as possible
+  job->task = nullptr;
+  m_finish(job);
+}
+
+void JobSystem::m_finish(JobHandle const &job) {
+  if (job->unfinished.fetch_sub(1) != 1)
+    return;
+
+  std::vector<JobHandle> dependents;
+  std::exception_ptr error;
+  {
+    std::lock_guard lock{job->mutex};
+    job->completed = true;
+    dependents.swap(job->dependents);
+    error = job->error;
+  }
+
+  auto parent = std::move(job->parent);
+  if (parent && error) {
+    std::lock_guard lock{parent->mutex};
+    if (!parent->error)
+      parent->error = error;
+  }
+
+  job->done.store(true, std::memory_order_release);
+
+  for (auto &dependent : dependents)
+    if (dependent->blockers.fetch_sub(1) == 1)
+      m_push(std::move(dependent));
+
+  if (parent)
+    m_finish(parent);
+}
+
+void JobSystem::m_spawn(JobHandle const &parent, std::function<void()> task) {
+  auto job = std::make_shared<Job>();
+  job->task = std::move(task);
+  job->parent = parent;
+  job->blockers = 0;
+  parent->unfinished++;
+  m_push(std::move(job));
+}
+
+void JobSystem::m_split(JobHandle const &parent, size_t begin, size_t end,
+                        size_t grainSize, M_Body const &body) {
+  while (end - begin > grainSize) {
+    auto middle = begin + (end - begin) / 2;
+    m_spawn(parent, [this, middle, end, grainSize, body]() {
+      m_split(*t_running, middle, end, grainSize, body);
+    });
+    end = middle;
+  }
+
+  if (begin < end)
+    (*body)(begin, end);
+}
+
+} // namespace RenderEngine
@@ -0,0 +1,104 @@
+#ifndef TESTAPP_JOBSYSTEM_H
+#define TESTAPP_JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace RenderEngine {
+
+/** Persistent pool of worker threads executing jobs.
+ *
+ *  Every worker owns a deque: jobs it schedules are pushed to and popped
+ *  from its back, idle workers steal the oldest jobs from the front of
+ *  other deques. Threads outside of the pool share one more deque. Job is
+ *  finished when its task and all jobs spawned by it are done, jobs
+ *  depending on it are queued then. Waiting thread executes queued jobs
+ *  instead of blocking, so jobs may wait for other jobs.
+ */
+class JobSystem {
+public:
+  class Job;
+
+  using JobHandle = std::shared_ptr<Job>;
+
+  /** @param workerCount  threads besides the ones waiting for jobs */
+  explicit JobSystem(unsigned workerCount = defaultWorkerCount());
+
+  JobSystem(JobSystem const &another) = delete;
+
+  JobSystem &operator=(JobSystem const &another) = delete;
+
+  /** Finishes all queued jobs before the workers are joined. */
+  ~JobSystem();
+
+  /** Instance shared by the whole application. */
+  static JobSystem &shared();
+
+  /** One less than hardware threads, as the waiting thread helps. */
+  static unsigned defaultWorkerCount();
+
+  unsigned workerCount() const { return m_workers.size(); }
+
+  /** Queues task once all dependencies are finished. */
+  JobHandle schedule(std::function<void()> task,
+                     std::span<const JobHandle> dependencies = {});
+
+  /** Calls body(begin, end) for subranges of [0, count) no longer than
+   *  grainSize. Range is split in halves by jobs, so idle workers steal
+   *  large ranges first.
+   */
+  JobHandle parallelFor(size_t count, size_t grainSize,
+                        std::function<void(size_t, size_t)> body,
+                        std::span<const JobHandle> dependencies = {});
+
+  /** Executes queued jobs until job is finished. Rethrows the first
+   *  exception thrown by job or jobs spawned by it.
+   */
+  void wait(JobHandle const &job);
+
+  bool finished(JobHandle const &job) const;
+
+private:
+  class M_Queue;
+
+  using M_Body = std::shared_ptr<std::function<void(size_t, size_t)>>;
+
+  void m_work(unsigned queue);
+
+  unsigned m_queueIndex() const;
+
+  void m_push(JobHandle job);
+
+  JobHandle m_find();
+
+  void m_run(JobHandle const &job);
+
+  /** Counts down task or spawned job of job, completes it at zero. */
+  void m_finish(JobHandle const &job);
+
+  /** Queues child of running parent, parent finishes after it. */
+  void m_spawn(JobHandle const &parent, std::function<void()> task);
+
+  void m_split(JobHandle const &parent, size_t begin, size_t end,
+               size_t grainSize, M_Body const &body);
+
+  // deque of each worker followed by deque shared by other threads
+  std::vector<std::unique_ptr<M_Queue>> m_queues;
+  std::vector<std::thread> m_workers;
+  // jobs in deques, workers sleep while it is zero
+  std::atomic<size_t> m_queued = 0;
+  std::atomic<unsigned> m_sleeping = 0;
+  std::mutex m_sleepMutex;
+  std::condition_variable m_wake;
+  bool m_stopping = false;
+};
+
+} // namespace RenderEngine
+#endif // TESTAPP_JOBSYSTEM_H
@@ -2,8 +2,9 @@
 #include <array>
 
 namespace RenderEngine {
-ShaderLoader::ShaderLoader(vkw::Device &device, std::string shaderLoadPath)
-    : ShaderImporter(device, shaderLoadPath),
+ShaderLoader::ShaderLoader(vkw::Device &device, std::string shaderLoadPath,
+                           AssetPackDirectory pack)
+    : ShaderImporter(device, shaderLoadPath, std::move(pack)),
       m_general_vert(loadModule("general.vert")),
       m_general_frag(loadModule("general.frag")) {}
 
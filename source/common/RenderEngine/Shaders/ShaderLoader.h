@@ -9,7 +9,8 @@ namespace RenderEngine {
 
 class ShaderLoader : public ShaderLoaderInterface, public ShaderImporter {
 public:
-  ShaderLoader(vkw::Device &device, std::string shaderLoadPath);
+  ShaderLoader(vkw::Device &device, std::string shaderLoadPath,
+               AssetPackDirectory pack = {});
   vkw::SPIRVModule loadModule(std::string_view name) override;
   vkw::VertexShader const &
   loadVertexShader(RenderEngine::GeometryLayout const &geometry,
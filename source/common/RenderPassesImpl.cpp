@@ -6,24 +6,28 @@
 #include <span>
 vkw::RenderPassCreateInfo
 TestApp::LightPass::m_compile_info(VkFormat colorFormat, VkFormat depthFormat,
-                                   VkImageLayout colorLayout) {
+                                   VkImageLayout colorLayout,
+                                   VkAttachmentLoadOp loadOp) {
   auto attachmentDescription =
       vkw::AttachmentDescription{colorFormat,
                                  VK_SAMPLE_COUNT_1_BIT,
-                                 VK_ATTACHMENT_LOAD_OP_CLEAR,
+                                 loadOp,
                                  VK_ATTACHMENT_STORE_OP_STORE,
                                  VK_ATTACHMENT_LOAD_OP_DONT_CARE,
                                  VK_ATTACHMENT_STORE_OP_DONT_CARE,
                                  colorLayout,
                                  colorLayout};
+  // loaded depth must be left by previous pass in attachment layout
   auto depthAttachment = vkw::AttachmentDescription{
       depthFormat,
       VK_SAMPLE_COUNT_1_BIT,
-      VK_ATTACHMENT_LOAD_OP_CLEAR,
-      VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      loadOp,
+      VK_ATTACHMENT_STORE_OP_STORE,
       VK_ATTACHMENT_LOAD_OP_DONT_CARE,
       VK_ATTACHMENT_STORE_OP_DONT_CARE,
-      VK_IMAGE_LAYOUT_UNDEFINED,
+      loadOp == VK_ATTACHMENT_LOAD_OP_LOAD
+          ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+          : VK_IMAGE_LAYOUT_UNDEFINED,
       VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
   m_attachments.push_back(attachmentDescription);
   m_attachments.push_back(depthAttachment);
@@ -57,39 +61,80 @@ TestApp::LightPass::m_compile_info(VkFormat colorFormat, VkFormat depthFormat,
       {inputDependency, outputDependency}};
 }
 
+namespace {
+
 vkw::RenderPassCreateInfo
-TestApp::ShadowPass::m_compile_info(VkFormat attachmentFormat) {
+depthOnlyPassInfo(std::vector<vkw::AttachmentDescription> &attachments,
+                  VkFormat attachmentFormat, VkAttachmentLoadOp loadOp,
+                  VkImageLayout initialLayout, VkImageLayout finalLayout) {
   auto depthAttachment =
       vkw::AttachmentDescription{attachmentFormat,
                                  VK_SAMPLE_COUNT_1_BIT,
-                                 VK_ATTACHMENT_LOAD_OP_CLEAR,
+                                 loadOp,
                                  VK_ATTACHMENT_STORE_OP_STORE,
                                  VK_ATTACHMENT_LOAD_OP_DONT_CARE,
                                  VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                                 VK_IMAGE_LAYOUT_UNDEFINED,
-                                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
-  m_attachments.push_back(depthAttachment);
+                                 initialLayout,
+                                 finalLayout};
+  attachments.push_back(depthAttachment);
   auto subpassDescription = vkw::SubpassDescription{};
   subpassDescription.addDepthAttachment(
-      m_attachments.at(0), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+      attachments.at(0), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 
+  // depth may come from a copy and go to a copy, which are not framebuffer
+  // local, so dependencies are not by region
   auto inputDependency = vkw::SubpassDependency{};
   inputDependency.setDstSubpass(subpassDescription);
-  inputDependency.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  inputDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-  inputDependency.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  inputDependency.srcAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  inputDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  inputDependency.srcStageMask =
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
   inputDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  inputDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+  inputDependency.dependencyFlags = 0;
 
   auto outputDependency = vkw::SubpassDependency{};
   outputDependency.setSrcSubpass(subpassDescription);
   outputDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-  outputDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  outputDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  outputDependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  outputDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+  outputDependency.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+  outputDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                  VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  outputDependency.dstStageMask =
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+  outputDependency.dependencyFlags = 0;
 
-  return vkw::RenderPassCreateInfo{{m_attachments.at(0)},
+  return vkw::RenderPassCreateInfo{{attachments.at(0)},
                                    {subpassDescription},
                                    {inputDependency, outputDependency}};
 }
+
+} // namespace
+
+vkw::RenderPassCreateInfo
+TestApp::ShadowPass::m_compile_info(VkFormat attachmentFormat,
+                                    VkAttachmentLoadOp loadOp,
+                                    VkImageLayout initialLayout,
+                                    VkImageLayout finalLayout) {
+  return depthOnlyPassInfo(m_attachments, attachmentFormat, loadOp,
+                           initialLayout, finalLayout);
+}
+
+vkw::RenderPassCreateInfo TestApp::LayeredShadowPass::m_compile_info(
+    VkFormat attachmentFormat, uint32_t layerCount, VkAttachmentLoadOp loadOp,
+    VkImageLayout initialLayout, VkImageLayout finalLayout) {
+  m_viewMask = (1u << layerCount) - 1u;
+  m_multiview.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+  m_multiview.pNext = nullptr;
+  m_multiview.subpassCount = 1;
+  m_multiview.pViewMasks = &m_viewMask;
+  // all views are rendered at once, so they may share vertex shading
+  m_multiview.correlationMaskCount = 1;
+  m_multiview.pCorrelationMasks = &m_viewMask;
+
+  auto ret = depthOnlyPassInfo(m_attachments, attachmentFormat, loadOp,
+                               initialLayout, finalLayout);
+  ret.pNext = &m_multiview;
+  return ret;
+}
@@ -9,30 +9,77 @@ public:
 protected:
   std::vector<vkw::AttachmentDescription> m_attachments;
 };
+/** On screen pass. Depth is stored, so it can be read after the pass. Pass
+ *  loading attachments continues the one clearing them and is compatible
+ *  with it.
+ */
 class LightPass : public PassBase, public vkw::RenderPass {
 public:
   using PassBase::m_attachments;
   LightPass(vkw::Device &device, VkFormat colorFormat, VkFormat depthFormat,
-            VkImageLayout colorLayout)
-      : vkw::RenderPass(device,
-                        m_compile_info(colorFormat, depthFormat, colorLayout)) {
-
-  }
+            VkImageLayout colorLayout,
+            VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR)
+      : vkw::RenderPass(device, m_compile_info(colorFormat, depthFormat,
+                                               colorLayout, loadOp)) {}
 
 private:
   vkw::RenderPassCreateInfo m_compile_info(VkFormat colorFormat,
                                            VkFormat depthFormat,
-                                           VkImageLayout colorLayout);
+                                           VkImageLayout colorLayout,
+                                           VkAttachmentLoadOp loadOp);
 };
 
+/** Depth only pass. Passes differing only in load operation and layouts
+ *  are compatible, so they share pipelines.
+ */
 class ShadowPass : public PassBase, public vkw::RenderPass {
 public:
   using PassBase::m_attachments;
-  ShadowPass(vkw::Device &device, VkFormat depthFormat)
-      : vkw::RenderPass(device, m_compile_info(depthFormat)) {}
+  ShadowPass(vkw::Device &device, VkFormat depthFormat,
+             VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+             VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+             VkImageLayout finalLayout =
+                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+      : vkw::RenderPass(device, m_compile_info(depthFormat, loadOp,
+                                               initialLayout, finalLayout)) {}
+
+private:
+  vkw::RenderPassCreateInfo m_compile_info(VkFormat attachmentFormat,
+                                           VkAttachmentLoadOp loadOp,
+                                           VkImageLayout initialLayout,
+                                           VkImageLayout finalLayout);
+};
+
+class MultiviewBase {
+protected:
+  VkRenderPassMultiviewCreateInfo m_multiview{};
+  uint32_t m_viewMask = 0;
+};
+
+/** Depth only pass rendering each layer of array attachment as a separate
+ *  view in a single subpass. Requires VK_KHR_multiview.
+ */
+class LayeredShadowPass : public PassBase,
+                          public MultiviewBase,
+                          public vkw::RenderPass {
+public:
+  using PassBase::m_attachments;
+  LayeredShadowPass(vkw::Device &device, VkFormat depthFormat,
+                    uint32_t layerCount,
+                    VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                    VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    VkImageLayout finalLayout =
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+      : vkw::RenderPass(device,
+                        m_compile_info(depthFormat, layerCount, loadOp,
+                                       initialLayout, finalLayout)) {}
 
 private:
-  vkw::RenderPassCreateInfo m_compile_info(VkFormat attachmentFormat);
+  vkw::RenderPassCreateInfo m_compile_info(VkFormat attachmentFormat,
+                                           uint32_t layerCount,
+                                           VkAttachmentLoadOp loadOp,
+                                           VkImageLayout initialLayout,
+                                           VkImageLayout finalLayout);
 };
 
 } // namespace TestApp
@@ -0,0 +1,139 @@
+#include "ResidencyManager.h"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace TestApp {
+
+ResidencyManager::ResidencyManager(vkw::Device &device, Settings settings)
+    : m_device(device), m_settings(settings) {
+  VkPhysicalDeviceMemoryProperties const *properties;
+  vmaGetMemoryProperties(device.getAllocator(), &properties);
+
+  for (uint32_t heap = 0; heap < properties->memoryHeapCount; ++heap)
+    if (properties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+      m_localHeaps |= 1u << heap;
+}
+
+uint32_t ResidencyManager::add(Asset &asset) {
+  Entry entry{&asset, m_frame};
+
+  if (m_free.empty()) {
+    m_assets.push_back(entry);
+    return m_assets.size() - 1;
+  }
+
+  auto index = m_free.back();
+  m_free.pop_back();
+  m_assets[index] = entry;
+  return index;
+}
+
+void ResidencyManager::remove(uint32_t asset) {
+  auto &entry = m_assets.at(asset);
+  if (!entry.asset)
+    throw std::runtime_error("[RESIDENCY][ERROR] asset is already removed");
+
+  entry = Entry{};
+  std::erase(m_requests, asset);
+  std::erase(m_restoring, asset);
+  m_free.push_back(asset);
+}
+
+bool ResidencyManager::use(uint32_t asset) {
+  auto &entry = m_assets.at(asset);
+  entry.lastUsed = m_frame;
+
+  if (entry.restoring)
+    return false;
+  if (entry.asset->residentBytes() != 0)
+    return true;
+
+  if (!entry.requested) {
+    entry.requested = true;
+    m_requests.push_back(asset);
+  }
+  return false;
+}
+
+void ResidencyManager::update(vkw::CommandBuffer &buffer) {
+  m_frame++;
+
+  // previous frame has finished, restores recorded by it are complete
+  for (auto i : m_restoring) {
+    m_assets[i].asset->finishRestore();
+    m_assets[i].restoring = false;
+  }
+  m_restoring.clear();
+
+  std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+  vmaGetHeapBudgets(m_device.get().getAllocator(), budgets.data());
+
+  size_t budget = 0;
+  size_t usage = 0;
+  for (uint32_t heap = 0; heap < VK_MAX_MEMORY_HEAPS; ++heap) {
+    if (!(m_localHeaps & (1u << heap)))
+      continue;
+    budget += budgets[heap].budget;
+    usage += budgets[heap].usage;
+  }
+
+  budget = static_cast<size_t>(budget * m_settings.budgetFraction);
+  m_headroom = static_cast<int64_t>(budget) - static_cast<int64_t>(usage);
+
+  if (m_headroom < 0) {
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < m_assets.size(); ++i) {
+      auto &entry = m_assets[i];
+      if (entry.asset && entry.asset->residentBytes() != 0 &&
+          entry.lastUsed + m_settings.minIdleFrames <= m_frame)
+        candidates.push_back(i);
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [this](uint32_t a, uint32_t b) {
+                       return m_assets[a].lastUsed < m_assets[b].lastUsed;
+                     });
+
+    for (auto i : candidates) {
+      if (m_headroom >= 0)
+        break;
+      auto &asset = *m_assets[i].asset;
+      auto freed = asset.residentBytes();
+      asset.evict();
+      m_headroom += static_cast<int64_t>(freed);
+      usage -= std::min(usage, freed);
+      m_statistics.evictions++;
+    }
+  }
+
+  for (auto i : m_requests) {
+    auto &entry = m_assets[i];
+    entry.requested = false;
+    if (entry.asset->residentBytes() != 0)
+      continue;
+    entry.asset->restore(buffer);
+    entry.restoring = true;
+    m_restoring.push_back(i);
+    m_statistics.restores++;
+  }
+  m_requests.clear();
+
+  m_statistics.budget = budget;
+  m_statistics.usage = usage;
+  m_statistics.residentBytes = 0;
+  m_statistics.resident = 0;
+  m_statistics.evicted = 0;
+  for (auto &entry : m_assets) {
+    if (!entry.asset)
+      continue;
+    auto bytes = entry.asset->residentBytes();
+    m_statistics.residentBytes += bytes;
+    if (bytes != 0)
+      m_statistics.resident++;
+    else
+      m_statistics.evicted++;
+  }
+}
+
+} // namespace TestApp
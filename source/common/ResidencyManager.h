@@ -0,0 +1,123 @@
+#ifndef TESTAPP_RESIDENCYMANAGER_H
+#define TESTAPP_RESIDENCYMANAGER_H
+
+#include <cstdint>
+#include <vector>
+#include <vkw/CommandBuffer.hpp>
+#include <vkw/Device.hpp>
+
+namespace TestApp {
+
+/** Keeps device local memory used by the application within the budget
+ *  reported for its heaps.
+ *
+ *  Heap usage and budget are queried from the allocator every frame. They
+ *  come from VK_EXT_memory_budget when the device has it enabled, otherwise
+ *  the allocator estimates them from its own allocations. While usage is
+ *  over budget, assets that were not used recently are evicted least
+ *  recently used first. Evicted asset keeps its source in host memory.
+ *  Using it requests a restore, which the next update records into the
+ *  frame command buffer. The asset stays unusable until that frame has
+ *  finished execution, so no frame waits for the upload.
+ */
+class ResidencyManager : public vkw::ReferenceGuard {
+public:
+  /** Device resource that can be released and reloaded from its source. */
+  class Asset {
+  public:
+    /** Device memory held by the asset, 0 while it is evicted. */
+    virtual size_t residentBytes() const = 0;
+
+    /** Releases device memory. Called only when no pending commands
+     *  reference the asset.
+     */
+    virtual void evict() = 0;
+
+    /** Records upload of evicted asset from its source into buffer. Upload
+     *  resources must be kept until finishRestore().
+     */
+    virtual void restore(vkw::CommandBuffer &buffer) = 0;
+
+    /** Called once commands recorded by restore() finished execution. */
+    virtual void finishRestore() = 0;
+
+  protected:
+    ~Asset() = default;
+  };
+
+  struct Settings {
+    // fraction of heap budget the application may use
+    float budgetFraction = 0.9f;
+    // assets used within this many frames are never evicted
+    uint32_t minIdleFrames = 2;
+  };
+
+  struct Statistics {
+    size_t budget = 0;
+    size_t usage = 0;
+    size_t residentBytes = 0;
+    uint32_t resident = 0;
+    uint32_t evicted = 0;
+    uint32_t evictions = 0;
+    uint32_t restores = 0;
+  };
+
+  explicit ResidencyManager(vkw::Device &device, Settings settings = {});
+
+  /** Asset must outlive its registration. Returned index may be reused
+   *  after remove().
+   */
+  uint32_t add(Asset &asset);
+
+  void remove(uint32_t asset);
+
+  /** Marks asset used by the current frame and requests its restore if it
+   *  is evicted. Must be called before commands referencing the asset are
+   *  recorded.
+   *
+   *  @return false if the asset must not be used by the current frame
+   */
+  bool use(uint32_t asset);
+
+  /** Queries heap budgets, evicts assets while usage exceeds budget and
+   *  records restores of requested assets into buffer. Must be called once
+   *  per frame after previous frame finished execution, outside of render
+   *  pass and before commands using the assets.
+   */
+  void update(vkw::CommandBuffer &buffer);
+
+  /** Device local memory that may still be allocated within the budget as
+   *  of the last update, negative when usage is over budget.
+   */
+  int64_t headroom() const { return m_headroom; }
+
+  Settings &settings() { return m_settings; }
+
+  Statistics const &statistics() const { return m_statistics; }
+
+private:
+  struct Entry {
+    Asset *asset = nullptr;
+    uint64_t lastUsed = 0;
+    bool requested = false;
+    // restore is recorded, but the frame has not finished yet
+    bool restoring = false;
+  };
+
+  vkw::StrongReference<vkw::Device> m_device;
+  Settings m_settings;
+  Statistics m_statistics;
+  // bit per heap of device local memory
+  uint32_t m_localHeaps = 0;
+  uint64_t m_frame = 0;
+  int64_t m_headroom = 0;
+
+  std::vector<Entry> m_assets;
+  // indices of removed assets
+  std::vector<uint32_t> m_free;
+  std::vector<uint32_t> m_requests;
+  std::vector<uint32_t> m_restoring;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_RESIDENCYMANAGER_H
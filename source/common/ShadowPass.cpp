@@ -1,10 +1,122 @@
 #include "common/ShadowPass.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 namespace TestApp {
 
+namespace {
+
+ShadowRenderPass::ShadowArrayT createDepthArray(vkw::Device &device,
+                                                VkImageUsageFlags usage) {
+  return ShadowRenderPass::ShadowArrayT{
+      device.getAllocator(),
+      VmaAllocationCreateInfo{.usage = VMA_MEMORY_USAGE_GPU_ONLY,
+                              .requiredFlags =
+                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT},
+      VK_FORMAT_D32_SFLOAT,
+      ShadowRenderPass::MAP_SIZE,
+      ShadowRenderPass::MAP_SIZE,
+      1,
+      TestApp::SHADOW_CASCADES_COUNT,
+      1,
+      usage | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+}
+
+/** Moves center along light space axes to the nearest shadow map texel
+ *  corner of cascade with given radius.
+ */
+glm::vec3 snapToTexels(glm::vec3 center, float radius, glm::vec3 lightDir) {
+  auto view = glm::lookAt(glm::vec3{0.0f}, lightDir,
+                          glm::vec3{0.0f, 1.0f, 0.0f});
+  auto texel = 2.0f * radius / static_cast<float>(ShadowRenderPass::MAP_SIZE);
+  auto lightSpace = view * glm::vec4(center, 1.0f);
+  lightSpace.x = std::floor(lightSpace.x / texel) * texel;
+  lightSpace.y = std::floor(lightSpace.y / texel) * texel;
+  return glm::vec3(glm::inverse(view) * lightSpace);
+}
+
+vkw::FrameBuffer
+layeredFrameBuffer(vkw::Device &device, vkw::RenderPass &pass,
+                   vkw::ImageView<vkw::DEPTH, vkw::V2DA> const &view) {
+  auto *viewPtr = static_cast<vkw::ImageViewVT<vkw::V2DA> const *>(&view);
+  return vkw::FrameBuffer{
+      device, pass,
+      VkExtent2D{ShadowRenderPass::MAP_SIZE, ShadowRenderPass::MAP_SIZE},
+      std::span<vkw::ImageViewVT<vkw::V2DA> const *>{&viewPtr, 1}};
+}
+
+} // namespace
+
+/** Passes, pipeline stages and framebuffers rendering all cascades at once
+ *  as views of a multiview pass.
+ */
+struct ShadowRenderPass::M_Layered {
+  struct LayeredProjection : public RenderEngine::Projection {
+    LayeredProjection(RenderEngine::ProjectionLayout &layout,
+                      vkw::UniformBuffer<ShadowMapSpace> const &ubo)
+        : RenderEngine::Projection(layout) {
+      set().write(0, ubo);
+    }
+  };
+
+  M_Layered(vkw::Device &device,
+            RenderEngine::ShaderLoaderInterface &shaderLoader,
+            vkw::UniformBuffer<ShadowMapSpace> const &ubo,
+            ShadowArrayT &cascades, ShadowArrayT &staticCache)
+      : pass(device, VK_FORMAT_D32_SFLOAT, TestApp::SHADOW_CASCADES_COUNT),
+        staticPass(device, VK_FORMAT_D32_SFLOAT,
+                   TestApp::SHADOW_CASCADES_COUNT, VK_ATTACHMENT_LOAD_OP_CLEAR,
+                   VK_IMAGE_LAYOUT_UNDEFINED,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL),
+        dynamicPass(device, VK_FORMAT_D32_SFLOAT,
+                    TestApp::SHADOW_CASCADES_COUNT, VK_ATTACHMENT_LOAD_OP_LOAD,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+        projectionLayout(device, shaderLoader,
+                         RenderEngine::SubstageDescription{
+                             .shaderSubstageName = "shadow_layered"},
+                         1),
+        projection(projectionLayout, ubo),
+        lightingLayout(
+            device, shaderLoader,
+            RenderEngine::LightingLayout::CreateInfo{
+                .substageDescription = {.shaderSubstageName = "shadow"},
+                .pass = pass,
+                .subpass = 0},
+            1),
+        lighting(lightingLayout),
+        view(device, cascades, cascades.format(), 0,
+             TestApp::SHADOW_CASCADES_COUNT),
+        staticView(device, staticCache, staticCache.format(), 0,
+                   TestApp::SHADOW_CASCADES_COUNT),
+        frameBuffer(layeredFrameBuffer(device, pass, view)),
+        staticFrameBuffer(layeredFrameBuffer(device, staticPass, staticView)) {
+  }
+
+  TestApp::LayeredShadowPass pass;
+  TestApp::LayeredShadowPass staticPass;
+  TestApp::LayeredShadowPass dynamicPass;
+  RenderEngine::ProjectionLayout projectionLayout;
+  LayeredProjection projection;
+  RenderEngine::LightingLayout lightingLayout;
+  RenderEngine::Lighting lighting;
+  vkw::ImageView<vkw::DEPTH, vkw::V2DA> view;
+  vkw::ImageView<vkw::DEPTH, vkw::V2DA> staticView;
+  vkw::FrameBuffer frameBuffer;
+  vkw::FrameBuffer staticFrameBuffer;
+};
+
 ShadowRenderPass::ShadowRenderPass(
     vkw::Device &device, RenderEngine::ShaderLoaderInterface &shaderLoader)
     : m_pass{TestApp::ShadowPass(device, VK_FORMAT_D32_SFLOAT)},
+      m_staticPass{TestApp::ShadowPass(
+          device, VK_FORMAT_D32_SFLOAT, VK_ATTACHMENT_LOAD_OP_CLEAR,
+          VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)},
+      m_dynamicPass{TestApp::ShadowPass(
+          device, VK_FORMAT_D32_SFLOAT, VK_ATTACHMENT_LOAD_OP_LOAD,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)},
       m_shadow_proj_layout(
           device, shaderLoader,
           RenderEngine::SubstageDescription{.shaderSubstageName = "shadow"},
@@ -30,19 +142,11 @@ ShadowRenderPass::ShadowRenderPass(
               .subpass = 0},
           1),
       m_shadow_pass(m_shadow_pass_layout),
-      m_shadowCascades{
-          device.getAllocator(),
-          VmaAllocationCreateInfo{.usage = VMA_MEMORY_USAGE_GPU_ONLY,
-                                  .requiredFlags =
-                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT},
-          VK_FORMAT_D32_SFLOAT,
-          2048,
-          2048,
-          1,
-          TestApp::SHADOW_CASCADES_COUNT,
-          1,
-          VK_IMAGE_USAGE_SAMPLED_BIT |
-              VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT},
+      m_shadowCascades(createDepthArray(device,
+                                        VK_IMAGE_USAGE_SAMPLED_BIT |
+                                            VK_IMAGE_USAGE_TRANSFER_DST_BIT)),
+      m_staticCache(
+          createDepthArray(device, VK_IMAGE_USAGE_TRANSFER_SRC_BIT)),
       m_ubo(device, VmaAllocationCreateInfo{
                         .usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
                         .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT}) {
@@ -69,87 +173,317 @@ ShadowRenderPass::ShadowRenderPass(
     auto *viewIt = dynamic_cast<vkw::ImageViewVT<vkw::V2D> const *>(
         m_per_cascade_views.data() + i);
     m_shadowBufs.emplace_back(
-        device, m_pass, VkExtent2D{2048, 2048},
+        device, m_pass, VkExtent2D{MAP_SIZE, MAP_SIZE},
         std::span<vkw::ImageViewVT<vkw::V2D> const *>{&viewIt, 1});
   }
-}
 
-void ShadowRenderPass::execute(
-    vkw::PrimaryCommandBuffer &buffer,
-    RenderEngine::GraphicsRecordingState &state) const {
+  for (unsigned i = 0; i < TestApp::SHADOW_CASCADES_COUNT; ++i) {
+    m_staticViews.emplace_back(vkw::ImageView<vkw::DEPTH, vkw::V2D>{
+        device, m_staticCache, m_staticCache.format(), i, 1});
+  }
+  for (int i = 0; i < TestApp::SHADOW_CASCADES_COUNT; ++i) {
+    auto *viewIt = dynamic_cast<vkw::ImageViewVT<vkw::V2D> const *>(
+        m_staticViews.data() + i);
+    m_staticBufs.emplace_back(
+        device, m_staticPass, VkExtent2D{MAP_SIZE, MAP_SIZE},
+        std::span<vkw::ImageViewVT<vkw::V2D> const *>{&viewIt, 1});
+  }
 
-  assert(&buffer == &state.commands() &&
-         "Recording state must be created with passed command buffer");
+  // the extension is enabled by CommonApp whenever it is supported
+  if (device.physicalDevice().extensionSupported(vkw::ext::KHR_multiview))
+    m_layered = std::make_unique<M_Layered>(device, shaderLoader, m_ubo,
+                                            m_shadowCascades, m_staticCache);
+}
+
+ShadowRenderPass::~ShadowRenderPass() = default;
 
+void ShadowRenderPass::m_beginPass(
+    vkw::PrimaryCommandBuffer &buffer,
+    RenderEngine::GraphicsRecordingState &state, vkw::RenderPass const &pass,
+    vkw::FrameBuffer const &frameBuffer, RenderEngine::Lighting const &lighting,
+    RenderEngine::Projection const &projection) const {
   VkViewport viewport;
 
-  viewport.height = 2048;
-  viewport.width = 2048;
+  viewport.height = MAP_SIZE;
+  viewport.width = MAP_SIZE;
   viewport.x = viewport.y = 0.0f;
   viewport.minDepth = 0.0f;
   viewport.maxDepth = 1.0f;
   VkRect2D scissor;
-  scissor.extent.width = 2048;
-  scissor.extent.height = 2048;
+  scissor.extent.width = MAP_SIZE;
+  scissor.extent.height = MAP_SIZE;
   scissor.offset.x = 0;
   scissor.offset.y = 0;
 
   auto value = VkClearValue{};
   value.depthStencil.depth = 1.0f;
 
+  buffer.beginRenderPass(pass, frameBuffer, frameBuffer.getFullRenderArea(),
+                         false, 1, &value);
+
+  buffer.setViewports({&viewport, 1}, 0);
+  buffer.setScissors({&scissor, 1}, 0);
+
+  state.setMaterial(m_shadow_material);
+  state.setLighting(lighting);
+  state.setProjection(projection);
+}
+
+void ShadowRenderPass::execute(
+    vkw::PrimaryCommandBuffer &buffer,
+    RenderEngine::GraphicsRecordingState &state) const {
+
+  assert(&buffer == &state.commands() &&
+         "Recording state must be created with passed command buffer");
+
+  if (layered()) {
+    m_executeLayered(buffer, state);
+    return;
+  }
+
   for (int i = 0; i < TestApp::SHADOW_CASCADES_COUNT; ++i) {
-    buffer.beginRenderPass(m_pass, m_shadowBufs.at(i),
-                           m_shadowBufs.at(i).getFullRenderArea(), false, 1,
-                           &value);
+    auto &cascade = m_cascadeStates.at(i);
+    if (!cascade.render)
+      continue;
+
+    auto &camera = m_cameras.at(i);
+    auto &casters = m_casterFrustums.at(i);
+    auto &projection = m_shadow_projs.at(i);
+
+    if (!onStaticPass) {
+      m_beginPass(buffer, state, m_pass, m_shadowBufs.at(i), m_shadow_pass,
+                  projection);
+      if (onPass)
+        onPass(state, camera, casters);
+      buffer.endRenderPass();
+      continue;
+    }
+
+    if (cascade.renderStatic) {
+      m_beginPass(buffer, state, m_staticPass, m_staticBufs.at(i),
+                  m_shadow_pass, projection);
+      onStaticPass(state, camera, casters);
+      buffer.endRenderPass();
+    }
+
+    m_copyStaticCache(buffer, i, 1);
+
+    m_beginPass(buffer, state, m_dynamicPass, m_shadowBufs.at(i),
+                m_shadow_pass, projection);
+    if (onPass)
+      onPass(state, camera, casters);
+    buffer.endRenderPass();
+  }
+}
 
-    buffer.setViewports({&viewport, 1}, 0);
-    buffer.setScissors({&scissor, 1}, 0);
+void ShadowRenderPass::m_executeLayered(
+    vkw::PrimaryCommandBuffer &buffer,
+    RenderEngine::GraphicsRecordingState &state) const {
+  // cascades share their schedule in layered mode
+  auto &cascade = m_cascadeStates.front();
+  if (!cascade.render)
+    return;
 
-    state.setMaterial(m_shadow_material);
-    state.setLighting(m_shadow_pass);
-    state.setProjection(m_shadow_projs.at(i));
+  auto &layered = *m_layered;
 
-    onPass(state, m_cameras.at(i));
+  if (!onStaticPass) {
+    m_beginPass(buffer, state, layered.pass, layered.frameBuffer,
+                layered.lighting, layered.projection);
+    if (onPass)
+      onPass(state, m_layeredCamera, m_layeredCasters);
+    buffer.endRenderPass();
+    return;
+  }
 
+  if (cascade.renderStatic) {
+    m_beginPass(buffer, state, layered.staticPass, layered.staticFrameBuffer,
+                layered.lighting, layered.projection);
+    onStaticPass(state, m_layeredCamera, m_layeredCasters);
     buffer.endRenderPass();
   }
+
+  m_copyStaticCache(buffer, 0, TestApp::SHADOW_CASCADES_COUNT);
+
+  m_beginPass(buffer, state, layered.dynamicPass, layered.frameBuffer,
+              layered.lighting, layered.projection);
+  if (onPass)
+    onPass(state, m_layeredCamera, m_layeredCasters);
+  buffer.endRenderPass();
+}
+
+void ShadowRenderPass::m_copyStaticCache(vkw::PrimaryCommandBuffer &buffer,
+                                         uint32_t firstCascade,
+                                         uint32_t cascadeCount) const {
+  // previous content of the cascade is overwritten entirely
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+  barrier.image = m_shadowCascades.vkw::AllocatedImage::operator VkImage_T *();
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  barrier.subresourceRange.baseArrayLayer = firstCascade;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.layerCount = cascadeCount;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+  buffer.imageMemoryBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT, {&barrier, 1});
+
+  VkImageCopy region{};
+  region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  region.srcSubresource.mipLevel = 0;
+  region.srcSubresource.baseArrayLayer = firstCascade;
+  region.srcSubresource.layerCount = cascadeCount;
+  region.dstSubresource = region.srcSubresource;
+  region.extent = {MAP_SIZE, MAP_SIZE, 1};
+
+  // static pass leaves the cache in transfer source layout
+  buffer.copyImageToImage(m_staticCache, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                          m_shadowCascades,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, {&region, 1});
+}
+
+void ShadowRenderPass::m_moveCascade(uint32_t index, glm::vec3 center,
+                                     float radius, glm::vec3 lightDir) {
+  auto shadowDepthFactor = 5.0f;
+  auto shadowDepth = 2000.0f;
+  if (shadowDepth < radius * shadowDepthFactor)
+    shadowDepth = radius * shadowDepthFactor;
+
+  auto &cam = m_cameras.at(index);
+  cam.setLeft(-radius);
+  cam.setRight(radius);
+  cam.setTop(radius);
+  cam.setBottom(-radius);
+  cam.setZNear(0.0f);
+  cam.setZFar(shadowDepth);
+  cam.update(0.0f);
+  cam.lookAt(center - lightDir * (shadowDepth - radius), center,
+             glm::vec3{0.0f, 1.0f, 0.0f});
+  m_casterFrustums.at(index) = cam.frustum().extruded(-lightDir);
+
+  m_mapped->cascades[index] = cam.projection() * cam.cameraSpace();
+
+  auto &state = m_cascadeStates.at(index);
+  state.center = center;
+  state.radius = radius;
+  state.lightDir = lightDir;
+}
+
+void ShadowRenderPass::m_fitLayeredCamera() {
+  auto lightDir = m_cascadeStates.front().lightDir;
+  auto view =
+      glm::lookAt(glm::vec3{0.0f}, lightDir, glm::vec3{0.0f, 1.0f, 0.0f});
+
+  // cascades share light space axes, the light looks along -z and each
+  // cascade spans from its eye, zFar - radius in front of its center, to
+  // radius behind the center
+  auto min = glm::vec3{std::numeric_limits<float>::max()};
+  auto max = glm::vec3{std::numeric_limits<float>::lowest()};
+  for (int i = 0; i < TestApp::SHADOW_CASCADES_COUNT; ++i) {
+    auto &state = m_cascadeStates.at(i);
+    auto center = glm::vec3(view * glm::vec4(state.center, 1.0f));
+    auto depth = m_cameras.at(i).zFar();
+    min = glm::min(min, center - glm::vec3{state.radius});
+    max = glm::max(max, center + glm::vec3{state.radius, state.radius,
+                                           depth - state.radius});
+  }
+
+  auto extent = (max - min) * 0.5f;
+  auto center =
+      glm::vec3(glm::inverse(view) * glm::vec4((min + max) * 0.5f, 1.0f));
+
+  auto &cam = m_layeredCamera;
+  cam.setLeft(-extent.x);
+  cam.setRight(extent.x);
+  cam.setTop(extent.y);
+  cam.setBottom(-extent.y);
+  cam.setZNear(0.0f);
+  cam.setZFar(2.0f * extent.z);
+  cam.update(0.0f);
+  cam.lookAt(center - lightDir * extent.z, center,
+             glm::vec3{0.0f, 1.0f, 0.0f});
+  m_layeredCasters = cam.frustum().extruded(-lightDir);
 }
 
 void ShadowRenderPass::update(
     TestApp::ShadowCascadesCamera<TestApp::SHADOW_CASCADES_COUNT> const &camera,
     glm::vec3 lightDir) {
-  lightDir *= -1.0f;
-  auto greaterRadius =
-      camera.cascade(TestApp::SHADOW_CASCADES_COUNT - 1).radius;
+  lightDir = glm::normalize(-lightDir);
+  auto minLightCos = std::cos(glm::radians(m_settings.lightAngleThreshold));
+  auto margin = m_settings.coverageMargin;
+
+  auto layered = this->layered();
+  if (layered != m_wasLayered) {
+    // cascades were scheduled and cached by the other mode
+    m_cascadeStates.fill(M_CascadeState{});
+    m_wasLayered = layered;
+  }
+
+  std::array<bool, TestApp::SHADOW_CASCADES_COUNT> moved;
+  std::array<bool, TestApp::SHADOW_CASCADES_COUNT> slice;
+
   for (int i = 0; i < TestApp::SHADOW_CASCADES_COUNT; ++i) {
     auto cascade = camera.cascade(i);
-    auto shadowDepthFactor = 5.0f;
-    auto center = cascade.center;
-    auto shadowDepth = 2000.0f;
-    if (shadowDepth < cascade.radius * shadowDepthFactor)
-      shadowDepth = cascade.radius * shadowDepthFactor;
-
-    auto &cam = m_cameras.at(i);
-    cam.setLeft(-cascade.radius);
-    cam.setRight(cascade.radius);
-    cam.setTop(cascade.radius);
-    cam.setBottom(-cascade.radius);
-    cam.setZNear(0.0f);
-    cam.setZFar(shadowDepth);
-    cam.update(0.0f);
-    cam.lookAt(center -
-                   glm::normalize(lightDir) * (shadowDepth - cascade.radius),
-               center, glm::vec3{0.0f, 1.0f, 0.0f});
-
-    glm::mat4 proj = glm::ortho(
-        -cascade.radius, cascade.radius, cascade.radius, -cascade.radius, 0.0f,
-        shadowDepth /*cascade.radius * shadowDepthFactor*/);
-    glm::mat4 lookAt = glm::lookAt(center - glm::normalize(lightDir) *
-                                                (shadowDepth - cascade.radius),
-                                   center, glm::vec3{0.0f, 1.0f, 0.0f});
-    m_mapped->cascades[i] = cam.projection() * cam.cameraSpace();
     m_mapped->splits[i * 4] = cascade.split;
+
+    auto &state = m_cascadeStates.at(i);
+
+    // cached volume must contain sphere of the slice and must not be much
+    // larger than needed, otherwise resolution is wasted
+    auto covered =
+        glm::length(cascade.center - state.center) + cascade.radius <=
+            state.radius &&
+        state.radius <= cascade.radius * (1.0f + 2.0f * margin);
+    moved.at(i) =
+        !covered || glm::dot(lightDir, state.lightDir) < minLightCos;
+
+    auto interval = std::max(m_settings.updateIntervals.at(i), 1u);
+    slice.at(i) = m_frame % interval == 0;
+  }
+
+  // one pass renders all cascades, so they are updated and moved together
+  if (layered) {
+    auto anyMoved = std::find(moved.begin(), moved.end(), true) != moved.end();
+    moved.fill(anyMoved);
+    slice.fill(slice.front());
   }
+
+  m_statistics = {};
+
+  for (int i = 0; i < TestApp::SHADOW_CASCADES_COUNT; ++i) {
+    auto &state = m_cascadeStates.at(i);
+
+    state.render = slice.at(i) && (moved.at(i) || onPass ||
+                                   (onStaticPass && !state.staticCached));
+    state.renderStatic =
+        state.render && onStaticPass && (moved.at(i) || !state.staticCached);
+
+    if (state.render && moved.at(i)) {
+      auto cascade = camera.cascade(i);
+      auto radius = cascade.radius * (1.0f + margin);
+      m_moveCascade(i, snapToTexels(cascade.center, radius, lightDir), radius,
+                    lightDir);
+    }
+
+    if (state.renderStatic)
+      state.staticCached = true;
+    if (!onStaticPass)
+      state.staticCached = false;
+
+    m_statistics.cascadesRendered += state.render;
+    m_statistics.staticCascadesRendered += state.renderStatic;
+  }
+
+  if (layered && m_cascadeStates.front().render)
+    m_fitLayeredCamera();
+
+  m_frame++;
   flush();
 }
-} // namespace TestApp
\ No newline at end of file
+} // namespace TestApp
@@ -4,14 +4,51 @@
 #include <RenderEngine/RecordingState.h>
 #include <RenderPassesImpl.h>
 #include <SceneProjector.h>
+#include <array>
+#include <functional>
+#include <memory>
+#include <span>
 #include <glm/glm.hpp>
 #include <vkw/FrameBuffer.hpp>
 
 namespace TestApp {
 
+/** Renders cascaded shadow map of the directional light.
+ *
+ *  Cascades are cached between frames. Each cascade covers its slice of the
+ *  view enlarged by a margin and is snapped to shadow map texels, so it is
+ *  moved only when the slice leaves the covered area or the light turns,
+ *  and static shadows do not shimmer when it is. Depth of static casters is
+ *  kept in a separate cache and copied into the cascade before dynamic
+ *  casters are drawn on top of it. Far cascades are updated less often.
+ *
+ *  When the device supports multiview, all cascades can be rendered by one
+ *  layered pass, so every caster is submitted once instead of per cascade.
+ */
 class ShadowRenderPass {
 public:
   using ShadowArrayT = vkw::Image<vkw::DEPTH, vkw::I2D, vkw::ARRAY>;
+
+  static constexpr uint32_t MAP_SIZE = 2048;
+
+  struct Settings {
+    /** Cascade i is updated at most once in updateIntervals[i] frames. */
+    std::array<uint32_t, TestApp::SHADOW_CASCADES_COUNT> updateIntervals = {
+        1, 1, 2, 4};
+    /** Fraction of cascade radius it is enlarged by. */
+    float coverageMargin = 0.1f;
+    /** Light rotation in degrees moving cached cascades. */
+    float lightAngleThreshold = 0.25f;
+    /** Renders all cascades by one multiview pass if supported. Cascades
+     *  then share update interval of the first one and move together.
+     */
+    bool layered = true;
+  };
+
+  struct Statistics {
+    uint32_t cascadesRendered = 0;
+    uint32_t staticCascadesRendered = 0;
+  };
   struct ShadowMapSpace {
     glm::mat4 cascades[TestApp::SHADOW_CASCADES_COUNT];
     float splits[TestApp::SHADOW_CASCADES_COUNT * 4];
@@ -20,15 +57,29 @@ public:
   ShadowRenderPass(vkw::Device &device,
                    RenderEngine::ShaderLoaderInterface &shaderLoader);
 
+  ~ShadowRenderPass();
+
   void execute(vkw::PrimaryCommandBuffer &buffer,
                RenderEngine::GraphicsRecordingState &state) const;
 
   auto &shadowMap() { return m_shadowCascades; }
 
-  std::function<void(RenderEngine::GraphicsRecordingState &state,
-                     const Camera &camera)>
-      onPass = [](RenderEngine::GraphicsRecordingState &state,
-                  const Camera &camera) {};
+  using PassCallback =
+      std::function<void(RenderEngine::GraphicsRecordingState &state,
+                         const Camera &camera, const Frustum &casters)>;
+
+  /** Draws dynamic casters of a cascade. Called each time the cascade is
+   *  updated. Casters frustum is the cascade volume extruded towards the
+   *  light, so objects outside of the view that still cast shadows into it
+   *  are kept by culling against it. In layered mode it is called once for
+   *  all cascades with camera and frustum enclosing all of them.
+   */
+  PassCallback onPass;
+
+  /** Draws static casters of a cascade into its cache. Called only when the
+   *  cascade is moved.
+   */
+  PassCallback onStaticPass;
 
   void
   update(TestApp::ShadowCascadesCamera<TestApp::SHADOW_CASCADES_COUNT> const
@@ -37,11 +88,75 @@ public:
 
   auto &ubo() const { return m_ubo; }
 
+  /** Cascade cameras, passed to onPass unless in layered mode. */
+  auto &cameras() const { return m_cameras; }
+
+  /** Caster frustums of cascades, passed to onPass unless in layered mode.
+   */
+  auto &casterFrustums() const { return m_casterFrustums; }
+
+  /** Frustums passed to onPass this frame: one per cascade, or single one
+   *  enclosing all cascades in layered mode.
+   */
+  std::span<Frustum const> passFrustums() const {
+    if (layered())
+      return {&m_layeredCasters, 1};
+    return m_casterFrustums;
+  }
+
+  Settings &settings() { return m_settings; }
+
+  bool layeredSupported() const { return m_layered != nullptr; }
+
+  /** True if cascades are rendered by one layered pass this frame. */
+  bool layered() const { return m_layered && m_settings.layered; }
+
+  /** Cascades rendered by the current frame. */
+  Statistics const &statistics() const { return m_statistics; }
+
 private:
+  struct M_CascadeState {
+    // cascade volume as of the last move
+    glm::vec3 center{};
+    float radius = 0.0f;
+    glm::vec3 lightDir{};
+    bool staticCached = false;
+    // decided by update() for the current frame
+    bool render = false;
+    bool renderStatic = false;
+  };
+
+  /** Moves cascade to cover sphere of its view slice. */
+  void m_moveCascade(uint32_t index, glm::vec3 center, float radius,
+                     glm::vec3 lightDir);
+
+  /** Fits layered camera around volumes of all cascades. */
+  void m_fitLayeredCamera();
+
+  void m_copyStaticCache(vkw::PrimaryCommandBuffer &buffer,
+                         uint32_t firstCascade, uint32_t cascadeCount) const;
+
+  struct M_Layered;
+
+  void m_beginPass(vkw::PrimaryCommandBuffer &buffer,
+                   RenderEngine::GraphicsRecordingState &state,
+                   vkw::RenderPass const &pass,
+                   vkw::FrameBuffer const &frameBuffer,
+                   RenderEngine::Lighting const &lighting,
+                   RenderEngine::Projection const &projection) const;
+
+  void m_executeLayered(vkw::PrimaryCommandBuffer &buffer,
+                        RenderEngine::GraphicsRecordingState &state) const;
+
   void flush() { m_ubo.flush(); }
   RenderEngine::ProjectionLayout m_shadow_proj_layout;
 
   std::array<CameraOrtho, 4> m_cameras;
+  std::array<Frustum, 4> m_casterFrustums;
+  std::array<M_CascadeState, 4> m_cascadeStates;
+  Settings m_settings;
+  Statistics m_statistics;
+  uint64_t m_frame = 0;
 
   struct ShadowProjection : public RenderEngine::Projection {
     ShadowProjection(RenderEngine::ProjectionLayout &layout,
@@ -69,6 +184,10 @@ private:
   vkw::UniformBuffer<ShadowMapSpace> m_ubo;
   ShadowMapSpace *m_mapped;
   TestApp::ShadowPass m_pass;
+  // renders static casters into the cache ready to be copied
+  TestApp::ShadowPass m_staticPass;
+  // draws dynamic casters over static depth copied into the cascade
+  TestApp::ShadowPass m_dynamicPass;
   RenderEngine::MaterialLayout m_shadow_material_layout;
   RenderEngine::Material m_shadow_material;
   RenderEngine::LightingLayout m_shadow_pass_layout;
@@ -76,6 +195,15 @@ private:
   ShadowArrayT m_shadowCascades;
   std::vector<vkw::ImageView<vkw::DEPTH, vkw::V2D>> m_per_cascade_views;
   std::vector<vkw::FrameBuffer> m_shadowBufs;
+  ShadowArrayT m_staticCache;
+  std::vector<vkw::ImageView<vkw::DEPTH, vkw::V2D>> m_staticViews;
+  std::vector<vkw::FrameBuffer> m_staticBufs;
+
+  // present if device supports multiview
+  std::unique_ptr<M_Layered> m_layered;
+  CameraOrtho m_layeredCamera;
+  Frustum m_layeredCasters;
+  bool m_wasLayered = false;
 };
 
 } // namespace TestApp
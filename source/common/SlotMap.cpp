@@ -0,0 +1,93 @@
+#include "SlotMap.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+void TestApp::SlotMap::reserve(uint32_t capacity) {
+  m_slots.reserve(capacity);
+  m_dense.reserve(capacity);
+}
+
+TestApp::SlotMap::Handle TestApp::SlotMap::insert() {
+  uint32_t slot = m_freeSlot;
+  if (slot == M_NO_SLOT) {
+    slot = m_slots.size();
+    m_slots.push_back({0, 0});
+  } else
+    m_freeSlot = m_slots[slot].index;
+
+  auto index = size();
+  m_slots[slot].index = index;
+  auto handle = Handle{slot, m_slots[slot].generation};
+  m_dense.push_back(handle);
+  markDirty(index);
+
+  return handle;
+}
+
+TestApp::SlotMap::Erased TestApp::SlotMap::erase(Handle handle) {
+  auto index = this->index(handle);
+  uint32_t last = size() - 1;
+
+  if (index != last) {
+    m_dense[index] = m_dense[last];
+    m_slots[m_dense[index].slot].index = index;
+    markDirty(index);
+  }
+  m_dense.pop_back();
+
+  // bumped generation invalidates every copy of the handle
+  auto &slot = m_slots[handle.slot];
+  ++slot.generation;
+  slot.index = m_freeSlot;
+  m_freeSlot = handle.slot;
+
+  return {index, last};
+}
+
+bool TestApp::SlotMap::contains(Handle handle) const {
+  return handle.slot < m_slots.size() &&
+         m_slots[handle.slot].generation == handle.generation;
+}
+
+uint32_t TestApp::SlotMap::index(Handle handle) const {
+  if (!contains(handle))
+    throw std::runtime_error("[SLOTMAP][ERROR] stale handle of slot " +
+                             std::to_string(handle.slot));
+  return m_slots[handle.slot].index;
+}
+
+TestApp::SlotMap::Handle TestApp::SlotMap::handle(uint32_t index) const {
+  return m_dense.at(index);
+}
+
+void TestApp::SlotMap::markDirty(uint32_t first, uint32_t count) {
+  if (count == 0)
+    return;
+  m_dirtyBegin = std::min(m_dirtyBegin, first);
+  m_dirtyEnd = std::max(m_dirtyEnd, first + count);
+}
+
+TestApp::SlotMap::Range TestApp::SlotMap::dirty() const {
+  auto end = std::min(m_dirtyEnd, size());
+  if (m_dirtyBegin >= end)
+    return {0, 0};
+  return {m_dirtyBegin, end - m_dirtyBegin};
+}
+
+void TestApp::SlotMap::clearDirty() {
+  m_dirtyBegin = UINT32_MAX;
+  m_dirtyEnd = 0;
+}
+
+void TestApp::SlotMap::clear() {
+  // generations are kept, so handles of cleared elements stay stale
+  for (auto &handle : m_dense) {
+    auto &slot = m_slots[handle.slot];
+    ++slot.generation;
+    slot.index = m_freeSlot;
+    m_freeSlot = handle.slot;
+  }
+  m_dense.clear();
+  clearDirty();
+}
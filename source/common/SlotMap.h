@@ -0,0 +1,95 @@
+#ifndef TESTAPP_SLOTMAP_H
+#define TESTAPP_SLOTMAP_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace TestApp {
+
+/** Generational handles to elements kept densely packed.
+ *
+ *  The map only tracks indices, element data lives in dense arrays of the
+ *  owner, such as mapped instance buffers, indexed by dense index. Adding,
+ *  removing and looking an element up take constant time. Removal moves the
+ *  last element into the freed place, so the owner must move its data the
+ *  same way. Handles of removed elements are detected by slot generation.
+ *
+ *  Dense indices written since the last clearDirty() are merged into one
+ *  range, so only it needs to be uploaded.
+ */
+class SlotMap {
+public:
+  struct Handle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(Handle const &) const = default;
+  };
+
+  /** Dense indices affected by erase(). Element at moved is to be moved to
+   *  index, they are equal if the erased element was the last one.
+   */
+  struct Erased {
+    uint32_t index;
+    uint32_t moved;
+  };
+
+  struct Range {
+    uint32_t first;
+    uint32_t count;
+  };
+
+  uint32_t size() const { return m_dense.size(); }
+
+  bool empty() const { return m_dense.empty(); }
+
+  void reserve(uint32_t capacity);
+
+  /** Appends element at dense index size() - 1 and marks it dirty. */
+  Handle insert();
+
+  Erased erase(Handle handle);
+
+  bool contains(Handle handle) const;
+
+  /** Dense index of element, throws if it was erased. */
+  uint32_t index(Handle handle) const;
+
+  Handle handle(uint32_t index) const;
+
+  /** Handles of elements in dense order. */
+  std::span<Handle const> handles() const { return m_dense; }
+
+  void markDirty(uint32_t index) { markDirty(index, 1); }
+
+  void markDirty(uint32_t first, uint32_t count);
+
+  /** Range of dense indices written since the last clearDirty(), clamped to
+   *  size(). Empty if nothing was written.
+   */
+  Range dirty() const;
+
+  void clearDirty();
+
+  void clear();
+
+private:
+  static constexpr uint32_t M_NO_SLOT = UINT32_MAX;
+
+  struct M_Slot {
+    // dense index of live element, next free slot otherwise
+    uint32_t index;
+    uint32_t generation;
+  };
+
+  std::vector<M_Slot> m_slots;
+  // handle of each dense element
+  std::vector<Handle> m_dense;
+  uint32_t m_freeSlot = M_NO_SLOT;
+  uint32_t m_dirtyBegin = UINT32_MAX;
+  uint32_t m_dirtyEnd = 0;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_SLOTMAP_H
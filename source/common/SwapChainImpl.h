@@ -22,6 +22,10 @@ public:
     return *m_depth_view;
   }
 
+  vkw::Image<vkw::DEPTH, vkw::I2D, vkw::SINGLE> const &depthImage() const {
+    return m_depth.value();
+  }
+
   SwapChainImpl(SwapChainImpl &&another) noexcept
       : vkw::SwapChain(std::move(another)),
         m_image_views(std::move(another.m_image_views)),
@@ -0,0 +1,149 @@
+#include "TextureCache.h"
+#include <stdexcept>
+#include <utility>
+
+namespace TestApp {
+
+TextureCache::Handle::Handle(TextureCache &cache, uint32_t texture)
+    : m_cache(&cache), m_texture(texture) {
+  m_cache->m_addReference(m_texture);
+}
+
+TextureCache::Handle::Handle(Handle const &another)
+    : m_cache(another.m_cache), m_texture(another.m_texture) {
+  if (m_cache)
+    m_cache->m_addReference(m_texture);
+}
+
+TextureCache::Handle::Handle(Handle &&another) noexcept
+    : m_cache(another.m_cache), m_texture(another.m_texture) {
+  another.m_cache = nullptr;
+}
+
+TextureCache::Handle &
+TextureCache::Handle::operator=(Handle another) noexcept {
+  std::swap(m_cache, another.m_cache);
+  std::swap(m_texture, another.m_texture);
+  return *this;
+}
+
+TextureCache::Handle::~Handle() {
+  if (m_cache)
+    m_cache->m_release(m_texture);
+}
+
+TextureCache::Image &TextureCache::Handle::image() const {
+  return m_cache->m_streamer.image(m_texture);
+}
+
+TextureCache::ImageView const &TextureCache::Handle::view() const {
+  return m_cache->m_entries.at(m_texture).view.value();
+}
+
+uint64_t TextureCache::Handle::generation() const {
+  return m_cache->m_entries.at(m_texture).generation;
+}
+
+TextureCache::TextureCache(vkw::Device &device, Settings settings)
+    : m_device(device), m_settings(settings),
+      m_streamer(device, settings.streaming),
+      m_sampler(device, VkSamplerCreateInfo{
+                            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                            .pNext = nullptr,
+                            .magFilter = VK_FILTER_LINEAR,
+                            .minFilter = VK_FILTER_LINEAR,
+                            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+                            .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                            .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                            .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+
+                            .minLod = 0.0f,
+                            .maxLod = VK_LOD_CLAMP_NONE,
+                        }) {}
+
+TextureCache::Handle
+TextureCache::acquire(Key const &key, std::span<const unsigned char> mipChain,
+                      std::shared_ptr<const void> owner) {
+  if (auto found = m_lookup.find(key); found != m_lookup.end()) {
+    m_statistics.hits++;
+    return Handle{*this, found->second};
+  }
+
+  m_statistics.misses++;
+
+  auto texture = m_streamer.add(mipChain, key.format, key.width, key.height,
+                                key.mipLevels);
+  if (texture == m_entries.size())
+    m_entries.emplace_back();
+
+  auto &entry = m_entries.at(texture);
+  entry.key = key;
+  entry.owner = std::move(owner);
+  entry.references = 0;
+  entry.generation = 0;
+  entry.unused = m_unused.end();
+  auto &image = m_streamer.image(texture);
+  entry.view.emplace(m_device.get(), image, image.format());
+
+  m_lookup.emplace(key, texture);
+
+  return Handle{*this, texture};
+}
+
+void TextureCache::m_addReference(uint32_t texture) {
+  auto &entry = m_entries.at(texture);
+  if (entry.references++ == 0 && entry.unused != m_unused.end()) {
+    m_unused.erase(entry.unused);
+    entry.unused = m_unused.end();
+  }
+}
+
+void TextureCache::m_release(uint32_t texture) {
+  auto &entry = m_entries.at(texture);
+  if (entry.references == 0)
+    throw std::runtime_error(
+        "[TEXTURE][ERROR] cached texture released more times than acquired");
+  if (--entry.references == 0) {
+    m_unused.push_front(texture);
+    entry.unused = m_unused.begin();
+  }
+}
+
+void TextureCache::m_evict(uint32_t texture) {
+  auto &entry = m_entries.at(texture);
+  m_unused.erase(entry.unused);
+  entry.unused = m_unused.end();
+  m_lookup.erase(entry.key);
+  // view goes first, image itself is retired by the streamer
+  entry.view.reset();
+  entry.owner.reset();
+  m_streamer.remove(texture);
+  m_statistics.evictions++;
+}
+
+void TextureCache::update(vkw::CommandBuffer &buffer) {
+  for (auto texture : m_streamer.update(buffer)) {
+    auto &entry = m_entries.at(texture);
+    auto &image = m_streamer.image(texture);
+    entry.view.emplace(m_device.get(), image, image.format());
+    entry.generation++;
+  }
+
+  // streamer shrinks unused textures first, so their size is measured after
+  // its update
+  size_t unusedBytes = 0;
+  for (auto texture : m_unused)
+    unusedBytes += m_streamer.residentBytes(texture);
+
+  while (unusedBytes > m_settings.unusedBudget && !m_unused.empty()) {
+    auto texture = m_unused.back();
+    unusedBytes -= m_streamer.residentBytes(texture);
+    m_evict(texture);
+  }
+
+  m_statistics.textures = m_lookup.size();
+  m_statistics.unused = m_unused.size();
+  m_statistics.unusedBytes = unusedBytes;
+}
+
+} // namespace TestApp
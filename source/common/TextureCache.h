@@ -0,0 +1,158 @@
+#ifndef TESTAPP_TEXTURECACHE_H
+#define TESTAPP_TEXTURECACHE_H
+
+#include "TextureStreamer.h"
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vkw/Image.hpp>
+#include <vkw/Sampler.hpp>
+
+namespace TestApp {
+
+/** Process-wide cache of streamed textures keyed by content hash, format
+ *  and dimensions, shared by all models.
+ *
+ *  Textures are handed out as reference counted handles. When the last
+ *  handle of a texture is dropped, the texture stays resident in a least
+ *  recently used list, so reloading a recently used model finds its
+ *  textures without uploading them again. Unused textures are evicted
+ *  oldest first once they occupy more than unusedBudget bytes.
+ *
+ *  All textures share a single TextureStreamer, so streaming budgets apply
+ *  to all models together.
+ */
+class TextureCache : public vkw::ReferenceGuard {
+public:
+  using Image = TextureStreamer::Image;
+  using ImageView = vkw::ImageView<vkw::COLOR, vkw::V2D>;
+
+  struct Settings {
+    TextureStreamer::Settings streaming;
+    // device memory unreferenced textures may keep occupied
+    size_t unusedBudget = 128u << 20;
+  };
+
+  struct Key {
+    uint64_t contentHash;
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+
+    bool operator==(Key const &another) const = default;
+  };
+
+  struct Statistics {
+    uint32_t textures = 0;
+    uint32_t unused = 0;
+    size_t unusedBytes = 0;
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+  };
+
+  /** Shared ownership of a cached texture. Cache must outlive handles. */
+  class Handle {
+  public:
+    Handle() = default;
+
+    Handle(Handle const &another);
+
+    Handle(Handle &&another) noexcept;
+
+    Handle &operator=(Handle another) noexcept;
+
+    ~Handle();
+
+    explicit operator bool() const { return m_cache != nullptr; }
+
+    /** Index of the texture in TextureCache::streamer(). */
+    uint32_t texture() const { return m_texture; }
+
+    /** Image and view addresses stay the same when image is replaced. */
+    Image &image() const;
+
+    ImageView const &view() const;
+
+    /** Incremented each time streaming replaces the image, descriptors
+     *  written with older generation must be rewritten.
+     */
+    uint64_t generation() const;
+
+  private:
+    Handle(TextureCache &cache, uint32_t texture);
+
+    TextureCache *m_cache = nullptr;
+    uint32_t m_texture = 0;
+
+    friend class TextureCache;
+  };
+
+  explicit TextureCache(vkw::Device &device, Settings settings = {});
+
+  /** Returns texture with equal key if it is cached, adds it otherwise.
+   *  owner keeps memory of mipChain alive while texture stays in the cache.
+   */
+  Handle acquire(Key const &key, std::span<const unsigned char> mipChain,
+                 std::shared_ptr<const void> owner);
+
+  TextureStreamer &streamer() { return m_streamer; }
+
+  /** Linear repeating sampler suitable for all cached textures. */
+  vkw::Sampler const &sampler() const { return m_sampler; }
+
+  /** Streams requested levels and evicts unused textures over budget. Must
+   *  be called once per frame after previous frame finished execution,
+   *  before any draw that samples the textures.
+   */
+  void update(vkw::CommandBuffer &buffer);
+
+  Settings &settings() { return m_settings; }
+
+  Statistics const &statistics() const { return m_statistics; }
+
+private:
+  struct KeyHash {
+    size_t operator()(Key const &key) const {
+      return key.contentHash ^ (uint64_t(key.format) << 32) ^
+             (uint64_t(key.width) << 16) ^ key.height ^
+             (uint64_t(key.mipLevels) << 48);
+    }
+  };
+
+  struct Entry {
+    Key key;
+    std::shared_ptr<const void> owner;
+    uint32_t references = 0;
+    std::optional<ImageView> view;
+    uint64_t generation = 0;
+    // position in m_unused while no handle references the entry
+    std::list<uint32_t>::iterator unused;
+  };
+
+  void m_addReference(uint32_t texture);
+
+  void m_release(uint32_t texture);
+
+  void m_evict(uint32_t texture);
+
+  vkw::StrongReference<vkw::Device> m_device;
+  Settings m_settings;
+  Statistics m_statistics;
+  TextureStreamer m_streamer;
+  vkw::Sampler m_sampler;
+
+  // indexed by streamer texture, deque keeps view addresses stable
+  std::deque<Entry> m_entries;
+  std::unordered_map<Key, uint32_t, KeyHash> m_lookup;
+  // unreferenced textures, most recently released first
+  std::list<uint32_t> m_unused;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_TEXTURECACHE_H
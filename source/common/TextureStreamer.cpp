@@ -0,0 +1,278 @@
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace TestApp {
+
+namespace {
+
+constexpr uint32_t NO_REQUEST = UINT32_MAX;
+
+} // namespace
+
+TextureStreamer::TextureStreamer(vkw::Device &device, Settings settings)
+    : m_device(device), m_loader(device, ""), m_settings(settings) {}
+
+uint32_t TextureStreamer::add(std::span<const unsigned char> mipChain,
+                              VkFormat format, uint32_t width, uint32_t height,
+                              uint32_t mipLevels) {
+  std::vector<size_t> levelOffsets{0};
+  uint32_t tailLevel = mipLevels - 1;
+
+  for (uint32_t level = 0; level < mipLevels; ++level) {
+    auto levelWidth = std::max(width >> level, 1u);
+    auto levelHeight = std::max(height >> level, 1u);
+    if (tailLevel == mipLevels - 1 &&
+        std::max(levelWidth, levelHeight) <= m_settings.tailDimension)
+      tailLevel = level;
+    levelOffsets.push_back(
+        levelOffsets.back() + RenderEngine::TextureLoader::mipLevelSize(
+                                  format, levelWidth, levelHeight));
+  }
+
+  if (levelOffsets.back() > mipChain.size())
+    throw std::runtime_error(
+        "[TEXTURE][ERROR] mip chain data is smaller than expected");
+
+  // levels of resident image are copied into its replacement
+  auto tail = m_loader.loadTexture(
+      mipChain.subspan(levelOffsets[tailLevel]), format,
+      std::max(width >> tailLevel, 1u), std::max(height >> tailLevel, 1u),
+      mipLevels - tailLevel, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+  Texture texture{mipChain, format, width, height, mipLevels,
+                  std::move(levelOffsets), tailLevel, tailLevel, NO_REQUEST,
+                  std::move(tail)};
+
+  m_statistics.residentBytes += texture.bytesFrom(tailLevel);
+
+  if (m_free.empty()) {
+    m_textures.emplace_back(std::move(texture));
+    return m_textures.size() - 1;
+  }
+
+  auto index = m_free.back();
+  m_free.pop_back();
+  m_textures[index] = std::move(texture);
+  return index;
+}
+
+void TextureStreamer::remove(uint32_t texture) {
+  auto &entry = m_textures.at(texture);
+  if (entry.removed)
+    throw std::runtime_error("[TEXTURE][ERROR] texture is already removed");
+
+  m_statistics.residentBytes -= entry.bytesFrom(entry.residentLevel);
+  m_retired.emplace_back(std::move(entry.image));
+  entry.mipChain = {};
+  entry.removed = true;
+  m_free.push_back(texture);
+}
+
+void TextureStreamer::request(uint32_t texture, uint32_t level) {
+  auto &requested = m_textures.at(texture).requestedLevel;
+  requested = std::min(requested, level);
+}
+
+TextureStreamer::Image
+TextureStreamer::m_createImage(Texture const &texture, uint32_t level) const {
+  VmaAllocationCreateInfo allocInfo{};
+  allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+  allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+  return Image{m_device.get().getAllocator(),
+               allocInfo,
+               texture.format,
+               std::max(texture.width >> level, 1u),
+               std::max(texture.height >> level, 1u),
+               1,
+               1,
+               texture.mipLevels - level,
+               VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                   VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                   VK_IMAGE_USAGE_SAMPLED_BIT};
+}
+
+void TextureStreamer::m_makeResident(uint32_t texture, uint32_t level,
+                                     vkw::CommandBuffer &buffer) {
+  auto &entry = m_textures.at(texture);
+  auto image = m_createImage(entry, level);
+
+  // levels of the source chain present in both images
+  auto firstShared = std::max(level, entry.residentLevel);
+
+  auto barrier = [](Image &target, uint32_t baseLevel, uint32_t levelCount,
+                    VkImageLayout oldLayout, VkImageLayout newLayout,
+                    VkAccessFlags srcAccess, VkAccessFlags dstAccess) {
+    VkImageMemoryBarrier ret{};
+    ret.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    ret.pNext = nullptr;
+    ret.image = target.vkw::AllocatedImage::operator VkImage_T *();
+    ret.oldLayout = oldLayout;
+    ret.newLayout = newLayout;
+    ret.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    ret.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    ret.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    ret.subresourceRange.baseArrayLayer = 0;
+    ret.subresourceRange.layerCount = 1;
+    ret.subresourceRange.baseMipLevel = baseLevel;
+    ret.subresourceRange.levelCount = levelCount;
+    ret.srcAccessMask = srcAccess;
+    ret.dstAccessMask = dstAccess;
+    return ret;
+  };
+
+  // old image is only read from now on, it is not sampled after update()
+  VkImageMemoryBarrier toTransfer[] = {
+      barrier(image, 0, entry.mipLevels - level, VK_IMAGE_LAYOUT_UNDEFINED,
+              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+              VK_ACCESS_TRANSFER_WRITE_BIT),
+      barrier(entry.image, firstShared - entry.residentLevel,
+              entry.mipLevels - firstShared,
+              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 0,
+              VK_ACCESS_TRANSFER_READ_BIT)};
+
+  buffer.imageMemoryBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT, toTransfer);
+
+  std::vector<VkImageCopy> copies;
+  for (auto source = firstShared; source < entry.mipLevels; ++source) {
+    auto &region = copies.emplace_back();
+    region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.srcSubresource.mipLevel = source - entry.residentLevel;
+    region.srcSubresource.baseArrayLayer = 0;
+    region.srcSubresource.layerCount = 1;
+    region.dstSubresource = region.srcSubresource;
+    region.dstSubresource.mipLevel = source - level;
+    region.extent = {std::max(entry.width >> source, 1u),
+                     std::max(entry.height >> source, 1u), 1};
+  }
+
+  buffer.copyImageToImage(entry.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                          image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copies);
+
+  // growing stages only levels that were not resident, shrinking none
+  if (level < entry.residentLevel) {
+    auto first = entry.levelOffsets[level];
+    auto size = entry.levelOffsets[entry.residentLevel] - first;
+    vkw::StagingBuffer<unsigned char> staging{
+        m_device, entry.mipChain.subspan(first, size)};
+
+    std::vector<VkBufferImageCopy> uploads;
+    for (auto source = level; source < entry.residentLevel; ++source) {
+      auto &region = uploads.emplace_back();
+      region.bufferOffset = entry.levelOffsets[source] - first;
+      region.imageExtent = {std::max(entry.width >> source, 1u),
+                            std::max(entry.height >> source, 1u), 1};
+      region.imageSubresource.mipLevel = source - level;
+      region.imageSubresource.layerCount = 1;
+      region.imageSubresource.baseArrayLayer = 0;
+      region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+
+    buffer.copyBufferToImage(staging, image,
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uploads);
+
+    m_statistics.uploadedBytes += size;
+    m_staging.emplace_back(std::move(staging));
+  }
+
+  auto toShaderRead = barrier(
+      image, 0, entry.mipLevels - level, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_ACCESS_SHADER_READ_BIT);
+  buffer.imageMemoryBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                            {&toShaderRead, 1});
+
+  m_statistics.residentBytes -= entry.bytesFrom(entry.residentLevel);
+  m_statistics.residentBytes += entry.bytesFrom(level);
+
+  // old image may still be referenced by descriptors until they are
+  // rewritten, so it is destroyed on the next update
+  m_retired.emplace_back(std::move(entry.image));
+  entry.image = std::move(image);
+  entry.residentLevel = level;
+  m_changed.push_back(texture);
+}
+
+std::span<const uint32_t> TextureStreamer::update(vkw::CommandBuffer &buffer) {
+  // previous frame has finished, its uploads are complete
+  m_staging.clear();
+  m_retired.clear();
+  m_changed.clear();
+  m_statistics.uploadedBytes = 0;
+  m_statistics.pendingLevels = 0;
+
+  std::vector<uint32_t> targets(m_textures.size());
+  std::vector<uint32_t> loads;
+  std::vector<uint32_t> shrinks;
+
+  for (uint32_t i = 0; i < m_textures.size(); ++i) {
+    auto &texture = m_textures[i];
+    if (texture.removed)
+      continue;
+    // textures nobody asked for may be shrunk down to their tail
+    targets[i] = std::min(texture.requestedLevel, texture.tailLevel);
+    if (targets[i] < texture.residentLevel) {
+      loads.push_back(i);
+      m_statistics.pendingLevels += texture.residentLevel - targets[i];
+    } else if (targets[i] > texture.residentLevel)
+      shrinks.push_back(i);
+  }
+
+  // biggest deficit first
+  std::stable_sort(loads.begin(), loads.end(), [&](uint32_t a, uint32_t b) {
+    return m_textures[a].residentLevel - targets[a] >
+           m_textures[b].residentLevel - targets[b];
+  });
+
+  // unused textures first, then the ones that free most memory
+  auto freedBytes = [&](uint32_t i) {
+    return m_textures[i].bytesFrom(m_textures[i].residentLevel) -
+           m_textures[i].bytesFrom(targets[i]);
+  };
+  std::stable_sort(shrinks.begin(), shrinks.end(),
+                   [&](uint32_t a, uint32_t b) {
+                     bool unusedA = m_textures[a].requestedLevel == NO_REQUEST;
+                     bool unusedB = m_textures[b].requestedLevel == NO_REQUEST;
+                     if (unusedA != unusedB)
+                       return unusedA;
+                     return freedBytes(a) > freedBytes(b);
+                   });
+
+  auto nextShrink = shrinks.begin();
+
+  for (auto i : loads) {
+    auto &texture = m_textures[i];
+    auto level = texture.residentLevel - 1;
+    // resident levels are copied on the device, so only the new one counts
+    auto growth = texture.bytesFrom(level) -
+                  texture.bytesFrom(texture.residentLevel);
+
+    if (m_statistics.uploadedBytes > 0 &&
+        m_statistics.uploadedBytes + growth > m_settings.uploadBudget)
+      break;
+
+    while (m_statistics.residentBytes + growth > m_settings.memoryBudget &&
+           nextShrink != shrinks.end()) {
+      m_makeResident(*nextShrink, targets[*nextShrink], buffer);
+      ++nextShrink;
+    }
+
+    if (m_statistics.residentBytes + growth > m_settings.memoryBudget)
+      break;
+
+    m_makeResident(i, level, buffer);
+    m_statistics.pendingLevels--;
+  }
+
+  for (auto &texture : m_textures)
+    texture.requestedLevel = NO_REQUEST;
+
+  return m_changed;
+}
+
+} // namespace TestApp
@@ -0,0 +1,146 @@
+#ifndef TESTAPP_TEXTURESTREAMER_H
+#define TESTAPP_TEXTURESTREAMER_H
+
+#include <RenderEngine/AssetImport/AssetImport.h>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <vector>
+#include <vkw/CommandBuffer.hpp>
+#include <vkw/Image.hpp>
+
+namespace TestApp {
+
+/** Keeps only demanded mip levels of textures in device memory.
+ *
+ *  Texture starts with the small tail of its mip chain resident. Every frame
+ *  users report the most detailed level they need and update() records
+ *  uploads of more detailed levels into the frame command buffer, one level
+ *  per texture per frame, within upload and memory budgets. When memory
+ *  budget is exceeded, textures holding more detail than currently needed
+ *  are shrunk first.
+ *
+ *  Image of a texture holds only resident levels, so its level 0 is the
+ *  most detailed resident level of the source chain. Growing or shrinking
+ *  replaces the image in place, so views and descriptors of changed
+ *  textures must be recreated after update(). Levels already resident are
+ *  copied from the old image on the device, only new levels are staged.
+ */
+class TextureStreamer {
+public:
+  using Image = vkw::Image<vkw::COLOR, vkw::I2D, vkw::SINGLE>;
+
+  struct Settings {
+    // device memory all textures of the streamer may occupy
+    size_t memoryBudget = 512u << 20;
+    // bytes staged per frame at most (at least one upload is always made)
+    size_t uploadBudget = 32u << 20;
+    // largest dimension of the level made resident on load
+    uint32_t tailDimension = 64;
+  };
+
+  struct Statistics {
+    size_t residentBytes = 0;
+    size_t uploadedBytes = 0;
+    // levels still to be uploaded to satisfy current demand
+    uint32_t pendingLevels = 0;
+  };
+
+  explicit TextureStreamer(vkw::Device &device, Settings settings = {});
+
+  /** Uploads the tail of the chain synchronously. Chain memory must outlive
+   *  the streamer, levels are re-read from it as they are streamed in.
+   */
+  uint32_t add(std::span<const unsigned char> mipChain, VkFormat format,
+               uint32_t width, uint32_t height, uint32_t mipLevels);
+
+  /** Frees texture. Its image is destroyed on the next update and its index
+   *  may be returned by later add().
+   */
+  void remove(uint32_t texture);
+
+  /** Address of the image stays the same when it is replaced. */
+  Image &image(uint32_t texture) { return m_textures.at(texture).image; }
+
+  uint32_t residentLevel(uint32_t texture) const {
+    return m_textures.at(texture).residentLevel;
+  }
+
+  uint32_t width(uint32_t texture) const {
+    return m_textures.at(texture).width;
+  }
+
+  uint32_t height(uint32_t texture) const {
+    return m_textures.at(texture).height;
+  }
+
+  uint32_t mipLevels(uint32_t texture) const {
+    return m_textures.at(texture).mipLevels;
+  }
+
+  VkFormat format(uint32_t texture) const {
+    return m_textures.at(texture).format;
+  }
+
+  size_t residentBytes(uint32_t texture) const {
+    auto &entry = m_textures.at(texture);
+    return entry.bytesFrom(entry.residentLevel);
+  }
+
+  /** Requests level for the current frame. Most detailed request wins. */
+  void request(uint32_t texture, uint32_t level);
+
+  /** Must be called once per frame after previous frame finished execution.
+   *  Records uploads into buffer before any draw that samples the textures.
+   *
+   *  @return textures whose images were replaced
+   */
+  std::span<const uint32_t> update(vkw::CommandBuffer &buffer);
+
+  Settings &settings() { return m_settings; }
+
+  Statistics const &statistics() const { return m_statistics; }
+
+private:
+  struct Texture {
+    std::span<const unsigned char> mipChain;
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    // offset of each level in chain, last element is the chain size
+    std::vector<size_t> levelOffsets;
+    uint32_t tailLevel;
+    uint32_t residentLevel;
+    uint32_t requestedLevel;
+    Image image;
+    bool removed = false;
+
+    size_t bytesFrom(uint32_t level) const {
+      return levelOffsets.back() - levelOffsets[level];
+    }
+  };
+
+  void m_makeResident(uint32_t texture, uint32_t level,
+                      vkw::CommandBuffer &buffer);
+
+  Image m_createImage(Texture const &texture, uint32_t level) const;
+
+  vkw::StrongReference<vkw::Device> m_device;
+  RenderEngine::TextureLoader m_loader;
+  Settings m_settings;
+  Statistics m_statistics;
+
+  // deque keeps image addresses stable
+  std::deque<Texture> m_textures;
+  // indices of removed textures
+  std::vector<uint32_t> m_free;
+  std::vector<uint32_t> m_changed;
+
+  // resources referenced by commands of the previous frame
+  std::vector<vkw::StagingBuffer<unsigned char>> m_staging;
+  std::vector<Image> m_retired;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_TEXTURESTREAMER_H
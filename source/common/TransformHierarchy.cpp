@@ -0,0 +1,209 @@
+#include "TransformHierarchy.h"
+#include <RenderEngine/JobSystem.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace TestApp {
+
+namespace {
+
+// below this amount of dirty node updates threads are not worth spawning
+constexpr size_t PARALLEL_UPDATE_THRESHOLD = 16384;
+
+} // namespace
+
+TransformHierarchy::TransformHierarchy(std::vector<int32_t> parents,
+                                       std::vector<LocalTransform> initial)
+    : m_parents(std::move(parents)), m_initial(std::move(initial)) {
+  if (m_parents.size() != m_initial.size())
+    throw std::runtime_error(
+        "[TRANSFORM][ERROR] parent and transform counts do not match");
+
+  for (int32_t i = 0; i < m_parents.size(); ++i)
+    if (m_parents[i] >= i)
+      throw std::runtime_error(
+          "[TRANSFORM][ERROR] nodes are not ordered topologically");
+}
+
+uint32_t TransformHierarchy::addInstance() {
+  auto instance = instanceCount();
+
+  for (auto &initial : m_initial) {
+    m_translation.push_back(initial.translation);
+    m_rotation.push_back(initial.rotation);
+    m_scale.push_back(initial.scale);
+  }
+  m_world.resize(m_world.size() + nodeCount(), glm::mat4(1.0f));
+  m_dirty.resize(m_dirty.size() + nodeCount(), 1);
+
+  m_root.emplace_back(1.0f);
+  m_instanceDirty.push_back(0);
+  m_markDirty(instance);
+
+  return instance;
+}
+
+void TransformHierarchy::removeInstance(uint32_t instance) {
+  auto last = instanceCount() - 1;
+  auto nodes = nodeCount();
+
+  if (instance != last) {
+    auto dst = instance * nodes;
+    auto src = last * nodes;
+    std::copy_n(m_translation.begin() + src, nodes,
+                m_translation.begin() + dst);
+    std::copy_n(m_rotation.begin() + src, nodes, m_rotation.begin() + dst);
+    std::copy_n(m_scale.begin() + src, nodes, m_scale.begin() + dst);
+    std::copy_n(m_world.begin() + src, nodes, m_world.begin() + dst);
+    std::copy_n(m_dirty.begin() + src, nodes, m_dirty.begin() + dst);
+    m_root[instance] = m_root[last];
+
+    bool listed = m_instanceDirty[instance];
+    m_instanceDirty[instance] = m_instanceDirty[last];
+    if (m_instanceDirty[instance] && !listed)
+      m_dirtyInstances.push_back(instance);
+  }
+
+  m_translation.resize(last * nodes);
+  m_rotation.resize(last * nodes);
+  m_scale.resize(last * nodes);
+  m_world.resize(last * nodes);
+  m_dirty.resize(last * nodes);
+  m_root.pop_back();
+  m_instanceDirty.pop_back();
+}
+
+void TransformHierarchy::setRoot(uint32_t instance,
+                                 glm::mat4 const &transform) {
+  m_root.at(instance) = transform;
+  auto offset = instance * nodeCount();
+  for (uint32_t node = 0; node < nodeCount(); ++node)
+    if (m_parents[node] < 0)
+      m_dirty[offset + node] = 1;
+  m_markDirty(instance);
+}
+
+void TransformHierarchy::setLocal(uint32_t instance, uint32_t node,
+                                  LocalTransform const &transform) {
+  auto index = instance * nodeCount() + node;
+  m_translation.at(index) = transform.translation;
+  m_rotation.at(index) = transform.rotation;
+  m_scale.at(index) = transform.scale;
+  m_dirty.at(index) = 1;
+  m_markDirty(instance);
+}
+
+void TransformHierarchy::setTranslation(uint32_t instance, uint32_t node,
+                                        glm::vec3 const &translation) {
+  m_translation.at(instance * nodeCount() + node) = translation;
+  m_markDirty(instance, node);
+}
+
+void TransformHierarchy::setRotation(uint32_t instance, uint32_t node,
+                                     glm::quat const &rotation) {
+  m_rotation.at(instance * nodeCount() + node) = rotation;
+  m_markDirty(instance, node);
+}
+
+void TransformHierarchy::setScale(uint32_t instance, uint32_t node,
+                                  glm::vec3 const &scale) {
+  m_scale.at(instance * nodeCount() + node) = scale;
+  m_markDirty(instance, node);
+}
+
+TransformHierarchy::LocalTransform
+TransformHierarchy::local(uint32_t instance, uint32_t node) const {
+  auto index = instance * nodeCount() + node;
+  return {m_translation.at(index), m_rotation.at(index), m_scale.at(index)};
+}
+
+glm::mat4 TransformHierarchy::initialWorld(uint32_t node) const {
+  glm::mat4 ret{1.0f};
+  for (int32_t current = node; current >= 0; current = m_parents[current]) {
+    auto &initial = m_initial[current];
+    ret = m_compose(initial.translation, initial.rotation, initial.scale) *
+          ret;
+  }
+  return ret;
+}
+
+void TransformHierarchy::m_markDirty(uint32_t instance) {
+  if (m_instanceDirty[instance])
+    return;
+  m_instanceDirty[instance] = 1;
+  m_dirtyInstances.push_back(instance);
+}
+
+void TransformHierarchy::m_markDirty(uint32_t instance, uint32_t node) {
+  m_dirty[instance * nodeCount() + node] = 1;
+  m_markDirty(instance);
+}
+
+glm::mat4 TransformHierarchy::m_compose(glm::vec3 const &translation,
+                                        glm::quat const &rotation,
+                                        glm::vec3 const &scale) {
+  auto ret = glm::mat4_cast(rotation);
+  ret[0] *= scale.x;
+  ret[1] *= scale.y;
+  ret[2] *= scale.z;
+  ret[3] = glm::vec4(translation, 1.0f);
+  return ret;
+}
+
+void TransformHierarchy::m_updateInstance(uint32_t instance) {
+  auto offset = instance * nodeCount();
+  auto *dirty = m_dirty.data() + offset;
+  auto *world = m_world.data() + offset;
+
+  for (uint32_t node = 0; node < nodeCount(); ++node) {
+    auto parent = m_parents[node];
+    if (parent >= 0)
+      dirty[node] |= dirty[parent];
+    if (!dirty[node])
+      continue;
+
+    auto local = m_compose(m_translation[offset + node],
+                           m_rotation[offset + node], m_scale[offset + node]);
+    world[node] = (parent >= 0 ? world[parent] : m_root[instance]) * local;
+  }
+
+  std::fill_n(dirty, nodeCount(), 0);
+  m_instanceDirty[instance] = 0;
+}
+
+std::span<const uint32_t> TransformHierarchy::update() {
+  m_changed.clear();
+
+  for (auto instance : m_dirtyInstances)
+    // entries may refer to instances removed after they were marked
+    if (instance < instanceCount() && m_instanceDirty[instance])
+      m_changed.push_back(instance);
+  m_dirtyInstances.clear();
+
+  std::sort(m_changed.begin(), m_changed.end());
+  m_changed.erase(std::unique(m_changed.begin(), m_changed.end()),
+                  m_changed.end());
+
+  auto workload = m_changed.size() * nodeCount();
+
+  if (workload < PARALLEL_UPDATE_THRESHOLD) {
+    for (auto instance : m_changed)
+      m_updateInstance(instance);
+    return m_changed;
+  }
+
+  // each job updates about PARALLEL_UPDATE_THRESHOLD nodes
+  auto &jobs = RenderEngine::JobSystem::shared();
+  jobs.wait(jobs.parallelFor(
+      m_changed.size(),
+      std::max<size_t>(PARALLEL_UPDATE_THRESHOLD / std::max(nodeCount(), 1u),
+                       1),
+      [this](size_t begin, size_t end) {
+        for (auto i = begin; i < end; ++i)
+          m_updateInstance(m_changed[i]);
+      }));
+
+  return m_changed;
+}
+
+} // namespace TestApp
@@ -0,0 +1,107 @@
+#ifndef TESTAPP_TRANSFORMHIERARCHY_H
+#define TESTAPP_TRANSFORMHIERARCHY_H
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <span>
+#include <vector>
+
+namespace TestApp {
+
+/** Node transforms of many instances of the same node tree, stored in flat
+ *  arrays. Nodes are ordered topologically (parent index is always less than
+ *  child index), so world matrices are computed by a single forward pass
+ *  without recursion. Only dirty nodes and their descendants are recomputed.
+ *
+ *  Per-node arrays are laid out instance-major: element of node n in
+ *  instance i is at index i * nodeCount() + n.
+ */
+class TransformHierarchy {
+public:
+  struct LocalTransform {
+    glm::vec3 translation = glm::vec3(0.0f);
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+  };
+
+  TransformHierarchy() = default;
+
+  TransformHierarchy(std::vector<int32_t> parents,
+                     std::vector<LocalTransform> initial);
+
+  uint32_t nodeCount() const { return m_parents.size(); }
+
+  uint32_t instanceCount() const { return m_root.size(); }
+
+  int32_t parent(uint32_t node) const { return m_parents.at(node); }
+
+  /** New instance starts with initial local transforms and identity root. */
+  uint32_t addInstance();
+
+  /** Removes instance by moving the last one into its place. */
+  void removeInstance(uint32_t instance);
+
+  /** Transform applied on top of all root nodes of instance. */
+  void setRoot(uint32_t instance, glm::mat4 const &transform);
+
+  void setLocal(uint32_t instance, uint32_t node,
+                LocalTransform const &transform);
+
+  /** Component setters for animation playback, leave other components of
+   *  the node intact. */
+  void setTranslation(uint32_t instance, uint32_t node,
+                      glm::vec3 const &translation);
+
+  void setRotation(uint32_t instance, uint32_t node, glm::quat const &rotation);
+
+  void setScale(uint32_t instance, uint32_t node, glm::vec3 const &scale);
+
+  LocalTransform local(uint32_t instance, uint32_t node) const;
+
+  glm::mat4 const &world(uint32_t instance, uint32_t node) const {
+    return m_world[instance * nodeCount() + node];
+  }
+
+  /** Node world matrix as it is before any instance is created. */
+  glm::mat4 initialWorld(uint32_t node) const;
+
+  /** Recomputes world matrices of dirty subtrees. Large batches of dirty
+   *  instances are split between threads.
+   *
+   *  @return sorted list of instances whose world matrices changed.
+   */
+  std::span<const uint32_t> update();
+
+private:
+  void m_markDirty(uint32_t instance);
+
+  void m_markDirty(uint32_t instance, uint32_t node);
+
+  void m_updateInstance(uint32_t instance);
+
+  static glm::mat4 m_compose(glm::vec3 const &translation,
+                             glm::quat const &rotation,
+                             glm::vec3 const &scale);
+
+  // per node
+  std::vector<int32_t> m_parents;
+  std::vector<LocalTransform> m_initial;
+
+  // per instance * node
+  std::vector<glm::vec3> m_translation;
+  std::vector<glm::quat> m_rotation;
+  std::vector<glm::vec3> m_scale;
+  std::vector<glm::mat4> m_world;
+  std::vector<uint8_t> m_dirty;
+
+  // per instance
+  std::vector<glm::mat4> m_root;
+  std::vector<uint8_t> m_instanceDirty;
+
+  std::vector<uint32_t> m_dirtyInstances;
+  std::vector<uint32_t> m_changed;
+};
+
+} // namespace TestApp
+#endif // TESTAPP_TRANSFORMHIERARCHY_H
@@ -15,7 +15,8 @@ createDepthStencilImage(vkw::Device &device, uint32_t width, uint32_t height) {
       1,
       1,
       1,
-      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+          VK_IMAGE_USAGE_SAMPLED_BIT};
 
   VkImageMemoryBarrier transitLayout{};
   transitLayout.image = depthMap.vkw::AllocatedImage::operator VkImage_T *();
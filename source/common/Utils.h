@@ -11,9 +11,11 @@
 
 namespace TestApp {
 
+/** Uploads range into device local buffer. extraUsage is added to usage of
+ *  the returned buffer, e.g. to let compute shaders read vertices. */
 template <typename Buffer, typename T, typename ForwardIter>
 Buffer createStaticBuffer(vkw::Device &device, ForwardIter begin,
-                          ForwardIter end) {
+                          ForwardIter end, VkBufferUsageFlags extraUsage = 0) {
   auto size = end - begin;
   VmaAllocationCreateInfo createInfo{};
 
@@ -37,7 +39,7 @@ Buffer createStaticBuffer(vkw::Device &device, ForwardIter begin,
   createInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
   Buffer ret{device, static_cast<uint64_t>(size), createInfo,
-             VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+             VK_BUFFER_USAGE_TRANSFER_DST_BIT | extraUsage};
 
   auto const &queue = device.anyTransferQueue();
 
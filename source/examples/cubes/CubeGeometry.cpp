@@ -4,39 +4,205 @@
 #include "vkw/Device.hpp"
 #include "vkw/Queue.hpp"
 #include <RenderEngine/RecordingState.h>
+#include <algorithm>
 #include <cstring>
+#include <stdexcept>
 
 namespace TestApp {
 
 CubePool::CubePool(vkw::Device &device,
                    RenderEngine::ShaderLoaderInterface &shaderLoader,
-                   uint32_t maxCubes)
+                   uint32_t maxCubes, uint32_t maxPasses)
     : m_geometry_layout(
           device, shaderLoader,
           RenderEngine::GeometryLayout::CreateInfo{
               .vertexInputState =
                   std::make_unique<vkw::VertexInputStateCreateInfo<
-                      vkw::per_vertex<PerVertex, 0>,
-                      vkw::per_instance<PerInstance, 1>>>(),
+                      vkw::per_vertex<PerVertex, 0>>>(),
               .substageDescription =
                   RenderEngine::SubstageDescription{.shaderSubstageName =
                                                         "cube"},
               .maxGeometries = 1}),
-      m_geometry(device, m_geometry_layout, maxCubes) {}
+      m_geometry(device, m_geometry_layout),
+      m_cullingLayout(std::make_unique<InstanceCullingLayout>(
+          device, shaderLoader, 1)),
+      m_occlusionLayout(std::make_unique<InstanceOcclusionLayout>(
+          device, shaderLoader, 1)),
+      m_culling(std::make_unique<InstanceCulling>(
+          device, *m_cullingLayout,
+          Frustum::Box{glm::vec3{-0.5f}, glm::vec3{0.5f}}, 36, maxCubes,
+          maxPasses, m_occlusionLayout.get())),
+      m_simulation(m_culling->capacity()),
+      m_simulationLayout(
+          std::make_unique<CubeSimulationLayout>(device, shaderLoader, 1)),
+      m_deviceSimulation(std::make_unique<DeviceCubeSimulation>(
+          device, *m_simulationLayout, m_culling->capacity(),
+          m_culling->deviceInstanceBuffer())) {
+  m_geometry.bindInstances(*m_culling);
+  m_cubes.reserve(m_culling->capacity());
+  m_culledFrustums.reserve(maxPasses);
+  m_frustums.reserve(maxPasses);
+}
 
 CubePool::CubePool(CubePool &&another) noexcept
     : m_geometry(std::move(another.m_geometry)),
       m_geometry_layout(std::move(another.m_geometry_layout)),
-      m_cubeCount(another.m_cubeCount), m_cubes(std::move(another.m_cubes)) {
-  for (auto &cube : m_cubes) {
-    cube.second->m_parent = this;
+      m_cullingLayout(std::move(another.m_cullingLayout)),
+      m_occlusionLayout(std::move(another.m_occlusionLayout)),
+      m_culling(std::move(another.m_culling)),
+      m_cubes(std::move(another.m_cubes)),
+      m_simulation(std::move(another.m_simulation)),
+      m_simulationLayout(std::move(another.m_simulationLayout)),
+      m_deviceSimulation(std::move(another.m_deviceSimulation)),
+      m_simulationMode(another.m_simulationMode),
+      m_hostCurrent(another.m_hostCurrent),
+      m_deviceCurrent(another.m_deviceCurrent),
+      m_movedAhead(another.m_movedAhead),
+      m_aheadStale(another.m_aheadStale),
+      m_culledFrustums(std::move(another.m_culledFrustums)),
+      m_frustums(std::move(another.m_frustums)) {}
+
+CubePool::~CubePool() { m_waitAhead(); }
+
+SlotMap::Handle CubePool::addCube(CubeSimulation::Cube const &cube) {
+  m_syncHost();
+  m_deviceCurrent = false;
+  m_aheadStale = true;
+  m_simulation.add(cube);
+  return m_cubes.insert();
+}
+
+void CubePool::removeCube(SlotMap::Handle cube) {
+  m_syncHost();
+  m_deviceCurrent = false;
+  m_aheadStale = true;
+  // simulation moves the last cube into removed place same as the map
+  m_simulation.remove(m_cubes.erase(cube).index);
+}
+
+CubeSimulation::Cube CubePool::cube(SlotMap::Handle handle) {
+  m_syncHost();
+  return m_simulation.get(m_cubes.index(handle));
+}
+
+void CubePool::setCube(SlotMap::Handle handle,
+                       CubeSimulation::Cube const &cube) {
+  m_syncHost();
+  m_deviceCurrent = false;
+  m_aheadStale = true;
+  m_simulation.set(m_cubes.index(handle), cube);
+}
+
+void CubePool::update(vkw::CommandBuffer &buffer, float deltaTime) {
+  if (m_simulationMode == Simulation::HOST) {
+    m_waitAhead();
+    // cubes changed after being moved ahead keep their position, only
+    // matrices are rewritten
+    if (!m_movedAhead || m_aheadStale)
+      m_simulation.update(m_movedAhead ? 0.0f : deltaTime,
+                          m_culling->instances());
+    m_movedAhead = false;
+    m_aheadStale = false;
+    m_deviceCurrent = false;
+    return;
+  }
+
+  if (!m_deviceCurrent)
+    m_deviceSimulation->upload(m_simulation);
+  m_deviceSimulation->update(buffer, deltaTime, m_culling->firstInstance());
+  m_deviceCurrent = true;
+  m_hostCurrent = false;
+}
+
+void CubePool::simulateAhead(float deltaTime) {
+  if (m_simulationMode != Simulation::HOST || m_movedAhead)
+    return;
+
+  m_movedAhead = true;
+  m_aheadStale = false;
+  auto instances = m_culling->instances();
+  m_ahead = RenderEngine::JobSystem::shared().schedule(
+      [this, deltaTime, instances]() {
+        m_simulation.update(deltaTime, instances);
+      });
+}
+
+void CubePool::setSimulation(Simulation simulation) {
+  if (simulation == m_simulationMode)
+    return;
+
+  // cubes moved ahead continue from there on device
+  m_waitAhead();
+  m_movedAhead = false;
+  if (simulation == Simulation::HOST)
+    m_syncHost();
+
+  m_simulationMode = simulation;
+  m_culling->setDeviceWritten(simulation == Simulation::DEVICE);
+  m_geometry.bindInstances(*m_culling);
+}
+
+void CubePool::m_syncHost() {
+  m_waitAhead();
+  if (m_hostCurrent)
+    return;
+
+  m_deviceSimulation->download(m_simulation);
+  m_hostCurrent = true;
+}
+
+void CubePool::m_waitAhead() {
+  if (!m_ahead)
+    return;
+
+  auto ahead = std::move(m_ahead);
+  m_ahead.reset();
+  RenderEngine::JobSystem::shared().wait(ahead);
+}
+
+void CubePool::cull(vkw::CommandBuffer &buffer,
+                    std::span<Frustum const *const> frustums,
+                    Frustum const *occluded) {
+  m_culledFrustums.assign(frustums.begin(), frustums.end());
+  m_frustums.clear();
+  for (auto *frustum : frustums)
+    m_frustums.push_back(*frustum);
+
+  auto occludedPass = InstanceCulling::NO_OCCLUSION;
+  if (occluded) {
+    auto found =
+        std::find(m_culledFrustums.begin(), m_culledFrustums.end(), occluded);
+    if (found == m_culledFrustums.end())
+      throw std::runtime_error(
+          "[CUBES][ERROR] occluded frustum is not one of culled frustums");
+    occludedPass = found - m_culledFrustums.begin();
   }
+
+  m_culling->cull(buffer, m_cubes.size(), m_frustums, occludedPass);
+}
+
+void CubePool::cullOccluded(vkw::CommandBuffer &buffer,
+                            DepthPyramid const &pyramid,
+                            glm::mat4 const &viewProjection) {
+  m_culling->cullOccluded(buffer, pyramid, viewProjection);
 }
 
-void CubePool::draw(RenderEngine::GraphicsRecordingState &state) const {
+void CubePool::drawDisoccluded(
+    RenderEngine::GraphicsRecordingState &state) const {
   bind(state);
+  m_culling->drawDisoccluded(state.commands());
+}
 
-  state.commands().draw(36, m_cubeCount, 0, 0);
+void CubePool::draw(RenderEngine::GraphicsRecordingState &state,
+                    Frustum const &frustum) const {
+  auto found =
+      std::find(m_culledFrustums.begin(), m_culledFrustums.end(), &frustum);
+  if (found == m_culledFrustums.end())
+    throw std::runtime_error(
+        "[CUBES][ERROR] cubes are drawn for frustum not culled this frame");
+
+  bind(state);
+  m_culling->draw(state.commands(), found - m_culledFrustums.begin());
 }
 
 void CubePool::bind(RenderEngine::GraphicsRecordingState &state) const {
@@ -45,17 +211,11 @@ void CubePool::bind(RenderEngine::GraphicsRecordingState &state) const {
 }
 
 CubePool::M_Cube_geometry::M_Cube_geometry(vkw::Device &device,
-                                           RenderEngine::GeometryLayout &layout,
-                                           uint32_t maxCubes)
+                                           RenderEngine::GeometryLayout &layout)
     : RenderEngine::Geometry(layout),
       m_vertices(device, m_makeCube().size(),
                  {.usage = VMA_MEMORY_USAGE_GPU_ONLY},
-                 VK_BUFFER_USAGE_TRANSFER_DST_BIT),
-      m_instances(device, maxCubes,
-                  {.usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
-                   .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT}) {
-  m_instances.map();
-  m_instance_mapped = m_instances.mapped().data();
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT) {
   VmaAllocationCreateInfo createInfo{};
   createInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
   createInfo.requiredFlags |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
@@ -228,7 +388,24 @@ void CubePool::M_Cube_geometry::bind(
     RenderEngine::GraphicsRecordingState &state) const {
   RenderEngine::Geometry::bind(state);
   state.commands().bindVertexBuffer(m_vertices, 0, 0);
-  state.commands().bindVertexBuffer(m_instances, 1, 0);
+}
+
+void CubePool::M_Cube_geometry::bindInstances(InstanceCulling &culling) {
+  set().writeStorageBuffer(0, culling.instanceBuffer());
+  set().writeStorageBuffer(1, culling.visibleBuffer());
+}
+
+CubePoolSettings::CubePoolSettings(GUIFrontEnd &gui, CubePool const &pool)
+    : GUIWindow(gui, WindowSettings{.title = "Cubes"}),
+      m_simulation(pool.simulation()) {}
+
+void CubePoolSettings::onGui() {
+  bool device = m_simulation == CubePool::Simulation::DEVICE;
+  if (ImGui::Checkbox("Simulate on device", &device))
+    m_simulation =
+        device ? CubePool::Simulation::DEVICE : CubePool::Simulation::HOST;
+  ImGui::Text("Host simulation: %s",
+              CubeSimulation::vectorized() ? "AVX2" : "scalar");
 }
 
 } // namespace TestApp
@@ -1,26 +1,32 @@
 #ifndef TESTAPP_CUBEGEOMETRY_H
 #define TESTAPP_CUBEGEOMETRY_H
 
+#include "Camera.h"
+#include "CubeSimulation.h"
+#include "GUI.h"
+#include "InstanceCulling.h"
+#include "SlotMap.h"
+#include <RenderEngine/JobSystem.h>
 #include <RenderEngine/Pipelines/PipelinePool.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <map>
+#include <memory>
 #include <optional>
+#include <span>
 #include <vkw/Pipeline.hpp>
 #include <vkw/VertexBuffer.hpp>
 
 namespace TestApp {
 
-class Cube;
-
 class CubePool {
 public:
   CubePool(vkw::Device &device,
            RenderEngine::ShaderLoaderInterface &shaderLoader,
-           uint32_t maxCubes);
+           uint32_t maxCubes, uint32_t maxPasses);
 
   CubePool(CubePool const &another) = delete;
 
+  /** Must not be called while cubes are simulated ahead. */
   CubePool(CubePool &&another) noexcept;
 
   CubePool &operator=(CubePool const &another) = delete;
@@ -37,132 +43,147 @@ public:
     glm::vec2 uv;
   };
 
-  struct PerInstance
-      : public vkw::AttributeBase<
-            vkw::VertexAttributeType::VEC4F, vkw::VertexAttributeType::VEC4F,
-            vkw::VertexAttributeType::VEC4F, vkw::VertexAttributeType::VEC4F> {
-    glm::mat4 model;
-  };
+  enum class Simulation { HOST, DEVICE };
 
-  void bind(RenderEngine::GraphicsRecordingState &state) const;
+  /** @return handle of added cube, valid until it is removed */
+  SlotMap::Handle addCube(CubeSimulation::Cube const &cube);
 
-  void draw(RenderEngine::GraphicsRecordingState &state) const;
+  void removeCube(SlotMap::Handle cube);
 
-  virtual ~CubePool() = default;
+  bool contains(SlotMap::Handle cube) const { return m_cubes.contains(cube); }
 
-private:
-  friend class Cube;
+  /** Current state of cube. Like adding and removing cubes, it syncs with
+   *  device simulation and must be called when no frame is executing.
+   */
+  CubeSimulation::Cube cube(SlotMap::Handle handle);
 
-  RenderEngine::GeometryLayout m_geometry_layout;
+  void setCube(SlotMap::Handle handle, CubeSimulation::Cube const &cube);
 
-  struct M_Cube_geometry : public RenderEngine::Geometry {
+  /** Moves cubes and writes their matrices into instances culled next. On
+   *  host it is done before return, on device it is recorded into buffer.
+   *  If cubes were simulated ahead, it only waits for that.
+   */
+  void update(vkw::CommandBuffer &buffer, float deltaTime);
 
-    M_Cube_geometry(vkw::Device &device, RenderEngine::GeometryLayout &layout,
-                    uint32_t maxCubes);
+  /** Starts moving cubes on host for the next frame on worker threads. Its
+   *  matrices go to instance region device does not read, so it runs while
+   *  the submitted frame executes. Should be called after frame is
+   *  submitted, deltaTime is the expected time of the next frame.
+   */
+  void simulateAhead(float deltaTime);
 
-    PerInstance &at(uint32_t index) { return m_instance_mapped[index]; }
+  Simulation simulation() const { return m_simulationMode; }
 
-    PerInstance const &at(uint32_t index) const {
-      return m_instance_mapped[index];
-    }
+  /** Moves state of cubes to the other simulation, so motion continues
+   *  where it was. Like adding and removing cubes while simulated on device,
+   *  it blocks on copies and must be called when no frame is executing.
+   */
+  void setSimulation(Simulation simulation);
 
-    void bind(RenderEngine::GraphicsRecordingState &state) const override;
+  void bind(RenderEngine::GraphicsRecordingState &state) const;
 
-    void flush() { m_instances.flush(); }
+  /** Records culling of all cubes against each frustum. Must be called once
+   *  per frame after cubes are updated and before they are drawn, outside of
+   *  render pass. Frustums must stay alive until they are drawn.
+   *
+   *  @param occluded  one of frustums whose pass is also occlusion culled,
+   *  draw() of it draws cubes visible in the previous frame
+   */
+  void cull(vkw::CommandBuffer &buffer,
+            std::span<Frustum const *const> frustums,
+            Frustum const *occluded = nullptr);
 
-  private:
-    static std::vector<PerVertex> m_makeCube();
+  /** Records occlusion culling of cubes against depth of the occluded pass
+   *  drawn so far. Must be called outside of render pass.
+   */
+  void cullOccluded(vkw::CommandBuffer &buffer, DepthPyramid const &pyramid,
+                    glm::mat4 const &viewProjection);
 
-    vkw::VertexBuffer<PerVertex> m_vertices;
-    vkw::VertexBuffer<PerInstance> m_instances;
-    PerInstance *m_instance_mapped;
-  } m_geometry;
+  /** Draws cubes of occluded pass hidden in the previous frame and visible
+   *  now.
+   */
+  void drawDisoccluded(RenderEngine::GraphicsRecordingState &state) const;
 
-  std::map<uint32_t, Cube *> m_cubes{};
-  uint32_t m_cubeCount = 0;
-};
+  /** Draws cubes whose bounds intersect frustum. Frustum must be one of
+   *  frustums culled this frame.
+   */
+  void draw(RenderEngine::GraphicsRecordingState &state,
+            Frustum const &frustum) const;
 
-class Cube {
-public:
-  Cube(CubePool &pool, glm::vec3 position, glm::vec3 scale, glm::vec3 rotation)
-      : m_translate(position), m_scale(scale), m_rotate(rotation),
-        m_parent(&pool), m_id(pool.m_cubeCount++) {
-    m_parent->m_cubes.emplace(m_id, this);
-    m_velocity = {std::rand() % 10 - 5.0f, std::rand() % 10 - 5.0f,
-                  std::rand() % 10 - 5.0f};
-    m_rotation = {std::rand() % 40 - 20.0f, std::rand() % 40 - 20.0f,
-                  std::rand() % 40 - 20.0f};
-    setModelMatrix();
-  };
+  uint32_t cubeCount() const { return m_cubes.size(); }
 
-  Cube(Cube &&another) noexcept
-      : m_translate(another.m_translate), m_scale(another.m_scale),
-        m_rotate(another.m_rotate), m_parent(another.m_parent),
-        m_id(another.m_id), m_velocity(another.m_velocity),
-        m_rotation(another.m_rotation), m_static(another.m_static) {
-    m_parent->m_cubes.at(m_id) = this;
-    another.m_id = M_MOVED_OUT;
-  };
+  /** Cube instances drawn by all passes of the previous frame. */
+  uint32_t drawnCount() const { return m_culling->drawnCount(); }
 
-  virtual ~Cube() {
-    if (m_id == M_MOVED_OUT)
-      return;
+  /** Cube instances drawn by late occlusion phase of the previous frame. */
+  uint32_t disoccludedCount() const { return m_culling->disoccludedCount(); }
 
-    m_parent->m_cubeCount--;
-    auto &cubes = m_parent->m_cubes;
+  virtual ~CubePool();
 
-    if (cubes.at(m_parent->m_cubeCount) != this) {
-      auto *swapCube = cubes.at(m_parent->m_cubeCount);
-      swapCube->m_id = m_id;
-      cubes.erase(m_parent->m_cubeCount);
-      cubes.at(m_id) = swapCube;
-    }
-  }
+private:
+  /** Downloads state of cubes simulated on device since the last sync and
+   *  waits for cubes simulated ahead.
+   */
+  void m_syncHost();
 
-  void makeStatic() { m_static = true; }
+  void m_waitAhead();
 
-  void update(double deltaTime) {
-    if (!m_static) {
-      m_translate += m_velocity * (float)deltaTime;
-      m_rotate += m_rotation * (float)deltaTime;
-    }
+  RenderEngine::GeometryLayout m_geometry_layout;
 
-    setModelMatrix();
-  }
+  struct M_Cube_geometry : public RenderEngine::Geometry {
 
-private:
-  void setModelMatrix() {
-    model.model = glm::translate(glm::mat4(1.0f), m_translate);
-    model.model = glm::rotate(model.model, glm::radians(m_rotate.x),
-                              glm::vec3{1.0f, 0.0f, 0.0f});
-    model.model = glm::rotate(model.model, glm::radians(m_rotate.y),
-                              glm::vec3{0.0f, 1.0f, 0.0f});
-    model.model = glm::rotate(model.model, glm::radians(m_rotate.z),
-                              glm::vec3{0.0f, 0.0f, 1.0f});
-    model.model = glm::scale(model.model, m_scale);
+    M_Cube_geometry(vkw::Device &device, RenderEngine::GeometryLayout &layout);
+
+    void bind(RenderEngine::GraphicsRecordingState &state) const override;
 
-    m_parent->m_geometry.at(m_id) = model;
-  }
+    /** Writes buffers vertex shader fetches matrices of visible cubes
+     *  from. Instance buffer changes with simulation.
+     */
+    void bindInstances(InstanceCulling &culling);
 
-  friend class CubePool;
+  private:
+    static std::vector<PerVertex> m_makeCube();
 
-  CubePool::PerInstance model;
-#undef max
-  static constexpr const uint32_t M_MOVED_OUT =
-      std::numeric_limits<uint32_t>::max();
+    vkw::VertexBuffer<PerVertex> m_vertices;
+  } m_geometry;
 
-  uint32_t m_id;
+  std::unique_ptr<InstanceCullingLayout> m_cullingLayout;
+  std::unique_ptr<InstanceOcclusionLayout> m_occlusionLayout;
+  std::unique_ptr<InstanceCulling> m_culling;
+  // dense index of each cube in simulation and instances
+  SlotMap m_cubes;
+  CubeSimulation m_simulation;
+  std::unique_ptr<CubeSimulationLayout> m_simulationLayout;
+  std::unique_ptr<DeviceCubeSimulation> m_deviceSimulation;
+  Simulation m_simulationMode = Simulation::HOST;
+  // whether each simulation holds the latest state, both may at once
+  bool m_hostCurrent = true;
+  bool m_deviceCurrent = false;
+  // host simulation of the next frame started by simulateAhead()
+  RenderEngine::JobSystem::JobHandle m_ahead;
+  // cubes were moved for the next frame, matrices are stale if cubes were
+  // changed since
+  bool m_movedAhead = false;
+  bool m_aheadStale = false;
+
+  // frustums culled this frame in order of culling passes
+  std::vector<Frustum const *> m_culledFrustums;
+  std::vector<Frustum> m_frustums;
+};
 
-  glm::vec3 m_translate;
-  glm::vec3 m_rotate;
-  glm::vec3 m_scale;
+class CubePoolSettings : public GUIWindow {
+public:
+  CubePoolSettings(GUIFrontEnd &gui, CubePool const &pool);
 
-  glm::vec3 m_rotation;
-  glm::vec3 m_velocity;
+  /** Simulation picked by user, applied by the application between frames.
+   */
+  CubePool::Simulation simulation() const { return m_simulation; }
 
-  bool m_static = false;
+protected:
+  void onGui() override;
 
-  CubePool *m_parent;
+private:
+  CubePool::Simulation m_simulation;
 };
 
 } // namespace TestApp
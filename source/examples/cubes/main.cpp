@@ -1,11 +1,12 @@
 #include "CommonApp.h"
 #include "CubeGeometry.h"
+#include "DepthPyramid.h"
 #include "ErrorCallbackWrapper.h"
 #include "GlobalLayout.h"
 #include "ShadowPass.h"
 #include "SkyBox.h"
+#include <array>
 #include <cmath>
-#include <thread>
 
 #undef max
 #undef min
@@ -53,7 +54,7 @@ private:
 
 class CubesApp final : public CommonApp {
 public:
-  CubesApp(unsigned cubeCount = 50000)
+  CubesApp(unsigned cubeCount = 1000000)
       : CommonApp(AppCreateInfo{
             true, "Cubes", [](auto &i) {},
             [](vkw::PhysicalDevice &device) {
@@ -69,16 +70,19 @@ public:
         globals(device(), shaderLoader(), onScreenPass(), 0, window().camera(),
                 shadow, skybox),
         globalLayoutSettings(gui(), globals),
-        cubePool(device(), shaderLoader(), cubeCount),
+        cubePool(device(), shaderLoader(), cubeCount,
+                 1 + TestApp::SHADOW_CASCADES_COUNT),
+        cubePoolSettings(gui(), cubePool),
         texturedSurface(device(), shaderLoader(), textureLoader(),
-                        textureSampler, "image") {
+                        textureSampler, "image"),
+        depthPyramid(std::make_unique<DepthPyramid>(device(), shaderLoader(),
+                                                    mainDepthImage())) {
 
     shadow.update(window().camera(), skybox.sunDirection());
 
-    cubes
-        .emplace_back(cubePool, glm::vec3{500.0f, -500.0f, 500.0f},
-                      glm::vec3{1000.0f}, glm::vec3{0.0f})
-        .makeStatic();
+    cubePool.addCube({.position = glm::vec3{500.0f, -500.0f, 500.0f},
+                      .rotation = glm::vec3{0.0f},
+                      .scale = glm::vec3{1000.0f}});
     for (int i = 0; i < cubeCount - 1; ++i) {
       float scale_mag = (float)(rand() % 5) + 1.0f;
       glm::vec3 pos = glm::vec3((float)(rand() % 1000), (float)(rand() % 1000),
@@ -86,8 +90,15 @@ public:
       glm::vec3 rotate =
           glm::vec3((float)(rand() % 1000), (float)(rand() % 1000),
                     (float)(rand() % 1000));
-      auto scale = glm::vec3(scale_mag);
-      cubes.emplace_back(cubePool, pos, scale, rotate);
+      glm::vec3 velocity = {rand() % 10 - 5.0f, rand() % 10 - 5.0f,
+                            rand() % 10 - 5.0f};
+      glm::vec3 angularVelocity = {rand() % 40 - 20.0f, rand() % 40 - 20.0f,
+                                   rand() % 40 - 20.0f};
+      cubePool.addCube({.position = pos,
+                        .rotation = rotate,
+                        .scale = glm::vec3(scale_mag),
+                        .velocity = velocity,
+                        .angularVelocity = angularVelocity});
     }
     // TODO: enable it
 #if 0
@@ -101,34 +112,35 @@ public:
         };
 #endif
     shadow.onPass = [this](RenderEngine::GraphicsRecordingState &state,
-                           const Camera &camera) {
-      cubePool.bind(state);
-      state.bindPipeline();
-      cubePool.draw(state);
+                           const Camera &camera, const Frustum &casters) {
+      cubePool.draw(state, casters);
     };
 
-    threads.reserve(thread_count);
+    addStatistics([this]() {
+      ImGui::Text("Cubes: %u total, %u instances drawn by all passes",
+                  cubePool.cubeCount(), cubePool.drawnCount());
+      ImGui::Text("Cubes disoccluded: %u", cubePool.disoccludedCount());
+    });
+
+    // cubes hidden by cubes drawn first are culled before late pass
+    enableLateMainPass(true);
   }
 
 protected:
   void preMainPass(vkw::PrimaryCommandBuffer &buffer,
                    RenderEngine::GraphicsPipelinePool &pool) override {
-    auto per_thread = cubes.size() / thread_count;
-
-    threads.clear();
-
     auto deltaTime = window().clock().frameTime();
 
-    for (int i = 0; i < thread_count; ++i) {
-      threads.emplace_back([this, i, per_thread, deltaTime]() {
-        for (int j = per_thread * i;
-             j < std::min(per_thread * (i + 1), cubes.size()); ++j)
-          cubes.at(j).update(deltaTime);
-      });
-    }
+    cubePool.update(buffer, deltaTime);
+
+    std::array<Frustum const *, 1 + TestApp::SHADOW_CASCADES_COUNT> frustums;
+    uint32_t frustumCount = 0;
+    frustums.at(frustumCount++) = &window().camera().frustum();
+    for (auto &casters : shadow.passFrustums())
+      frustums.at(frustumCount++) = &casters;
+    cubePool.cull(buffer, {frustums.data(), frustumCount},
+                  &window().camera().frustum());
 
-    for (auto &thread : threads)
-      thread.join();
     RenderEngine::GraphicsRecordingState recorder{buffer, pool};
     shadow.execute(buffer, recorder);
   }
@@ -139,7 +151,35 @@ protected:
     globals.bind(recorder);
     recorder.setMaterial(texturedSurface.get());
 
-    cubePool.draw(recorder);
+    cubePool.draw(recorder, window().camera().frustum());
+  }
+
+  void betweenMainPasses(vkw::PrimaryCommandBuffer &buffer,
+                         RenderEngine::GraphicsPipelinePool &pool) override {
+    auto &camera = window().camera();
+    depthPyramid->build(buffer);
+    cubePool.cullOccluded(buffer, *depthPyramid,
+                          camera.projection() * camera.cameraSpace());
+  }
+
+  void onLateMainPass(vkw::PrimaryCommandBuffer &buffer,
+                      RenderEngine::GraphicsRecordingState &recorder) override {
+    globals.bind(recorder);
+    recorder.setMaterial(texturedSurface.get());
+
+    cubePool.drawDisoccluded(recorder);
+  }
+
+  void postSubmit() override {
+    // next frame writes instances device does not read, so cubes are moved
+    // while this one executes
+    cubePool.simulateAhead(window().clock().frameTime());
+  }
+
+  void onFramebufferResize() override {
+    CommonApp::onFramebufferResize();
+    depthPyramid = std::make_unique<DepthPyramid>(device(), shaderLoader(),
+                                                  mainDepthImage());
   }
 
   void onPollEvents() override {
@@ -149,6 +189,9 @@ protected:
     if (skyboxSettings.needRecomputeOutScatter()) {
       skybox.recomputeOutScatter();
     }
+    // previous frame is finished, so state may be copied between simulations
+    if (cubePoolSettings.simulation() != cubePool.simulation())
+      cubePool.setSimulation(cubePoolSettings.simulation());
   }
 
 private:
@@ -177,12 +220,11 @@ private:
   SkyBoxSettings skyboxSettings;
   GlobalLayout globals;
   GlobalLayoutSettings globalLayoutSettings;
-  unsigned thread_count = 12;
   TestApp::CubePool cubePool;
-  std::vector<TestApp::Cube> cubes;
+  TestApp::CubePoolSettings cubePoolSettings;
   TexturedSurface texturedSurface;
-
-  std::vector<std::thread> threads;
+  // built from depth of cubes drawn by the first main pass
+  std::unique_ptr<DepthPyramid> depthPyramid;
 };
 
 int runCubes() {
@@ -1,11 +1,13 @@
 #include "AssetPath.inc"
 #include "CommonApp.h"
+#include "CookedModel.h"
 #include "ErrorCallbackWrapper.h"
 #include "GlobalLayout.h"
 #include "Model.h"
 #include "RenderEngine/Window/Boxer.h"
 #include "ShadowPass.h"
 #include "SkyBox.h"
+#include <cmath>
 #include <cwchar>
 
 using namespace TestApp;
@@ -58,13 +60,24 @@ listAvailableModels(std::filesystem::path const &root) {
   }
   return ret;
 }
+/** Block compressed textures if device can sample them, RGBA otherwise. */
+std::optional<RenderEngine::TextureCompressionSettings>
+textureCompression(vkw::Device &device) {
+  if (!device.physicalDevice().enabledFeatures().textureCompressionBC)
+    return std::nullopt;
+  return RenderEngine::TextureCompressionSettings{};
+}
+
 std::unique_ptr<GLTFModel>
 tryLoad(vkw::Device &renderer,
         RenderEngine::ShaderLoaderInterface &shaderLoader,
-        DefaultTexturePool &pool, std::filesystem::path const &path) {
+        DefaultTexturePool &pool, TextureCache &textureCache,
+        std::filesystem::path const &path, ModelCache const *cache,
+        ResidencyManager &residency) {
 
   try {
-    return std::make_unique<GLTFModel>(renderer, shaderLoader, pool, path);
+    return std::make_unique<GLTFModel>(renderer, shaderLoader, pool,
+                                       textureCache, path, cache, &residency);
   } catch (std::runtime_error &e) {
     std::stringstream ss;
     ss << "Error while loading " << path.filename();
@@ -77,12 +90,25 @@ tryLoad(vkw::Device &renderer,
 class ModelApp final : public CommonApp {
 public:
   ModelApp()
-      : CommonApp(AppCreateInfo{true, "Model"}),
+      : CommonApp(AppCreateInfo{
+            .enableValidation = true,
+            .applicationName = "Model",
+            .amendDeviceCreateInfo =
+                [](vkw::PhysicalDevice &device) {
+                  if (device.isFeatureSupported(
+                          vkw::PhysicalDevice::feature::textureCompressionBC))
+                    device.enableFeature(
+                        vkw::PhysicalDevice::feature::textureCompressionBC);
+                }}),
         shadowPass(device(), shaderLoader()),
         skybox(device(), onScreenPass(), 0, shaderLoader()),
         globalState{device(),          shaderLoader(), onScreenPass(), 0,
                     window().camera(), shadowPass,     skybox},
         skyboxSettings(gui(), skybox, "Sky box"), defaultTextures(device()),
+        residency(device()), textureCache(device()),
+        modelCache(std::filesystem::path(EXAMPLE_ASSET_PATH) / "cache" /
+                       "models",
+                   textureCompression(device())),
         modelPipelinePool(device(), shaderLoader()), modelTransform(gui()) {
     modelList = listAvailableModels(EXAMPLE_GLTF_PATH);
 
@@ -102,7 +128,8 @@ public:
 
     int loadedModel = 0;
     for (auto &modelPath : modelList) {
-      model = tryLoad(device(), shaderLoader(), defaultTextures, modelPath);
+      model = tryLoad(device(), shaderLoader(), defaultTextures, textureCache,
+                      modelPath, &modelCache, residency);
       if (model)
         break;
       loadedModel++;
@@ -111,9 +138,11 @@ public:
       throw std::runtime_error("Failed to load any GLTF model");
     }
 
-    model = std::make_unique<GLTFModel>(device(), shaderLoader(),
-                                        defaultTextures, modelList.front());
+    model = std::make_unique<GLTFModel>(
+        device(), shaderLoader(), defaultTextures, textureCache,
+        modelList.front(), &modelCache, &residency);
     instance = std::make_unique<GLTFModelInstance>(model->createNewInstance());
+    startAnimation(*instance);
     instance->update();
 
     modelTransform.gui_impl = [this, loadedModel]() {
@@ -135,8 +164,10 @@ public:
       upd =
           ImGui::SliderFloat("scale z", &instance->scale.z, 0.1f, 10.0f) | upd;
 
+      upd = ImGui::SliderInt("instances", &instanceCount, 1, 10000) | upd;
+
       if (upd)
-        instance->update();
+        updateInstances();
 
       auto oldSelect = current_model;
       if (ImGui::Combo("models", &current_model, modelListCstr.data(),
@@ -146,9 +177,11 @@ public:
           auto dummy = std::move(instance);
         }
         instance.reset();
+        copies.clear();
         modelPipelinePool.clear();
-        auto expectModel = tryLoad(device(), shaderLoader(), defaultTextures,
-                                   modelList.at(current_model));
+        auto expectModel =
+            tryLoad(device(), shaderLoader(), defaultTextures, textureCache,
+                    modelList.at(current_model), &modelCache, residency);
         if (!expectModel) {
           current_model = oldSelect;
         } else {
@@ -157,7 +190,8 @@ public:
         }
         instance =
             std::make_unique<GLTFModelInstance>(model->createNewInstance());
-        instance->update();
+        startAnimation(*instance);
+        updateInstances();
       }
 
       static float splitL = window().camera().splitLambda();
@@ -173,14 +207,81 @@ public:
     };
 
     shadowPass.onPass = [this](RenderEngine::GraphicsRecordingState &state,
-                               const Camera &camera) {
-      instance->drawGeometryOnly(state);
+                               const Camera &camera, const Frustum &casters) {
+      model->drawGeometryOnly(state, casters);
     };
+
+    addStatistics([this]() {
+      auto &stats = model->cullingStatistics();
+      ImGui::Text("Model primitives: %u drawn, %u culled", stats.visible,
+                  stats.culled);
+      auto &streaming = textureCache.streamer().statistics();
+      ImGui::Text("Textures: %zuM resident, %zuK uploaded, %u levels pending",
+                  streaming.residentBytes >> 20, streaming.uploadedBytes >> 10,
+                  streaming.pendingLevels);
+      auto &memory = residency.statistics();
+      ImGui::Text("Device memory: %zuM of %zuM budget", memory.usage >> 20,
+                  memory.budget >> 20);
+      ImGui::Text("Meshes: %u resident, %u evicted, %u evictions",
+                  memory.resident, memory.evicted, memory.evictions);
+      auto &cached = textureCache.statistics();
+      ImGui::Text("Texture cache: %u hits, %u misses, %u unused (%zuM)",
+                  cached.hits, cached.misses, cached.unused,
+                  cached.unusedBytes >> 20);
+      if (model->animationCount() > 0)
+        ImGui::Text("Animation: %s (%u total)",
+                    std::string(model->animationName(0)).c_str(),
+                    model->animationCount());
+    });
+  }
+
+  /** Loops first animation of the model, if it has any. */
+  void startAnimation(GLTFModelInstance &target) {
+    if (model->animationCount() > 0)
+      target.playAnimation(0);
+  }
+
+  /** Places copies of the model on a square grid around the main instance. */
+  void updateInstances() {
+    instance->update();
+
+    if (copies.size() > instanceCount - 1)
+      copies.erase(copies.begin() + instanceCount - 1, copies.end());
+    while (copies.size() < instanceCount - 1) {
+      copies.emplace_back(model->createNewInstance());
+      startAnimation(copies.back());
+    }
+
+    auto side = static_cast<int>(std::ceil(std::sqrt(instanceCount)));
+    auto spacing = glm::max(model->bounds().radius * 2.0f, 0.1f) *
+                   glm::max(glm::max(instance->scale.x, instance->scale.y),
+                            instance->scale.z);
+    for (int i = 0; i < copies.size(); ++i) {
+      auto &copy = copies.at(i);
+      auto cell = i + 1;
+      copy.rotation = instance->rotation;
+      copy.scale = instance->scale;
+      copy.translation = instance->translation +
+                         glm::vec3(cell % side, 0.0f, cell / side) * spacing;
+      copy.update();
+    }
   }
 
 protected:
   void preMainPass(vkw::PrimaryCommandBuffer &buffer,
                    RenderEngine::GraphicsPipelinePool &pool) override {
+    residency.update(buffer);
+    // textures may grow into device memory left within the budget
+    auto &streaming = textureCache.streamer();
+    auto available =
+        static_cast<int64_t>(streaming.statistics().residentBytes) +
+        residency.headroom();
+    streaming.settings().memoryBudget =
+        std::min<size_t>(textureCache.settings().streaming.memoryBudget,
+                         std::max<int64_t>(available, 0));
+    textureCache.update(buffer);
+    model->streamTextures(window().camera(), currentSurfaceExtents().height);
+    model->skin(buffer);
     RenderEngine::GraphicsRecordingState recorder{buffer, modelPipelinePool};
     shadowPass.execute(buffer, recorder);
   }
@@ -193,10 +294,12 @@ protected:
 
     globalState.bind(localRecorder);
 
-    instance->draw(localRecorder);
+    model->draw(localRecorder, window().camera().frustum());
   }
 
   void onPollEvents() override {
+    model->newFrame();
+    model->animate(window().clock().frameTime());
     globalState.update();
     shadowPass.update(window().camera(), skybox.sunDirection());
     skybox.update(window().camera());
@@ -212,8 +315,14 @@ private:
   GlobalLayout globalState;
   SkyBoxSettings skyboxSettings;
   TestApp::DefaultTexturePool defaultTextures;
+  // shared by all loaded models, must outlive them
+  ResidencyManager residency;
+  TextureCache textureCache;
+  ModelCache modelCache;
   std::unique_ptr<GLTFModel> model;
   std::unique_ptr<GLTFModelInstance> instance;
+  std::vector<GLTFModelInstance> copies;
+  int instanceCount = 1;
   RenderEngine::GraphicsPipelinePool modelPipelinePool;
   std::vector<std::filesystem::path> modelList;
   std::vector<std::string> modelListString{};
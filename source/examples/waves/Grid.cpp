@@ -1,5 +1,7 @@
 #include "Grid.h"
 #include "common/Utils.h"
+#include <algorithm>
+#include <cmath>
 
 namespace TestApp {
 
@@ -14,13 +16,24 @@ void GridSettings::onGui() {
   auto &grid = m_grid.get();
   if (!ImGui::CollapsingHeader("Tile grid settings"))
     return;
+  const char *modes[] = {"Cascades", "CDLOD"};
+  int mode = static_cast<int>(grid.mode);
+  if (ImGui::Combo("Mode", &mode, modes, 2))
+    grid.mode = static_cast<Grid::Mode>(mode);
   ImGui::SliderInt("Tile cascades", &grid.cascades, 1, 15);
-  ImGui::SliderInt("Cascade power", &grid.cascadePower, 1, 4);
   ImGui::SliderFloat("Tile scale", &grid.tileScale, 0.1f, 10.0f);
-  ImGui::SliderFloat("Elevation scale", &grid.elevationScale, 0.0f, 1.0f);
-  ImGui::Checkbox("Camera aligned", &grid.cameraAligned);
+  // CDLOD levels follow distance including elevation and are world aligned
+  if (grid.mode == Grid::Mode::CDLOD) {
+    ImGui::SliderFloat("LOD range", &grid.lodRange, 2.0f, 8.0f);
+    ImGui::Text("Used LOD range: %.2f", grid.usedLodRange());
+  } else {
+    ImGui::SliderInt("Cascade power", &grid.cascadePower, 1, 4);
+    ImGui::SliderFloat("Elevation scale", &grid.elevationScale, 0.0f, 1.0f);
+    ImGui::Checkbox("Camera aligned", &grid.cameraAligned);
+  }
   ImGui::Checkbox("Enabled", &m_enabled);
   ImGui::Text("Total tiles: %d", grid.totalTiles());
+  ImGui::Text("Total triangles: %d", grid.totalTriangles());
 }
 } // namespace TestApp
 
@@ -29,7 +42,7 @@ TestApp::Grid::Grid(vkw::Device &device, bool cameraAligned)
       m_buffer(device, 2 * TILE_DIM * TILE_DIM,
                VmaAllocationCreateInfo{.usage = VMA_MEMORY_USAGE_GPU_ONLY},
                VK_BUFFER_USAGE_TRANSFER_DST_BIT),
-      cameraAligned(cameraAligned) {
+      m_tiles(device, 256), cameraAligned(cameraAligned) {
 
   std::vector<PrimitiveAttrs> attrs{};
 
@@ -68,6 +81,14 @@ TestApp::Grid::Grid(vkw::Device &device, bool cameraAligned)
   m_buffer = TestApp::createStaticBuffer<vkw::VertexBuffer<PrimitiveAttrs>,
                                          PrimitiveAttrs>(device, attrs.begin(),
                                                          attrs.end());
+
+  // uploads block, so all variants are built before the first draw
+  m_full_tiles.reserve(M_VARIANTS);
+  for (int side = 0; side < M_VARIANTS; ++side)
+    m_full_tiles.emplace_back(
+        side == M_COARSE_TILE
+            ? m_makeCoarseTile(device)
+            : m_makeFullTile(device, static_cast<ConnectSide>(side)));
 }
 
 void TestApp::Grid::m_addConnectingEdge(TestApp::Grid::ConnectSide side,
@@ -137,12 +158,9 @@ void TestApp::Grid::m_addConnectingEdge(TestApp::Grid::ConnectSide side,
   }
 }
 
-vkw::IndexBuffer<VK_INDEX_TYPE_UINT32> const &
-TestApp::Grid::m_full_tile(TestApp::Grid::ConnectSide side) {
-  int iside = static_cast<int>(side);
-  if (m_full_tiles.contains(iside))
-    return m_full_tiles.at(iside);
-
+vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>
+TestApp::Grid::m_makeFullTile(vkw::Device &device,
+                              TestApp::Grid::ConnectSide side) {
   std::vector<uint32_t> indices;
 
   indices.reserve((TILE_DIM) * (TILE_DIM)*6u);
@@ -170,22 +188,34 @@ TestApp::Grid::m_full_tile(TestApp::Grid::ConnectSide side) {
     m_addConnectingEdge(side, indices);
   }
 
-  return m_full_tiles
-      .emplace(iside, TestApp::createStaticBuffer<
-                          vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>, uint32_t>(
-                          m_device, indices.begin(), indices.end()))
-      .first->second;
+  return TestApp::createStaticBuffer<vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>,
+                                     uint32_t>(device, indices.begin(),
+                                               indices.end());
 }
 
-void TestApp::Grid::draw(RenderEngine::GraphicsRecordingState &buffer,
-                         glm::vec3 center, Camera const &camera) {
-  struct PushConstantBlock {
-    glm::vec2 translate;
-    float scale = 1.0f;
-    float cellSize;
-    glm::vec4 arbitraryData;
-  } constants;
+vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>
+TestApp::Grid::m_makeCoarseTile(vkw::Device &device) {
+  std::vector<uint32_t> indices;
+
+  indices.reserve((TILE_DIM / 2) * (TILE_DIM / 2) * 6u);
+
+  for (int i = 0; i < TILE_DIM; i += 2)
+    for (int j = 0; j < TILE_DIM; j += 2) {
+      indices.push_back(i + (TILE_DIM + 1) * j);
+      indices.push_back((i + 2) + (TILE_DIM + 1) * j);
+      indices.push_back(i + (TILE_DIM + 1) * (j + 2));
+      indices.push_back((i + 2) + (TILE_DIM + 1) * (j + 2));
+      indices.push_back(i + (TILE_DIM + 1) * (j + 2));
+      indices.push_back((i + 2) + (TILE_DIM + 1) * j);
+    }
+
+  return TestApp::createStaticBuffer<vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>,
+                                     uint32_t>(device, indices.begin(),
+                                               indices.end());
+}
 
+void TestApp::Grid::draw(RenderEngine::GraphicsRecordingState &buffer,
+                         glm::vec3 center, Frustum const &frustum) {
 #if 0
     if (wireframe)
         buffer.bindGraphicsPipeline(m_wireframe_pipeline);
@@ -198,12 +228,48 @@ void TestApp::Grid::draw(RenderEngine::GraphicsRecordingState &buffer,
     buffer.bindVertexBuffer();
 #endif
 
+  for (auto &tiles : m_visibleTiles)
+    tiles.clear();
+  m_totalTiles = 0;
+  m_totalTriangles = 0;
+
+  if (mode == Mode::CDLOD)
+    m_selectNodes(center, frustum);
+  else
+    m_selectCascades(center, frustum);
+
+  if (m_totalTiles == 0)
+    return;
+
+  // tiles of the same variant are contiguous, so each variant is drawn by
+  // a single instanced call
+  auto first = m_tiles.begin(m_totalTiles);
+  auto slot = first;
+  for (auto &tiles : m_visibleTiles)
+    for (auto &tile : tiles)
+      m_tiles.at(slot++) = tile;
+  m_tiles.end(m_totalTiles);
+  m_tiles.flush(first, m_totalTiles);
+
   preDraw(buffer);
 
   buffer.commands().bindVertexBuffer(m_buffer, 0, 0);
+  buffer.commands().bindVertexBuffer(m_tiles.buffer(), 1, 0);
+
+  for (int side = 0; side < M_VARIANTS; ++side) {
+    auto count = m_visibleTiles[side].size();
+    if (count != 0) {
+      auto &indexBuffer = m_full_tiles.at(side);
+      buffer.commands().bindIndexBuffer(indexBuffer, 0);
+      buffer.commands().drawIndexed(indexBuffer.size(), count, 0, 0, first);
+      m_totalTriangles += indexBuffer.size() / 3 * count;
+    }
+    first += count;
+  }
+}
 
-  int cascadeIndex = 0;
-
+void TestApp::Grid::m_selectCascades(glm::vec3 center,
+                                     Frustum const &frustum) {
   auto baseTileSize = tileScale * TILE_SIZE;
   if (!cameraAligned) {
     center = {
@@ -214,8 +280,6 @@ void TestApp::Grid::draw(RenderEngine::GraphicsRecordingState &buffer,
             baseTileSize};
   }
 
-  m_totalTiles = 0;
-
   float elevationFactor = 1.0f + glm::abs(center.y) * elevationScale;
   if (!cameraAligned)
     elevationFactor = 1.0f;
@@ -252,29 +316,120 @@ void TestApp::Grid::draw(RenderEngine::GraphicsRecordingState &buffer,
             glm::vec3(center.x, 0.0f, center.z) +
             glm::vec3(i * TILE_SIZE, 0.0f, j * TILE_SIZE) * scale;
 
-        // Discard tiles that do not appear in camera frustum
-        if (camera.offBounds(
+        // Discard tiles that do not appear in frustum
+        if (!frustum.intersects(
                 tileTranslate + glm::vec3{-2.0f, heightBoundsL.first, -2.0f},
                 tileTranslate + glm::vec3{TILE_SIZE * scale + 2.0f,
                                           heightBoundsL.second,
                                           TILE_SIZE * scale + 2.0f}))
           continue;
 
-        auto &indexBuffer = m_full_tile(cside);
+        TileAttrs tile{};
+        tile.translate = glm::vec2(tileTranslate.x, tileTranslate.z);
+        tile.scale = scale;
+        tile.cellSize = scale * tileScale * TILE_SIZE / (float)TILE_DIM;
+        tile.lodCenter = center;
+        tile.morphSpacing = scale * TILE_SIZE / (float)TILE_DIM;
+        m_visibleTiles.at(static_cast<int>(cside)).push_back(tile);
 
-        constants.translate = glm::vec2(tileTranslate.x, tileTranslate.z);
-        constants.scale = scale;
-        constants.cellSize = scale * tileScale * TILE_SIZE / (float)TILE_DIM;
-        constants.arbitraryData =
-            arbitraryData(constants.translate,
-                          constants.translate + glm::vec2{scale * TILE_SIZE});
+        m_totalTiles++;
+      }
+}
 
-        buffer.commands().bindIndexBuffer(indexBuffer, 0);
+void TestApp::Grid::m_selectNodes(glm::vec3 center, Frustum const &frustum) {
+  auto levels = std::max(cascades, 1);
+  auto leafSize = TILE_SIZE * tileScale;
+
+  // finer nodes reach half of level range and diagonal of their bounds
+  // further, leaf level leaves the smallest part of its range to morph
+  auto minRange =
+      glm::sqrt(2.0f) * (0.5f * leafSize + 2.0f * M_BOUNDS_MARGIN) /
+      ((0.5f - MIN_MORPH_PART) * leafSize);
+  m_lodRange = std::max(lodRange, minRange);
+
+  m_ranges.resize(levels);
+  for (int level = 0; level < levels; ++level)
+    m_ranges[level] = m_lodRange * leafSize * static_cast<float>(1u << level);
+
+  // roots are aligned to their size, so node bounds do not depend on center
+  auto rootSize = leafSize * static_cast<float>(1u << (levels - 1));
+  auto reach = static_cast<int>(std::ceil(m_ranges.back() / rootSize));
+  auto rootX = static_cast<int>(std::floor(center.x / rootSize));
+  auto rootZ = static_cast<int>(std::floor(center.z / rootSize));
+
+  for (int i = -reach; i <= reach; ++i)
+    for (int j = -reach; j <= reach; ++j)
+      m_selectNode(center, frustum,
+                   glm::vec2(rootX + i, rootZ + j) * rootSize, rootSize,
+                   levels - 1);
+}
 
-        buffer.pushConstants(constants, VK_SHADER_STAGE_VERTEX_BIT, 0);
+bool TestApp::Grid::m_selectNode(glm::vec3 center, Frustum const &frustum,
+                                 glm::vec2 begin, float size, int level) {
+  auto bounds = m_nodeBounds(begin, size);
+  auto inRange = [&bounds, center](float range) {
+    auto nearest = glm::clamp(center, bounds.min, bounds.max);
+    return glm::distance(center, nearest) <= range;
+  };
 
-        buffer.commands().drawIndexed(indexBuffer.size(), 1, 0, 0);
+  if (!inRange(m_ranges[level]))
+    return false;
 
-        m_totalTiles++;
-      }
+  // node out of frustum is handled by drawing nothing
+  if (!frustum.intersects(bounds.min, bounds.max))
+    return true;
+
+  if (level == 0 || !inRange(m_ranges[level - 1])) {
+    m_addNode(center, begin, size, level, false);
+    return true;
+  }
+
+  // quadrants out of range of finer level are drawn at this level
+  auto half = 0.5f * size;
+  for (int quadrant = 0; quadrant < 4; ++quadrant) {
+    auto child = begin + glm::vec2(quadrant & 1, quadrant >> 1) * half;
+    if (m_selectNode(center, frustum, child, half, level - 1))
+      continue;
+    auto childBounds = m_nodeBounds(child, half);
+    if (frustum.intersects(childBounds.min, childBounds.max))
+      m_addNode(center, child, half, level, true);
+  }
+
+  return true;
+}
+
+void TestApp::Grid::m_addNode(glm::vec3 center, glm::vec2 begin, float size,
+                              int level, bool coarse) {
+  auto heightBoundsL = heightBounds();
+  auto levelSize = coarse ? 2.0f * size : size;
+  // vertices on edges shared with finer nodes are not morphed yet
+  auto finerReach =
+      0.5f * m_ranges[level] +
+      glm::sqrt(2.0f) * (0.5f * levelSize + 2.0f * M_BOUNDS_MARGIN);
+
+  TileAttrs tile{};
+  tile.translate = begin;
+  tile.scale = size / TILE_SIZE;
+  tile.cellSize = size / (float)TILE_DIM * (coarse ? 2.0f : 1.0f);
+  tile.lodCenter = glm::vec3(
+      center.x,
+      center.y -
+          glm::clamp(center.y, heightBoundsL.first, heightBoundsL.second),
+      center.z);
+  tile.morphSpacing = tile.cellSize;
+  tile.morphRange = glm::vec2(finerReach, m_ranges[level]);
+
+  m_visibleTiles
+      .at(coarse ? M_COARSE_TILE : static_cast<int>(ConnectSide::NO_CONNECT))
+      .push_back(tile);
+  m_totalTiles++;
+}
+
+TestApp::Frustum::Box TestApp::Grid::m_nodeBounds(glm::vec2 begin,
+                                                float size) const {
+  auto heightBoundsL = heightBounds();
+  return {glm::vec3{begin.x - M_BOUNDS_MARGIN, heightBoundsL.first,
+                    begin.y - M_BOUNDS_MARGIN},
+          glm::vec3{begin.x + size + M_BOUNDS_MARGIN, heightBoundsL.second,
+                    begin.y + size + M_BOUNDS_MARGIN}};
 }
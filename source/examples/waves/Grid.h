@@ -3,7 +3,9 @@
 
 #include "GUI.h"
 #include "GlobalLayout.h"
+#include "InstanceRing.h"
 #include "RenderEngine/Pipelines/PipelinePool.h"
+#include <array>
 #include <glm/glm.hpp>
 #include <map>
 #include <vector>
@@ -20,21 +22,69 @@ public:
     glm::vec2 uv;
   };
 
+  /** Placement of a single drawn tile. Cascade of the tile is implied by
+   *  its scale. Vertices morph onto grid of twice morphSpacing while their
+   *  distance from lodCenter goes from morphRange.x to morphRange.y, empty
+   *  range disables morphing. Height of lodCenter is its distance from
+   *  height bounds, so morph follows distance to node bounds.
+   */
+  struct TileAttrs
+      : public vkw::AttributeBase<vkw::VertexAttributeType::VEC4F,
+                                  vkw::VertexAttributeType::VEC4F,
+                                  vkw::VertexAttributeType::VEC2F> {
+    glm::vec2 translate;
+    float scale;
+    float cellSize;
+    glm::vec3 lodCenter;
+    float morphSpacing;
+    glm::vec2 morphRange = glm::vec2{0.0f};
+  };
+
+  /** CASCADES draws fixed concentric rings of tiles stitched at ring
+   *  borders. CDLOD selects nodes of quadtree by their distance from center,
+   *  ranges double with every level and vertices morph close to range end.
+   */
+  enum class Mode { CASCADES, CDLOD };
+
   static constexpr uint32_t TILE_DIM = 64;
   static constexpr float TILE_SIZE = 20.0f;
-
+  /** Least part of CDLOD level range where vertices morph to the coarser
+   *  level. Morph starts past the reach of finer nodes, so vertices on edges
+   *  shared with them stay in place.
+   */
+  static constexpr float MIN_MORPH_PART = 0.1f;
+
+  Mode mode = Mode::CASCADES;
+  /** Cascades or CDLOD levels. */
   int cascades = 7;
   float tileScale = 1.0f;
   float elevationScale = 0.1f;
   bool cameraAligned;
   int cascadePower = 1;
+  /** Range of the finest CDLOD level in its node sizes. Raised to the least
+   *  range leaving MIN_MORPH_PART for morphing, about 2.5 for tile scale 1.
+   */
+  float lodRange = 3.0f;
 
   explicit Grid(vkw::Device &device, bool cameraAligned = true);
 
   int totalTiles() const { return m_totalTiles; }
 
+  int totalTriangles() const { return m_totalTriangles; }
+
+  /** lodRange used by the last CDLOD draw. */
+  float usedLodRange() const { return m_lodRange; }
+
+  /** Must be called once per frame when previous frame finished execution,
+   *  before any tile is drawn.
+   */
+  void newFrame() { m_tiles.reset(); }
+
+  /** Draws tiles around center whose bounds intersect frustum with one
+   *  instanced draw per tile variant.
+   */
   void draw(RenderEngine::GraphicsRecordingState &buffer, glm::vec3 center,
-            Camera const &camera);
+            Frustum const &frustum);
 
 private:
   enum class ConnectSide {
@@ -45,28 +95,61 @@ private:
     NO_CONNECT = 4
   };
 
+  // tile with every second row and column of vertices, quadrant of CDLOD
+  // node drawn at the node level
+  static constexpr int M_COARSE_TILE = 5;
+  static constexpr int M_VARIANTS = 6;
+  // node bounds margin covering horizontal displacement of surface vertices
+  static constexpr float M_BOUNDS_MARGIN = 2.0f;
+
   static void m_addConnectingEdge(ConnectSide side,
                                   std::vector<uint32_t> &indices);
 
-  vkw::IndexBuffer<VK_INDEX_TYPE_UINT32> const &m_full_tile(ConnectSide side);
+  static vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>
+  m_makeFullTile(vkw::Device &device, ConnectSide side);
+
+  static vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>
+  m_makeCoarseTile(vkw::Device &device);
+
+  void m_selectCascades(glm::vec3 center, Frustum const &frustum);
+
+  void m_selectNodes(glm::vec3 center, Frustum const &frustum);
+
+  /** Selects node or its descendants within range of level.
+   *  @return false if node is out of range and parent must draw it
+   */
+  bool m_selectNode(glm::vec3 center, Frustum const &frustum,
+                    glm::vec2 begin, float size, int level);
+
+  void m_addNode(glm::vec3 center, glm::vec2 begin, float size, int level,
+                 bool coarse);
+
+  Frustum::Box m_nodeBounds(glm::vec2 begin, float size) const;
 
   int m_totalTiles = 0;
+  int m_totalTriangles = 0;
+  // CDLOD range of each level
+  std::vector<float> m_ranges;
+  float m_lodRange = 0.0f;
 
   vkw::VertexBuffer<PrimitiveAttrs> m_buffer;
-  std::map<int, vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>> m_full_tiles;
+  // indices of tile of each variant, indexed by ConnectSide and
+  // M_COARSE_TILE
+  std::vector<vkw::IndexBuffer<VK_INDEX_TYPE_UINT32>> m_full_tiles;
+  InstanceRing<TileAttrs> m_tiles;
+  // visible tiles of the current draw grouped by variant
+  std::array<std::vector<TileAttrs>, M_VARIANTS> m_visibleTiles;
 
 protected:
   vkw::StrongReference<vkw::Device> m_device;
 
   auto m_createVertexState() {
     return std::make_unique<
-        vkw::VertexInputStateCreateInfo<vkw::per_vertex<PrimitiveAttrs, 0>>>();
+        vkw::VertexInputStateCreateInfo<vkw::per_vertex<PrimitiveAttrs, 0>,
+                                        vkw::per_instance<TileAttrs, 1>>>();
   }
 
   virtual void preDraw(RenderEngine::GraphicsRecordingState &buffer) {}
-  virtual glm::vec4 arbitraryData(glm::vec2 tileBegin, glm::vec2 tileEnd) {
-    return glm::vec4{0.0f};
-  };
 
   virtual std::pair<float, float> heightBounds() const { return {0.0f, 1.0f}; };
 };
@@ -86,11 +86,21 @@ public:
         std::span<vkw::Semaphore const>{computeImageReady.get(), 1}};
     computeQueue.submit(syncCSubmitInfo);
 
-    shadowPass.onPass = [this](RenderEngine::GraphicsRecordingState &state,
-                               const Camera &camera) {
-      if (landSettings.enabled())
-        land.draw(state, globalState.camera().position(), camera);
-    };
+    // land does not move, so its shadows are drawn only when cascades move
+    shadowPass.onStaticPass =
+        [this](RenderEngine::GraphicsRecordingState &state,
+               const Camera &camera, const Frustum &casters) {
+          if (landSettings.enabled())
+            land.draw(state, globalState.camera().position(), casters);
+        };
+
+    addStatistics([this]() {
+      auto &shadows = shadowPass.statistics();
+      ImGui::Text("Shadow cascades: %u rendered, %u static caches rendered",
+                  shadows.cascadesRendered, shadows.staticCascadesRendered);
+      ImGui::Text("Shadow pass: %s",
+                  shadowPass.layered() ? "layered" : "per cascade");
+    });
     // TODO: enable it
 #if 0
         gui.customGui = [this]() {
@@ -149,13 +159,13 @@ protected:
     if (landSettings.enabled()) {
       recorder.setMaterial(landSettings.pickedMaterial().get());
       land.draw(recorder, globalState.camera().position(),
-                globalState.camera());
+                globalState.camera().frustum());
     }
 
     if (waveSettings.enabled()) {
       recorder.setMaterial(waveSettings.pickedMaterial().get());
       waves.draw(recorder, globalState.camera().position(),
-                 globalState.camera());
+                 globalState.camera().frustum());
     }
   }
   void afterMainPass(vkw::PrimaryCommandBuffer &buffer,
@@ -168,6 +178,8 @@ protected:
 
   void onFramebufferResize() override{};
   void onPollEvents() override {
+    waves.newFrame();
+    land.newFrame();
     globalState.update();
     skybox.update(window().camera());
     waveSurfaceTexture.update(window().clock().frameTime());
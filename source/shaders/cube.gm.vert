@@ -7,14 +7,25 @@ layout (location = 1) in vec3 col;
 layout (location = 2) in vec3 normal;
 layout (location = 3) in vec2 inUV;
 
-layout (location = 4) in mat4 inModel;
+// matrices of all cubes
+layout (std430, set = 0, binding = 0) readonly buffer Instances {
+    mat4 instances[];
+};
+
+// indices of visible cubes written by instance_culling.comp, indirect draw
+// of each pass starts at its own region
+layout (std430, set = 0, binding = 1) readonly buffer VisibleInstances {
+    uint visible[];
+};
 
 
 WorldVertexInfo Geometry(){
+    mat4 model = instances[visible[gl_InstanceIndex]];
+
     WorldVertexInfo ret;
     ret.UVW = vec3(inUV, 0.0f);
-    ret.position = vec3(inModel * vec4(pos, 1.0));
-    ret.normal = normalize(vec3(inModel * vec4(normal, 0.0f)));
+    ret.position = vec3(model * vec4(pos, 1.0));
+    ret.normal = normalize(vec3(model * vec4(normal, 0.0f)));
     ret.color = vec4(col, 1.0);
     return ret;
 }
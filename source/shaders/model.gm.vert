@@ -10,16 +10,15 @@ layout (location = 4) in vec4 inColor;
 layout (location = 5) in vec4 inJoint;
 layout (location = 6) in vec4 inWeight;
 
-layout (set = 0, binding = 0) uniform PrimitiveTransform{
-    mat4 local;
-} transform;
+// per-instance node transform
+layout (location = 7) in mat4 inTransform;
 
 
 WorldVertexInfo Geometry(){
     WorldVertexInfo ret;
     ret.UVW = vec3(inUV, 0.0f);
-    ret.position = vec3(transform.local * inPos);
-    ret.normal = normalize(vec3(transform.local * vec4(inNormal, 0.0f)));
-    ret.tangent = normalize(vec3(transform.local * vec4(inTangent, 0.0f)));
+    ret.position = vec3(inTransform * inPos);
+    ret.normal = normalize(vec3(inTransform * vec4(inNormal, 0.0f)));
+    ret.tangent = normalize(vec3(inTransform * vec4(inTangent, 0.0f)));
     return ret;
 }
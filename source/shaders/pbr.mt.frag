@@ -15,10 +15,13 @@ layout (set = 2, binding = 2) uniform sampler2D metallicRoughnessMap;
 
 vec3 calculateNormal()
 {
-    vec3 tangentSample = texture(normalMap, inUVW.xy).xyz;
+    // only red and green are stored (BC5 normal maps), blue is reconstructed
+    vec2 tangentSample = texture(normalMap, inUVW.xy).xy;
     if(length(tangentSample) == 0.0f)
         return inWorldNormal;
-    vec3 tangentNormal = tangentSample * 2.0 - 1.0;
+    vec3 tangentNormal;
+    tangentNormal.xy = tangentSample * 2.0 - 1.0;
+    tangentNormal.z = sqrt(max(1.0 - dot(tangentNormal.xy, tangentNormal.xy), 0.0));
 
     vec3 N = normalize(inWorldNormal);
     vec3 T = normalize(inWorldTangent.xyz);
@@ -6,6 +6,13 @@
 #define CELL_SIZE 0.1f
 
 layout (location = 0) in vec3 inPos;
+// tile translate in xy, scale in z and cell size in w
+layout (location = 2) in vec4 inTile;
+// CDLOD center in xz, its height above or below height bounds in y and
+// spacing of vertices in w
+layout (location = 3) in vec4 inLodCenter;
+// distances where morph starts and ends, empty range disables it
+layout (location = 4) in vec2 inMorphRange;
 
 layout (set = 0, binding = 1) uniform sampler2D displacementMap1;
 layout (set = 0, binding = 2) uniform sampler2D displacementMap2;
@@ -19,16 +26,25 @@ layout (set = 1, binding = 0) uniform Camera{
     mat4 cameraSpace;
 } camera;
 
-layout (push_constant) uniform PushConstants {
-    vec2 translate;
-    float scale;
-    float cellSize;
-} pushConstants;
+// Moves odd vertices of the tile onto the grid twice as coarse as they
+// near the end of the tile level range, so it meets the coarser level
+// without seams.
+vec2 morph(vec2 localPos, vec2 translate){
+    if (inMorphRange.y <= inMorphRange.x)
+      return localPos;
+
+    vec3 worldPos = vec3(localPos.x + translate.x, 0.0f, localPos.y + translate.y);
+    float distance = length(worldPos - inLodCenter.xyz);
+    float factor = clamp((distance - inMorphRange.x) / (inMorphRange.y - inMorphRange.x), 0.0f, 1.0f);
+    // rounded, since fract of half index may give 2 for even vertices
+    vec2 odd = mod(round(localPos / inLodCenter.w), 2.0f);
+    return localPos - odd * inLodCenter.w * factor;
+}
 
 WorldVertexInfo Geometry(){
-    vec2 localPos = inPos.xz * pushConstants.scale;
+    vec2 localPos = morph(inPos.xz * inTile.z, inTile.xy);
 
-    vec2 translate = pushConstants.translate;
+    vec2 translate = inTile.xy;
     vec2 gridPos = localPos + translate;
     vec2 inUV1 = gridPos / ubo.scales.x;
     vec2 inUV2 = gridPos / ubo.scales.y;
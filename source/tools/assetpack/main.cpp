@@ -0,0 +1,49 @@
+#include "AssetPath.inc"
+#include <RenderEngine/AssetImport/AssetPack.h>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+  std::vector<std::string> args{argv + 1, argv + argc};
+
+  if (!args.empty() && (args[0] == "-h" || args[0] == "--help")) {
+    std::cout << "Usage: " << argv[0] << " [data directory] [output]"
+              << std::endl
+              << "Packs all files of data directory except cache/ into single "
+                 "file."
+              << std::endl
+              << "Default data directory is " << EXAMPLE_ASSET_PATH
+              << ", default output is <data directory>/assets.pack"
+              << std::endl
+              << "Examples load assets from the pack when it is present, "
+                 "rebuild it after data changes."
+              << std::endl;
+    return 1;
+  }
+
+  std::filesystem::path root =
+      args.size() > 0 ? std::filesystem::path(args[0])
+                      : std::filesystem::path(EXAMPLE_ASSET_PATH);
+  std::filesystem::path output =
+      args.size() > 1 ? std::filesystem::path(args[1]) : root / "assets.pack";
+  std::filesystem::path excluded[] = {root / "cache"};
+
+  try {
+    auto start = std::chrono::steady_clock::now();
+    auto count = RenderEngine::AssetPack::build(root, output, excluded);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::cout << root.generic_string() << " -> " << output.generic_string()
+              << " (" << count << " files, "
+              << std::filesystem::file_size(output) / 1024 << " KiB, "
+              << elapsed.count() << " ms)" << std::endl;
+  } catch (std::exception &e) {
+    std::cout << "[ASSETPACK][ERROR]: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,214 @@
+#include "AssetPath.inc"
+#include "CubeSimulation.h"
+#include "Utils.h"
+#include <RenderEngine/Shaders/ShaderLoader.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+#include <vkw/CommandPool.hpp>
+#include <vkw/Device.hpp>
+#include <vkw/Instance.hpp>
+#include <vkw/Library.hpp>
+#include <vkw/Queue.hpp>
+
+using namespace TestApp;
+
+namespace {
+
+// Vulkan allows absolute error of 2^-11 for sin and cos, rotation
+// elements are products of up to three of them
+constexpr float ROTATION_TOLERANCE = 4.0f / 2048.0f;
+// translation is integrated the same way on both sides
+constexpr float TRANSLATION_TOLERANCE = 1e-4f;
+// exit code of runs without software device, ctest reports them skipped
+constexpr int SKIPPED = 77;
+
+void addCubes(CubeSimulation &simulation, uint32_t count) {
+  std::mt19937 random{1};
+  std::uniform_real_distribution<float> position{0.0f, 1000.0f};
+  std::uniform_real_distribution<float> rotation{0.0f, 1000.0f};
+  std::uniform_real_distribution<float> scale{1.0f, 5.0f};
+  std::uniform_real_distribution<float> velocity{-5.0f, 5.0f};
+  std::uniform_real_distribution<float> angularVelocity{-20.0f, 20.0f};
+
+  auto vec3 = [&random](auto &distribution) {
+    return glm::vec3{distribution(random), distribution(random),
+                     distribution(random)};
+  };
+
+  for (uint32_t i = 0; i < count; ++i)
+    simulation.add({.position = vec3(position),
+                    .rotation = vec3(rotation),
+                    .scale = vec3(scale),
+                    .velocity = vec3(velocity),
+                    .angularVelocity = vec3(angularVelocity)});
+}
+
+/** Index of the first software device, or of the first one if any. */
+std::optional<uint32_t> pickDevice(vkw::Instance &instance, bool anyDevice) {
+  auto count = instance.enumerateAvailableDevices().size();
+  for (uint32_t i = 0; i < count; ++i) {
+    vkw::PhysicalDevice device{instance, i};
+    if (anyDevice ||
+        device.properties().deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)
+      return i;
+  }
+  return std::nullopt;
+}
+
+/** Largest errors of device matrices. */
+struct Errors {
+  // largest error relative to the allowed one
+  float worst = 0.0f;
+  // largest absolute errors of rotation elements divided by scale and of
+  // translation
+  float rotation = 0.0f;
+  float translation = 0.0f;
+};
+
+Errors compare(CubeSimulation const &simulation,
+               std::span<InstanceCulling::Instance const> expected,
+               std::span<InstanceCulling::Instance const> computed) {
+  Errors ret;
+  for (uint32_t i = 0; i < simulation.size(); ++i) {
+    auto scale = simulation.get(i).scale;
+    auto &want = expected[i].model;
+    auto &got = computed[i].model;
+
+    for (int column = 0; column < 4; ++column)
+      for (int row = 0; row < 4; ++row) {
+        auto error = std::abs(want[column][row] - got[column][row]);
+        if (column < 3) {
+          ret.rotation = std::max(ret.rotation, error / scale[column]);
+          ret.worst = std::max(
+              ret.worst, error / (ROTATION_TOLERANCE * scale[column]));
+        } else {
+          ret.translation = std::max(ret.translation, error);
+          ret.worst = std::max(
+              ret.worst, error / (TRANSLATION_TOLERANCE *
+                                  std::max(1.0f, std::abs(want[column][row]))));
+        }
+      }
+  }
+  return ret;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> args;
+  bool anyDevice = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--any-device")
+      anyDevice = true;
+    else
+      args.push_back(arg);
+  }
+
+  if (!args.empty() && (args[0] == "-h" || args[0] == "--help")) {
+    std::cout << "Usage: " << argv[0]
+              << " [--any-device] [cube count] [steps]" << std::endl
+              << "Runs cube simulation on host and in compute shader and "
+                 "compares model matrices."
+              << std::endl
+              << "  --any-device  use the first device instead of a software "
+                 "one"
+              << std::endl
+              << "Default is 100000 cubes moved by 100 steps. Exits with 1 "
+                 "if matrices differ more than allowed and with "
+              << SKIPPED << " if no device to run on is found." << std::endl;
+    return 1;
+  }
+
+  uint32_t cubeCount = args.size() > 0 ? std::stoul(args[0]) : 100000;
+  uint32_t steps = args.size() > 1 ? std::stoul(args[1]) : 100;
+  constexpr float DELTA_TIME = 1.0f / 60.0f;
+
+  vkw::Library library{nullptr, nullptr};
+  vkw::InstanceCreateInfo instanceCreateInfo{};
+  instanceCreateInfo.applicationName = "cubesim";
+  instanceCreateInfo.engineName = "Common test engine";
+  vkw::Instance instance{library, instanceCreateInfo};
+
+  auto deviceIndex = pickDevice(instance, anyDevice);
+  if (!deviceIndex) {
+    std::cout << "No software Vulkan device found, install lavapipe or "
+                 "SwiftShader or pass --any-device"
+              << std::endl;
+    return SKIPPED;
+  }
+  vkw::PhysicalDevice physicalDevice{instance, *deviceIndex};
+  std::cout << "Device: " << physicalDevice.properties().deviceName
+            << std::endl;
+
+  requestQueues(physicalDevice);
+  vkw::Device device{instance, physicalDevice};
+  RenderEngine::ShaderLoader shaderLoader{
+      device, EXAMPLE_ASSET_PATH + std::string("/shaders/")};
+
+  CubeSimulation simulation{cubeCount};
+  addCubes(simulation, cubeCount);
+
+  // device results are read back by host, so memory is coherent to avoid
+  // invalidation
+  vkw::Buffer<InstanceCulling::Instance> instances{
+      device, std::max(cubeCount, 1u), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VmaAllocationCreateInfo{
+          .usage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+          .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT}};
+  instances.map();
+
+  CubeSimulationLayout layout{device, shaderLoader, 1};
+  DeviceCubeSimulation deviceSimulation{device, layout, cubeCount, instances};
+  deviceSimulation.upload(simulation);
+
+  auto &queue = device.anyComputeQueue();
+  auto commandPool = vkw::CommandPool{
+      device, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, queue.family().index()};
+  auto commandBuffer = vkw::PrimaryCommandBuffer{commandPool};
+
+  commandBuffer.begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+  for (uint32_t step = 0; step < steps; ++step)
+    deviceSimulation.update(commandBuffer, DELTA_TIME);
+
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = instances;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+  commandBuffer.bufferMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                    VK_PIPELINE_STAGE_HOST_BIT,
+                                    {&barrier, 1});
+  commandBuffer.end();
+
+  queue.submit(vkw::SubmitInfo{commandBuffer});
+  queue.waitIdle();
+
+  std::vector<InstanceCulling::Instance> expected(cubeCount);
+  for (uint32_t step = 0; step < steps; ++step)
+    simulation.update(DELTA_TIME, expected);
+
+  auto errors = compare(simulation, expected, instances.mapped());
+  std::cout << "Host simulation: "
+            << (CubeSimulation::vectorized() ? "AVX2" : "scalar") << std::endl
+            << cubeCount << " cubes, " << steps << " steps" << std::endl
+            << "Largest rotation error " << errors.rotation
+            << " per unit of scale, translation error " << errors.translation
+            << std::endl
+            << "Largest error is " << errors.worst << " of allowed"
+            << std::endl;
+
+  return errors.worst <= 1.0f ? 0 : 1;
+}
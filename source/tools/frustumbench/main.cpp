@@ -0,0 +1,171 @@
+#include "Frustum.h"
+#include <algorithm>
+#include <chrono>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace TestApp;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <typename F> double microseconds(unsigned repeats, F &&run) {
+  auto start = Clock::now();
+  for (unsigned i = 0; i < repeats; ++i)
+    run();
+  std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+  return elapsed.count() / repeats;
+}
+
+void report(std::string const &name, double value, char const *unit) {
+  std::cout << std::left << std::setw(40) << name << std::right
+            << std::setw(12) << std::fixed << std::setprecision(3) << value
+            << " " << unit << std::endl;
+}
+
+/** Test Camera::offBounds did before frustum planes: eight corners are
+ *  projected and their bounds are compared with clip volume.
+ */
+bool cornersVisible(glm::mat4 const &viewProjection, glm::vec3 min,
+                    glm::vec3 max) {
+  auto overlaps = [](float begin1, float end1, float begin2, float end2) {
+    return begin1 < begin2 ? end1 > begin2 : begin1 < end2;
+  };
+
+  glm::vec3 low{std::numeric_limits<float>::max()};
+  glm::vec3 high{std::numeric_limits<float>::lowest()};
+  for (int corner = 0; corner < 8; ++corner) {
+    glm::vec4 point{corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y,
+                    corner & 4 ? max.z : min.z, 1.0f};
+    point = viewProjection * point;
+    point /= glm::abs(point.w);
+    low = glm::min(low, glm::vec3(point));
+    high = glm::max(high, glm::vec3(point));
+  }
+
+  return overlaps(-1.0f, 1.0f, low.x, high.x) &&
+         overlaps(-1.0f, 1.0f, low.y, high.y) &&
+         overlaps(0.0f, 1.0f, low.z, high.z);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> args{argv + 1, argv + argc};
+
+  if (!args.empty() && (args[0] == "-h" || args[0] == "--help")) {
+    std::cout << "Usage: " << argv[0] << " [volume count]" << std::endl
+              << "Checks batched Frustum::cull against scalar plane tests "
+                 "and times both against the projected corner test it "
+                 "replaced."
+              << std::endl
+              << "Default volume count is 100000." << std::endl;
+    return 1;
+  }
+
+  size_t count = args.empty() ? 100000 : std::stoul(args[0]);
+  constexpr unsigned REPEATS = 50;
+
+  // camera set up the same way Camera does it
+  auto projection =
+      glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+  projection[1][1] *= -1.0f;
+  auto view = glm::lookAt(glm::vec3{0.0f, 10.0f, 0.0f},
+                          glm::vec3{100.0f, 0.0f, 50.0f},
+                          glm::vec3{0.0f, 1.0f, 0.0f});
+  auto viewProjection = projection * view;
+  Frustum frustum{viewProjection};
+
+  std::mt19937 random{1};
+  std::uniform_real_distribution<float> position{-1200.0f, 1200.0f};
+  std::uniform_real_distribution<float> size{0.1f, 50.0f};
+
+  std::vector<Frustum::Box> boxes(count);
+  std::vector<Frustum::Sphere> spheres(count);
+  for (size_t i = 0; i < count; ++i) {
+    glm::vec3 center{position(random), position(random), position(random)};
+    glm::vec3 extent{size(random), size(random), size(random)};
+    boxes[i] = {center - extent, center + extent};
+    spheres[i] = {center, size(random)};
+  }
+
+  std::vector<uint8_t> batched(count);
+  std::vector<uint8_t> scalar(count);
+  std::vector<uint8_t> corners(count);
+
+  size_t mismatches = 0;
+  // plane test keeps boxes near frustum corners the projection culls
+  size_t keptByPlanes = 0;
+  size_t keptByCorners = 0;
+
+  frustum.cull(boxes, batched);
+  for (size_t i = 0; i < count; ++i) {
+    scalar[i] = frustum.intersects(boxes[i].min, boxes[i].max);
+    corners[i] = cornersVisible(viewProjection, boxes[i].min, boxes[i].max);
+    mismatches += batched[i] != scalar[i];
+    keptByPlanes += scalar[i] && !corners[i];
+    keptByCorners += corners[i] && !scalar[i];
+  }
+
+  frustum.cull(spheres, batched);
+  for (size_t i = 0; i < count; ++i)
+    mismatches +=
+        batched[i] != frustum.intersects(spheres[i].center, spheres[i].radius);
+
+  std::cout << count << " boxes and spheres, "
+            << std::count(scalar.begin(), scalar.end(), 1)
+            << " boxes visible" << std::endl
+            << "batched and scalar results differ for " << mismatches
+            << " volumes" << std::endl
+            << "boxes kept only by planes: " << keptByPlanes
+            << ", only by projected corners: " << keptByCorners << std::endl;
+
+  report("boxes, Frustum::cull", microseconds(REPEATS, [&]() {
+           frustum.cull(boxes, batched);
+         }),
+         "us");
+
+  report("boxes, scalar planes", microseconds(REPEATS, [&]() {
+           for (size_t i = 0; i < count; ++i)
+             scalar[i] = frustum.intersects(boxes[i].min, boxes[i].max);
+         }),
+         "us");
+
+  report("boxes, projected corners", microseconds(REPEATS, [&]() {
+           for (size_t i = 0; i < count; ++i)
+             corners[i] =
+                 cornersVisible(viewProjection, boxes[i].min, boxes[i].max);
+         }),
+         "us");
+
+  report("spheres, Frustum::cull", microseconds(REPEATS, [&]() {
+           frustum.cull(spheres, batched);
+         }),
+         "us");
+
+  report("spheres, scalar planes", microseconds(REPEATS, [&]() {
+           for (size_t i = 0; i < count; ++i)
+             scalar[i] =
+                 frustum.intersects(spheres[i].center, spheres[i].radius);
+         }),
+         "us");
+
+  // old test had no sphere variant, spheres were tested by their boxes
+  report("spheres, projected corners", microseconds(REPEATS, [&]() {
+           for (size_t i = 0; i < count; ++i) {
+             glm::vec3 extent{spheres[i].radius};
+             corners[i] = cornersVisible(viewProjection,
+                                         spheres[i].center - extent,
+                                         spheres[i].center + extent);
+           }
+         }),
+         "us");
+
+  return mismatches == 0 ? 0 : 1;
+}
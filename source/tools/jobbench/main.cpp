@@ -0,0 +1,194 @@
+#include <RenderEngine/JobSystem.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace RenderEngine;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <typename F> double microseconds(unsigned repeats, F &&run) {
+  auto start = Clock::now();
+  for (unsigned i = 0; i < repeats; ++i)
+    run();
+  std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+  return elapsed.count() / repeats;
+}
+
+void report(std::string const &name, double value, char const *unit) {
+  std::cout << std::left << std::setw(48) << name << std::right
+            << std::setw(12) << std::fixed << std::setprecision(3) << value
+            << " " << unit << std::endl;
+}
+
+/** Whether wait() on job rethrows what its task threw. */
+template <typename F> bool rethrows(JobSystem &jobs, F &&schedule) {
+  try {
+    jobs.wait(schedule());
+  } catch (std::runtime_error const &error) {
+    return error.what() == std::string("expected");
+  }
+  return false;
+}
+
+/** Checks that parallelFor visits every index once in subranges no longer
+ *  than grain and that exceptions reach the waiting thread.
+ *
+ *  @return number of failed checks
+ */
+unsigned check(JobSystem &jobs) {
+  unsigned failures = 0;
+  auto expect = [&failures](bool passed, std::string const &what) {
+    if (passed)
+      return;
+    std::cout << "FAILED: " << what << std::endl;
+    failures++;
+  };
+
+  for (size_t count : {0, 1, 7, 1000, 100003})
+    for (size_t grain : {0, 1, 3, 64, 100000}) {
+      std::vector<std::atomic<unsigned>> visits(count);
+      std::atomic<bool> badRange = false;
+      jobs.wait(jobs.parallelFor(count, grain, [&](size_t begin, size_t end) {
+        if (begin >= end || end - begin > std::max<size_t>(grain, 1))
+          badRange = true;
+        for (auto i = begin; i < end; ++i)
+          visits[i]++;
+      }));
+      expect(!badRange && std::all_of(visits.begin(), visits.end(),
+                                      [](auto &visit) { return visit == 1; }),
+             "parallelFor of " + std::to_string(count) + " with grain " +
+                 std::to_string(grain) + " visits every index once");
+    }
+
+  auto thrower = []() { throw std::runtime_error("expected"); };
+
+  expect(rethrows(jobs, [&]() { return jobs.schedule(thrower); }),
+         "scheduled job rethrows");
+
+  expect(rethrows(jobs,
+                  [&]() {
+                    return jobs.parallelFor(
+                        10000, 16, [&](size_t begin, size_t end) {
+                          if (begin <= 5000 && 5000 < end)
+                            thrower();
+                        });
+                  }),
+         "parallelFor rethrows from one subrange");
+
+  expect(rethrows(jobs,
+                  [&]() {
+                    return jobs.parallelFor(8, 1, [&](size_t, size_t) {
+                      jobs.wait(jobs.schedule(thrower));
+                    });
+                  }),
+         "job waiting for failed job rethrows");
+
+  // failures leave workers usable
+  std::atomic<size_t> total = 0;
+  jobs.wait(jobs.parallelFor(
+      1000, 10, [&](size_t begin, size_t end) { total += end - begin; }));
+  expect(total == 1000, "parallelFor after exceptions covers its range");
+
+  return failures;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> args{argv + 1, argv + argc};
+
+  if (!args.empty() && (args[0] == "-h" || args[0] == "--help")) {
+    std::cout << "Usage: " << argv[0] << " [element count]" << std::endl
+              << "Checks parallelFor coverage and exception propagation, "
+                 "then measures overhead of JobSystem against threads "
+                 "created for every frame. Exits with 1 if a check fails."
+              << std::endl
+              << "Default element count is 50000."
+              << std::endl;
+    return 1;
+  }
+
+  size_t count = args.empty() ? 50000 : std::stoul(args[0]);
+  constexpr unsigned REPEATS = 200;
+
+  auto &jobs = JobSystem::shared();
+  std::cout << jobs.workerCount() << " workers" << std::endl;
+
+  auto failures = check(jobs);
+  std::cout << failures << " checks failed" << std::endl;
+
+  // cheap per element work, so overhead dominates
+  std::vector<float> values(count, 1.0f);
+  auto touch = [&values](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i)
+      values[i] = values[i] * 0.5f + 1.0f;
+  };
+
+  report("empty job, schedule and wait", microseconds(REPEATS * 50, [&]() {
+           jobs.wait(jobs.schedule([]() {}));
+         }),
+         "us");
+
+  report("chain of 64 dependent jobs", microseconds(REPEATS, [&]() {
+           auto job = jobs.schedule([]() {});
+           for (int i = 1; i < 64; ++i)
+             job = jobs.schedule([]() {}, {&job, 1});
+           jobs.wait(job);
+         }),
+         "us");
+
+  report("sequential loop", microseconds(REPEATS, [&]() { touch(0, count); }),
+         "us");
+
+  for (size_t grain : {64, 256, 1024, 4096}) {
+    report("parallelFor, grain " + std::to_string(grain),
+           microseconds(REPEATS,
+                        [&]() {
+                          jobs.wait(jobs.parallelFor(count, grain, touch));
+                        }),
+           "us");
+  }
+
+  // what cubes example did before: threads created and joined every frame
+  auto threadCount = jobs.workerCount() + 1;
+  report("std::thread per frame, " + std::to_string(threadCount) + " threads",
+         microseconds(REPEATS,
+                      [&]() {
+                        std::vector<std::thread> threads;
+                        auto chunk = (count + threadCount - 1) / threadCount;
+                        for (size_t first = 0; first < count; first += chunk)
+                          threads.emplace_back(touch, first,
+                                               std::min(first + chunk, count));
+                        for (auto &thread : threads)
+                          thread.join();
+                      }),
+         "us");
+
+  // nested fork-join: outer jobs wait for inner ones while helping
+  std::atomic<size_t> total = 0;
+  report("nested parallelFor, 64 x 1024", microseconds(REPEATS, [&]() {
+           jobs.wait(jobs.parallelFor(64, 1, [&](size_t, size_t) {
+             jobs.wait(jobs.parallelFor(
+                 1024, 64, [&](size_t begin, size_t end) {
+                   total += end - begin;
+                 }));
+           }));
+         }),
+         "us");
+
+  if (total != size_t(64) * 1024 * REPEATS) {
+    std::cout << "FAILED: nested parallelFor covers its range" << std::endl;
+    failures++;
+  }
+
+  return failures == 0 ? 0 : 1;
+}
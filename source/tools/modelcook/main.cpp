@@ -0,0 +1,97 @@
+#include "AssetPath.inc"
+#include "CookedModel.h"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace TestApp;
+
+namespace {
+
+bool isModelFile(std::filesystem::path const &path) {
+  return path.extension() == ".gltf" || path.extension() == ".glb";
+}
+
+std::vector<std::filesystem::path>
+collectModels(std::filesystem::path const &input) {
+  std::vector<std::filesystem::path> ret;
+
+  if (!std::filesystem::is_directory(input)) {
+    ret.push_back(input);
+    return ret;
+  }
+
+  for (auto &entry : std::filesystem::recursive_directory_iterator(input)) {
+    if (entry.is_regular_file() && isModelFile(entry.path()))
+      ret.push_back(entry.path());
+  }
+
+  return ret;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> args;
+  std::optional<RenderEngine::TextureCompressionSettings> compression =
+      RenderEngine::TextureCompressionSettings{};
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--uncompressed")
+      compression.reset();
+    else if (arg == "--fast")
+      compression->highQuality = false;
+    else
+      args.push_back(arg);
+  }
+
+  if (args.empty()) {
+    std::cout << "Usage: " << argv[0]
+              << " [--uncompressed] [--fast] <model.gltf|model.glb|directory>"
+                 " [cache directory]"
+              << std::endl
+              << "  --uncompressed  keep textures in RGBA8" << std::endl
+              << "  --fast          BC1/BC3 instead of BC7 for color maps"
+              << std::endl
+              << "Default cache directory is " << EXAMPLE_ASSET_PATH
+              << "/cache/models" << std::endl;
+    return 1;
+  }
+
+  std::filesystem::path cacheDirectory =
+      args.size() > 1
+          ? std::filesystem::path(args[1])
+          : std::filesystem::path(EXAMPLE_ASSET_PATH) / "cache" / "models";
+
+  int failed = 0;
+
+  try {
+    ModelCache cache{cacheDirectory, compression};
+
+    for (auto &source : collectModels(args[0])) {
+      try {
+        auto start = std::chrono::steady_clock::now();
+        auto cooked = CookedModel::cook(source, cache.compressor());
+        cache.store(source, cooked);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+        std::cout << source.generic_string() << " -> "
+                  << cache.cachePathOf(source).generic_string() << " ("
+                  << elapsed.count() << " ms)" << std::endl;
+      } catch (std::runtime_error &e) {
+        std::cout << "[MODELCOOK][ERROR]: " << source.generic_string() << ": "
+                  << e.what() << std::endl;
+        failed++;
+      }
+    }
+  } catch (std::exception &e) {
+    std::cout << "[MODELCOOK][ERROR]: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return failed == 0 ? 0 : 1;
+}
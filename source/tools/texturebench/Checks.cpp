@@ -0,0 +1,339 @@
+#include "Checks.h"
+#include <RenderEngine/AssetImport/BlockCompression.h>
+#include <RenderEngine/AssetImport/PixelConversion.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace TextureChecks {
+
+namespace {
+
+using namespace RenderEngine;
+
+void printResult(bool passed, std::string const &what) {
+  std::cout << (passed ? "passed: " : "FAILED: ") << what << std::endl;
+}
+
+/** Reference decoders of the formats BlockCompression encodes. Each
+ *  writes 16 RGBA8 texels of one block, channels the format lacks are left
+ *  as they are.
+ */
+
+void decodeColorBlock(const unsigned char *block, unsigned char *texels) {
+  uint16_t packed[2];
+  memcpy(packed, block, 4);
+
+  int palette[4][3];
+  for (int e = 0; e < 2; ++e) {
+    auto r = (packed[e] >> 11) & 31;
+    auto g = (packed[e] >> 5) & 63;
+    auto b = packed[e] & 31;
+    palette[e][0] = (r << 3) | (r >> 2);
+    palette[e][1] = (g << 2) | (g >> 4);
+    palette[e][2] = (b << 3) | (b >> 2);
+  }
+  for (int c = 0; c < 3; ++c) {
+    if (packed[0] > packed[1]) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    } else {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+  }
+
+  uint32_t indices;
+  memcpy(&indices, block + 4, 4);
+  for (int i = 0; i < 16; ++i)
+    for (int c = 0; c < 3; ++c)
+      texels[i * 4 + c] = palette[(indices >> (2 * i)) & 3][c];
+}
+
+void decodeChannelBlock(const unsigned char *block, int channel,
+                        unsigned char *texels) {
+  int palette[8] = {block[0], block[1]};
+  if (palette[0] > palette[1]) {
+    for (int p = 2; p < 8; ++p)
+      palette[p] = ((8 - p) * palette[0] + (p - 1) * palette[1]) / 7;
+  } else {
+    for (int p = 2; p < 6; ++p)
+      palette[p] = ((6 - p) * palette[0] + (p - 1) * palette[1]) / 5;
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+
+  uint64_t indices = 0;
+  for (int i = 0; i < 6; ++i)
+    indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+  for (int i = 0; i < 16; ++i)
+    texels[i * 4 + channel] = palette[(indices >> (3 * i)) & 7];
+}
+
+/** Decodes mode 6 only, the one encoder writes. */
+bool decodeBC7(const unsigned char *block, unsigned char *texels) {
+  static constexpr int weights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                      34, 38, 43, 47, 51, 55, 60, 64};
+
+  int position = 0;
+  auto read = [&](int bits) {
+    uint32_t value = 0;
+    for (int i = 0; i < bits; ++i, ++position)
+      value |= ((block[position / 8] >> (position % 8)) & 1u) << i;
+    return value;
+  };
+
+  if (read(7) != 1u << 6)
+    return false;
+
+  int endpoints[2][4];
+  for (int c = 0; c < 4; ++c) {
+    endpoints[0][c] = read(7);
+    endpoints[1][c] = read(7);
+  }
+  for (auto &endpoint : endpoints) {
+    auto pBit = read(1);
+    for (auto &component : endpoint)
+      component = component << 1 | pBit;
+  }
+
+  for (int i = 0; i < 16; ++i) {
+    auto w = weights[read(i == 0 ? 3 : 4)];
+    for (int c = 0; c < 4; ++c)
+      texels[i * 4 + c] =
+          ((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6;
+  }
+  return true;
+}
+
+struct Format {
+  VkFormat format;
+  char const *name;
+  // channels stored by format, others are not compared
+  int channels[4];
+  int channelCount;
+  // bounds of root mean square and largest error per compared channel
+  double maxRMSE;
+  int maxError;
+};
+
+bool decodeBlock(VkFormat format, const unsigned char *block,
+                 unsigned char *texels) {
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    decodeColorBlock(block, texels);
+    return true;
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+    decodeChannelBlock(block, 3, texels);
+    decodeColorBlock(block + 8, texels);
+    return true;
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+    decodeChannelBlock(block, 0, texels);
+    return true;
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+    decodeChannelBlock(block, 0, texels);
+    decodeChannelBlock(block + 8, 1, texels);
+    return true;
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+    return decodeBC7(block, texels);
+  default:
+    return false;
+  }
+}
+
+struct Image {
+  std::string name;
+  size_t width;
+  size_t height;
+  uint32_t mipLevels;
+  std::vector<unsigned char> rgba;
+};
+
+/** Diagonal ramp with all channels on one line through color space, so
+ *  blocks of every mip level are representable by single segment. Extent is
+ *  not a multiple of block size.
+ */
+Image gradient() {
+  Image ret{"gradient 37x29", 37, 29, 0, {}};
+  ret.mipLevels = BlockCompression::mipLevelCount(ret.width, ret.height);
+  for (size_t y = 0; y < ret.height; ++y)
+    for (size_t x = 0; x < ret.width; ++x) {
+      auto t = (x + y) * 255 / (ret.width + ret.height - 2);
+      ret.rgba.push_back(t);
+      ret.rgba.push_back(255 - t);
+      ret.rgba.push_back(64 + t / 2);
+      ret.rgba.push_back(255 - t / 4);
+    }
+  return ret;
+}
+
+/** Every block mixes two random colors, so a single segment between them
+ *  represents it up to endpoint quantization. Downsampled levels mix blocks,
+ *  so only the base level is compressed.
+ */
+Image twoColorBlocks() {
+  Image ret{"two color blocks 64x64", 64, 64, 1, {}};
+  ret.rgba.resize(ret.width * ret.height * 4);
+  std::mt19937 random{7};
+  std::uniform_int_distribution<int> component{0, 255};
+  for (size_t by = 0; by < ret.height; by += 4)
+    for (size_t bx = 0; bx < ret.width; bx += 4) {
+      unsigned char colors[2][4];
+      for (auto &color : colors)
+        for (auto &c : color)
+          c = component(random);
+      for (size_t y = by; y < by + 4; ++y)
+        for (size_t x = bx; x < bx + 4; ++x)
+          memcpy(&ret.rgba[(y * ret.width + x) * 4],
+                 colors[component(random) & 1], 4);
+    }
+  return ret;
+}
+
+/** Compresses mip chain of image and compares every decoded level with the
+ *  source level.
+ */
+bool roundTrip(Image const &image, Format const &format) {
+  auto mipLevels = image.mipLevels;
+  auto chain = BlockCompression::generateMipChain(image.rgba, image.width,
+                                                  image.height, mipLevels);
+  auto compressed = BlockCompression::compressMipChain(
+      chain, format.format, image.width, image.height, mipLevels);
+
+  auto blockBytes = BlockCompression::blockSize(format.format);
+  auto dim = BlockCompression::BLOCK_DIM;
+  double squaredSum = 0.0;
+  size_t compared = 0;
+  int maxError = 0;
+  bool decoded = true;
+
+  const unsigned char *source = chain.data();
+  const unsigned char *block = compressed.data();
+  auto width = image.width;
+  auto height = image.height;
+  for (uint32_t level = 0; level < mipLevels; ++level) {
+    auto blocksX = (width + dim - 1) / dim;
+    auto blocksY = (height + dim - 1) / dim;
+    if (block + blocksX * blocksY * blockBytes >
+        compressed.data() + compressed.size()) {
+      decoded = false;
+      break;
+    }
+
+    for (size_t by = 0; by < blocksY; ++by)
+      for (size_t bx = 0; bx < blocksX; ++bx, block += blockBytes) {
+        unsigned char texels[16 * 4] = {};
+        decoded = decodeBlock(format.format, block, texels) && decoded;
+
+        for (size_t y = 0; y < dim; ++y)
+          for (size_t x = 0; x < dim; ++x) {
+            auto sx = bx * dim + x;
+            auto sy = by * dim + y;
+            if (sx >= width || sy >= height)
+              continue;
+            for (int i = 0; i < format.channelCount; ++i) {
+              auto c = format.channels[i];
+              int error = std::abs(texels[(y * dim + x) * 4 + c] -
+                                   source[(sy * width + sx) * 4 + c]);
+              squaredSum += error * error;
+              maxError = std::max(maxError, error);
+              compared++;
+            }
+          }
+      }
+
+    source += width * height * 4;
+    width = std::max<size_t>(width / 2, 1);
+    height = std::max<size_t>(height / 2, 1);
+  }
+
+  auto rmse = std::sqrt(squaredSum / std::max<size_t>(compared, 1));
+  bool passed = decoded && block == compressed.data() + compressed.size() &&
+                rmse <= format.maxRMSE && maxError <= format.maxError;
+
+  std::ostringstream what;
+  what << format.name << ", " << image.name << ", " << mipLevels
+       << " levels: RMSE " << std::fixed << std::setprecision(2) << rmse
+       << " (bound " << format.maxRMSE << "), max error " << maxError
+       << " (bound " << format.maxError << ")";
+  printResult(passed, what.str());
+  return passed;
+}
+
+} // namespace
+
+unsigned checkPixelConversion() {
+  unsigned failures = 0;
+  std::mt19937 random{3};
+  std::uniform_int_distribution<int> component{0, 255};
+
+  for (int channels = 1; channels <= 4; ++channels)
+    for (size_t texelCount : {0, 1, 3, 5, 15, 16, 17, 64, 1001}) {
+      std::vector<unsigned char> source(texelCount * channels);
+      for (auto &c : source)
+        c = component(random);
+
+      // gray is replicated into color, missing alpha is opaque
+      std::vector<unsigned char> expected(texelCount * 4);
+      for (size_t i = 0; i < texelCount; ++i) {
+        auto *src = &source[i * channels];
+        auto *dst = &expected[i * 4];
+        if (channels < 3) {
+          dst[0] = dst[1] = dst[2] = src[0];
+          dst[3] = channels == 2 ? src[1] : 255;
+        } else {
+          dst[0] = src[0];
+          dst[1] = src[1];
+          dst[2] = src[2];
+          dst[3] = channels == 4 ? src[3] : 255;
+        }
+      }
+
+      // guard bytes catch writes past the destination
+      std::vector<unsigned char> converted(texelCount * 4 + 16, 0xcd);
+      PixelConversion::expandToRGBA(source.data(), channels, converted.data(),
+                                    texelCount);
+
+      bool passed =
+          std::equal(expected.begin(), expected.end(), converted.begin()) &&
+          std::all_of(converted.end() - 16, converted.end(),
+                      [](unsigned char c) { return c == 0xcd; });
+      if (!passed) {
+        printResult(false, "expandToRGBA of " + std::to_string(texelCount) +
+                               " texels of " + std::to_string(channels) +
+                               " channels");
+        failures++;
+      }
+    }
+
+  printResult(failures == 0, "expandToRGBA matches per texel expansion");
+  return failures;
+}
+
+unsigned checkBlockCompression() {
+  // bounds are about 1.5 times the largest errors of current encoders, most
+  // of which come from few palette entries spanning small mip levels
+  Format formats[] = {
+      {VK_FORMAT_BC1_RGB_UNORM_BLOCK, "BC1", {0, 1, 2}, 3, 5.0, 32},
+      {VK_FORMAT_BC3_UNORM_BLOCK, "BC3", {0, 1, 2, 3}, 4, 4.5, 32},
+      {VK_FORMAT_BC4_UNORM_BLOCK, "BC4", {0}, 1, 2.5, 15},
+      {VK_FORMAT_BC5_UNORM_BLOCK, "BC5", {0, 1}, 2, 2.5, 15},
+      {VK_FORMAT_BC7_UNORM_BLOCK, "BC7", {0, 1, 2, 3}, 4, 1.2, 6},
+  };
+
+  unsigned failures = 0;
+  for (auto const &image : {gradient(), twoColorBlocks()})
+    for (auto const &format : formats)
+      failures += !roundTrip(image, format);
+
+  return failures;
+}
+
+} // namespace TextureChecks
@@ -0,0 +1,20 @@
+#ifndef TESTAPP_TEXTUREBENCH_CHECKS_H
+#define TESTAPP_TEXTUREBENCH_CHECKS_H
+
+/** Device independent checks of texture import, run by texturebench
+ *  --check. Each returns number of failed checks and prints them.
+ */
+namespace TextureChecks {
+
+/** expandToRGBA matches per texel expansion for every channel count and
+ *  texel counts not filling whole SIMD registers.
+ */
+unsigned checkPixelConversion();
+
+/** Mip chains compressed into every encoded format decode within error
+ *  bounds of the source.
+ */
+unsigned checkBlockCompression();
+
+} // namespace TextureChecks
+#endif // TESTAPP_TEXTUREBENCH_CHECKS_H
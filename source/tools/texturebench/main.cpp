@@ -0,0 +1,146 @@
+#include "Checks.h"
+#include "Utils.h"
+#include "tiny_gltf/stb_image.h"
+#include <RenderEngine/AssetImport/AssetImport.h>
+#include <RenderEngine/AssetImport/MappedFile.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <vkw/Device.hpp>
+#include <vkw/Instance.hpp>
+#include <vkw/Library.hpp>
+
+using namespace TestApp;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+  double milliseconds = 0.0;
+  size_t texels = 0;
+  size_t bytesCopied = 0;
+};
+
+/** Runs load repeatedly and averages time and loader statistics. */
+template <typename F>
+Result measure(RenderEngine::TextureLoader const &loader, unsigned repeats,
+               F &&load) {
+  auto before = loader.statistics();
+  size_t extraBytes = 0;
+
+  auto start = Clock::now();
+  for (unsigned i = 0; i < repeats; ++i)
+    extraBytes += load();
+  std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+
+  auto after = loader.statistics();
+  return {elapsed.count() / repeats, (after.texels - before.texels) / repeats,
+          (after.bytesCopied - before.bytesCopied + extraBytes) / repeats};
+}
+
+void report(std::string const &name, Result const &result) {
+  std::cout << std::left << std::setw(32) << name << std::right
+            << std::setw(12) << std::fixed << std::setprecision(3)
+            << result.milliseconds << " ms" << std::setw(10)
+            << std::setprecision(2)
+            << static_cast<double>(result.bytesCopied) /
+                   static_cast<double>(std::max<size_t>(result.texels, 1))
+            << " bytes/texel" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> args{argv + 1, argv + argc};
+
+  if (args.empty() || args[0] == "-h" || args[0] == "--help") {
+    std::cout << "Usage: " << argv[0] << " <image.png|image.jpg> [repeats]"
+              << std::endl
+              << "       " << argv[0] << " --check" << std::endl
+              << "Loads image through TextureLoader, decoding it straight "
+                 "into staging memory, and through the old path that "
+                 "decoded to RGBA and copied it before staging."
+              << std::endl
+              << "Both paths upload and generate mip levels the same way. "
+                 "Default is 10 repeats."
+              << std::endl
+              << "--check compares channel expansion with per texel "
+                 "reference and decodes BCn mip chains against their "
+                 "source, without a device. Exits with 1 if a check fails."
+              << std::endl;
+    return 1;
+  }
+
+  if (args[0] == "--check") {
+    auto failures = TextureChecks::checkPixelConversion() +
+                    TextureChecks::checkBlockCompression();
+    std::cout << failures << " checks failed" << std::endl;
+    return failures == 0 ? 0 : 1;
+  }
+
+  std::filesystem::path path = args[0];
+  unsigned repeats = args.size() > 1 ? std::stoul(args[1]) : 10;
+
+  vkw::Library library{nullptr, nullptr};
+  vkw::InstanceCreateInfo instanceCreateInfo{};
+  instanceCreateInfo.applicationName = "texturebench";
+  instanceCreateInfo.engineName = "Common test engine";
+  vkw::Instance instance{library, instanceCreateInfo};
+
+  if (instance.enumerateAvailableDevices().empty()) {
+    std::cout << "No Vulkan device found" << std::endl;
+    return 1;
+  }
+  vkw::PhysicalDevice physicalDevice{instance, 0u};
+  std::cout << "Device: " << physicalDevice.properties().deviceName
+            << std::endl;
+
+  requestQueues(physicalDevice);
+  vkw::Device device{instance, physicalDevice};
+
+  // loader looks the image up by name without extension
+  auto directory = path.has_parent_path() ? path.parent_path() : ".";
+  RenderEngine::TextureLoader loader{device,
+                                     directory.generic_string() + "/"};
+  auto name = path.stem().generic_string();
+  RenderEngine::MappedFile file{path};
+
+  auto direct = measure(loader, repeats, [&]() {
+    loader.loadTexture(name);
+    return size_t(0);
+  });
+
+  // what loader did before: stb_image expands to RGBA, the result is
+  // copied into a vector and then into staging memory
+  auto copied = measure(loader, repeats, [&]() {
+    int width, height, channels;
+    std::unique_ptr<unsigned char, void (*)(void *)> decoded{
+        stbi_load_from_memory(file.data().data(), file.data().size(), &width,
+                              &height, &channels, STBI_rgb_alpha),
+        stbi_image_free};
+    if (!decoded)
+      throw std::runtime_error("[TEXTUREBENCH][ERROR] failed to decode " +
+                               path.generic_string());
+
+    std::vector<unsigned char> rgba(size_t(width) * height * 4);
+    std::memcpy(rgba.data(), decoded.get(), rgba.size());
+    loader.loadTexture(rgba.data(), width, height);
+    // channel expansion inside stb_image writes the image once more
+    return rgba.size() * (channels == 4 ? 1 : 2);
+  });
+
+  std::cout << path.generic_string() << ", " << direct.texels << " texels"
+            << std::endl;
+  report("decode into staging", direct);
+  report("decode, copy, stage", copied);
+
+  return 0;
+}